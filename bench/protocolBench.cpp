@@ -0,0 +1,953 @@
+#include "protocol.hpp"
+#include "ringBuffer.hpp"
+#include "streamWindow.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace protocol;
+
+namespace
+{
+  using StreamT = std::vector<uint8_t>;
+
+  constexpr size_t STREAM_SIZE = 64 * 1024;
+
+  // Results are accumulated here so that the compiler cannot drop the work
+  volatile uint64_t sink {0};
+
+  struct OptionsS
+  {
+    uint64_t minTimeMs {250};     ///< Measured time per benchmark
+    size_t repetitions {5};       ///< Best of N
+    uint64_t seed {1};
+    std::string filter;           ///< Only run benchmarks whose name contains this
+    std::string outPath;
+    std::string basePath;         ///< Compare mode
+    std::string newPath;
+    double threshold {0.10};      ///< Relative ns/byte increase flagged as regression
+    double minRecovery {0.99};    ///< Decoded / embedded valid frames per stream
+    double floorFramesPerS {0.0}; ///< Valid frames/s required under adversarial input
+  };
+
+  struct ResultS
+  {
+    std::string name;
+    uint64_t bytes {0};           ///< Bytes per run
+    uint64_t frames {0};          ///< Frames per run
+    uint64_t expected {0};        ///< Valid frames embedded in the stream, 0 if n/a
+    double nsPerByte {0.0};
+    double framesPerS {0.0};
+  };
+
+  struct RecoveryS
+  {
+    std::string name;
+    uint64_t drops {0};             ///< Trials, one damaged frame each
+    double lostFramesPerDrop {0.0}; ///< Intact frames lost besides the damaged one
+    double meanDelayUs {0.0};       ///< Extra delay until the next intact frame is decoded
+    double maxDelayUs {0.0};
+  };
+
+  struct BerPointS
+  {
+    std::string name;
+    uint64_t frames {0};            ///< Frames sent
+    uint64_t delivered {0};         ///< Frames decoded intact
+    uint64_t falseFrames {0};       ///< Corrupted frames that passed all checks
+    uint64_t corrected {0};         ///< FEC codewords corrected in delivered frames
+    uint64_t uncorrectable {0};     ///< FEC candidates dropped for a double bit error, FEC runs only
+    uint64_t falseFecSofs {0};      ///< FEC candidates that were no FEC frame
+  };
+
+  struct ReportS
+  {
+    std::vector<ResultS> results;
+    std::vector<RecoveryS> recoveries;
+    std::vector<BerPointS> berSweep;
+  };
+
+  // ---------------------------------------------------------------------------
+  // Stream generators
+  // ---------------------------------------------------------------------------
+  void appendFrame(StreamT& stream, signalIdE sigId, const uint8_t* payload, size_t payloadLen,
+                   frameFormatE format = frameFormatE::BASIC)
+  {
+    uint8_t frame[MAX_FRAME_SIZE];
+    size_t len = encodeFrame(sigId, payload, payloadLen, frame, format);
+    stream.insert(stream.end(), frame, frame + len);
+  }
+
+  /// Traffic as seen on the link: mostly ticks, some button and connect frames
+  StreamT makeValidStream(std::mt19937_64& rng, frameFormatE format = frameFormatE::BASIC)
+  {
+    StreamT stream;
+    std::uniform_int_distribution<int> pick(0, 9);
+    while (stream.size() < STREAM_SIZE)
+    {
+      const int kind = pick(rng);
+      if (kind < 7)
+      {
+        appendFrame(stream, (kind & 1) ? signalIdE::TICK_IND : signalIdE::TICK_CFM, nullptr, 0, format);
+      }
+      else if (kind < 9)
+      {
+        appendFrame(stream, (kind & 1) ? signalIdE::BUTTON_IND : signalIdE::BUTTON_CFM, nullptr, 0, format);
+      }
+      else
+      {
+        appendFrame(stream, signalIdE::CONNECT_REQ, nullptr, 0, format);
+      }
+    }
+    return stream;
+  }
+
+  StreamT makeNoiseStream(std::mt19937_64& rng)
+  {
+    StreamT stream(STREAM_SIZE);
+    std::uniform_int_distribution<uint32_t> value(0, 0xFF);
+    for (uint8_t& byte : stream)
+    {
+      byte = static_cast<uint8_t>(value(rng));
+    }
+    return stream;
+  }
+
+  StreamT makeSofStream()
+  {
+    return StreamT(STREAM_SIZE, SOF);
+  }
+
+  /// Signal with the longest payload any signal may carry
+  void findLongestFrame(uint8_t& sigId, size_t& payloadLen)
+  {
+    sigId = 0;
+    payloadLen = 0;
+    for (size_t sig = 0; sig <= 0xFF; ++sig)
+    {
+      for (size_t len = MAX_PAYLOAD + 1U; len-- > 0U;)
+      {
+        if (!isPlausibleFrame(static_cast<uint8_t>(sig), len))
+          continue;
+        if (sigId == 0U || len > payloadLen)
+        {
+          sigId = static_cast<uint8_t>(sig);
+          payloadLen = len;
+        }
+        break;
+      }
+    }
+  }
+
+  void appendLongestFrame(StreamT& stream, std::mt19937_64& rng)
+  {
+    uint8_t sigId;
+    size_t payloadLen;
+    findLongestFrame(sigId, payloadLen);
+
+    std::uniform_int_distribution<uint32_t> value(0, 0xFF);
+    uint8_t payload[MAX_PAYLOAD];
+    for (uint8_t& byte : payload)
+    {
+      byte = static_cast<uint8_t>(value(rng));
+    }
+    appendFrame(stream, static_cast<signalIdE>(sigId), payload, payloadLen);
+  }
+
+  StreamT makeMaxLengthStream(std::mt19937_64& rng)
+  {
+    StreamT stream;
+    while (stream.size() < STREAM_SIZE)
+    {
+      appendLongestFrame(stream, rng);
+    }
+    return stream;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Adversarial generators: every valid frame is preceded by input built to
+  // keep the decoder busy or to swallow the frame behind it
+  // ---------------------------------------------------------------------------
+  enum class AttackE
+  {
+    LONG_LEN,       ///< SOF, LEN=33 and random bytes
+    PLAUSIBLE,      ///< SOF, LEN=1, known SIG and a wrong CRC
+    SOF_PREFIX,     ///< Short runs of SOF / LEN-like bytes
+    NOISE           ///< Random bytes of random length
+  };
+
+  void appendTypicalFrame(StreamT& stream, std::mt19937_64& rng)
+  {
+    std::uniform_int_distribution<int> pick(0, 2);
+    static const signalIdE signals[] {signalIdE::TICK_IND, signalIdE::TICK_CFM, signalIdE::BUTTON_IND};
+    appendFrame(stream, signals[pick(rng)], nullptr, 0);
+  }
+
+  StreamT makeAdversarialStream(AttackE attack, std::mt19937_64& rng, uint64_t& expected)
+  {
+    StreamT stream;
+    std::uniform_int_distribution<uint32_t> value(0, 0xFF);
+    std::uniform_int_distribution<uint32_t> signal(1, 7);
+    std::uniform_int_distribution<uint32_t> shortLen(1, 3);
+    std::uniform_int_distribution<uint32_t> noiseLen(0, 16);
+    static const uint8_t prefixBytes[] {SOF, 0x01, MAX_PAYLOAD + 1U};
+
+    expected = 0;
+    while (stream.size() < STREAM_SIZE)
+    {
+      switch (attack)
+      {
+      case AttackE::LONG_LEN:
+        stream.push_back(SOF);
+        stream.push_back(MAX_PAYLOAD + 1U);
+        for (size_t i = 0; i < MAX_PAYLOAD - 1U; ++i)
+        {
+          stream.push_back(static_cast<uint8_t>(value(rng)));
+        }
+        break;
+
+      case AttackE::PLAUSIBLE:
+      {
+        const uint8_t sig = static_cast<uint8_t>(signal(rng));
+        stream.push_back(SOF);
+        stream.push_back(1U);
+        stream.push_back(sig);
+        stream.push_back(static_cast<uint8_t>(crc8(&sig, 1U) ^ 0x5AU));
+        break;
+      }
+
+      case AttackE::SOF_PREFIX:
+        for (uint32_t i = shortLen(rng); i > 0U; --i)
+        {
+          stream.push_back(prefixBytes[value(rng) % sizeof(prefixBytes)]);
+        }
+        break;
+
+      case AttackE::NOISE:
+        for (uint32_t i = noiseLen(rng); i > 0U; --i)
+        {
+          stream.push_back(static_cast<uint8_t>(value(rng)));
+        }
+        break;
+      }
+
+      appendTypicalFrame(stream, rng);
+      ++expected;
+    }
+    return stream;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Measurement
+  // ---------------------------------------------------------------------------
+
+  /**
+   * @brief Run body repeatedly for the configured time and keep the best
+   * repetition. body returns the number of frames it handled.
+   */
+  ResultS measure(const std::string& name, uint64_t bytesPerRun,
+                  const std::function<uint64_t()>& body, const OptionsS& options)
+  {
+    using ClockT = std::chrono::steady_clock;
+
+    ResultS result;
+    result.name = name;
+    result.bytes = bytesPerRun;
+    result.frames = body();   // Warm-up run also counts the frames
+
+    const auto slice = std::chrono::milliseconds(options.minTimeMs) / options.repetitions;
+    double bestNsPerRun = 0.0;
+    for (size_t rep = 0; rep < options.repetitions; ++rep)
+    {
+      uint64_t runs {0};
+      const ClockT::time_point start = ClockT::now();
+      ClockT::duration elapsed {};
+      do
+      {
+        sink = sink + body();
+        ++runs;
+        elapsed = ClockT::now() - start;
+      } while (elapsed < slice);
+
+      const double nsPerRun =
+        static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())
+        / static_cast<double>(runs);
+      if (rep == 0U || nsPerRun < bestNsPerRun)
+        bestNsPerRun = nsPerRun;
+    }
+
+    result.nsPerByte = bestNsPerRun / static_cast<double>(bytesPerRun);
+    result.framesPerS = static_cast<double>(result.frames) * 1e9 / bestNsPerRun;
+    return result;
+  }
+
+  uint64_t decodeStream(const StreamT& stream)
+  {
+    Decoder decoder;
+    uint64_t frames {0};
+    for (uint8_t byte : stream)
+    {
+      if (decoder.processByte(byte).valid)
+        ++frames;
+    }
+    return frames;
+  }
+
+  void runBenchmarks(const OptionsS& options, std::vector<ResultS>& results)
+  {
+    std::mt19937_64 rng(options.seed);
+    auto selected = [&options](const std::string& name) {
+      return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    };
+
+    // Decoder over the stream mixes
+    const std::vector<std::pair<std::string, StreamT>> mixes {
+      {"valid", makeValidStream(rng)},
+      {"noise", makeNoiseStream(rng)},
+      {"all_sof", makeSofStream()},
+      {"max_len", makeMaxLengthStream(rng)}
+    };
+    for (const auto& mix : mixes)
+    {
+      const std::string name = "decoder/" + mix.first;
+      if (!selected(name))
+        continue;
+      const StreamT& stream = mix.second;
+      results.push_back(measure(name, stream.size(), [&stream]() { return decodeStream(stream); }, options));
+    }
+
+    // Same traffic in the FEC format, with its own rng to keep the other streams unchanged
+    if (selected("decoder/valid_fec"))
+    {
+      std::mt19937_64 fecRng(options.seed);
+      const StreamT stream = makeValidStream(fecRng, frameFormatE::FEC);
+      results.push_back(measure("decoder/valid_fec", stream.size(), [&stream]() { return decodeStream(stream); },
+                                options));
+    }
+
+    // Decoder under adversarial input, valid frame recovery is checked
+    const std::vector<std::pair<std::string, AttackE>> attacks {
+      {"adv_long_len", AttackE::LONG_LEN},
+      {"adv_plausible", AttackE::PLAUSIBLE},
+      {"adv_sof_prefix", AttackE::SOF_PREFIX},
+      {"adv_noise", AttackE::NOISE}
+    };
+    for (const auto& attack : attacks)
+    {
+      const std::string name = "decoder/" + attack.first;
+      uint64_t expected {0};
+      const StreamT stream = makeAdversarialStream(attack.second, rng, expected);
+      if (!selected(name))
+        continue;
+      results.push_back(measure(name, stream.size(), [&stream]() { return decodeStream(stream); }, options));
+      results.back().expected = expected;
+    }
+
+    // CRC over max-length [LEN][SIG][PAYLOAD] blocks
+    const StreamT blocks = makeNoiseStream(rng);
+    const size_t blockLen = MAX_PAYLOAD + 1U;
+    const size_t numBlocks = blocks.size() / blockLen;
+    if (selected("crc8/max_len"))
+    {
+      results.push_back(measure("crc8/max_len", numBlocks * blockLen, [&]() {
+        uint8_t crc {0};
+        for (size_t i = 0; i < numBlocks; ++i)
+        {
+          crc = static_cast<uint8_t>(crc ^ crc8(&blocks[i * blockLen], blockLen));
+        }
+        sink = sink + crc;
+        return static_cast<uint64_t>(numBlocks);
+      }, options));
+    }
+
+    // Encoder, empty and max-length payloads
+    const size_t numEncodes = 1024;
+    uint8_t payload[MAX_PAYLOAD];
+    std::memcpy(payload, blocks.data(), sizeof(payload));
+    for (size_t payloadLen : {static_cast<size_t>(0), MAX_PAYLOAD})
+    {
+      const std::string name = payloadLen == 0U ? "encode/empty" : "encode/max_len";
+      if (!selected(name))
+        continue;
+      results.push_back(measure(name, numEncodes * (4U + payloadLen), [&]() {
+        uint8_t frame[MAX_FRAME_SIZE];
+        uint64_t total {0};
+        for (size_t i = 0; i < numEncodes; ++i)
+        {
+          payload[0] = static_cast<uint8_t>(i);
+          total += encodeFrame(signalIdE::BUTTON_IND, payload, payloadLen, frame);
+          total += frame[payloadLen + 3U];
+        }
+        sink = sink + total;
+        return static_cast<uint64_t>(numEncodes);
+      }, options));
+    }
+
+    // RingBuffer as used by the target TX path: fill, gather, release
+    if (selected("ring_buffer/max_len"))
+    {
+      uint8_t maxFrame[MAX_FRAME_SIZE];
+      encodeFrame(signalIdE::BUTTON_IND, payload, MAX_PAYLOAD, maxFrame);
+      const size_t numFrames = 1024;
+      results.push_back(measure("ring_buffer/max_len", numFrames * MAX_FRAME_SIZE, [&]() {
+        RingBuffer<4, MAX_FRAME_SIZE> queue;
+        uint64_t total {0};
+        for (size_t i = 0; i < numFrames; ++i)
+        {
+          maxFrame[3] = static_cast<uint8_t>(i);
+          queue.push(maxFrame, sizeof(maxFrame));
+          if (queue.size() == 4U)
+          {
+            const uint8_t* frame;
+            size_t len;
+            for (size_t j = 0; queue.peek(j, frame, len); ++j)
+            {
+              total += frame[3];
+            }
+            queue.pop(queue.size());
+          }
+        }
+        sink = sink + total;
+        return static_cast<uint64_t>(numFrames);
+      }, options));
+    }
+
+    // Target telemetry sampling path per sample, frame encoding included:
+    // raw STREAM_DATA against one STREAM_SUMMARY per window
+    const size_t numSamples = STREAM_MAX_SAMPLES * 1000U;
+    if (selected("stream/raw"))
+    {
+      results.push_back(measure("stream/raw", numSamples * STREAM_SAMPLE_SIZE, [&]() {
+        uint8_t buffer[MAX_PAYLOAD];
+        uint8_t frame[MAX_FRAME_SIZE];
+        uint64_t total {0};
+        size_t fill {0};
+        for (size_t seq = 0; seq < numSamples; ++seq)
+        {
+          if (fill == 0U)
+            writeUint16(static_cast<uint16_t>(seq), buffer);
+          writeUint16(static_cast<uint16_t>(seq), buffer + STREAM_HEADER_SIZE + fill * STREAM_SAMPLE_SIZE);
+          if (++fill == STREAM_MAX_SAMPLES)
+          {
+            total += encodeFrame(signalIdE::STREAM_DATA, buffer, STREAM_HEADER_SIZE + fill * STREAM_SAMPLE_SIZE, frame);
+            fill = 0;
+          }
+        }
+        sink = sink + total;
+        return static_cast<uint64_t>(numSamples / STREAM_MAX_SAMPLES);
+      }, options));
+    }
+
+    const size_t windowSamples = 1000;
+    for (uint8_t bins : {static_cast<uint8_t>(0), static_cast<uint8_t>(STREAM_MAX_BINS)})
+    {
+      const std::string name = bins == 0U ? "stream/window" : "stream/window_hist";
+      if (!selected(name))
+        continue;
+      StreamWindowS config;
+      config.samples = static_cast<uint16_t>(windowSamples);
+      config.bins = bins;
+      config.binShift = 13;
+      results.push_back(measure(name, numSamples * STREAM_SAMPLE_SIZE, [&]() {
+        StreamWindow window;
+        window.configure(config);
+        uint8_t payload[MAX_PAYLOAD];
+        uint8_t frame[MAX_FRAME_SIZE];
+        uint64_t total {0};
+        size_t fill {0};
+        for (size_t seq = 0; seq < numSamples; ++seq)
+        {
+          if (fill == 0U)
+            window.start(static_cast<uint32_t>(seq));
+          window.add(static_cast<uint16_t>(seq));
+          if (++fill == windowSamples)
+          {
+            const size_t len = encodeStreamSummary(window.summary(), payload);
+            total += encodeFrame(signalIdE::STREAM_SUMMARY, payload, len, frame);
+            fill = 0;
+          }
+        }
+        sink = sink + total;
+        return static_cast<uint64_t>(numSamples / windowSamples);
+      }, options));
+    }
+  }
+
+  // ---------------------------------------------------------------------------
+  // Recovery after a damaged frame, on a timestamped 115200 baud line
+  // ---------------------------------------------------------------------------
+  constexpr uint32_t BYTE_TIME_US = 87;
+  constexpr size_t RECOVERY_FRAMES = 8;
+
+  enum class DamageE
+  {
+    DROP_BYTE,      ///< One byte lost on the line
+    FLIP_LEN        ///< One bit flipped in LEN
+  };
+
+  /**
+   * @brief Damage every inner frame in every possible way in turn and
+   * measure the frames lost behind it and how late the next intact frame
+   * is decoded.
+   */
+  RecoveryS measureRecovery(const std::string& name, DamageE damage, uint32_t gapBytes,
+                            uint32_t timeoutUs, const OptionsS& options)
+  {
+    // Short frames alternate with the longest frame the protocol has
+    std::mt19937_64 rng(options.seed);
+    std::vector<StreamT> frames(RECOVERY_FRAMES);
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+      if (i & 1U)
+        appendLongestFrame(frames[i], rng);
+      else
+        appendFrame(frames[i], signalIdE::TICK_CFM, nullptr, 0);
+    }
+
+    RecoveryS recovery;
+    recovery.name = name;
+    uint64_t lost {0};
+    double totalDelayUs {0.0};
+    for (size_t damaged = 1; damaged + 1U < frames.size(); ++damaged)
+    {
+      const size_t variants = damage == DamageE::DROP_BYTE ? frames[damaged].size() : 8U;
+      for (size_t variant = 0; variant < variants; ++variant)
+      {
+        Decoder decoder;
+        decoder.setInterByteTimeout(timeoutUs);
+
+        uint32_t nowUs {0};
+        uint32_t nextFrameEndUs {0};
+        uint32_t firstDecodedUs {0};
+        uint64_t decoded {0};
+        for (size_t i = 0; i < frames.size(); ++i)
+        {
+          for (size_t j = 0; j < frames[i].size(); ++j)
+          {
+            // Bytes are stamped at their end, a lost byte still took its time
+            nowUs += BYTE_TIME_US;
+            uint8_t byte = frames[i][j];
+            if (i == damaged && damage == DamageE::DROP_BYTE && j == variant)
+              continue;
+            if (i == damaged && damage == DamageE::FLIP_LEN && j == 1U)
+              byte = static_cast<uint8_t>(byte ^ (1U << variant));
+
+            if (decoder.processByte(byte, nowUs).valid)
+            {
+              ++decoded;
+              if (i > damaged && firstDecodedUs == 0U && nowUs >= nextFrameEndUs)
+                firstDecodedUs = nowUs;
+            }
+          }
+          if (i == damaged)
+            nextFrameEndUs = nowUs + (gapBytes + frames[i + 1U].size()) * BYTE_TIME_US;
+          nowUs += gapBytes * BYTE_TIME_US;
+        }
+
+        // The damaged frame still counts if only its SOF was hit
+        const uint64_t expected = frames.size() - 1U;
+        lost += decoded < expected ? expected - decoded : 0U;
+        const double delayUs = static_cast<double>((firstDecodedUs != 0U ? firstDecodedUs : nowUs) - nextFrameEndUs);
+        totalDelayUs += delayUs;
+        if (delayUs > recovery.maxDelayUs)
+          recovery.maxDelayUs = delayUs;
+        ++recovery.drops;
+      }
+    }
+    recovery.lostFramesPerDrop = static_cast<double>(lost) / static_cast<double>(recovery.drops);
+    recovery.meanDelayUs = totalDelayUs / static_cast<double>(recovery.drops);
+    return recovery;
+  }
+
+  void runRecovery(const OptionsS& options, std::vector<RecoveryS>& recoveries)
+  {
+    const std::vector<std::pair<std::string, uint32_t>> traffic {
+      {"back_to_back", 0U},
+      {"sparse", 100U}
+    };
+    const std::vector<std::pair<std::string, DamageE>> damages {
+      {"drop_byte", DamageE::DROP_BYTE},
+      {"flip_len", DamageE::FLIP_LEN}
+    };
+    for (const auto& pattern : traffic)
+    {
+      for (const auto& damage : damages)
+      {
+        for (uint32_t timeoutUs : {0U, 3U * BYTE_TIME_US})
+        {
+          const std::string name = "recovery/" + pattern.first + "/" + damage.first
+                                   + (timeoutUs == 0U ? "/no_timeout" : "/timeout");
+          if (options.filter.empty() || name.find(options.filter) != std::string::npos)
+            recoveries.push_back(measureRecovery(name, damage.second, pattern.second, timeoutUs, options));
+        }
+      }
+    }
+  }
+
+  // ---------------------------------------------------------------------------
+  // Frame loss of both frame formats over a bit error rate sweep
+  // ---------------------------------------------------------------------------
+  constexpr size_t BER_SWEEP_FRAMES = 20000;
+
+  struct SentFrameS
+  {
+    uint8_t sigId;
+    uint8_t payloadLen;
+    uint8_t payload[MAX_PAYLOAD];
+  };
+
+  BerPointS measureBer(const std::string& name, frameFormatE format, double ber, const OptionsS& options)
+  {
+    // Same traffic for every point: short frames, framing masks and the longest frame
+    std::mt19937_64 rng(options.seed);
+    std::uniform_int_distribution<int> pick(0, 3);
+    std::uniform_int_distribution<uint32_t> value(0, 0xFF);
+    uint8_t longestSig;
+    size_t longestLen;
+    findLongestFrame(longestSig, longestLen);
+
+    std::vector<SentFrameS> sent(BER_SWEEP_FRAMES);
+    std::vector<size_t> frameEnds;
+    StreamT stream;
+    for (SentFrameS& frame : sent)
+    {
+      const int kind = pick(rng);
+      frame.sigId = static_cast<uint8_t>(kind == 0 ? signalIdE::TICK_IND
+                                       : kind == 1 ? signalIdE::TICK_CFM
+                                       : kind == 2 ? signalIdE::CONNECT_CFM
+                                       : static_cast<signalIdE>(longestSig));
+      frame.payloadLen = static_cast<uint8_t>(kind == 2 ? 1U : kind == 3 ? longestLen : 0U);
+      for (uint8_t& byte : frame.payload)
+      {
+        byte = static_cast<uint8_t>(value(rng));
+      }
+
+      uint8_t encoded[MAX_FRAME_SIZE];
+      size_t len = encodeFrame(static_cast<signalIdE>(frame.sigId), frame.payload, frame.payloadLen, encoded, format);
+      stream.insert(stream.end(), encoded, encoded + len);
+      frameEnds.push_back(stream.size());
+    }
+
+    // Flip bits with geometric gaps, the line corrupts all formats alike
+    std::mt19937_64 lineRng(options.seed ^ 0x9E3779B97F4A7C15ULL);
+    if (ber > 0.0)
+    {
+      std::geometric_distribution<uint64_t> gap(ber);
+      for (uint64_t bit = gap(lineRng); bit < stream.size() * 8U; bit += 1U + gap(lineRng))
+      {
+        stream[bit / 8U] = static_cast<uint8_t>(stream[bit / 8U] ^ (1U << (bit % 8U)));
+      }
+    }
+
+    BerPointS point;
+    point.name = name;
+    point.frames = sent.size();
+
+    // A decoded frame is matched against the last sent frames that ended up
+    // to its position, a rescan may deliver a frame a few bytes late
+    Decoder decoder;
+    size_t next {0};
+    size_t ended {0};
+    for (size_t pos = 0; pos < stream.size(); ++pos)
+    {
+      auto res = decoder.processByte(stream[pos]);
+      while (ended < frameEnds.size() && frameEnds[ended] <= pos + 1U)
+      {
+        ++ended;
+      }
+      if (!res.valid)
+        continue;
+
+      bool matched = false;
+      for (size_t i = std::max(next, ended > 8U ? ended - 8U : 0U); i < ended; ++i)
+      {
+        const SentFrameS& frame = sent[i];
+        if (static_cast<uint8_t>(res.frame.sigId) == frame.sigId && res.frame.payloadLen == frame.payloadLen
+            && std::memcmp(res.frame.payload.data(), frame.payload, frame.payloadLen) == 0)
+        {
+          matched = true;
+          next = i + 1U;
+          break;
+        }
+      }
+      if (matched)
+        ++point.delivered;
+      else
+        ++point.falseFrames;
+    }
+    // The decoder accepts every format, in a run of another format each
+    // FEC candidate is a payload byte or a bit flip that hit a SOF_FEC
+    const FecStatsS& fec = decoder.fecStats();
+    point.corrected = fec.corrected;
+    if (format == frameFormatE::FEC)
+    {
+      point.uncorrectable = fec.uncorrectable;
+      point.falseFecSofs = fec.falseSofs;
+    }
+    else
+    {
+      point.falseFecSofs = fec.falseSofs + fec.uncorrectable;
+    }
+    return point;
+  }
+
+  void runBerSweep(const OptionsS& options, std::vector<BerPointS>& points)
+  {
+    const std::vector<std::pair<std::string, frameFormatE>> formats {
+      {"basic", frameFormatE::BASIC},
+      {"header_check", frameFormatE::HEADER_CHECK},
+      {"fec", frameFormatE::FEC}
+    };
+    for (double ber : {1e-5, 1e-4, 1e-3, 3e-3, 1e-2})
+    {
+      for (const auto& format : formats)
+      {
+        std::ostringstream name;
+        name << "ber/" << format.first << "/" << std::scientific << std::setprecision(0) << ber;
+        if (options.filter.empty() || name.str().find(options.filter) != std::string::npos)
+          points.push_back(measureBer(name.str(), format.second, ber, options));
+      }
+    }
+  }
+
+  /**
+   * @brief Check frame recovery and the frames/s floor of the streams with
+   * embedded valid frames. Returns the number of failures.
+   */
+  size_t checkFloors(const OptionsS& options, const std::vector<ResultS>& results)
+  {
+    size_t failures {0};
+    for (const ResultS& result : results)
+    {
+      if (result.expected == 0U)
+        continue;
+
+      const double recovery = static_cast<double>(result.frames) / static_cast<double>(result.expected);
+      if (recovery < options.minRecovery)
+      {
+        std::cerr << "[protocol_bench] " << result.name << ": recovered " << result.frames
+                  << " of " << result.expected << " frames" << std::endl;
+        ++failures;
+      }
+      if (result.framesPerS < options.floorFramesPerS)
+      {
+        std::cerr << "[protocol_bench] " << result.name << ": " << result.framesPerS
+                  << " frames/s is below the floor" << std::endl;
+        ++failures;
+      }
+    }
+    return failures;
+  }
+
+  // ---------------------------------------------------------------------------
+  // JSON output and comparison
+  // ---------------------------------------------------------------------------
+  void writeJson(std::ostream& out, const OptionsS& options, const ReportS& report)
+  {
+    const std::vector<ResultS>& results = report.results;
+    const std::vector<RecoveryS>& recoveries = report.recoveries;
+    out << "{\n";
+    out << "  \"suite\": \"protocol_bench\",\n";
+    out << "  \"seed\": " << options.seed << ",\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+      const ResultS& result = results[i];
+      out << "    {\"name\": \"" << result.name << "\""
+          << ", \"bytes\": " << result.bytes
+          << ", \"frames\": " << result.frames
+          << ", \"expected\": " << result.expected
+          << std::fixed << std::setprecision(4)
+          << ", \"ns_per_byte\": " << result.nsPerByte
+          << std::setprecision(0)
+          << ", \"frames_per_s\": " << result.framesPerS
+          << "}" << (i + 1U < results.size() ? "," : "") << "\n";
+      out.unsetf(std::ios::floatfield);
+    }
+    out << "  ],\n";
+    out << "  \"recovery\": [\n";
+    for (size_t i = 0; i < recoveries.size(); ++i)
+    {
+      const RecoveryS& recovery = recoveries[i];
+      out << "    {\"name\": \"" << recovery.name << "\""
+          << ", \"drops\": " << recovery.drops
+          << std::fixed << std::setprecision(3)
+          << ", \"lost_frames_per_drop\": " << recovery.lostFramesPerDrop
+          << std::setprecision(1)
+          << ", \"mean_delay_us\": " << recovery.meanDelayUs
+          << ", \"max_delay_us\": " << recovery.maxDelayUs
+          << "}" << (i + 1U < recoveries.size() ? "," : "") << "\n";
+      out.unsetf(std::ios::floatfield);
+    }
+    out << "  ],\n";
+    out << "  \"ber_sweep\": [\n";
+    for (size_t i = 0; i < report.berSweep.size(); ++i)
+    {
+      const BerPointS& point = report.berSweep[i];
+      const double loss = 1.0 - static_cast<double>(point.delivered) / static_cast<double>(point.frames);
+      out << "    {\"name\": \"" << point.name << "\""
+          << ", \"frames\": " << point.frames
+          << ", \"delivered\": " << point.delivered
+          << ", \"false_frames\": " << point.falseFrames
+          << ", \"fec_corrected\": " << point.corrected
+          << ", \"fec_uncorrectable\": " << point.uncorrectable
+          << ", \"false_fec_sofs\": " << point.falseFecSofs
+          << std::fixed << std::setprecision(5)
+          << ", \"frame_loss\": " << loss
+          << ", \"residual_errors\": "
+          << static_cast<double>(point.falseFrames) / static_cast<double>(point.frames)
+          << "}" << (i + 1U < report.berSweep.size() ? "," : "") << "\n";
+      out.unsetf(std::ios::floatfield);
+    }
+    out << "  ]\n";
+    out << "}\n";
+  }
+
+  /**
+   * @brief Read ns/byte per benchmark name from a file written by writeJson().
+   */
+  bool readJson(const std::string& path, std::map<std::string, double>& nsPerByte)
+  {
+    std::ifstream in(path);
+    if (!in)
+      return false;
+
+    const std::string nameKey = "\"name\": \"";
+    const std::string valueKey = "\"ns_per_byte\": ";
+    std::string line;
+    while (std::getline(in, line))
+    {
+      size_t name = line.find(nameKey);
+      size_t value = line.find(valueKey);
+      if (name == std::string::npos || value == std::string::npos)
+        continue;
+      name += nameKey.size();
+      const size_t nameEnd = line.find('"', name);
+      nsPerByte[line.substr(name, nameEnd - name)] =
+        std::strtod(line.c_str() + value + valueKey.size(), nullptr);
+    }
+    return true;
+  }
+
+  int compare(const OptionsS& options)
+  {
+    std::map<std::string, double> base;
+    std::map<std::string, double> current;
+    if (!readJson(options.basePath, base) || !readJson(options.newPath, current))
+    {
+      std::cout << "[protocol_bench] Failed to read result files" << std::endl;
+      return 2;
+    }
+
+    size_t regressions {0};
+    for (const auto& entry : current)
+    {
+      auto baseEntry = base.find(entry.first);
+      if (baseEntry == base.end() || baseEntry->second <= 0.0)
+        continue;
+
+      const double change = entry.second / baseEntry->second - 1.0;
+      const bool regression = change > options.threshold;
+      if (regression)
+        ++regressions;
+      std::cout << std::left << std::setw(24) << entry.first << std::right
+                << std::fixed << std::setprecision(3)
+                << std::setw(10) << baseEntry->second << " -> "
+                << std::setw(10) << entry.second << " ns/byte "
+                << std::showpos << std::setprecision(1) << change * 100.0 << "%" << std::noshowpos
+                << (regression ? "  REGRESSION" : "") << std::endl;
+    }
+    std::cout << regressions << " regression(s) above " << options.threshold * 100.0 << "%" << std::endl;
+    return regressions == 0U ? 0 : 1;
+  }
+
+  void printUsage()
+  {
+    std::cout << "Usage: protocol_bench [options]" << std::endl;
+    std::cout << "       protocol_bench --compare <base.json> <new.json> [--threshold <pct>]" << std::endl;
+    std::cout << "  --min-time-ms <ms>   measured time per benchmark (default 250)" << std::endl;
+    std::cout << "  --repetitions <n>    keep the best of n repetitions (default 5)" << std::endl;
+    std::cout << "  --filter <text>      only run benchmarks whose name contains text" << std::endl;
+    std::cout << "  --seed <n>           stream generator seed (default 1)" << std::endl;
+    std::cout << "  --out <file>         write the JSON results to file instead of stdout" << std::endl;
+    std::cout << "  --threshold <pct>    ns/byte increase reported as regression (default 10)" << std::endl;
+    std::cout << "  --min-recovery <r>   required ratio of decoded to embedded frames (default 0.99)" << std::endl;
+    std::cout << "  --floor <n>          required valid frames/s under adversarial input" << std::endl;
+  }
+
+  bool parseOptions(int argc, char* argv[], OptionsS& options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      if (std::strcmp(argv[i], "--compare") == 0 && i + 2 < argc)
+      {
+        options.basePath = argv[++i];
+        options.newPath = argv[++i];
+        continue;
+      }
+      if (i + 1 >= argc)
+        return false;
+
+      const char* value = argv[++i];
+      if (std::strcmp(argv[i - 1], "--min-time-ms") == 0)
+        options.minTimeMs = std::strtoull(value, nullptr, 10);
+      else if (std::strcmp(argv[i - 1], "--repetitions") == 0)
+        options.repetitions = std::strtoul(value, nullptr, 10);
+      else if (std::strcmp(argv[i - 1], "--filter") == 0)
+        options.filter = value;
+      else if (std::strcmp(argv[i - 1], "--seed") == 0)
+        options.seed = std::strtoull(value, nullptr, 10);
+      else if (std::strcmp(argv[i - 1], "--out") == 0)
+        options.outPath = value;
+      else if (std::strcmp(argv[i - 1], "--threshold") == 0)
+        options.threshold = std::strtod(value, nullptr) / 100.0;
+      else if (std::strcmp(argv[i - 1], "--min-recovery") == 0)
+        options.minRecovery = std::strtod(value, nullptr);
+      else if (std::strcmp(argv[i - 1], "--floor") == 0)
+        options.floorFramesPerS = std::strtod(value, nullptr);
+      else
+        return false;
+    }
+    return options.repetitions > 0U && options.minTimeMs > 0U;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  OptionsS options;
+  if (!parseOptions(argc, argv, options))
+  {
+    printUsage();
+    return 2;
+  }
+
+  if (!options.basePath.empty())
+    return compare(options);
+
+  ReportS report;
+  runBenchmarks(options, report.results);
+  runRecovery(options, report.recoveries);
+  runBerSweep(options, report.berSweep);
+  const int status = checkFloors(options, report.results) == 0U ? 0 : 1;
+
+  if (options.outPath.empty())
+  {
+    writeJson(std::cout, options, report);
+    return status;
+  }
+
+  std::ofstream out(options.outPath);
+  writeJson(out, options, report);
+  return out ? status : 1;
+}
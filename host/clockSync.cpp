@@ -0,0 +1,86 @@
+#include "clockSync.hpp"
+
+#include <cmath>
+
+constexpr size_t ClockSync::SAMPLES_PER_ROUND;
+constexpr size_t ClockSync::MAX_POINTS;
+
+void ClockSync::reset()
+{
+  *this = ClockSync {};
+}
+
+void ClockSync::addSample(uint64_t t1Us, uint32_t t2Us, uint32_t t3Us, uint64_t t4Us)
+{
+  if (!started_)
+  {
+    started_ = true;
+    originUs_ = t1Us;
+    lastTargetUs_ = static_cast<int64_t>(t3Us);
+  }
+  const int64_t origin = static_cast<int64_t>(originUs_);
+  const int64_t t2 = unwrap(t2Us) - origin;
+  lastTargetUs_ = unwrap(t3Us);
+  const int64_t t3 = lastTargetUs_ - origin;
+
+  const int64_t t1 = static_cast<int64_t>(t1Us - originUs_);
+  const int64_t t4 = static_cast<int64_t>(t4Us - originUs_);
+  const int64_t rtt = (t4 - t1) - (t3 - t2);
+
+  PointS sample;
+  sample.hostUs = t1 + (t4 - t1) / 2;
+  sample.offsetUs = static_cast<double>((t2 - t1) + (t3 - t4)) / 2.0;
+  sample.rttUs = rtt < 0 ? 0U : static_cast<uint64_t>(rtt);
+
+  if (roundSamples_ == 0U || sample.rttUs < roundBest_.rttUs)
+    roundBest_ = sample;
+  if (++roundSamples_ < SAMPLES_PER_ROUND)
+    return;
+
+  roundSamples_ = 0;
+  lastRttUs_ = roundBest_.rttUs;
+  points_[nextPoint_] = roundBest_;
+  nextPoint_ = (nextPoint_ + 1U) % MAX_POINTS;
+  if (numPoints_ < MAX_POINTS)
+    ++numPoints_;
+  fit();
+}
+
+uint64_t ClockSync::toHostUs(uint32_t targetUs) const
+{
+  // target = host + intercept + slope * (host - mean), solved for host
+  const double targetRel = static_cast<double>(unwrap(targetUs) - static_cast<int64_t>(originUs_));
+  const double hostRel = (targetRel - intercept_ + slope_ * meanHostUs_) / (1.0 + slope_);
+  return originUs_ + static_cast<uint64_t>(static_cast<int64_t>(std::llround(hostRel)));
+}
+
+int64_t ClockSync::unwrap(uint32_t targetUs) const
+{
+  // Nearest value to the last exchange with the same low 32 bits
+  const int32_t delta = static_cast<int32_t>(targetUs - static_cast<uint32_t>(lastTargetUs_));
+  return lastTargetUs_ + delta;
+}
+
+void ClockSync::fit()
+{
+  double sumHost {0.0};
+  double sumOffset {0.0};
+  for (size_t i = 0; i < numPoints_; ++i)
+  {
+    sumHost += static_cast<double>(points_[i].hostUs);
+    sumOffset += points_[i].offsetUs;
+  }
+  meanHostUs_ = sumHost / static_cast<double>(numPoints_);
+  intercept_ = sumOffset / static_cast<double>(numPoints_);
+
+  // A single point gives the offset only
+  double sxx {0.0};
+  double sxy {0.0};
+  for (size_t i = 0; i < numPoints_; ++i)
+  {
+    const double dx = static_cast<double>(points_[i].hostUs) - meanHostUs_;
+    sxx += dx * dx;
+    sxy += dx * (points_[i].offsetUs - intercept_);
+  }
+  slope_ = sxx == 0.0 ? 0.0 : sxy / sxx;
+}
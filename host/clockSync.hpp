@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Maps target timestamps to the host timeline from TIME_REQ/TIME_CFM exchanges.
+ *
+ * Each exchange gives the four NTP timestamps: host send T1, target receive
+ * T2, target send T3 and host receive T4. The exchange with the lowest round
+ * trip time out of every SAMPLES_PER_ROUND has the least queueing in it and
+ * becomes one offset point. A least squares line through the last MAX_POINTS
+ * points gives the offset and the drift of the target clock.
+ *
+ * Host times are steady clock microseconds, target times the 32-bit
+ * Target::timestampUs(), unwrapped here. Not thread-safe.
+ */
+class ClockSync
+{
+public:
+  static constexpr size_t SAMPLES_PER_ROUND = 4;
+  static constexpr size_t MAX_POINTS = 32;
+
+  /**
+   * @brief Add one exchange.
+   */
+  void addSample(uint64_t t1Us, uint32_t t2Us, uint32_t t3Us, uint64_t t4Us);
+
+  /**
+   * @brief Forget all samples, for a new connection.
+   */
+  void reset();
+
+  /**
+   * @brief True once the first round is complete.
+   */
+  bool synced() const { return numPoints_ != 0U; }
+
+  /**
+   * @brief Host time of a target timestamp within about 35 minutes of the last sample.
+   */
+  uint64_t toHostUs(uint32_t targetUs) const;
+
+  /**
+   * @brief Target clock rate error, positive when it runs fast.
+   */
+  double driftPpm() const { return slope_ * 1e6; }
+
+  /**
+   * @brief Round trip time of the last point, without the target processing time.
+   */
+  uint64_t rttUs() const { return lastRttUs_; }
+
+  size_t points() const { return numPoints_; }
+
+private:
+  struct PointS
+  {
+    int64_t hostUs {0};       ///< Midpoint of T1 and T4, relative to originUs_
+    double offsetUs {0.0};    ///< Target minus host time
+    uint64_t rttUs {0};
+  };
+
+  int64_t unwrap(uint32_t targetUs) const;
+  void fit();
+
+  // Best exchange of the current round
+  size_t roundSamples_ {0};
+  PointS roundBest_ {};
+
+  PointS points_[MAX_POINTS] {};
+  size_t numPoints_ {0};
+  size_t nextPoint_ {0};
+  uint64_t lastRttUs_ {0};
+
+  uint64_t originUs_ {0};       ///< Host time of the first point
+  int64_t lastTargetUs_ {0};    ///< Unwrapped T3 of the last exchange
+  bool started_ {false};
+
+  // offset(host) = intercept_ + slope_ * (host - originUs_ - meanHostUs_)
+  double meanHostUs_ {0.0};
+  double intercept_ {0.0};
+  double slope_ {0.0};
+};
@@ -1,10 +1,95 @@
 #include "host.hpp"
+#include "hostTrace.hpp"
 
 #include <iostream>
 #include <array>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
 
-Host::Host(const std::string& comPort)
-  : comPort_{comPort}{};
+namespace
+{
+  const char* const BUTTON_STAGE_NAMES[Host::BUTTON_STAGE_COUNT] = {
+    "target", "queue", "wire", "host", "total"
+  };
+
+  const char* const PROBE_NAMES[static_cast<size_t>(protocol::probeIdE::COUNT)] = {
+    "rx_isr", "tx_done_isr", "tick_isr", "process", "sample_isr"
+  };
+
+  // PERF_CFM histogram bucket limits, see CycleProbe
+  constexpr unsigned PERF_FIRST_BUCKET_BITS = 4;
+
+  uint64_t toMicros(std::chrono::steady_clock::time_point time)
+  {
+    return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count());
+  }
+
+  // Per-second rate of a counter, the error counters arrive as their low 16 bits
+  double ratePerS(uint32_t now, uint32_t last, double seconds, bool wraps16 = false)
+  {
+    const uint32_t delta = wraps16 ? static_cast<uint16_t>(now - last) : now - last;
+    return static_cast<double>(delta) / seconds;
+  }
+
+  uint64_t elapsedUs(uint64_t fromUs, uint64_t toUs)
+  {
+    return toUs > fromUs ? toUs - fromUs : 0U;
+  }
+
+  void writeHistogramJson(std::ostream& out, const char* name, const LatencyHistogram& histogram, bool last)
+  {
+    out << "    \"" << name << "\": {\"count\": " << histogram.count()
+        << ", \"p50\": " << histogram.percentile(50.0)
+        << ", \"p99\": " << histogram.percentile(99.0)
+        << ", \"p999\": " << histogram.percentile(99.9)
+        << ", \"max\": " << histogram.max() << ", \"buckets\": [";
+    bool first = true;
+    for (size_t i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i)
+    {
+      const uint64_t count = histogram.bucketCount(i);
+      if (count == 0U)
+        continue;
+      out << (first ? "" : ", ") << "[" << LatencyHistogram::bucketValue(i) << ", " << count << "]";
+      first = false;
+    }
+    out << "]}" << (last ? "" : ",") << "\n";
+  }
+}
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+// Out-of-line definitions of the constants (required by C++11 when ODR-used)
+constexpr decltype(Host::CONNECT_TIMEOUT) Host::CONNECT_TIMEOUT;
+constexpr decltype(Host::TICK_PERIOD) Host::TICK_PERIOD;
+constexpr decltype(Host::TICK_SUMMARY_PERIOD) Host::TICK_SUMMARY_PERIOD;
+constexpr size_t Host::MAX_TICKS_IN_FLIGHT;
+constexpr decltype(Host::TIME_SYNC_OFFSET) Host::TIME_SYNC_OFFSET;
+constexpr decltype(Host::SYNC_CLOCK_INTERVAL) Host::SYNC_CLOCK_INTERVAL;
+constexpr decltype(Host::SYNC_CLOCK_TIMEOUT) Host::SYNC_CLOCK_TIMEOUT;
+constexpr decltype(Host::CONNECT_POLL_DELAY) Host::CONNECT_POLL_DELAY;
+constexpr decltype(Host::RX_IDLE_SLEEP) Host::RX_IDLE_SLEEP;
+constexpr decltype(Host::RX_INTER_BYTE_TIMEOUT) Host::RX_INTER_BYTE_TIMEOUT;
+constexpr uint32_t Host::MAX_BAUD_RATE;
+constexpr uint8_t Host::RX_QUEUE_DEPTH;
+constexpr decltype(Host::BAUD_CFM_TIMEOUT) Host::BAUD_CFM_TIMEOUT;
+constexpr decltype(Host::BAUD_PROBE_WAIT) Host::BAUD_PROBE_WAIT;
+constexpr unsigned Host::BAUD_PROBE_ATTEMPTS;
+constexpr decltype(Host::BAUD_POLL_DELAY) Host::BAUD_POLL_DELAY;
+constexpr uint32_t Host::UART_BITS_PER_BYTE;
+constexpr decltype(Host::LOG_IDLE_TIMEOUT) Host::LOG_IDLE_TIMEOUT;
+constexpr unsigned Host::LOG_REQ_ATTEMPTS;
+
+Host::Host(const std::string& comPort, uint8_t frameFormats, uint32_t baudRate)
+  : comPort_{comPort}, frameFormats_{frameFormats}, baudRate_{baudRate}{};
 
 Host::~Host()
 {
@@ -14,6 +99,7 @@ Host::~Host()
 // ------------------------------------------------------------------
 // COM port handling
 // ------------------------------------------------------------------
+#ifdef _WIN32
 bool Host::openPort()
 {
   serial_ = CreateFileA(
@@ -56,6 +142,20 @@ bool Host::openPort()
   return true;
 }
 
+bool Host::setPortBaudRate(uint32_t baudRate)
+{
+  DCB dcb{};
+  dcb.DCBlength = sizeof(dcb);
+  if (!GetCommState(serial_, &dcb))
+    return false;
+
+  dcb.BaudRate = baudRate;
+  if (!SetCommState(serial_, &dcb))
+    return false;
+  lineBaudRate_ = baudRate;
+  return true;
+}
+
 void Host::closePort()
 {
   if (serial_ != INVALID_HANDLE_VALUE)
@@ -65,14 +165,136 @@ void Host::closePort()
   }
 }
 
+size_t Host::readPort(uint8_t* data, size_t len)
+{
+  DWORD read {0};
+  if (!ReadFile(serial_, data, static_cast<DWORD>(len), &read, nullptr))
+    return 0;
+  return read;
+}
+
+void Host::writePort(const uint8_t* data, size_t len)
+{
+  DWORD written = 0;
+  WriteFile(serial_, data, static_cast<DWORD>(len), &written, nullptr);
+}
+#else
+bool Host::openPort()
+{
+  serial_ = open(comPort_.c_str(), O_RDWR | O_NOCTTY);
+  if (serial_ < 0)
+  {
+    std::cout << "[host] Failed to open " << comPort_ << std::endl;
+    return false;
+  }
+
+  std::cout << "[host] Port is opened" << std::endl;
+  termios tio{};
+  tcgetattr(serial_, &tio);
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, B115200);
+  cfsetospeed(&tio, B115200);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+
+  // Same behaviour as the Windows read timeouts: return after 100 ms
+  // without data so the RX thread can check portOpened_
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 1;
+  tcsetattr(serial_, TCSANOW, &tio);
+
+  return true;
+}
+
+bool Host::setPortBaudRate(uint32_t baudRate)
+{
+  speed_t speed;
+  switch (baudRate)
+  {
+  case 115200: speed = B115200; break;
+  case 230400: speed = B230400; break;
+#ifdef B460800
+  case 460800: speed = B460800; break;
+#endif
+#ifdef B921600
+  case 921600: speed = B921600; break;
+#endif
+  default:
+    return false;
+  }
+
+  termios tio{};
+  if (tcgetattr(serial_, &tio) != 0)
+    return false;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  // Let queued bytes leave at the old rate first
+  if (tcsetattr(serial_, TCSADRAIN, &tio) != 0)
+    return false;
+  lineBaudRate_ = baudRate;
+  return true;
+}
+
+void Host::closePort()
+{
+  if (serial_ >= 0)
+  {
+    close(serial_);
+    serial_ = -1;
+  }
+}
+
+size_t Host::readPort(uint8_t* data, size_t len)
+{
+  ssize_t received = read(serial_, data, len);
+  return received > 0 ? static_cast<size_t>(received) : 0U;
+}
+
+void Host::writePort(const uint8_t* data, size_t len)
+{
+  while (len > 0U)
+  {
+    ssize_t written = write(serial_, data, len);
+    if (written <= 0)
+      return;
+    data += written;
+    len -= static_cast<size_t>(written);
+  }
+}
+#endif
+
 // -----------------------------------------------------------------------------
 // Main connection logic
 // -----------------------------------------------------------------------------
 void Host::connect()
+{
+  if (start())
+  {
+    if (!flightLogPath_.empty())
+      drainFlightLog();
+    if (streamRateHz_ != 0U)
+      startStream(streamRateHz_, streamWindow_);
+  }
+  mainLoop();
+}
+
+bool Host::start()
 {
   init();
   waitingConnectCfm();
-  mainLoop();
+  if (state_ == StateE::CONNECTED)
+    upshiftBaudRate();
+  return state_ == StateE::CONNECTED;
+}
+
+void Host::stop()
+{
+  if (state_ == StateE::CONNECTED)
+  {
+    sendDisconnectReq();
+    changeState(StateE::DISCONNECTING);
+  }
+  disconnect();
 }
 
 // -----------------------------------------------------------------------------
@@ -81,6 +303,7 @@ void Host::connect()
 void Host::changeState(StateE newState)
 {
   state_ = newState;
+  TRACE(HOST_STATE, newState, 0, 0);
   switch (state_)
   {
   case StateE::INIT:
@@ -89,6 +312,7 @@ void Host::changeState(StateE newState)
 
   case StateE::CONNECTING:
     std::cout << "[host] Connection to the target ..." << std::endl;
+    txFormat_ = protocol::frameFormatE::BASIC;
     break;
 
   case StateE::CONNECTED:
@@ -107,7 +331,6 @@ void Host::changeState(StateE newState)
 // -----------------------------------------------------------------------------
 void Host::waitingConnectCfm()
 {
-  using namespace std::chrono_literals;
   while(state_ == StateE::CONNECTING &&
         !connectCfmReceived_.load())
   {
@@ -120,6 +343,83 @@ void Host::waitingConnectCfm()
     }
     std::this_thread::sleep_for(CONNECT_POLL_DELAY);
   }
+
+  // Snapshot once, the main thread reads session_ from here on
+  if (state_ == StateE::CONNECTED)
+    session_ = rxSession_;
+}
+
+// -----------------------------------------------------------------------------
+// Baud rate upshift after CONNECT_CFM, before the first TICK_IND
+// -----------------------------------------------------------------------------
+bool Host::upshiftBaudRate()
+{
+  const uint32_t baudRate = std::min(baudRate_, session_.maxBaudRate);
+  if (baudRate <= protocol::BASELINE_BAUD_RATE)
+    return false;
+
+  std::cout << "[host] Send BAUD_REQ " << baudRate << std::endl;
+  baudCfmRate_ = 0;
+  std::vector<uint8_t> payload(protocol::BAUD_RATE_SIZE);
+  protocol::writeUint32(baudRate, payload.data());
+  sendSignal(protocol::signalIdE::BAUD_REQ, payload);
+
+  const auto cfmDeadline = std::chrono::steady_clock::now() + BAUD_CFM_TIMEOUT;
+  while (baudCfmRate_ == 0U && std::chrono::steady_clock::now() < cfmDeadline)
+  {
+    std::this_thread::sleep_for(BAUD_POLL_DELAY);
+  }
+  if (baudCfmRate_ != baudRate)
+  {
+    std::cout << "[host] BAUD_REQ not confirmed, staying at " << protocol::BASELINE_BAUD_RATE << " baud" << std::endl;
+    return false;
+  }
+
+  // The target switched once BAUD_CFM was out, check the new rate end to end
+  if (setPortBaudRate(baudRate) && probeBaudRate())
+  {
+    std::cout << "[host] Running at " << baudRate << " baud" << std::endl;
+    return true;
+  }
+
+  // Fall back and wait until the target has given up on the probes too
+  std::cout << "[host] Probe failed, back to " << protocol::BASELINE_BAUD_RATE << " baud" << std::endl;
+  setPortBaudRate(protocol::BASELINE_BAUD_RATE);
+  std::this_thread::sleep_for(std::chrono::milliseconds{protocol::BAUD_PROBE_TIMEOUT_MS});
+  if (probeBaudRate())
+    return false;
+
+  // A probe got through and committed the new rate, only its PROBE_CFMs
+  // were lost. The target keeps the new rate, so go back to it.
+  std::cout << "[host] No answer at " << protocol::BASELINE_BAUD_RATE << " baud, retrying " << baudRate << std::endl;
+  if (setPortBaudRate(baudRate) && probeBaudRate())
+  {
+    std::cout << "[host] Running at " << baudRate << " baud" << std::endl;
+    return true;
+  }
+  std::cout << "[host] No answer at either rate" << std::endl;
+  setPortBaudRate(protocol::BASELINE_BAUD_RATE);
+  return false;
+}
+
+// Exchange PROBE_REQ/CFM at the current port rate, true once a CFM came back
+bool Host::probeBaudRate()
+{
+  const std::vector<uint8_t> pattern(std::begin(protocol::BAUD_PROBE_PATTERN),
+                                     std::end(protocol::BAUD_PROBE_PATTERN));
+  for (unsigned attempt = 0; attempt < BAUD_PROBE_ATTEMPTS; ++attempt)
+  {
+    probeCfmReceived_ = false;
+    sendSignal(protocol::signalIdE::PROBE_REQ, pattern);
+    const auto probeDeadline = std::chrono::steady_clock::now() + BAUD_PROBE_WAIT;
+    while (!probeCfmReceived_ && std::chrono::steady_clock::now() < probeDeadline)
+    {
+      std::this_thread::sleep_for(BAUD_POLL_DELAY);
+    }
+    if (probeCfmReceived_)
+      return true;
+  }
+  return false;
 }
 
 // -----------------------------------------------------------------------------
@@ -127,21 +427,39 @@ void Host::waitingConnectCfm()
 // -----------------------------------------------------------------------------
 void Host::mainLoop()
 {
-  using namespace std::chrono_literals;
   auto nextTickTime = std::chrono::steady_clock::now();
+  auto nextSummaryTime = nextTickTime + TICK_SUMMARY_PERIOD;
   while(state_ == StateE::CONNECTED)
   {
     nextTickTime += TICK_PERIOD;
     sendTickInd();
+    if (targetStats_)
+      sendStatsReq();
+    if (perfProbes_)
+      sendPerfReq();
 
     auto now = std::chrono::steady_clock::now();
+    if (now >= nextSummaryTime)
+    {
+      nextSummaryTime += TICK_SUMMARY_PERIOD;
+      printTickSummary();
+      printButtonSummary();
+      if (!statsPath_.empty())
+        writeStatsFile();
+    }
+
     auto diff = now - lastRxTime_;
     auto diff_s = std::chrono::duration_cast<std::chrono::seconds>(diff).count();
     if (diff > CONNECT_TIMEOUT)
     {
       std::cout << "Connection lost: " << diff_s << "s" << std::endl;
+      TRACE(HOST_LINK_LOST, diff_s, 0, 0);
       changeState(StateE::DISCONNECTING);
     }
+
+    std::this_thread::sleep_until(nextTickTime - TICK_PERIOD + TIME_SYNC_OFFSET);
+    if (state_ == StateE::CONNECTED)
+      sendTimeReq();
     std::this_thread::sleep_until(nextTickTime);
   }
 }
@@ -151,17 +469,18 @@ void Host::mainLoop()
 // -----------------------------------------------------------------------------
 void Host::rxThread()
 {
+  hostTrace::setThreadName("rx");
   uint8_t byte {0};
-  DWORD read {0};
+  decoder_.setInterByteTimeout(static_cast<uint32_t>(
+    std::chrono::duration_cast<std::chrono::microseconds>(RX_INTER_BYTE_TIMEOUT).count()));
 
   while (portOpened_)
   {
-    if (!ReadFile(serial_, &byte, 1, &read, nullptr))
-      continue;
-
-    if (read == 1)
+    if (readPort(&byte, 1) == 1)
     {
-      auto res = decoder_.processByte(byte);
+      auto nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch());
+      auto res = decoder_.processByte(byte, static_cast<uint32_t>(nowUs.count()));
       // check if frame is valid
       if (res.valid)
       {
@@ -182,27 +501,544 @@ void Host::rxThread()
 // -----------------------------------------------------------------------------
 void Host::handleSignal(const protocol::FrameS& frame)
 {
+  TRACE(HOST_RX, frame.sigId, frame.payloadLen, 0);
   switch (frame.sigId)
   {
   case protocol::signalIdE::CONNECT_CFM:
     if (state_ == StateE::CONNECTING)
     {
-      connectCfmReceived_.store(true);
+      // A legacy target confirms without a record and gets the baseline
+      rxSession_ = protocol::decodeCapabilities(frame.payload.data(), frame.payloadLen);
+      txFormat_ = protocol::selectFrameFormat(rxSession_.frameFormats);
+      std::cout << "[host] Protocol v" << static_cast<unsigned>(rxSession_.version)
+                << ", frame format " << protocol::frameFormatName(txFormat_)
+                << ", max payload " << static_cast<unsigned>(rxSession_.maxPayload)
+                << ", max baud " << rxSession_.maxBaudRate
+                << ", target RX queue " << static_cast<unsigned>(rxSession_.rxQueueDepth) << std::endl;
+      {
+        std::lock_guard<std::mutex> lock(clockSyncMutex_);
+        clockSync_.reset();
+      }
+      haveTargetStats_ = false;
+      // The state store publishes rxSession_ to waitingConnectCfm()
       changeState(StateE::CONNECTED);
+      connectCfmReceived_.store(true);
     }
     break;
   case protocol::signalIdE::TICK_CFM:
     std::cout << "[host] Received TICK_CFM" << std::endl;
-    tickCfmPending_ = false;
+    onTickCfm(frame);
     break;
   case protocol::signalIdE::BUTTON_IND:
-    sendButtonCfm();
+    onButtonInd(frame);
+    break;
+  case protocol::signalIdE::TIME_CFM:
+    onTimeCfm(frame);
+    break;
+  case protocol::signalIdE::STATS_CFM:
+    onStatsCfm(frame);
+    break;
+  case protocol::signalIdE::LOOP_CFM:
+    onLoopCfm(frame);
+    break;
+  case protocol::signalIdE::PERF_CFM:
+    onPerfCfm(frame);
+    break;
+  case protocol::signalIdE::TRACE_CFM:
+    onTraceCfm(frame);
+    break;
+  case protocol::signalIdE::LOG_CFM:
+    onLogCfm(frame);
+    break;
+  case protocol::signalIdE::STREAM_DATA:
+    onStreamData(frame);
+    break;
+  case protocol::signalIdE::STREAM_SUMMARY:
+    onStreamSummary(frame);
+    break;
+  case protocol::signalIdE::BAUD_CFM:
+    baudCfmRate_ = protocol::readUint32(frame.payload.data());
+    break;
+  case protocol::signalIdE::ECHO_CFM:
+    if (echoHandler_)
+    {
+      echoHandler_(protocol::readUint16(frame.payload.data()),
+                   frame.payload.data() + protocol::ECHO_HEADER_SIZE,
+                   frame.payloadLen - protocol::ECHO_HEADER_SIZE, lastRxTime_);
+    }
+    break;
+  case protocol::signalIdE::PROBE_CFM:
+    if (std::memcmp(frame.payload.data(), protocol::BAUD_PROBE_PATTERN, protocol::BAUD_PROBE_SIZE) == 0)
+      probeCfmReceived_ = true;
     break;
   default:
     break;
   }
 }
 
+// -----------------------------------------------------------------------------
+// Heartbeat statistics
+// -----------------------------------------------------------------------------
+void Host::onTickCfm(const protocol::FrameS& frame)
+{
+  if (frame.payloadLen != protocol::TICK_SEQ_SIZE)
+  {
+    // Legacy target, the CFM cannot be matched to its tick
+    ++ticksConfirmed_;
+    return;
+  }
+
+  // A late CFM finds its slot reused by a newer tick and is ignored
+  const uint16_t seq = protocol::readUint16(frame.payload.data());
+  std::atomic<uint64_t>& slot = tickSlots_[seq % MAX_TICKS_IN_FLIGHT];
+  uint64_t sent = slot.load();
+  if (sent == 0U || static_cast<uint16_t>(sent) != seq || !slot.compare_exchange_strong(sent, 0U))
+    return;
+
+  ++ticksConfirmed_;
+  const uint64_t rxUs = toMicros(lastRxTime_);
+  tickRtt_.record(rxUs - (sent >> 16));
+
+  // Deviation of the CFM spacing from the tick schedule
+  if (lastTickCfmUs_ != 0U)
+  {
+    const uint64_t periodUs = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(TICK_PERIOD).count());
+    const uint64_t expectedUs = static_cast<uint16_t>(seq - lastTickCfmSeq_) * periodUs;
+    const uint64_t actualUs = rxUs - lastTickCfmUs_;
+    tickJitter_.record(actualUs > expectedUs ? actualUs - expectedUs : expectedUs - actualUs);
+  }
+  lastTickCfmUs_ = rxUs;
+  lastTickCfmSeq_ = seq;
+}
+
+// -----------------------------------------------------------------------------
+// Clock synchronization
+// -----------------------------------------------------------------------------
+void Host::onTimeCfm(const protocol::FrameS& frame)
+{
+  const uint16_t seq = protocol::readUint16(frame.payload.data());
+  uint64_t sent = timeSyncSlot_.load();
+  if (sent == 0U || static_cast<uint16_t>(sent) != seq || !timeSyncSlot_.compare_exchange_strong(sent, 0U))
+    return;
+
+  const uint32_t t2 = protocol::readUint32(frame.payload.data() + sizeof(seq));
+  const uint32_t t3 = protocol::readUint32(frame.payload.data() + sizeof(seq) + sizeof(t2));
+  std::lock_guard<std::mutex> lock(clockSyncMutex_);
+  clockSync_.addSample(sent >> 16, t2, t3, toMicros(lastRxTime_));
+}
+
+bool Host::syncClock()
+{
+  if ((session_.features & protocol::FEATURE_TIME_SYNC) == 0U)
+    return false;
+
+  const auto deadline = std::chrono::steady_clock::now() + SYNC_CLOCK_TIMEOUT;
+  while (state_ == StateE::CONNECTED && std::chrono::steady_clock::now() < deadline)
+  {
+    {
+      std::lock_guard<std::mutex> lock(clockSyncMutex_);
+      if (clockSync_.synced())
+        return true;
+    }
+    // A lost TIME_CFM is replaced by the next request
+    sendTimeReq();
+    std::this_thread::sleep_for(SYNC_CLOCK_INTERVAL);
+  }
+  std::lock_guard<std::mutex> lock(clockSyncMutex_);
+  return clockSync_.synced();
+}
+
+bool Host::targetToHostTime(uint32_t targetUs, std::chrono::steady_clock::time_point& hostTime)
+{
+  std::lock_guard<std::mutex> lock(clockSyncMutex_);
+  if (!clockSync_.synced())
+    return false;
+  hostTime = std::chrono::steady_clock::time_point(
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::microseconds{clockSync_.toHostUs(targetUs)}));
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Button latency
+// -----------------------------------------------------------------------------
+void Host::onButtonInd(const protocol::FrameS& frame)
+{
+  sendButtonCfm();
+  const uint64_t cfmUs = toMicros(std::chrono::steady_clock::now());
+
+  std::chrono::steady_clock::time_point pressTime;
+  std::chrono::steady_clock::time_point queuedTime;
+  if (frame.payloadLen != protocol::BUTTON_TIME_SIZE
+      || !targetToHostTime(protocol::readUint32(frame.payload.data()), pressTime)
+      || !targetToHostTime(protocol::readUint32(frame.payload.data() + sizeof(uint32_t)), queuedTime))
+    return;
+
+  // Serialization time of this BUTTON_IND, the target sends in our TX format
+  std::array<uint8_t, protocol::MAX_FRAME_SIZE> encoded;
+  const size_t frameSize = protocol::encodeFrame(frame.sigId, frame.payload.data(), frame.payloadLen,
+                                                 encoded.data(), txFormat_);
+  const uint64_t wireUs = frameSize * UART_BITS_PER_BYTE * 1000000ULL / lineBaudRate_;
+
+  const uint64_t pressUs = toMicros(pressTime);
+  const uint64_t queuedUs = toMicros(queuedTime);
+  const uint64_t rxUs = toMicros(lastRxTime_);
+  uint64_t stageUs[BUTTON_STAGE_COUNT];
+  stageUs[BUTTON_TARGET] = elapsedUs(pressUs, queuedUs);
+  stageUs[BUTTON_QUEUE] = elapsedUs(queuedUs + wireUs, rxUs);
+  stageUs[BUTTON_WIRE] = wireUs;
+  stageUs[BUTTON_HOST] = elapsedUs(rxUs, cfmUs);
+  stageUs[BUTTON_TOTAL] = elapsedUs(pressUs, cfmUs);
+
+  std::cout << "[host] Button latency";
+  for (size_t stage = 0; stage < BUTTON_STAGE_COUNT; ++stage)
+  {
+    buttonLatency_[stage].record(stageUs[stage]);
+    std::cout << (stage == 0U ? ": " : ", ") << BUTTON_STAGE_NAMES[stage] << " " << stageUs[stage];
+  }
+  std::cout << " us" << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+// Target link counters
+// -----------------------------------------------------------------------------
+void Host::onStatsCfm(const protocol::FrameS& frame)
+{
+  const protocol::LinkStatsS stats = protocol::decodeLinkStats(frame.payload.data(), frame.payloadLen);
+  const protocol::LinkStatsS last = lastTargetStats_;
+  const double seconds = std::chrono::duration<double>(lastRxTime_ - lastTargetStatsTime_).count();
+  const bool first = !haveTargetStats_;
+  lastTargetStats_ = stats;
+  lastTargetStatsTime_ = lastRxTime_;
+  haveTargetStats_ = true;
+  if (first || seconds <= 0.0)
+    return;
+
+  std::ostringstream line;
+  line << std::fixed << std::setprecision(1);
+  line << "[host] Target link per s: rx " << ratePerS(stats.rxBytes, last.rxBytes, seconds) << " B "
+       << ratePerS(stats.rxFrames, last.rxFrames, seconds) << " frames, tx "
+       << ratePerS(stats.txBytes, last.txBytes, seconds) << " B "
+       << ratePerS(stats.txFrames, last.txFrames, seconds) << " frames, errors crc "
+       << ratePerS(stats.crcErrors, last.crcErrors, seconds, true) << " len "
+       << ratePerS(stats.lengthErrors, last.lengthErrors, seconds, true) << " timeout "
+       << ratePerS(stats.rxTimeouts, last.rxTimeouts, seconds, true) << " uart "
+       << ratePerS(stats.uartErrors, last.uartErrors, seconds, true) << " overrun "
+       << ratePerS(stats.uartOverruns, last.uartOverruns, seconds, true) << ", drops rx "
+       << ratePerS(stats.rxQueueDrops, last.rxQueueDrops, seconds, true) << " tx "
+       << ratePerS(stats.txQueueDrops, last.txQueueDrops, seconds, true) << ", queue high water rx "
+       << static_cast<unsigned>(stats.rxQueueHighWater) << " tx "
+       << static_cast<unsigned>(stats.txQueueHighWater);
+  std::cout << line.str() << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+// Target main loop load
+// -----------------------------------------------------------------------------
+void Host::onLoopCfm(const protocol::FrameS& frame)
+{
+  const protocol::LoopStatsS stats = protocol::decodeLoopStats(frame.payload.data(), frame.payloadLen);
+  std::ostringstream line;
+  line << std::fixed << std::setprecision(1);
+  line << "[host] Target main loop: busy " << stats.dutyCyclePermille / 10.0 << "%, max latency";
+  for (size_t i = 0; i < static_cast<size_t>(protocol::loopEventE::COUNT); ++i)
+  {
+    line << ' ' << protocol::loopEventName(static_cast<uint8_t>(i)) << ' ' << stats.maxLatencyUs[i];
+  }
+  line << " us";
+  std::cout << line.str() << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+// Target cycle probes
+// -----------------------------------------------------------------------------
+void Host::onPerfCfm(const protocol::FrameS& frame)
+{
+  const uint8_t id = frame.payload[0];
+  const uint8_t page = frame.payload[1];
+  if (id >= static_cast<uint8_t>(protocol::probeIdE::COUNT) || page >= protocol::PERF_PAGES)
+    return;
+
+  PerfProbeS& probe = perf_[id];
+  const uint8_t* data = frame.payload.data() + protocol::PERF_REQ_SIZE;
+  if (page == 0U)
+  {
+    probe.clockHz = protocol::readUint32(data);
+    probe.count = protocol::readUint32(data + 4);
+    probe.minCycles = protocol::readUint32(data + 8);
+    probe.maxCycles = protocol::readUint32(data + 12);
+    probe.avgCycles = protocol::readUint32(data + 16);
+    return;
+  }
+
+  const size_t first = (page - 1U) * protocol::PERF_BUCKETS_PER_PAGE;
+  for (size_t i = 0; i < protocol::PERF_BUCKETS_PER_PAGE; ++i)
+  {
+    probe.buckets[first + i] = protocol::readUint32(data + 4U * i);
+  }
+  if (page + 1U < protocol::PERF_PAGES || probe.count == 0U || probe.clockHz == 0U)
+    return;
+
+  // Percentiles as the upper limit of the bucket they fall in
+  uint32_t p50 {0};
+  uint32_t p99 {0};
+  uint64_t seen {0};
+  for (size_t i = 0; i < protocol::PERF_BUCKETS; ++i)
+  {
+    seen += probe.buckets[i];
+    const uint32_t limit = i + 1U < protocol::PERF_BUCKETS ? 1U << (PERF_FIRST_BUCKET_BITS + i) : probe.maxCycles;
+    if (p50 == 0U && seen * 100U >= probe.count * 50ULL)
+      p50 = std::min(limit, probe.maxCycles);
+    if (p99 == 0U && seen * 100U >= probe.count * 99ULL)
+      p99 = std::min(limit, probe.maxCycles);
+  }
+
+  const double cyclesPerUs = probe.clockHz / 1e6;
+  std::ostringstream line;
+  line << std::fixed << std::setprecision(2);
+  line << "[host] Probe " << PROBE_NAMES[id] << ": " << probe.count << " runs, cycles min/avg/max "
+       << probe.minCycles << "/" << probe.avgCycles << "/" << probe.maxCycles << ", p50 <= " << p50
+       << " p99 <= " << p99 << ", max " << probe.maxCycles / cyclesPerUs << " us";
+  if (static_cast<protocol::probeIdE>(id) == protocol::probeIdE::RX_ISR)
+  {
+    // The next byte overruns the UART if the RX ISR takes longer than a byte time
+    const double byteCycles = static_cast<double>(probe.clockHz) * UART_BITS_PER_BYTE / lineBaudRate_;
+    line << " = " << probe.maxCycles * 100.0 / byteCycles << " % of a byte time at " << lineBaudRate_ << " baud";
+  }
+  std::cout << line.str() << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+// Target trace ring
+// -----------------------------------------------------------------------------
+void Host::onTraceCfm(const protocol::FrameS& frame)
+{
+  if (!traceHandler_)
+    return;
+
+  const uint8_t* data = frame.payload.data();
+  std::vector<protocol::TraceEventS> events;
+  for (size_t offset = protocol::TRACE_CFM_HEADER_SIZE; offset < frame.payloadLen; offset += protocol::TRACE_EVENT_SIZE)
+  {
+    events.push_back(protocol::decodeTraceEvent(data + offset));
+  }
+  traceHandler_(protocol::readUint32(data), protocol::readUint32(data + sizeof(uint32_t)), events);
+}
+
+// -----------------------------------------------------------------------------
+// Telemetry stream
+// -----------------------------------------------------------------------------
+void Host::onStreamData(const protocol::FrameS& frame)
+{
+  const uint16_t seq = protocol::readUint16(frame.payload.data());
+  const size_t count = (frame.payloadLen - protocol::STREAM_HEADER_SIZE) / protocol::STREAM_SAMPLE_SIZE;
+  // Frames arrive in order, a jump forward is samples dropped or lost
+  if (haveStreamSeq_.exchange(true))
+    streamLost_ += static_cast<uint16_t>(seq - static_cast<uint16_t>(streamSeq_));
+  streamSeq_ = static_cast<uint16_t>(seq + count);
+  ++streamFrames_;
+  streamSamples_ += count;
+
+  // Handed over in place, no copy on the RX thread
+  if (streamHandler_)
+    streamHandler_(seq, frame.payload.data() + protocol::STREAM_HEADER_SIZE, count);
+}
+
+void Host::onStreamSummary(const protocol::FrameS& frame)
+{
+  const protocol::StreamSummaryS summary = protocol::decodeStreamSummary(frame.payload.data(), frame.payloadLen);
+  if (haveStreamSeq_.exchange(true))
+    streamLost_ += summary.seq - streamSeq_;
+  streamSeq_ = summary.seq + summary.count;
+  ++streamFrames_;
+  streamSamples_ += summary.count;
+  {
+    std::lock_guard<std::mutex> lock(summaryMutex_);
+    lastSummary_ = summary;
+  }
+
+  if (summaryHandler_)
+    summaryHandler_(summary);
+}
+
+// -----------------------------------------------------------------------------
+// Target flight recorder
+// -----------------------------------------------------------------------------
+void Host::onLogCfm(const protocol::FrameS& frame)
+{
+  const uint8_t* data = frame.payload.data();
+  const uint32_t head = protocol::readUint32(data);
+  const uint32_t seq = protocol::readUint32(data + sizeof(head));
+  const uint32_t count = (frame.payloadLen - protocol::LOG_CFM_HEADER_SIZE) / protocol::LOG_RECORD_SIZE;
+
+  std::lock_guard<std::mutex> lock(logMutex_);
+  if (!logDraining_)
+    return;
+  if (!haveLogCfm_)
+  {
+    haveLogCfm_ = true;
+    logEnd_ = head;
+  }
+  // Records before a repeated LOG_REQ may arrive twice
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    if (seq + i < logSeq_)
+      continue;
+    if (seq + i > logSeq_)
+      logLost_ += seq + i - logSeq_;
+    logRecords_.emplace_back(seq + i, protocol::decodeLogRecord(
+      data + protocol::LOG_CFM_HEADER_SIZE + i * protocol::LOG_RECORD_SIZE));
+    logSeq_ = seq + i + 1U;
+  }
+  if (count == 0U && seq > logSeq_)
+    logSeq_ = seq;
+  if (count == 0U || logSeq_ >= logEnd_)
+    logDraining_ = false;
+  logReceived_.notify_one();
+}
+
+size_t Host::drainFlightLog()
+{
+  if ((session_.features & protocol::FEATURE_LOG) == 0U)
+  {
+    std::cout << "[host] Target has no flight recorder" << std::endl;
+    return 0;
+  }
+
+  std::unique_lock<std::mutex> lock(logMutex_);
+  logDraining_ = true;
+  haveLogCfm_ = false;
+  logLost_ = 0;
+  logRecords_.clear();
+  const auto start = std::chrono::steady_clock::now();
+  size_t received {0};
+  unsigned attempts {0};
+  // The target streams the records in one go, ask again where it stalled
+  while (logDraining_ && attempts < LOG_REQ_ATTEMPTS)
+  {
+    const uint32_t seq = logSeq_;
+    lock.unlock();
+    sendLogReq(seq);
+    lock.lock();
+    ++attempts;
+    while (logDraining_ && logReceived_.wait_for(lock, LOG_IDLE_TIMEOUT) == std::cv_status::no_timeout)
+    {
+      if (logRecords_.size() != received)
+      {
+        received = logRecords_.size();
+        attempts = 0;
+      }
+    }
+  }
+  const bool complete = !logDraining_;
+  logDraining_ = false;
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  const std::vector<std::pair<uint32_t, protocol::LogRecordS>> records = std::move(logRecords_);
+  const uint32_t lost = logLost_;
+  logRecords_.clear();
+  lock.unlock();
+
+  if (!flightLogPath_.empty())
+  {
+    // One line per record: SEQ, target time, event and both arguments
+    std::ofstream out(flightLogPath_, std::ios::app);
+    out << "# " << records.size() << " records, " << lost << " overwritten before they were read\n";
+    for (const auto& entry : records)
+    {
+      const protocol::LogRecordS& record = entry.second;
+      out << entry.first << " " << record.timeMs << " ms " << protocol::logEventName(record.event) << " "
+          << static_cast<unsigned>(record.arg0) << " " << record.arg1 << "\n";
+    }
+    if (!out)
+      std::cout << "[host] Failed to write " << flightLogPath_ << std::endl;
+  }
+
+  std::ostringstream line;
+  line << std::fixed << std::setprecision(1);
+  line << "[host] Flight log: " << records.size() << " records, " << lost << " overwritten, "
+       << (complete ? "" : "incomplete, ") << seconds * 1000.0 << " ms";
+  if (seconds > 0.0)
+    line << ", " << records.size() / seconds << " records/s";
+  std::cout << line.str() << std::endl;
+  return records.size();
+}
+
+void Host::printButtonSummary()
+{
+  if (buttonLatency_[BUTTON_TOTAL].count() == 0U)
+    return;
+
+  std::cout << "[host] Button latency p50/p99/max";
+  for (size_t stage = 0; stage < BUTTON_STAGE_COUNT; ++stage)
+  {
+    const LatencyHistogram& histogram = buttonLatency_[stage];
+    std::cout << (stage == 0U ? ": " : ", ") << BUTTON_STAGE_NAMES[stage] << " "
+              << histogram.percentile(50.0) << "/" << histogram.percentile(99.0) << "/" << histogram.max();
+  }
+  std::cout << " us" << std::endl;
+}
+
+void Host::writeStatsFile()
+{
+  std::ofstream out(statsPath_);
+  out << "{\n";
+  out << "  \"unit\": \"us\",\n";
+  out << "  \"histograms\": {\n";
+  writeHistogramJson(out, "tick_rtt", tickRtt_, false);
+  writeHistogramJson(out, "tick_jitter", tickJitter_, false);
+  for (size_t stage = 0; stage < BUTTON_STAGE_COUNT; ++stage)
+  {
+    const std::string name = std::string("button_") + BUTTON_STAGE_NAMES[stage];
+    writeHistogramJson(out, name.c_str(), buttonLatency_[stage], stage + 1U == BUTTON_STAGE_COUNT);
+  }
+  out << "  }\n";
+  out << "}\n";
+  if (!out)
+    std::cout << "[host] Failed to write " << statsPath_ << std::endl;
+}
+
+void Host::printTickSummary()
+{
+  std::cout << "[host] Ticks " << ticksConfirmed_ << "/" << ticksSent_ << " confirmed";
+  if (tickRtt_.count() != 0U)
+  {
+    std::cout << ", RTT p50 " << tickRtt_.percentile(50.0) << " p99 " << tickRtt_.percentile(99.0)
+              << " p999 " << tickRtt_.percentile(99.9) << " max " << tickRtt_.max() << " us"
+              << ", jitter p50 " << tickJitter_.percentile(50.0) << " p99 " << tickJitter_.percentile(99.0)
+              << " p999 " << tickJitter_.percentile(99.9) << " max " << tickJitter_.max() << " us";
+  }
+  std::cout << std::endl;
+
+  if (streamFrames_ != 0U)
+  {
+    std::cout << "[host] Stream " << streamSamples_ << " samples in " << streamFrames_ << " frames, "
+              << streamLost_ << " lost" << std::endl;
+  }
+  if (streamWindow_.samples != 0U)
+  {
+    std::lock_guard<std::mutex> lock(summaryMutex_);
+    if (lastSummary_.count != 0U)
+    {
+      std::cout << "[host] Last window " << lastSummary_.count << " samples, min " << lastSummary_.min
+                << " max " << lastSummary_.max << " mean "
+                << static_cast<double>(lastSummary_.mean) / (1U << protocol::STREAM_MEAN_FRACTION_BITS);
+      for (size_t i = 0; i < lastSummary_.bins; ++i)
+      {
+        std::cout << (i == 0U ? ", bins " : " ") << lastSummary_.binCounts[i];
+      }
+      std::cout << std::endl;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(clockSyncMutex_);
+  if (clockSync_.synced())
+  {
+    std::cout << "[host] Clock sync " << clockSync_.points() << " points, drift "
+              << clockSync_.driftPpm() << " ppm, RTT " << clockSync_.rttUs() << " us" << std::endl;
+  }
+}
+
 // -----------------------------------------------------------------------------
 // Initialization
 // -----------------------------------------------------------------------------
@@ -212,6 +1048,10 @@ bool Host::init()
     return false;
 
   changeState(StateE::INIT);
+  // Forget the previous connection, the port opens at the baseline rate
+  connectCfmReceived_ = false;
+  lineBaudRate_ = protocol::BASELINE_BAUD_RATE;
+  decoder_ = protocol::Decoder {};
   portOpened_ = true;
   lastRxTime_ = std::chrono::steady_clock::now();
   changeState(StateE::CONNECTING);
@@ -242,16 +1082,28 @@ void Host::sendSignal(protocol::signalIdE sig,
                       const std::vector<uint8_t>& payload)
 {
   std::array<uint8_t, protocol::MAX_FRAME_SIZE> frame;
-  size_t frameSize = protocol::encodeFrame(sig, payload.data(), payload.size(), frame.data());
+  size_t frameSize = protocol::encodeFrame(sig, payload.data(), payload.size(), frame.data(), txFormat_);
 
-  DWORD written = 0;
-  WriteFile(serial_, frame.data(), static_cast<DWORD>(frameSize), &written, nullptr);
+  std::lock_guard<std::mutex> lock(txMutex_);
+  TRACE(HOST_TX, sig, payload.size(), 0);
+  writePort(frame.data(), frameSize);
 }
 
 void Host::sendConnectReq()
 {
   std::cout << "[host] Send CONNECT_REQ" << std::endl;
-  sendSignal(protocol::signalIdE::CONNECT_REQ);
+  // Offer our capabilities, the target picks the configuration in CONNECT_CFM
+  protocol::CapabilitiesS local;
+  local.version = protocol::PROTOCOL_VERSION;
+  local.frameFormats = frameFormats_;
+  local.maxBaudRate = MAX_BAUD_RATE;
+  local.rxQueueDepth = RX_QUEUE_DEPTH;
+  local.features = protocol::FEATURE_TICK_SEQ | protocol::FEATURE_TIME_SYNC | protocol::FEATURE_BUTTON_TIME
+                   | protocol::FEATURE_STATS | protocol::FEATURE_PERF | protocol::FEATURE_TRACE
+                   | protocol::FEATURE_LOG | protocol::FEATURE_STREAM;
+  std::vector<uint8_t> record(protocol::CAPABILITIES_SIZE);
+  protocol::encodeCapabilities(local, record.data());
+  sendSignal(protocol::signalIdE::CONNECT_REQ, record);
   std::cout << "[host] Waiting for CONNECT_CFM from target" << std::endl;
 }
 
@@ -263,12 +1115,134 @@ void Host::sendDisconnectReq()
 
 void Host::sendTickInd()
 {
-  if (tickCfmPending_)
+  std::cout << "[host] Send TICK_IND" << std::endl;
+  ++ticksSent_;
+  if ((session_.features & protocol::FEATURE_TICK_SEQ) == 0U)
+  {
+    sendSignal(protocol::signalIdE::TICK_IND);
     return;
+  }
 
-  std::cout << "[host] Send TICK_IND" << std::endl;
-  tickCfmPending_ = true;
-  sendSignal(protocol::signalIdE::TICK_IND);
+  // Ticks keep going while earlier ones are unconfirmed, each carries its id
+  const uint16_t seq = tickSeq_++;
+  tickSlots_[seq % MAX_TICKS_IN_FLIGHT] = (toMicros(std::chrono::steady_clock::now()) << 16) | seq;
+  std::vector<uint8_t> payload(protocol::TICK_SEQ_SIZE);
+  protocol::writeUint16(seq, payload.data());
+  sendSignal(protocol::signalIdE::TICK_IND, payload);
+}
+
+void Host::sendTimeReq()
+{
+  if ((session_.features & protocol::FEATURE_TIME_SYNC) == 0U)
+    return;
+
+  // Padded to the TIME_CFM size, T1 is taken as close to the write as possible
+  const uint16_t seq = timeSyncSeq_++;
+  std::vector<uint8_t> payload(protocol::TIME_SYNC_SIZE);
+  protocol::writeUint16(seq, payload.data());
+  timeSyncSlot_ = (toMicros(std::chrono::steady_clock::now()) << 16) | seq;
+  sendSignal(protocol::signalIdE::TIME_REQ, payload);
+}
+
+void Host::sendStatsReq()
+{
+  if ((session_.features & protocol::FEATURE_STATS) == 0U)
+    return;
+  sendSignal(protocol::signalIdE::STATS_REQ);
+  if (session_.version >= protocol::LOOP_STATS_VERSION)
+    sendSignal(protocol::signalIdE::LOOP_REQ);
+}
+
+void Host::sendPerfReq()
+{
+  if ((session_.features & protocol::FEATURE_PERF) == 0U)
+    return;
+
+  // One probe per tick, all pages back to back
+  const uint8_t id = nextPerfProbe_;
+  nextPerfProbe_ = static_cast<uint8_t>((nextPerfProbe_ + 1U) % static_cast<uint8_t>(protocol::probeIdE::COUNT));
+  for (uint8_t page = 0; page < protocol::PERF_PAGES; ++page)
+  {
+    sendSignal(protocol::signalIdE::PERF_REQ, {id, page});
+  }
+}
+
+void Host::sendLogReq(uint32_t seq)
+{
+  // Everything from seq on, the target stops at the records it had when asked
+  std::vector<uint8_t> payload(protocol::LOG_REQ_SIZE);
+  protocol::writeUint32(seq, payload.data());
+  protocol::writeUint16(0xFFFF, payload.data() + sizeof(seq));
+  sendSignal(protocol::signalIdE::LOG_REQ, payload);
+}
+
+void Host::sendEchoReq(uint16_t seq, const uint8_t* data, size_t len)
+{
+  // A target advertising less than the echo header gets header-only echoes
+  const size_t maxData = session_.maxPayload > protocol::ECHO_HEADER_SIZE ?
+                         session_.maxPayload - protocol::ECHO_HEADER_SIZE : 0U;
+  len = std::min(len, maxData);
+  std::vector<uint8_t> payload(protocol::ECHO_HEADER_SIZE + len);
+  protocol::writeUint16(seq, payload.data());
+  std::copy(data, data + len, payload.begin() + protocol::ECHO_HEADER_SIZE);
+  sendSignal(protocol::signalIdE::ECHO_REQ, payload);
+}
+
+void Host::setEchoHandler(EchoHandlerT handler)
+{
+  echoHandler_ = std::move(handler);
+}
+
+void Host::sendTraceReq(uint32_t seq, bool freeze)
+{
+  if ((session_.features & protocol::FEATURE_TRACE) == 0U)
+    return;
+
+  std::vector<uint8_t> payload(protocol::TRACE_REQ_SIZE);
+  protocol::writeUint32(seq, payload.data());
+  payload[sizeof(seq)] = freeze ? protocol::TRACE_FREEZE : 0U;
+  sendSignal(protocol::signalIdE::TRACE_REQ, payload);
+}
+
+void Host::setTraceHandler(TraceHandlerT handler)
+{
+  traceHandler_ = std::move(handler);
+}
+
+void Host::startStream(uint32_t rateHz, const protocol::StreamWindowS& window)
+{
+  if ((session_.features & protocol::FEATURE_STREAM) == 0U)
+    return;
+
+  std::cout << "[host] Send STREAM_START " << rateHz << " Hz";
+  if (window.samples != 0U)
+    std::cout << ", " << window.samples << " sample windows";
+  std::cout << std::endl;
+  streamFrames_ = 0;
+  streamSamples_ = 0;
+  streamLost_ = 0;
+  haveStreamSeq_ = false;
+  std::vector<uint8_t> payload(protocol::STREAM_START_WINDOW_SIZE);
+  payload.resize(protocol::encodeStreamStart(rateHz, window, payload.data()));
+  sendSignal(protocol::signalIdE::STREAM_START, payload);
+}
+
+void Host::stopStream()
+{
+  if ((session_.features & protocol::FEATURE_STREAM) == 0U)
+    return;
+  std::cout << "[host] Send STREAM_STOP" << std::endl;
+  sendSignal(protocol::signalIdE::STREAM_STOP);
+}
+
+void Host::setStreamHandler(StreamHandlerT handler)
+{
+  streamHandler_ = std::move(handler);
+}
+
+void Host::setSummaryHandler(SummaryHandlerT handler)
+{
+  summaryHandler_ = std::move(handler);
 }
 
 void Host::sendButtonCfm()
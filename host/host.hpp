@@ -1,15 +1,24 @@
 #pragma once
 
 #include "../protocol/protocol.hpp"
+#include "../protocol/trace.hpp"
+#include "clockSync.hpp"
+#include "latencyHistogram.hpp"
 
 #include <string>
 #include <thread>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <utility>
 #include <vector>
 #include <cstdint>
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 
 /**
@@ -19,16 +28,207 @@
  */
 class Host{
 public:
-  explicit Host(const std::string& comPort);
+  /**
+   * @brief baudRate above the baseline is proposed to the target after connecting.
+   */
+  explicit Host(const std::string& comPort,
+                uint8_t frameFormats = protocol::DEFAULT_FRAME_FORMATS,
+                uint32_t baudRate = protocol::BASELINE_BAUD_RATE);
   ~Host();
 
+  /**
+   * @brief Stages of the button press to BUTTON_CFM latency, in microseconds.
+   */
+  enum ButtonStageE : size_t
+  {
+    BUTTON_TARGET,    ///< EXTI to BUTTON_IND queued, target main loop latency
+    BUTTON_QUEUE,     ///< Queued to host receive minus the wire time: TX queue, driver, RX thread
+    BUTTON_WIRE,      ///< Serialization of BUTTON_IND at the line rate
+    BUTTON_HOST,      ///< BUTTON_IND decoded to BUTTON_CFM written
+    BUTTON_TOTAL,     ///< EXTI to BUTTON_CFM written
+    BUTTON_STAGE_COUNT
+  };
+
+  /**
+   * @brief Called on the RX thread for every ECHO_CFM with its sequence id,
+   * the echoed data and the time the frame was complete.
+   */
+  using EchoHandlerT = std::function<void(uint16_t seq, const uint8_t* data, size_t len,
+                                          std::chrono::steady_clock::time_point rxTime)>;
+
+  /**
+   * @brief Called on the RX thread for every TRACE_CFM with the target ring
+   * head, the sequence number of the first event and the events.
+   */
+  using TraceHandlerT = std::function<void(uint32_t head, uint32_t seq,
+                                           const std::vector<protocol::TraceEventS>& events)>;
+
+  /**
+   * @brief Called on the RX thread for every STREAM_DATA with the sequence
+   * number of the first sample and count samples of STREAM_SAMPLE_SIZE bytes
+   * (LE). samples points into the received frame, valid during the call only.
+   */
+  using StreamHandlerT = std::function<void(uint16_t seq, const uint8_t* samples, size_t count)>;
+
+  /**
+   * @brief Called on the RX thread for every STREAM_SUMMARY.
+   */
+  using SummaryHandlerT = std::function<void(const protocol::StreamSummaryS& summary)>;
+
+  /**
+   * @brief Open the port, connect and run the heartbeat until the link is lost.
+   */
   void connect();
+
+  /**
+   * @brief Open the port and connect, including the baud rate upshift.
+   * Returns true once CONNECTED.
+   */
+  bool start();
+
+  /**
+   * @brief Send DISCONNECT_REQ and close the port.
+   */
+  void stop();
+
+  /**
+   * @brief Send ECHO_REQ, data is truncated to the negotiated max payload.
+   */
+  void sendEchoReq(uint16_t seq, const uint8_t* data = nullptr, size_t len = 0);
+  void setEchoHandler(EchoHandlerT handler);
+
+  /**
+   * @brief Send TRACE_REQ for the target ring events from seq on, needs
+   * FEATURE_TRACE. freeze stops the target recording until a request without it.
+   */
+  void sendTraceReq(uint32_t seq, bool freeze);
+  void setTraceHandler(TraceHandlerT handler);
+
+  /**
+   * @brief Send STREAM_START, needs FEATURE_STREAM. The target samples at
+   * rateHz until stopStream() or the next connect and sends the samples in
+   * STREAM_DATA, or with a window one STREAM_SUMMARY per window.
+   */
+  void startStream(uint32_t rateHz, const protocol::StreamWindowS& window = protocol::StreamWindowS {});
+  void stopStream();
+  void setStreamHandler(StreamHandlerT handler);
+  void setSummaryHandler(SummaryHandlerT handler);
+
+  /**
+   * @brief Start the telemetry stream after connecting and print its sample
+   * and loss counts with the tick summary. Call before connect().
+   */
+  void setStreamRate(uint32_t rateHz, const protocol::StreamWindowS& window = protocol::StreamWindowS {})
+  {
+    streamRateHz_ = rateHz;
+    streamWindow_ = window;
+  }
+
+  /**
+   * @brief Read the target flight recorder from where the last drain stopped
+   * and append it to the flight log file. Needs FEATURE_LOG. Returns the
+   * number of records read.
+   */
+  size_t drainFlightLog();
+
+  /**
+   * @brief Append the target flight recorder to path after connecting, before
+   * the first tick. Call before connect().
+   */
+  void setFlightLogFile(const std::string& path) { flightLogPath_ = path; }
+
+  /**
+   * @brief Exchange TIME_REQ/TIME_CFM back to back until targetToHostTime()
+   * works, instead of one per tick. False on timeout or without FEATURE_TIME_SYNC.
+   */
+  bool syncClock();
+
+  /**
+   * @brief Configuration confirmed by CONNECT_CFM, main thread only.
+   */
+  const protocol::CapabilitiesS& session() const { return session_; }
+
+  /**
+   * @brief Current line rate, BASELINE_BAUD_RATE unless upshifted.
+   */
+  uint32_t baudRate() const { return lineBaudRate_; }
+
+  /**
+   * @brief Heartbeat statistics, safe to read while the RX thread records.
+   * RTT and jitter of the TICK_CFM arrivals against the TICK_PERIOD schedule
+   * are in microseconds and need a target with FEATURE_TICK_SEQ.
+   */
+  const LatencyHistogram& tickRtt() const { return tickRtt_; }
+  const LatencyHistogram& tickJitter() const { return tickJitter_; }
+  uint64_t ticksSent() const { return ticksSent_; }
+  uint64_t ticksConfirmed() const { return ticksConfirmed_; }
+
+  /**
+   * @brief Telemetry stream counters since the last startStream(), samples
+   * received raw or summarized. Lost samples are gaps in the sequence
+   * numbers: dropped on the target or in frames lost on the line.
+   */
+  uint64_t streamSamples() const { return streamSamples_; }
+  uint64_t streamLost() const { return streamLost_; }
+
+  /**
+   * @brief Host time of a Target::timestampUs() value, from the TIME_REQ/CFM
+   * exchanges. False until the first round of exchanges is complete or if the
+   * target lacks FEATURE_TIME_SYNC.
+   */
+  bool targetToHostTime(uint32_t targetUs, std::chrono::steady_clock::time_point& hostTime);
+
+  /**
+   * @brief Button latency per stage, needs FEATURE_BUTTON_TIME and clock sync.
+   */
+  const LatencyHistogram& buttonLatency(ButtonStageE stage) const { return buttonLatency_[stage]; }
+
+  /**
+   * @brief Rewrite path with all histograms as JSON every TICK_SUMMARY_PERIOD.
+   * Call before connect().
+   */
+  void setStatsFile(const std::string& path) { statsPath_ = path; }
+
+  /**
+   * @brief Poll the target link counters with STATS_REQ every tick and print
+   * per-second rates. Needs FEATURE_STATS. Call before connect().
+   */
+  void setTargetStats(bool enabled) { targetStats_ = enabled; }
+
+  /**
+   * @brief Read one target cycle probe per tick with PERF_REQ and print it.
+   * Needs a target built with TARGET_CYCLE_PROBES. Call before connect().
+   */
+  void setPerfProbes(bool enabled) { perfProbes_ = enabled; }
 private:
   // --- Constants ------------------------------------------------
   static constexpr auto CONNECT_TIMEOUT    = std::chrono::seconds{5};
   static constexpr auto TICK_PERIOD        = std::chrono::seconds{1};
+  static constexpr auto TICK_SUMMARY_PERIOD = std::chrono::seconds{10};
+  // A TICK_CFM that is more than this many ticks late counts as lost
+  static constexpr size_t MAX_TICKS_IN_FLIGHT = 8;
+  // One TIME_REQ per tick, half way between ticks so it does not queue behind TICK_CFM
+  static constexpr auto TIME_SYNC_OFFSET   = std::chrono::milliseconds{500};
+  // syncClock(): one TIME_REQ per interval until the first round is complete
+  static constexpr auto SYNC_CLOCK_INTERVAL = std::chrono::milliseconds{20};
+  static constexpr auto SYNC_CLOCK_TIMEOUT  = std::chrono::seconds{2};
   static constexpr auto CONNECT_POLL_DELAY = std::chrono::seconds{1};
   static constexpr auto RX_IDLE_SLEEP      = std::chrono::milliseconds{10};
+  // Bytes of one frame may be split over OS reads, so well above RX_IDLE_SLEEP
+  static constexpr auto RX_INTER_BYTE_TIMEOUT = std::chrono::milliseconds{50};
+  // Capabilities offered in CONNECT_REQ
+  static constexpr uint32_t MAX_BAUD_RATE     = 921600;
+  // Frames are handled on the RX thread as they arrive, only the OS buffer limits them
+  static constexpr uint8_t RX_QUEUE_DEPTH     = 255;
+  // Baud rate upshift: wait for BAUD_CFM, then probe the new rate a few times
+  static constexpr auto BAUD_CFM_TIMEOUT      = std::chrono::milliseconds{500};
+  static constexpr auto BAUD_PROBE_WAIT       = std::chrono::milliseconds{100};
+  static constexpr unsigned BAUD_PROBE_ATTEMPTS = 3;
+  static constexpr auto BAUD_POLL_DELAY       = std::chrono::milliseconds{5};
+  static constexpr uint32_t UART_BITS_PER_BYTE  = 10; // 8N1
+  // Flight recorder drain: LOG_REQ again if no LOG_CFM came for this long
+  static constexpr auto LOG_IDLE_TIMEOUT      = std::chrono::milliseconds{500};
+  static constexpr unsigned LOG_REQ_ATTEMPTS  = 3;
 
   enum class StateE
   {
@@ -41,11 +241,26 @@ private:
   // --- State machine ------------------------------------------------
   void changeState(StateE newState);
   void waitingConnectCfm();
+  bool upshiftBaudRate();
+  bool probeBaudRate();
   void mainLoop();
 
   // --- RX handling ------------------------------------------------
   void rxThread();
   void handleSignal(const protocol::FrameS& frame);
+  void onTickCfm(const protocol::FrameS& frame);
+  void onTimeCfm(const protocol::FrameS& frame);
+  void onButtonInd(const protocol::FrameS& frame);
+  void onStatsCfm(const protocol::FrameS& frame);
+  void onLoopCfm(const protocol::FrameS& frame);
+  void onPerfCfm(const protocol::FrameS& frame);
+  void onTraceCfm(const protocol::FrameS& frame);
+  void onLogCfm(const protocol::FrameS& frame);
+  void onStreamData(const protocol::FrameS& frame);
+  void onStreamSummary(const protocol::FrameS& frame);
+  void printTickSummary();
+  void printButtonSummary();
+  void writeStatsFile();
 
   // --- Initialization and disconnection --------------------------
   bool init();
@@ -55,22 +270,55 @@ private:
   void sendConnectReq();
   void sendDisconnectReq();
   void sendTickInd();
+  void sendTimeReq();
+  void sendStatsReq();
+  void sendPerfReq();
+  void sendLogReq(uint32_t seq);
   void sendButtonCfm();
 
   // --- Serial port handling ----------------------------------------
   bool openPort();
+  bool setPortBaudRate(uint32_t baudRate);
   void closePort();
+  size_t readPort(uint8_t* data, size_t len);
+  void writePort(const uint8_t* data, size_t len);
   void sendSignal(protocol::signalIdE sigId,
                   const std::vector<uint8_t>& payload = {});
 
   // --- Internal data members ------------------------------------------------
   // COM port
   std::string comPort_;
+#ifdef _WIN32
   HANDLE serial_ {INVALID_HANDLE_VALUE};
+#else
+  int serial_ {-1};
+#endif
   std::atomic<bool> portOpened_ {false};
+  // Frames are sent from the main and the RX thread
+  std::mutex txMutex_;
 
   // Protocol
   protocol::Decoder decoder_;
+  uint8_t frameFormats_;    // Framing mask offered in CONNECT_REQ
+  // Configuration confirmed by CONNECT_CFM, written by the RX thread before
+  // the CONNECTED state store, read by the main thread only through session_
+  protocol::CapabilitiesS rxSession_ {};
+  // Main thread copy of rxSession_, taken once by waitingConnectCfm()
+  protocol::CapabilitiesS session_ {};
+  // TX frame format confirmed by CONNECT_CFM, BASIC until then
+  std::atomic<protocol::frameFormatE> txFormat_ {protocol::frameFormatE::BASIC};
+
+  // Baud rate upshift
+  uint32_t baudRate_;       // Rate proposed after CONNECT_CFM
+  std::atomic<uint32_t> lineBaudRate_ {protocol::BASELINE_BAUD_RATE};
+  std::atomic<uint32_t> baudCfmRate_ {0};   // Rate confirmed by BAUD_CFM, 0 until received
+  std::atomic<bool> probeCfmReceived_ {false};
+
+  // Set before open(), called on the RX thread
+  EchoHandlerT echoHandler_;
+  TraceHandlerT traceHandler_;
+  StreamHandlerT streamHandler_;
+  SummaryHandlerT summaryHandler_;
 
   // RX thread
   std::thread rxThread_;
@@ -82,6 +330,68 @@ private:
   // Time tracking
   std::chrono::steady_clock::time_point lastRxTime_ {};
 
-  // Tick handling
-  std::atomic<bool> tickCfmPending_ {false};
+  // Tick handling, several TICK_IND may be in flight
+  uint16_t tickSeq_ {0};
+  // (send time in us << 16) | sequence id of each tick in flight, 0 = free
+  std::atomic<uint64_t> tickSlots_[MAX_TICKS_IN_FLIGHT] {};
+  std::atomic<uint64_t> ticksSent_ {0};
+  std::atomic<uint64_t> ticksConfirmed_ {0};
+  LatencyHistogram tickRtt_;
+  LatencyHistogram tickJitter_;
+  // Arrival and sequence id of the previous matched TICK_CFM, RX thread only
+  uint64_t lastTickCfmUs_ {0};
+  uint16_t lastTickCfmSeq_ {0};
+
+  // Clock sync, one TIME_REQ in flight
+  uint16_t timeSyncSeq_ {0};
+  // (send time in us << 16) | sequence id of the TIME_REQ in flight, 0 = none
+  std::atomic<uint64_t> timeSyncSlot_ {0};
+  std::mutex clockSyncMutex_;
+  ClockSync clockSync_;
+
+  // Button latency breakdown, recorded on the RX thread
+  LatencyHistogram buttonLatency_[BUTTON_STAGE_COUNT];
+  std::string statsPath_;
+
+  // Target link counters, the previous STATS_CFM on the RX thread
+  bool targetStats_ {false};
+  bool haveTargetStats_ {false};
+  protocol::LinkStatsS lastTargetStats_ {};
+  std::chrono::steady_clock::time_point lastTargetStatsTime_ {};
+
+  // Target cycle probes, pages of PERF_CFM collected on the RX thread
+  struct PerfProbeS
+  {
+    uint32_t clockHz {0};
+    uint32_t count {0};
+    uint32_t minCycles {0};
+    uint32_t maxCycles {0};
+    uint32_t avgCycles {0};
+    uint32_t buckets[protocol::PERF_BUCKETS] {};
+  };
+  // Flight recorder drain, LOG_CFMs collected on the RX thread
+  std::string flightLogPath_;
+  std::mutex logMutex_;
+  std::condition_variable logReceived_;
+  bool logDraining_ {false};
+  bool haveLogCfm_ {false};
+  uint32_t logSeq_ {0};         // Next record expected, kept for the next drain
+  uint32_t logEnd_ {0};         // HEAD of the first LOG_CFM
+  uint32_t logLost_ {0};        // Overwritten before they were read
+  std::vector<std::pair<uint32_t, protocol::LogRecordS>> logRecords_;
+
+  // Telemetry stream, the expected sequence number is kept on the RX thread
+  uint32_t streamRateHz_ {0};
+  protocol::StreamWindowS streamWindow_ {};
+  std::atomic<bool> haveStreamSeq_ {false};
+  uint32_t streamSeq_ {0};      // Next sample expected, STREAM_DATA has the low 16 bits
+  protocol::StreamSummaryS lastSummary_ {};  // Printed with the tick summary
+  std::mutex summaryMutex_;
+  std::atomic<uint64_t> streamFrames_ {0};
+  std::atomic<uint64_t> streamSamples_ {0};
+  std::atomic<uint64_t> streamLost_ {0};
+
+  bool perfProbes_ {false};
+  uint8_t nextPerfProbe_ {0};
+  PerfProbeS perf_[static_cast<size_t>(protocol::probeIdE::COUNT)] {};
 };
\ No newline at end of file
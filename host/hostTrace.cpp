@@ -0,0 +1,83 @@
+#include "hostTrace.hpp"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+  struct ThreadRingS
+  {
+    std::string name;
+    protocol::TraceRing<hostTrace::EVENTS_PER_THREAD> ring;
+  };
+
+  std::mutex registryMutex;
+  std::vector<std::unique_ptr<ThreadRingS>> registry;
+  thread_local ThreadRingS* threadRing {nullptr};
+  thread_local std::string threadName;
+
+  uint64_t nowUs()
+  {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+}
+
+#if PROTOCOL_TRACE
+namespace
+{
+  ThreadRingS& ring()
+  {
+    if (threadRing == nullptr)
+    {
+      std::lock_guard<std::mutex> lock(registryMutex);
+      registry.emplace_back(new ThreadRingS);
+      threadRing = registry.back().get();
+      threadRing->name = threadName.empty() ? "thread" + std::to_string(registry.size()) : threadName;
+    }
+    return *threadRing;
+  }
+}
+
+void protocol::traceWrite(protocol::traceIdE id, uint8_t arg0, uint8_t arg1, uint8_t arg2)
+{
+  protocol::TraceEventS event;
+  event.timeUs = static_cast<uint32_t>(nowUs());
+  event.id = static_cast<uint8_t>(id);
+  event.args[0] = arg0;
+  event.args[1] = arg1;
+  event.args[2] = arg2;
+  ring().ring.push(event);
+}
+#endif
+
+namespace hostTrace
+{
+  void setThreadName(const std::string& name)
+  {
+    threadName = name;
+    if (threadRing != nullptr)
+      threadRing->name = name;
+  }
+
+  std::vector<EventS> snapshot()
+  {
+    const uint64_t now = nowUs();
+    std::vector<EventS> events;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto& thread : registry)
+    {
+      for (uint32_t seq = thread->ring.oldest(); seq < thread->ring.head(); ++seq)
+      {
+        EventS event;
+        event.thread = thread->name;
+        thread->ring.get(seq, event.event);
+        // Events are less than 71 minutes old
+        event.timeUs = now - static_cast<uint32_t>(static_cast<uint32_t>(now) - event.event.timeUs);
+        events.push_back(event);
+      }
+    }
+    return events;
+  }
+} // namespace hostTrace
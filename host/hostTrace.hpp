@@ -0,0 +1,37 @@
+#pragma once
+
+#include "../protocol/trace.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Trace sink of the host, one ring per thread.
+ *
+ * Each thread writes to its own ring, so recording takes no lock. A ring is
+ * registered on the first event of its thread and lives as long as the
+ * process. With PROTOCOL_TRACE off nothing is recorded.
+ */
+namespace hostTrace
+{
+  constexpr size_t EVENTS_PER_THREAD = 4096;
+
+  struct EventS
+  {
+    std::string thread;
+    uint64_t timeUs {0};    ///< Steady clock, unwrapped from TraceEventS::timeUs
+    protocol::TraceEventS event {};
+  };
+
+  /**
+   * @brief Name the calling thread in dumps, call before its first event.
+   */
+  void setThreadName(const std::string& name);
+
+  /**
+   * @brief Events of all threads, oldest first per thread. Call while no
+   * other thread records, e.g. after the RX thread was joined.
+   */
+  std::vector<EventS> snapshot();
+} // namespace hostTrace
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Lock-free latency histogram with HDR-style log-linear buckets.
+ *
+ * Values below SUB_BUCKETS are counted exactly. Above, every power of two
+ * range is split into SUB_BUCKETS / 2 linear buckets, so a reported value is
+ * at most 1 / (SUB_BUCKETS / 2) above the recorded one. Memory is fixed and
+ * record() is a few shifts and one relaxed atomic increment, so the RX
+ * thread can record while another thread reads percentiles.
+ */
+class LatencyHistogram
+{
+public:
+  static constexpr unsigned SUB_BUCKET_BITS = 5;
+  static constexpr uint64_t SUB_BUCKETS = 1ULL << SUB_BUCKET_BITS;
+  static constexpr unsigned VALUE_BITS = 32;            ///< Larger values are clamped
+  static constexpr uint64_t MAX_VALUE = (1ULL << VALUE_BITS) - 1U;
+  static constexpr size_t NUM_BUCKETS = (VALUE_BITS - SUB_BUCKET_BITS + 2) * (SUB_BUCKETS / 2);
+
+  void record(uint64_t value)
+  {
+    if (value > MAX_VALUE)
+      value = MAX_VALUE;
+    counts_[bucketIndex(value)].fetch_add(1U, std::memory_order_relaxed);
+
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+  }
+
+  uint64_t count() const
+  {
+    uint64_t total {0};
+    for (const auto& count : counts_)
+    {
+      total += count.load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+
+  uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Smallest bucket value that percent of the samples do not exceed, 0 if empty.
+   */
+  uint64_t percentile(double percent) const
+  {
+    const uint64_t total = count();
+    if (total == 0U)
+      return 0;
+
+    uint64_t rank = static_cast<uint64_t>(percent / 100.0 * static_cast<double>(total) + 0.5);
+    if (rank == 0U)
+      rank = 1U;
+    uint64_t seen {0};
+    for (size_t i = 0; i < NUM_BUCKETS; ++i)
+    {
+      seen += counts_[i].load(std::memory_order_relaxed);
+      if (seen >= rank)
+        return bucketValue(i) < max() ? bucketValue(i) : max();
+    }
+    return max();
+  }
+
+  /**
+   * @brief Samples in bucket index, for exporting the distribution.
+   */
+  uint64_t bucketCount(size_t index) const { return counts_[index].load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Largest value that falls into bucket index.
+   */
+  static uint64_t bucketValue(size_t index)
+  {
+    if (index < SUB_BUCKETS)
+      return index;
+
+    const unsigned shift = static_cast<unsigned>(index / (SUB_BUCKETS / 2)) - 1U;
+    const uint64_t subBucket = index - shift * (SUB_BUCKETS / 2);
+    return ((subBucket + 1U) << shift) - 1U;
+  }
+
+private:
+  static size_t bucketIndex(uint64_t value)
+  {
+    if (value < SUB_BUCKETS)
+      return static_cast<size_t>(value);
+
+    // shift keeps the top SUB_BUCKET_BITS bits, value >> shift is in [SUB_BUCKETS / 2, SUB_BUCKETS)
+    unsigned shift {1};
+    while ((value >> shift) >= SUB_BUCKETS)
+    {
+      ++shift;
+    }
+    return static_cast<size_t>(shift * (SUB_BUCKETS / 2) + (value >> shift));
+  }
+
+  std::atomic<uint64_t> counts_[NUM_BUCKETS] {};
+  std::atomic<uint64_t> max_ {0};
+};
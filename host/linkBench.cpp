@@ -0,0 +1,235 @@
+#include "linkBench.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iomanip>
+
+namespace
+{
+  constexpr double UART_BITS_PER_BYTE = 10.0;   // 8N1
+  // Data sizes of the RTT sweep, clamped to the largest one the session allows
+  constexpr size_t SWEEP_DATA_BYTES[] = {0, 8, 16, 24, protocol::MAX_PAYLOAD};
+
+  double percentile(const std::vector<double>& sorted, double p)
+  {
+    if (sorted.empty())
+      return 0.0;
+    const size_t index = static_cast<size_t>(p / 100.0 * static_cast<double>(sorted.size() - 1U) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1U)];
+  }
+
+  size_t maxDataBytes(const protocol::CapabilitiesS& session)
+  {
+    return session.maxPayload > protocol::ECHO_HEADER_SIZE ? session.maxPayload - protocol::ECHO_HEADER_SIZE : 0U;
+  }
+}
+
+LinkBench::LinkBench(Host& host, const OptionsS& options)
+  : host_{host}, options_{options}
+{
+  // Mixed bit pattern, so the data is not all SOF or zero bytes
+  for (size_t i = 0; i < sizeof(data_); ++i)
+  {
+    data_[i] = static_cast<uint8_t>(0x55U + i * 0x1DU);
+  }
+  host_.setEchoHandler(
+    [this](uint16_t seq, const uint8_t*, size_t len, ClockT::time_point rxTime) { onEcho(seq, len, rxTime); });
+}
+
+// -----------------------------------------------------------------------------
+// Echo bookkeeping
+// -----------------------------------------------------------------------------
+void LinkBench::onEcho(uint16_t seq, size_t, ClockT::time_point rxTime)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto entry = inFlight_.find(seq);
+  if (entry == inFlight_.end())
+    return;   // Late echo of a request already counted as lost
+
+  rttUs_.push_back(std::chrono::duration<double, std::micro>(rxTime - entry->second).count());
+  inFlight_.erase(entry);
+  ++received_;
+  echoReceived_.notify_one();
+}
+
+void LinkBench::send(size_t dataBytes)
+{
+  uint16_t seq;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    seq = nextSeq_++;
+    inFlight_[seq] = ClockT::now();
+  }
+  host_.sendEchoReq(seq, data_, dataBytes);
+}
+
+// -----------------------------------------------------------------------------
+// Measurements
+// -----------------------------------------------------------------------------
+LinkBench::ReportS LinkBench::run()
+{
+  ReportS report;
+  report.session = host_.session();
+  report.baudRate = host_.baudRate();
+
+  const size_t maxData = maxDataBytes(report.session);
+  for (size_t dataBytes : SWEEP_DATA_BYTES)
+  {
+    dataBytes = std::min(dataBytes, maxData);
+    if (!report.rtt.empty() && report.rtt.back().dataBytes >= dataBytes)
+      continue;
+    report.rtt.push_back(measureRtt(dataBytes));
+  }
+  report.throughput = measureThroughput(maxData);
+  return report;
+}
+
+LinkBench::RttS LinkBench::measureRtt(size_t dataBytes)
+{
+  RttS result;
+  result.name = "rtt/data_" + std::to_string(dataBytes);
+  result.dataBytes = dataBytes;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rttUs_.clear();
+  }
+
+  // One echo at a time, so each RTT is the unloaded round trip
+  for (unsigned i = 0; i < options_.echoCount; ++i)
+  {
+    send(dataBytes);
+    ++result.sent;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!echoReceived_.wait_for(lock, options_.echoTimeout, [this] { return inFlight_.empty(); }))
+    {
+      ++result.lost;
+      inFlight_.clear();
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::sort(rttUs_.begin(), rttUs_.end());
+  result.p50Us = percentile(rttUs_, 50.0);
+  result.p90Us = percentile(rttUs_, 90.0);
+  result.p99Us = percentile(rttUs_, 99.0);
+  result.maxUs = rttUs_.empty() ? 0.0 : rttUs_.back();
+  return result;
+}
+
+LinkBench::ThroughputS LinkBench::measureThroughput(size_t dataBytes)
+{
+  const protocol::CapabilitiesS session = host_.session();
+  ThroughputS result;
+  result.window = options_.window != 0U ? options_.window : session.rxQueueDepth;
+  result.dataBytes = dataBytes;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  inFlight_.clear();
+  received_ = 0;
+
+  // Keep the window full, requests not answered within the timeout are lost
+  const ClockT::time_point start = ClockT::now();
+  const ClockT::time_point end = start + options_.duration;
+  for (ClockT::time_point now = start; now < end; now = ClockT::now())
+  {
+    for (auto entry = inFlight_.begin(); entry != inFlight_.end();)
+    {
+      entry = (now - entry->second > options_.echoTimeout) ? inFlight_.erase(entry) : std::next(entry);
+    }
+
+    if (inFlight_.size() < result.window)
+    {
+      lock.unlock();
+      send(dataBytes);
+      lock.lock();
+      ++result.sent;
+    }
+    else
+    {
+      echoReceived_.wait_until(lock, std::min(end, now + options_.echoTimeout));
+    }
+  }
+  const unsigned receivedInTime = received_;
+
+  // Let the last echoes come back before the next measurement or disconnect
+  echoReceived_.wait_for(lock, options_.echoTimeout, [this] { return inFlight_.empty(); });
+  inFlight_.clear();
+  result.received = received_;
+
+  const double seconds = std::chrono::duration<double>(options_.duration).count();
+  result.echoesPerS = receivedInTime / seconds;
+  result.payloadBytesPerS = result.echoesPerS * static_cast<double>(protocol::ECHO_HEADER_SIZE + dataBytes);
+
+  std::array<uint8_t, protocol::MAX_FRAME_SIZE> frame;
+  const size_t frameSize = protocol::encodeFrame(protocol::signalIdE::ECHO_REQ, data_,
+                                                 protocol::ECHO_HEADER_SIZE + dataBytes, frame.data(),
+                                                 protocol::selectFrameFormat(session.frameFormats));
+  const double lineBytesPerS = host_.baudRate() / UART_BITS_PER_BYTE;
+  result.lineUtilization = result.echoesPerS * static_cast<double>(frameSize) / lineBytesPerS;
+  return result;
+}
+
+// -----------------------------------------------------------------------------
+// Reports
+// -----------------------------------------------------------------------------
+void LinkBench::writeText(std::ostream& out, const ReportS& report)
+{
+  out << std::fixed << std::setprecision(1);
+  out << "link: v" << static_cast<unsigned>(report.session.version) << ", "
+      << protocol::frameFormatName(protocol::selectFrameFormat(report.session.frameFormats))
+      << ", " << report.baudRate << " baud" << std::endl;
+  out << "rtt (us)          sent  lost      p50      p90      p99      max" << std::endl;
+  for (const RttS& rtt : report.rtt)
+  {
+    out << std::left << std::setw(16) << rtt.name << std::right
+        << std::setw(6) << rtt.sent << std::setw(6) << rtt.lost
+        << std::setw(9) << rtt.p50Us << std::setw(9) << rtt.p90Us
+        << std::setw(9) << rtt.p99Us << std::setw(9) << rtt.maxUs << std::endl;
+  }
+  const ThroughputS& tp = report.throughput;
+  out << "throughput: window " << tp.window << ", " << tp.dataBytes << " data bytes, "
+      << tp.received << "/" << tp.sent << " echoed, " << tp.echoesPerS << " echoes/s, "
+      << tp.payloadBytesPerS << " B/s, " << tp.lineUtilization * 100.0 << " % of line" << std::endl;
+  out.unsetf(std::ios::floatfield);
+}
+
+void LinkBench::writeJson(std::ostream& out, const ReportS& report)
+{
+  out << "{\n";
+  out << "  \"suite\": \"linkbench\",\n";
+  out << "  \"session\": {\"version\": " << static_cast<unsigned>(report.session.version)
+      << ", \"frame_format\": \""
+      << protocol::frameFormatName(protocol::selectFrameFormat(report.session.frameFormats)) << "\""
+      << ", \"baud_rate\": " << report.baudRate
+      << ", \"max_payload\": " << static_cast<unsigned>(report.session.maxPayload)
+      << ", \"rx_queue\": " << static_cast<unsigned>(report.session.rxQueueDepth) << "},\n";
+  out << "  \"rtt\": [\n";
+  for (size_t i = 0; i < report.rtt.size(); ++i)
+  {
+    const RttS& rtt = report.rtt[i];
+    out << "    {\"name\": \"" << rtt.name << "\""
+        << ", \"data_bytes\": " << rtt.dataBytes
+        << ", \"sent\": " << rtt.sent
+        << ", \"lost\": " << rtt.lost
+        << std::fixed << std::setprecision(1)
+        << ", \"p50_us\": " << rtt.p50Us
+        << ", \"p90_us\": " << rtt.p90Us
+        << ", \"p99_us\": " << rtt.p99Us
+        << ", \"max_us\": " << rtt.maxUs
+        << "}" << (i + 1U < report.rtt.size() ? "," : "") << "\n";
+    out.unsetf(std::ios::floatfield);
+  }
+  out << "  ],\n";
+  const ThroughputS& tp = report.throughput;
+  out << "  \"throughput\": {\"window\": " << tp.window
+      << ", \"data_bytes\": " << tp.dataBytes
+      << ", \"sent\": " << tp.sent
+      << ", \"received\": " << tp.received
+      << std::fixed << std::setprecision(1)
+      << ", \"echoes_per_s\": " << tp.echoesPerS
+      << ", \"payload_bytes_per_s\": " << tp.payloadBytesPerS
+      << std::setprecision(4)
+      << ", \"line_utilization\": " << tp.lineUtilization << "}\n";
+  out.unsetf(std::ios::floatfield);
+  out << "}\n";
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "host.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Link benchmark over ECHO_REQ/ECHO_CFM against a connected target.
+ *
+ * Measures round trip time percentiles of single echoes over a payload size
+ * sweep and pipelined echo throughput with several requests in flight. The
+ * report is written as JSON with stable names, so runs against different
+ * firmware builds or lines can be diffed.
+ *
+ * Construct before Host::start(), the echo handler is installed here.
+ */
+class LinkBench
+{
+public:
+  struct OptionsS
+  {
+    unsigned echoCount {200};                       ///< Echoes per RTT measurement
+    unsigned window {0};                            ///< Echoes in flight, 0 = target RX queue depth
+    std::chrono::milliseconds duration {2000};      ///< Throughput measurement time
+    std::chrono::milliseconds echoTimeout {500};    ///< An echo not back by then is lost
+  };
+
+  /**
+   * @brief RTT statistics of one measurement, in microseconds.
+   */
+  struct RttS
+  {
+    std::string name;
+    size_t dataBytes {0};       ///< Data bytes after the sequence id
+    unsigned sent {0};
+    unsigned lost {0};
+    double p50Us {0};
+    double p90Us {0};
+    double p99Us {0};
+    double maxUs {0};
+  };
+
+  struct ThroughputS
+  {
+    unsigned window {0};
+    size_t dataBytes {0};
+    unsigned sent {0};
+    unsigned received {0};
+    double echoesPerS {0};
+    double payloadBytesPerS {0};  ///< ECHO_REQ payload bytes echoed per second
+    double lineUtilization {0};   ///< Encoded bytes per direction over the line capacity
+  };
+
+  struct ReportS
+  {
+    protocol::CapabilitiesS session {};
+    uint32_t baudRate {0};
+    std::vector<RttS> rtt;        ///< One entry per swept data size
+    ThroughputS throughput {};
+  };
+
+  LinkBench(Host& host, const OptionsS& options);
+
+  /**
+   * @brief Run all measurements. The host must be connected.
+   */
+  ReportS run();
+
+  static void writeText(std::ostream& out, const ReportS& report);
+  static void writeJson(std::ostream& out, const ReportS& report);
+
+private:
+  using ClockT = std::chrono::steady_clock;
+
+  void onEcho(uint16_t seq, size_t len, ClockT::time_point rxTime);
+  void send(size_t dataBytes);
+  RttS measureRtt(size_t dataBytes);
+  ThroughputS measureThroughput(size_t dataBytes);
+
+  Host& host_;
+  OptionsS options_;
+  uint8_t data_[protocol::MAX_PAYLOAD] {};
+
+  // Echoes in flight by sequence id, shared with the RX thread
+  std::mutex mutex_;
+  std::condition_variable echoReceived_;
+  std::map<uint16_t, ClockT::time_point> inFlight_;
+  std::vector<double> rttUs_;
+  unsigned received_ {0};
+  uint16_t nextSeq_ {0};
+};
@@ -1,14 +1,130 @@
 #include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 #include "host.hpp"
+#include "linkBench.hpp"
+#include "traceDump.hpp"
+
+namespace
+{
+  void printUsage()
+  {
+    std::cout << "Usage: host <port> [options]  (e.g. COM4 or /dev/ttyACM0)" << std::endl;
+    std::cout << "  --header-check     offer header-checked frames, fewer corrupted frames pass at high BER" << std::endl;
+    std::cout << "  --fec              offer forward error corrected frames for noisy lines" << std::endl;
+    std::cout << "  --baud <rate>      switch to this rate after connecting, if the target supports it" << std::endl;
+    std::cout << "  --linkbench        measure echo RTT and throughput instead of running the heartbeat" << std::endl;
+    std::cout << "  --echo-count <n>   linkbench echoes per RTT measurement (default 200)" << std::endl;
+    std::cout << "  --window <n>       linkbench echoes in flight (default: target RX queue depth)" << std::endl;
+    std::cout << "  --json <file>      write the linkbench report as JSON" << std::endl;
+    std::cout << "  --stats-json <file> keep heartbeat and button latency histograms in file" << std::endl;
+    std::cout << "  --target-stats     poll the target link counters and print per-second rates" << std::endl;
+    std::cout << "  --perf             read the target cycle probes (TARGET_CYCLE_PROBES builds)" << std::endl;
+    std::cout << "  --flight-log <file> append the target flight recorder to file after connecting" << std::endl;
+    std::cout << "  --stream <rate_hz> start the target telemetry stream after connecting" << std::endl;
+    std::cout << "  --stream-window <n> summarize every n samples on the target instead of streaming them" << std::endl;
+    std::cout << "  --stream-bins <n>  histogram bins per summary, 0 to 8, each 8192 values wide" << std::endl;
+    std::cout << "  --trace <file>     on link loss, write the host and target trace timeline (PROTOCOL_TRACE builds)" << std::endl;
+  }
+}
 
 int main(int argc, char* argv[])
 {
-  if (argc < 2)
+  uint8_t frameFormats = protocol::DEFAULT_FRAME_FORMATS;
+  uint32_t baudRate = protocol::BASELINE_BAUD_RATE;
+  bool linkBench = false;
+  LinkBench::OptionsS benchOptions;
+  std::string jsonPath;
+  std::string statsPath;
+  std::string tracePath;
+  std::string flightLogPath;
+  bool targetStats = false;
+  bool perfProbes = false;
+  uint32_t streamRateHz = 0;
+  protocol::StreamWindowS streamWindow;
+  // 8 bins of 2^13 values cover the 16-bit sample range
+  streamWindow.binShift = 13;
+  bool valid = argc >= 2;
+  for (int i = 2; valid && i < argc; ++i)
+  {
+    const bool hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--header-check") == 0)
+      frameFormats |= static_cast<uint8_t>(protocol::frameFormatE::HEADER_CHECK);
+    else if (std::strcmp(argv[i], "--fec") == 0)
+      frameFormats |= static_cast<uint8_t>(protocol::frameFormatE::FEC);
+    else if (std::strcmp(argv[i], "--target-stats") == 0)
+      targetStats = true;
+    else if (std::strcmp(argv[i], "--perf") == 0)
+      perfProbes = true;
+    else if (std::strcmp(argv[i], "--linkbench") == 0)
+      linkBench = true;
+    else if (std::strcmp(argv[i], "--baud") == 0 && hasValue)
+      baudRate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "--echo-count") == 0 && hasValue)
+      benchOptions.echoCount = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "--window") == 0 && hasValue)
+      benchOptions.window = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "--json") == 0 && hasValue)
+      jsonPath = argv[++i];
+    else if (std::strcmp(argv[i], "--stats-json") == 0 && hasValue)
+      statsPath = argv[++i];
+    else if (std::strcmp(argv[i], "--flight-log") == 0 && hasValue)
+      flightLogPath = argv[++i];
+    else if (std::strcmp(argv[i], "--stream") == 0 && hasValue)
+      streamRateHz = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "--stream-window") == 0 && hasValue)
+      streamWindow.samples = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "--stream-bins") == 0 && hasValue)
+      streamWindow.bins = static_cast<uint8_t>(std::strtoul(argv[++i], nullptr, 10));
+    else if (std::strcmp(argv[i], "--trace") == 0 && hasValue)
+      tracePath = argv[++i];
+    else
+      valid = false;
+  }
+
+  if (!valid)
   {
-    std::cout << "Usage: host.exe COMx" << std::endl;
+    printUsage();
     return 0;
   }
 
-  Host host(argv[1]);
-  host.connect();
-}
\ No newline at end of file
+  Host host(argv[1], frameFormats, baudRate);
+  if (!linkBench)
+  {
+    host.setStatsFile(statsPath);
+    host.setTargetStats(targetStats);
+    host.setPerfProbes(perfProbes);
+    host.setFlightLogFile(flightLogPath);
+    host.setStreamRate(streamRateHz, streamWindow);
+    if (tracePath.empty())
+    {
+      host.connect();
+      return 0;
+    }
+
+    TraceDump dump(host);
+    host.connect();
+    const std::vector<TraceDump::EntryS> entries = dump.collect();
+    std::ofstream out(tracePath);
+    TraceDump::writeText(out, entries);
+    return out ? 0 : 1;
+  }
+
+  LinkBench bench(host, benchOptions);
+  if (!host.start())
+    return 1;
+  const LinkBench::ReportS report = bench.run();
+  host.stop();
+
+  LinkBench::writeText(std::cout, report);
+  if (!jsonPath.empty())
+  {
+    std::ofstream out(jsonPath);
+    LinkBench::writeJson(out, report);
+    if (!out)
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,189 @@
+#include "traceDump.hpp"
+#include "hostTrace.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+constexpr decltype(TraceDump::CFM_TIMEOUT) TraceDump::CFM_TIMEOUT;
+constexpr unsigned TraceDump::REQ_ATTEMPTS;
+constexpr unsigned TraceDump::RECONNECT_ATTEMPTS;
+
+TraceDump::TraceDump(Host& host)
+  : host_{host}
+{
+  hostTrace::setThreadName("main");
+  host_.setTraceHandler(
+    [this](uint32_t head, uint32_t seq, const std::vector<protocol::TraceEventS>& events)
+    { onTraceCfm(head, seq, events); });
+}
+
+void TraceDump::onTraceCfm(uint32_t head, uint32_t seq, const std::vector<protocol::TraceEventS>& events)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  haveCfm_ = true;
+  cfmHead_ = head;
+  cfmSeq_ = seq;
+  cfmEvents_ = events;
+  cfmReceived_.notify_one();
+}
+
+bool TraceDump::request(uint32_t seq, bool freeze, uint32_t& head, uint32_t& first,
+                        std::vector<protocol::TraceEventS>& events)
+{
+  for (unsigned attempt = 0; attempt < REQ_ATTEMPTS; ++attempt)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    haveCfm_ = false;
+    lock.unlock();
+    host_.sendTraceReq(seq, freeze);
+    lock.lock();
+    // Each CFM names its first event, so a late one of an earlier request is as good
+    if (cfmReceived_.wait_for(lock, CFM_TIMEOUT, [this] { return haveCfm_; }))
+    {
+      head = cfmHead_;
+      first = cfmSeq_;
+      events = cfmEvents_;
+      return true;
+    }
+  }
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+// Collection
+// -----------------------------------------------------------------------------
+std::vector<protocol::TraceEventS> TraceDump::readTarget()
+{
+  std::vector<protocol::TraceEventS> events;
+  if ((host_.session().features & protocol::FEATURE_TRACE) == 0U)
+  {
+    std::cout << "[trace] Target has no trace ring" << std::endl;
+    return events;
+  }
+
+  // Freeze first, the readout and the clock sync would overwrite the ring
+  uint32_t head {0};
+  uint32_t first {0};
+  std::vector<protocol::TraceEventS> page;
+  if (!request(0, true, head, first, page))
+  {
+    std::cout << "[trace] No TRACE_CFM" << std::endl;
+    return events;
+  }
+  const uint32_t end = head;
+  uint32_t seq = first;
+  while (seq < end && request(seq, true, head, first, page) && !page.empty())
+  {
+    events.insert(events.end(), page.begin(), page.end());
+    seq = first + static_cast<uint32_t>(page.size());
+  }
+  // Events past end were recorded by the readout itself
+  if (seq > end)
+    events.resize(events.size() - (seq - end));
+  std::cout << "[trace] Read " << events.size() << " target events" << std::endl;
+  return events;
+}
+
+std::vector<TraceDump::EntryS> TraceDump::collect()
+{
+  // The RX thread must stop before its ring is read
+  host_.stop();
+  std::vector<EntryS> entries;
+  for (const hostTrace::EventS& hostEvent : hostTrace::snapshot())
+  {
+    EntryS entry;
+    entry.source = hostEvent.thread;
+    entry.timeUs = hostEvent.timeUs;
+    entry.event = hostEvent.event;
+    entries.push_back(entry);
+  }
+  std::cout << "[trace] " << entries.size() << " host events" << std::endl;
+
+  // Frames queued before the link was lost may still overflow the target RX queue
+  bool connected = false;
+  for (unsigned attempt = 0; !connected && attempt < RECONNECT_ATTEMPTS; ++attempt)
+  {
+    connected = host_.start();
+    if (!connected)
+      host_.stop();
+  }
+  std::vector<protocol::TraceEventS> targetEvents;
+  bool synced = false;
+  if (connected)
+  {
+    targetEvents = readTarget();
+    synced = !targetEvents.empty() && host_.syncClock();
+    if (!targetEvents.empty() && !synced)
+      std::cout << "[trace] No clock sync, target events keep target time" << std::endl;
+    // Resume recording on the target
+    uint32_t head {0};
+    uint32_t first {0};
+    std::vector<protocol::TraceEventS> page;
+    if (!targetEvents.empty())
+      request(0, false, head, first, page);
+  }
+  else
+  {
+    std::cout << "[trace] Reconnect failed, host events only" << std::endl;
+  }
+  host_.stop();
+
+  std::vector<EntryS> unmapped;
+  for (const protocol::TraceEventS& event : targetEvents)
+  {
+    EntryS entry;
+    entry.source = "target";
+    entry.event = event;
+    std::chrono::steady_clock::time_point hostTime;
+    if (synced && host_.targetToHostTime(event.timeUs, hostTime))
+    {
+      entry.timeUs = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(hostTime.time_since_epoch()).count());
+      entries.push_back(entry);
+    }
+    else
+    {
+      entry.timeUs = event.timeUs;
+      entry.mapped = false;
+      unmapped.push_back(entry);
+    }
+  }
+  // Stable, so events of one source keep their recorded order
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const EntryS& a, const EntryS& b) { return a.timeUs < b.timeUs; });
+  entries.insert(entries.end(), unmapped.begin(), unmapped.end());
+  return entries;
+}
+
+// -----------------------------------------------------------------------------
+// Report
+// -----------------------------------------------------------------------------
+void TraceDump::writeText(std::ostream& out, const std::vector<EntryS>& entries)
+{
+  // Times in ms relative to the first event of the same time base
+  uint64_t originUs[2] {0, 0};
+  bool haveOrigin[2] {false, false};
+  out << std::fixed << std::setprecision(3);
+  out << "    time ms  source  event               args" << std::endl;
+  for (const EntryS& entry : entries)
+  {
+    const size_t base = entry.mapped ? 0U : 1U;
+    if (!haveOrigin[base])
+    {
+      haveOrigin[base] = true;
+      originUs[base] = entry.timeUs;
+      if (!entry.mapped)
+        out << "target events without clock sync, target time:" << std::endl;
+    }
+    out << std::setw(11) << static_cast<double>(entry.timeUs - originUs[base]) / 1000.0 << "  "
+        << std::left << std::setw(8) << entry.source << std::setw(20) << protocol::traceName(entry.event.id)
+        << std::right;
+    for (uint8_t arg : entry.event.args)
+    {
+      out << std::setw(4) << static_cast<unsigned>(arg);
+    }
+    out << std::endl;
+  }
+  out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "host.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Merged host and target trace timeline after a lost connection.
+ *
+ * Takes the host trace rings once the heartbeat has stopped, then reconnects,
+ * freezes the target ring with TRACE_REQ, synchronizes the clocks and reads
+ * the target events. Target times are mapped to host time, so both sides
+ * sort into one timeline. Needs PROTOCOL_TRACE builds for events on either
+ * side; a side built without it contributes nothing.
+ *
+ * Construct before Host::connect(), the trace handler is installed here.
+ */
+class TraceDump
+{
+public:
+  struct EntryS
+  {
+    std::string source;         ///< "target" or the host thread name
+    uint64_t timeUs {0};        ///< Host steady clock, or target time if not mapped
+    bool mapped {true};         ///< False for target events without clock sync
+    protocol::TraceEventS event {};
+  };
+
+  explicit TraceDump(Host& host);
+
+  /**
+   * @brief Collect both sides, call after Host::connect() returned. Host
+   * events sorted by time, followed by the target ones if the clocks could
+   * not be synchronized.
+   */
+  std::vector<EntryS> collect();
+
+  static void writeText(std::ostream& out, const std::vector<EntryS>& entries);
+
+private:
+  static constexpr auto CFM_TIMEOUT = std::chrono::milliseconds{200};
+  static constexpr unsigned REQ_ATTEMPTS = 3;
+  static constexpr unsigned RECONNECT_ATTEMPTS = 3;
+
+  void onTraceCfm(uint32_t head, uint32_t seq, const std::vector<protocol::TraceEventS>& events);
+  bool request(uint32_t seq, bool freeze, uint32_t& head, uint32_t& first,
+               std::vector<protocol::TraceEventS>& events);
+  std::vector<protocol::TraceEventS> readTarget();
+
+  Host& host_;
+
+  // Last TRACE_CFM, shared with the RX thread
+  std::mutex mutex_;
+  std::condition_variable cfmReceived_;
+  bool haveCfm_ {false};
+  uint32_t cfmHead_ {0};
+  uint32_t cfmSeq_ {0};
+  std::vector<protocol::TraceEventS> cfmEvents_;
+};
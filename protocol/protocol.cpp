@@ -1,7 +1,76 @@
 #include "protocol.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstring>
 
 namespace protocol
 {
+  namespace
+  {
+    // frameFormatE started by each byte, 0 for no SOF. SOF_FEC is also
+    // accepted with one bit flipped, its neighbours are all above the
+    // largest LEN and none of them is a codeword.
+    constexpr uint8_t SOF_FORMAT[256] {
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 4, 0, 0, 0, 0, 0, 0, 4, 4, 0, 4, 0, 4, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+
+    static_assert(SOF_FORMAT[SOF] == static_cast<uint8_t>(frameFormatE::BASIC)
+                  && SOF_FORMAT[SOF_HC] == static_cast<uint8_t>(frameFormatE::HEADER_CHECK)
+                  && SOF_FORMAT[SOF_FEC] == static_cast<uint8_t>(frameFormatE::FEC),
+                  "SOF_FORMAT does not match the SOF markers");
+
+    inline bool isSof(uint8_t byte)
+    {
+      return SOF_FORMAT[byte] != 0U;
+    }
+
+    // SECDED(8,4) codeword per nibble: Hamming(7,4) in bits 0..6 with the
+    // parity bits at positions 1, 2 and 4, overall parity in bit 7
+    constexpr uint8_t FEC_ENCODE[16] {
+      0x00, 0x87, 0x99, 0x1E, 0xAA, 0x2D, 0x33, 0xB4,
+      0x4B, 0xCC, 0xD2, 0x55, 0xE1, 0x66, 0x78, 0xFF
+    };
+
+    // Nibble per received codeword, FEC_CORRECTED is set when one bit was
+    // flipped. Two flipped bits give FEC_UNCORRECTABLE.
+    constexpr uint8_t FEC_CORRECTED = 0x10;
+    constexpr uint8_t FEC_UNCORRECTABLE = 0xFF;
+    constexpr uint8_t FEC_DECODE[256] {
+      0x00, 0x10, 0x10, 0xFF, 0x10, 0xFF, 0xFF, 0x11, 0x10, 0xFF, 0xFF, 0x18, 0xFF, 0x15, 0x13, 0xFF,
+      0x10, 0xFF, 0xFF, 0x16, 0xFF, 0x1B, 0x13, 0xFF, 0xFF, 0x12, 0x13, 0xFF, 0x13, 0xFF, 0x03, 0x13,
+      0x10, 0xFF, 0xFF, 0x16, 0xFF, 0x15, 0x1D, 0xFF, 0xFF, 0x15, 0x14, 0xFF, 0x15, 0x05, 0xFF, 0x15,
+      0xFF, 0x16, 0x16, 0x06, 0x17, 0xFF, 0xFF, 0x16, 0x1E, 0xFF, 0xFF, 0x16, 0xFF, 0x15, 0x13, 0xFF,
+      0x10, 0xFF, 0xFF, 0x18, 0xFF, 0x1B, 0x1D, 0xFF, 0xFF, 0x18, 0x18, 0x08, 0x19, 0xFF, 0xFF, 0x18,
+      0xFF, 0x1B, 0x1A, 0xFF, 0x1B, 0x0B, 0xFF, 0x1B, 0x1E, 0xFF, 0xFF, 0x18, 0xFF, 0x1B, 0x13, 0xFF,
+      0xFF, 0x1C, 0x1D, 0xFF, 0x1D, 0xFF, 0x0D, 0x1D, 0x1E, 0xFF, 0xFF, 0x18, 0xFF, 0x15, 0x1D, 0xFF,
+      0x1E, 0xFF, 0xFF, 0x16, 0xFF, 0x1B, 0x1D, 0xFF, 0x0E, 0x1E, 0x1E, 0xFF, 0x1E, 0xFF, 0xFF, 0x1F,
+      0x10, 0xFF, 0xFF, 0x11, 0xFF, 0x11, 0x11, 0x01, 0xFF, 0x12, 0x14, 0xFF, 0x19, 0xFF, 0xFF, 0x11,
+      0xFF, 0x12, 0x1A, 0xFF, 0x17, 0xFF, 0xFF, 0x11, 0x12, 0x02, 0xFF, 0x12, 0xFF, 0x12, 0x13, 0xFF,
+      0xFF, 0x1C, 0x14, 0xFF, 0x17, 0xFF, 0xFF, 0x11, 0x14, 0xFF, 0x04, 0x14, 0xFF, 0x15, 0x14, 0xFF,
+      0x17, 0xFF, 0xFF, 0x16, 0x07, 0x17, 0x17, 0xFF, 0xFF, 0x12, 0x14, 0xFF, 0x17, 0xFF, 0xFF, 0x1F,
+      0xFF, 0x1C, 0x1A, 0xFF, 0x19, 0xFF, 0xFF, 0x11, 0x19, 0xFF, 0xFF, 0x18, 0x09, 0x19, 0x19, 0xFF,
+      0x1A, 0xFF, 0x0A, 0x1A, 0xFF, 0x1B, 0x1A, 0xFF, 0xFF, 0x12, 0x1A, 0xFF, 0x19, 0xFF, 0xFF, 0x1F,
+      0x1C, 0x0C, 0xFF, 0x1C, 0xFF, 0x1C, 0x1D, 0xFF, 0xFF, 0x1C, 0x14, 0xFF, 0x19, 0xFF, 0xFF, 0x1F,
+      0xFF, 0x1C, 0x1A, 0xFF, 0x17, 0xFF, 0xFF, 0x1F, 0x1E, 0xFF, 0xFF, 0x1F, 0xFF, 0x1F, 0x1F, 0x0F
+    };
+  }
+
   // ---------------------------------------------------------------------------
   // CRC8
   // Polynomial: x^8 + x^2 + x + 1 (0x07)
@@ -24,66 +93,576 @@ namespace protocol
   // Format:
   //   [SOF][LEN][SIG][PAYLOAD...][CRC]
   // CRC is calculated over [SIG][PAYLOAD...]
+  // Header-checked format:
+  //   [SOF_HC][LEN][SIG][HCRC][PAYLOAD...][CRC]
+  // HCRC is calculated over [SOF_HC][LEN][SIG], CRC over everything after SOF_HC
+  // FEC format:
+  //   [SOF_FEC] + two codewords for every byte of a basic frame after its SOF
   // ---------------------------------------------------------------------------
   size_t encodeFrame(
     signalIdE sigId,
     const uint8_t* payload,
     size_t payloadLen,
-    uint8_t* outFrame)
+    uint8_t* outFrame,
+    frameFormatE format)
   {
+    if (format == frameFormatE::FEC)
+    {
+      uint8_t basic[4U + MAX_PAYLOAD];
+      const size_t basicLen = encodeFrame(sigId, payload, payloadLen, basic);
+      size_t byteIndex{0};
+      outFrame[byteIndex++] = SOF_FEC;
+      for (size_t i = 1; i < basicLen; ++i)
+      {
+        outFrame[byteIndex++] = FEC_ENCODE[basic[i] >> 4];
+        outFrame[byteIndex++] = FEC_ENCODE[basic[i] & 0x0FU];
+      }
+      return byteIndex;
+    }
+
+    const bool headerCheck = (format == frameFormatE::HEADER_CHECK);
     size_t byteIndex{0};
-    outFrame[byteIndex++] = SOF;
+    outFrame[byteIndex++] = headerCheck ? SOF_HC : SOF;
     
     uint8_t len = static_cast<uint8_t>(1U + payloadLen);
     outFrame[byteIndex++] = len;
 
     outFrame[byteIndex++] = static_cast<uint8_t>(sigId);
 
+    if (headerCheck)
+    {
+      outFrame[byteIndex] = crc8(outFrame, byteIndex);
+      ++byteIndex;
+    }
+
     for (size_t i = 0; i < payloadLen; ++i)
     {
       outFrame[byteIndex++] = payload[i];
     }
-    uint8_t crc = crc8(&outFrame[2], len); // CRC over [SIG][PAYLOAD...]
+
+    uint8_t crc = headerCheck
+      ? crc8(&outFrame[1], byteIndex - 1U)  // CRC over [LEN][SIG][HCRC][PAYLOAD...]
+      : crc8(&outFrame[2], len);            // CRC over [SIG][PAYLOAD...]
     outFrame[byteIndex++] = crc;
 
     return byteIndex;
   }
 
+  frameFormatE selectFrameFormat(uint8_t offeredMask)
+  {
+    const uint8_t common = offeredMask & SUPPORTED_FRAME_FORMATS;
+    if (common & static_cast<uint8_t>(frameFormatE::FEC))
+      return frameFormatE::FEC;
+    if (common & static_cast<uint8_t>(frameFormatE::HEADER_CHECK))
+      return frameFormatE::HEADER_CHECK;
+    return frameFormatE::BASIC;
+  }
+
+  const char* frameFormatName(frameFormatE format)
+  {
+    switch (format)
+    {
+    case frameFormatE::BASIC:
+      return "BASIC";
+    case frameFormatE::HEADER_CHECK:
+      return "HEADER_CHECK";
+    case frameFormatE::FEC:
+      return "FEC";
+    }
+    return "UNKNOWN";
+  }
+
+  // ---------------------------------------------------------------------------
+  // Payload fields
+  // ---------------------------------------------------------------------------
+  size_t writeUint16(uint16_t value, uint8_t* out)
+  {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    return sizeof(value);
+  }
+
+  uint16_t readUint16(const uint8_t* data)
+  {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+  }
+
+  size_t writeUint32(uint32_t value, uint8_t* out)
+  {
+    for (size_t i = 0; i < sizeof(value); ++i)
+    {
+      out[i] = static_cast<uint8_t>(value >> (8U * i));
+    }
+    return sizeof(value);
+  }
+
+  uint32_t readUint32(const uint8_t* data)
+  {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8)
+         | (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+  }
+
+  // ---------------------------------------------------------------------------
+  // Capability record
+  // ---------------------------------------------------------------------------
+  size_t encodeCapabilities(const CapabilitiesS& caps, uint8_t* out)
+  {
+    size_t byteIndex{0};
+    out[byteIndex++] = caps.version;
+    out[byteIndex++] = caps.maxPayload;
+    out[byteIndex++] = caps.frameFormats;
+    byteIndex += writeUint32(caps.maxBaudRate, &out[byteIndex]);
+    out[byteIndex++] = caps.rxQueueDepth;
+    out[byteIndex++] = caps.features;
+    return byteIndex;
+  }
+
+  CapabilitiesS decodeCapabilities(const uint8_t* data, size_t len)
+  {
+    CapabilitiesS caps {};
+    if (len > 0U)
+      caps.version = data[0];
+    if (len > 1U)
+      caps.maxPayload = std::min<uint8_t>(data[1], MAX_PAYLOAD);
+    if (len > 2U)
+      caps.frameFormats = data[2];
+    if (len > 6U)
+      caps.maxBaudRate = std::max(readUint32(&data[3]), BASELINE_BAUD_RATE);
+    if (len > 7U)
+      caps.rxQueueDepth = std::max<uint8_t>(data[7], 1U);
+    if (len > 8U)
+      caps.features = data[8];
+    return caps;
+  }
+
+  CapabilitiesS negotiateCapabilities(const CapabilitiesS& local, const CapabilitiesS& peer)
+  {
+    CapabilitiesS agreed;
+    agreed.version = std::min(local.version, peer.version);
+    agreed.maxPayload = std::min(local.maxPayload, peer.maxPayload);
+    agreed.frameFormats = static_cast<uint8_t>(selectFrameFormat(local.frameFormats & peer.frameFormats));
+    agreed.maxBaudRate = std::min(local.maxBaudRate, peer.maxBaudRate);
+    // Each side keeps its own queue, the record tells the peer how far it may run ahead
+    agreed.rxQueueDepth = local.rxQueueDepth;
+    agreed.features = local.features & peer.features;
+    return agreed;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Link statistics
+  // ---------------------------------------------------------------------------
+  size_t encodeLinkStats(const LinkStatsS& stats, uint8_t* out)
+  {
+    size_t byteIndex{0};
+    byteIndex += writeUint32(stats.rxBytes, &out[byteIndex]);
+    byteIndex += writeUint32(stats.txBytes, &out[byteIndex]);
+    byteIndex += writeUint32(stats.rxFrames, &out[byteIndex]);
+    byteIndex += writeUint32(stats.txFrames, &out[byteIndex]);
+    byteIndex += writeUint16(static_cast<uint16_t>(stats.crcErrors), &out[byteIndex]);
+    byteIndex += writeUint16(static_cast<uint16_t>(stats.lengthErrors), &out[byteIndex]);
+    byteIndex += writeUint16(static_cast<uint16_t>(stats.rxTimeouts), &out[byteIndex]);
+    byteIndex += writeUint16(static_cast<uint16_t>(stats.rxQueueDrops), &out[byteIndex]);
+    byteIndex += writeUint16(static_cast<uint16_t>(stats.txQueueDrops), &out[byteIndex]);
+    byteIndex += writeUint16(static_cast<uint16_t>(stats.uartErrors), &out[byteIndex]);
+    byteIndex += writeUint16(static_cast<uint16_t>(stats.uartOverruns), &out[byteIndex]);
+    out[byteIndex++] = stats.rxQueueHighWater;
+    out[byteIndex++] = stats.txQueueHighWater;
+    return byteIndex;
+  }
+
+  LinkStatsS decodeLinkStats(const uint8_t* data, size_t len)
+  {
+    LinkStatsS stats {};
+    if (len < LINK_STATS_SIZE)
+      return stats;
+
+    stats.rxBytes = readUint32(&data[0]);
+    stats.txBytes = readUint32(&data[4]);
+    stats.rxFrames = readUint32(&data[8]);
+    stats.txFrames = readUint32(&data[12]);
+    stats.crcErrors = readUint16(&data[16]);
+    stats.lengthErrors = readUint16(&data[18]);
+    stats.rxTimeouts = readUint16(&data[20]);
+    stats.rxQueueDrops = readUint16(&data[22]);
+    stats.txQueueDrops = readUint16(&data[24]);
+    stats.uartErrors = readUint16(&data[26]);
+    stats.uartOverruns = readUint16(&data[28]);
+    stats.rxQueueHighWater = data[30];
+    stats.txQueueHighWater = data[31];
+    return stats;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Main loop statistics
+  // ---------------------------------------------------------------------------
+  size_t encodeLoopStats(const LoopStatsS& stats, uint8_t* out)
+  {
+    size_t byteIndex = writeUint16(stats.dutyCyclePermille, out);
+    for (uint32_t latencyUs : stats.maxLatencyUs)
+    {
+      byteIndex += writeUint32(latencyUs, &out[byteIndex]);
+    }
+    return byteIndex;
+  }
+
+  LoopStatsS decodeLoopStats(const uint8_t* data, size_t len)
+  {
+    LoopStatsS stats {};
+    if (len < LOOP_STATS_SIZE)
+      return stats;
+
+    stats.dutyCyclePermille = readUint16(data);
+    for (size_t i = 0; i < static_cast<size_t>(loopEventE::COUNT); ++i)
+    {
+      stats.maxLatencyUs[i] = readUint32(&data[2U + 4U * i]);
+    }
+    return stats;
+  }
+
+  const char* loopEventName(uint8_t event)
+  {
+    static const char* const NAMES[static_cast<size_t>(loopEventE::COUNT)] = {
+      "rx", "tx_done", "tick", "button", "stream"
+    };
+    return event < static_cast<uint8_t>(loopEventE::COUNT) ? NAMES[event] : "unknown";
+  }
+
+  // ---------------------------------------------------------------------------
+  // Flight recorder
+  // ---------------------------------------------------------------------------
+  size_t encodeLogRecord(const LogRecordS& record, uint8_t* out)
+  {
+    size_t byteIndex = writeUint32(record.timeMs, out);
+    out[byteIndex++] = record.event;
+    out[byteIndex++] = record.arg0;
+    byteIndex += writeUint16(record.arg1, out + byteIndex);
+    return byteIndex;
+  }
+
+  LogRecordS decodeLogRecord(const uint8_t* data)
+  {
+    LogRecordS record;
+    record.timeMs = readUint32(data);
+    record.event = data[4];
+    record.arg0 = data[5];
+    record.arg1 = readUint16(data + 6);
+    return record;
+  }
+
+  const char* logEventName(uint8_t event)
+  {
+    static const char* const NAMES[static_cast<size_t>(logEventE::COUNT)] = {
+      "BOOT", "STATE", "TICK_TIMEOUT", "BAUD_RATE", "BAUD_FALLBACK", "BUTTON", "CRC_ERRORS",
+      "LENGTH_ERRORS", "RX_TIMEOUTS", "RX_DROPS", "TX_DROPS", "UART_ERRORS", "STREAM_DROPS"
+    };
+    return event < static_cast<uint8_t>(logEventE::COUNT) ? NAMES[event] : "UNKNOWN";
+  }
+
+  // ---------------------------------------------------------------------------
+  // Telemetry stream
+  // ---------------------------------------------------------------------------
+  size_t encodeStreamStart(uint32_t rateHz, const StreamWindowS& window, uint8_t* out)
+  {
+    size_t byteIndex = writeUint32(rateHz, out);
+    if (window.samples == 0U)
+      return byteIndex;
+    byteIndex += writeUint16(window.samples, out + byteIndex);
+    out[byteIndex++] = window.bins;
+    out[byteIndex++] = window.binShift;
+    byteIndex += writeUint16(window.binLow, out + byteIndex);
+    return byteIndex;
+  }
+
+  StreamWindowS decodeStreamWindow(const uint8_t* data, size_t len)
+  {
+    StreamWindowS window {};
+    if (len < STREAM_START_WINDOW_SIZE)
+      return window;
+
+    window.samples = readUint16(&data[4]);
+    window.bins = data[6];
+    window.binShift = data[7];
+    window.binLow = readUint16(&data[8]);
+    return window;
+  }
+
+  size_t encodeStreamSummary(const StreamSummaryS& summary, uint8_t* out)
+  {
+    size_t byteIndex = writeUint32(summary.seq, out);
+    byteIndex += writeUint16(summary.count, out + byteIndex);
+    byteIndex += writeUint16(summary.min, out + byteIndex);
+    byteIndex += writeUint16(summary.max, out + byteIndex);
+    byteIndex += writeUint32(summary.mean, out + byteIndex);
+    for (size_t i = 0; i < summary.bins && i < STREAM_MAX_BINS; ++i)
+    {
+      byteIndex += writeUint16(summary.binCounts[i], out + byteIndex);
+    }
+    return byteIndex;
+  }
+
+  StreamSummaryS decodeStreamSummary(const uint8_t* data, size_t len)
+  {
+    StreamSummaryS summary {};
+    if (len < STREAM_SUMMARY_HEADER_SIZE)
+      return summary;
+
+    summary.seq = readUint32(&data[0]);
+    summary.count = readUint16(&data[4]);
+    summary.min = readUint16(&data[6]);
+    summary.max = readUint16(&data[8]);
+    summary.mean = readUint32(&data[10]);
+    const size_t bins = std::min<size_t>((len - STREAM_SUMMARY_HEADER_SIZE) / STREAM_SAMPLE_SIZE, STREAM_MAX_BINS);
+    summary.bins = static_cast<uint8_t>(bins);
+    for (size_t i = 0; i < bins; ++i)
+    {
+      summary.binCounts[i] = readUint16(&data[STREAM_SUMMARY_HEADER_SIZE + i * STREAM_SAMPLE_SIZE]);
+    }
+    return summary;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Trace events
+  // ---------------------------------------------------------------------------
+  size_t encodeTraceEvent(const TraceEventS& event, uint8_t* out)
+  {
+    size_t byteIndex = writeUint32(event.timeUs, out);
+    out[byteIndex++] = event.id;
+    for (uint8_t arg : event.args)
+    {
+      out[byteIndex++] = arg;
+    }
+    return byteIndex;
+  }
+
+  TraceEventS decodeTraceEvent(const uint8_t* data)
+  {
+    TraceEventS event;
+    event.timeUs = readUint32(data);
+    event.id = data[4];
+    for (size_t i = 0; i < sizeof(event.args); ++i)
+    {
+      event.args[i] = data[5U + i];
+    }
+    return event;
+  }
+
+  const char* traceName(uint8_t id)
+  {
+    static const char* const NAMES[static_cast<size_t>(traceIdE::COUNT)] = {
+      "DECODER_SOF", "DECODER_FRAME", "DECODER_LEN_ERROR", "DECODER_CRC_ERROR", "DECODER_TIMEOUT",
+      "TARGET_STATE", "TARGET_RX_PUSH", "TARGET_RX_DROP", "TARGET_RX_POP", "TARGET_TX_PUSH",
+      "TARGET_TX_DROP", "TARGET_TX_START", "TARGET_TX_DONE", "TARGET_BAUD", "TARGET_UART_ERROR",
+      "HOST_STATE", "HOST_TX", "HOST_RX", "HOST_LINK_LOST"
+    };
+    return id < static_cast<uint8_t>(traceIdE::COUNT) ? NAMES[id] : "UNKNOWN";
+  }
+
+  // ---------------------------------------------------------------------------
+  // Payload length accepted per signal
+  // ---------------------------------------------------------------------------
+  bool isPlausibleFrame(uint8_t sigId, size_t payloadLen)
+  {
+    switch (static_cast<signalIdE>(sigId))
+    {
+    case signalIdE::CONNECT_REQ:
+    case signalIdE::CONNECT_CFM:
+      return payloadLen <= CAPABILITIES_SIZE;   // Optional capability record
+    case signalIdE::TICK_IND:
+    case signalIdE::TICK_CFM:
+      return payloadLen == 0U || payloadLen == TICK_SEQ_SIZE;   // FEATURE_TICK_SEQ
+    case signalIdE::BUTTON_IND:
+      return payloadLen == 0U || payloadLen == BUTTON_TIME_SIZE;  // FEATURE_BUTTON_TIME
+    case signalIdE::BUTTON_CFM:
+    case signalIdE::DISCONNECT_REQ:
+      return payloadLen == 0U;
+    case signalIdE::BAUD_REQ:
+    case signalIdE::BAUD_CFM:
+      return payloadLen == BAUD_RATE_SIZE;
+    case signalIdE::PROBE_REQ:
+    case signalIdE::PROBE_CFM:
+      return payloadLen == BAUD_PROBE_SIZE;
+    case signalIdE::ECHO_REQ:
+    case signalIdE::ECHO_CFM:
+      return payloadLen >= ECHO_HEADER_SIZE;
+    case signalIdE::TIME_REQ:
+    case signalIdE::TIME_CFM:
+      return payloadLen == TIME_SYNC_SIZE;
+    case signalIdE::STATS_REQ:
+      return payloadLen == 0U;
+    case signalIdE::STATS_CFM:
+      return payloadLen == LINK_STATS_SIZE;
+    case signalIdE::LOOP_REQ:
+      return payloadLen == 0U;
+    case signalIdE::LOOP_CFM:
+      return payloadLen == LOOP_STATS_SIZE;
+    case signalIdE::PERF_REQ:
+      return payloadLen == PERF_REQ_SIZE;
+    case signalIdE::PERF_CFM:
+      return payloadLen == PERF_SUMMARY_SIZE || payloadLen == PERF_HISTOGRAM_SIZE;
+    case signalIdE::TRACE_REQ:
+      return payloadLen == TRACE_REQ_SIZE;
+    case signalIdE::TRACE_CFM:
+      return payloadLen >= TRACE_CFM_HEADER_SIZE
+             && payloadLen <= TRACE_CFM_HEADER_SIZE + TRACE_EVENTS_PER_CFM * TRACE_EVENT_SIZE
+             && (payloadLen - TRACE_CFM_HEADER_SIZE) % TRACE_EVENT_SIZE == 0U;
+    case signalIdE::LOG_REQ:
+      return payloadLen == LOG_REQ_SIZE;
+    case signalIdE::LOG_CFM:
+      return payloadLen >= LOG_CFM_HEADER_SIZE
+             && payloadLen <= LOG_CFM_HEADER_SIZE + LOG_RECORDS_PER_CFM * LOG_RECORD_SIZE
+             && (payloadLen - LOG_CFM_HEADER_SIZE) % LOG_RECORD_SIZE == 0U;
+    case signalIdE::STREAM_START:
+      return payloadLen == STREAM_START_SIZE || payloadLen == STREAM_START_WINDOW_SIZE;
+    case signalIdE::STREAM_DATA:
+      return payloadLen > STREAM_HEADER_SIZE && (payloadLen - STREAM_HEADER_SIZE) % STREAM_SAMPLE_SIZE == 0U;
+    case signalIdE::STREAM_SUMMARY:
+      return payloadLen >= STREAM_SUMMARY_HEADER_SIZE
+             && payloadLen <= STREAM_SUMMARY_HEADER_SIZE + STREAM_MAX_BINS * STREAM_SAMPLE_SIZE
+             && (payloadLen - STREAM_SUMMARY_HEADER_SIZE) % STREAM_SAMPLE_SIZE == 0U;
+    case signalIdE::STREAM_STOP:
+      return payloadLen == 0U;
+    }
+    return false;
+  }
+
   // ---------------------------------------------------------------------------
   // Frame decoder (byte-by-byte)
   // ---------------------------------------------------------------------------  
-  frameResult Decoder::processByte(uint8_t byte)
+  inline void Decoder::startCandidate(uint8_t sof)
   {
-    frameResult res {};
+    candidateLen_ = 0;
+    format_ = SOF_FORMAT[sof];
+    TRACE(DECODER_SOF, format_, 0, 0);
+    codewordsLen_ = 0;
+    state_ = rxStateE::LEN_READING;
+  }
+
+  // A LEN or SIG that cannot start a frame, the byte may be the next SOF
+  inline void Decoder::rejectField(uint8_t byte)
+  {
+    if (isFec())
+    {
+      // The decoded byte was never on the line, rescan the codewords
+      reject();
+      return;
+    }
+    state_ = rxStateE::SOF_WAITING;
+    if (isSof(byte))
+      startCandidate(byte);
+  }
+
+  // Kept out of line so that step() stays small enough to be inlined.
+  // Returns true with the decoded byte once both codewords are in.
+  bool Decoder::takeCodeword(uint8_t& byte)
+  {
+    const uint8_t low = FEC_DECODE[byte];
+    if (codewordsLen_ == 0U)
+    {
+      // The high nibble of LEN already tells most false SOFs apart,
+      // nothing was taken yet that would need a rescan. Noise and the
+      // payload bytes of other formats hit SOF_FEC and its neighbours,
+      // these are not counted as decoding failures.
+      if (low == FEC_UNCORRECTABLE || (low & 0x0FU) > ((MAX_PAYLOAD + 1U) >> 4))
+      {
+        ++fecStats_.falseSofs;
+        state_ = rxStateE::SOF_WAITING;
+        if (isSof(byte))
+          startCandidate(byte);
+        return false;
+      }
+      candidateCorrections_ = 0;
+    }
+
+    // Two codewords make one byte, high nibble first
+    codewords_[codewordsLen_++] = byte;
+    if (low == FEC_UNCORRECTABLE)
+    {
+      ++fecStats_.uncorrectable;
+      reject();
+      return false;
+    }
+    if ((codewordsLen_ & 1U) != 0U)
+      return false;
+
+    const uint8_t high = FEC_DECODE[codewords_[codewordsLen_ - 2U]];
+    candidateCorrections_ += static_cast<uint32_t>(((high & FEC_CORRECTED) >> 4) + ((low & FEC_CORRECTED) >> 4));
+    byte = static_cast<uint8_t>((high << 4) | (low & 0x0FU));
+    return true;
+  }
+
+  // Returns true when a valid frame was decoded
+  inline bool Decoder::step(uint8_t byte, frameResult& res)
+  {
+    if (isFec() && state_ != rxStateE::SOF_WAITING && !takeCodeword(byte))
+      return false;
 
     switch (state_)
     {
     case rxStateE::SOF_WAITING:
-      if (byte == SOF)
+      if (isSof(byte))
       {
-        bufferIndex_ = 0;
-        state_ = rxStateE::LEN_READING;
+        startCandidate(byte);
       }
       break;
 
     case rxStateE::LEN_READING:
+      candidate_[candidateLen_++] = byte;
       len_ = byte;
       if (len_ == 0U || len_ > (MAX_PAYLOAD + 1U))
       {
-        // Invalid length, reset state
-        state_ = rxStateE::SOF_WAITING;
+        // Invalid length, it may be the SOF of the next frame
+        ++stats_.lengthErrors;
+        TRACE(DECODER_LEN_ERROR, len_, 0, 0);
+        rejectField(byte);
+      }
+      else
+      {
+        state_ = rxStateE::SIG_READING;
+      }
+      break;
+
+    case rxStateE::SIG_READING:
+      candidate_[candidateLen_++] = byte;
+      if (!isPlausibleFrame(byte, len_ - 1U))
+      {
+        // Unknown signal or a length it never has. LEN was in range so
+        // it is no SOF, only SIG may start the next frame.
+        ++stats_.lengthErrors;
+        TRACE(DECODER_LEN_ERROR, len_, byte, 0);
+        rejectField(byte);
+      }
+      else if (isHeaderCheck())
+      {
+        state_ = rxStateE::HCRC_READING;
+      }
+      else
+      {
+        state_ = (len_ == 1U) ? rxStateE::CRC_READING : rxStateE::PAYLOAD_READING;
+      }
+      break;
+
+    case rxStateE::HCRC_READING:
+    {
+      candidate_[candidateLen_++] = byte;
+      const uint8_t header[] {SOF_HC, candidate_[0], candidate_[1]};
+      if (byte != crc8(header, sizeof(header)))
+      {
+        // Corrupted header, do not wait for LEN bytes
+        ++stats_.crcErrors;
+        TRACE(DECODER_CRC_ERROR, candidate_[1], byte, 1);
+        reject();
       }
       else
       {
-        bufferIndex_ = 0;
-        state_ = rxStateE::PAYLOAD_READING;
+        state_ = (len_ == 1U) ? rxStateE::CRC_READING : rxStateE::PAYLOAD_READING;
       }
       break;
+    }
 
     case rxStateE::PAYLOAD_READING:
-      // Store bytes in buffer
-      buffer_[bufferIndex_++] = byte;
-      if (bufferIndex_ >= len_)
+      candidate_[candidateLen_++] = byte;
+      // [LEN]([HCRC]) come on top of the LEN bytes of SIG + PAYLOAD
+      if (candidateLen_ >= len_ + (isHeaderCheck() ? 2U : 1U))
       {
         state_ = rxStateE::CRC_READING;
       }
@@ -92,29 +671,119 @@ namespace protocol
     case rxStateE::CRC_READING:
     {
       uint8_t received_crc = byte;
-      uint8_t calculated_crc = crc8(buffer_.data(), bufferIndex_);
-      state_ = rxStateE::SOF_WAITING;
+      uint8_t calculated_crc = isHeaderCheck()
+        ? crc8(candidate_.data(), candidateLen_)  // CRC over [LEN][SIG][HCRC][PAYLOAD...]
+        : crc8(&candidate_[1], len_);             // CRC over [SIG][PAYLOAD...]
       if (received_crc != calculated_crc)
       {
         // CRC error, frame invalid
-        res.valid = false;
-        return res;
+        ++stats_.crcErrors;
+        TRACE(DECODER_CRC_ERROR, candidate_[1], byte, 0);
+        candidate_[candidateLen_++] = byte;
+        reject();
+        return false;
       }
+      state_ = rxStateE::SOF_WAITING;
+      ++stats_.frames;
+      TRACE(DECODER_FRAME, candidate_[1], len_ - 1U, 0);
+      if (isFec())
+        fecStats_.corrected += candidateCorrections_;
+
+      res.valid = true;
+      res.frame.sigId = static_cast<signalIdE>(candidate_[1]);
+      res.frame.payloadLen = static_cast<uint8_t>(len_ - 1U);
+      std::memcpy(res.frame.payload.data(), &candidate_[isHeaderCheck() ? 3U : 2U], res.frame.payloadLen);
+      return true;
+    }
+    }
+    return false;
+  }
 
-      FrameS frame;
-      frame.sigId = static_cast<signalIdE>(buffer_[0]);
+  frameResult Decoder::processByte(uint8_t byte)
+  {
+    frameResult res {};
 
-      // Start from index 1 to skip sigId
-      for (size_t i = 1; i < bufferIndex_; ++i)
+    if (pendingLen_ == 0U)
+    {
+      // Common case, nothing to rescan. Hunting for SOF is kept inline.
+      if (state_ == rxStateE::SOF_WAITING)
       {
-        frame.payload[i - 1] = buffer_[i];
+        if (isSof(byte))
+        {
+          startCandidate(byte);
+        }
+        return res;
       }
-
-      res.valid = true;
-      res.frame = frame;
-      return res;
+      if (step(byte, res) || pendingLen_ == 0U)
+        return res;
+    }
+    else if (pendingLen_ < pending_.size())
+    {
+      // Bytes left over from a rescan come first
+      pending_[pendingLen_++] = byte;
     }
+
+    while (pendingLen_ > 0U)
+    {
+      // step() may put rejected bytes back in front of pending_
+      uint8_t next = pending_[0];
+      --pendingLen_;
+      std::memmove(pending_.data(), &pending_[1], pendingLen_);
+
+      if (step(next, res))
+        break;
     }
     return res;
   }
+
+  frameResult Decoder::processByte(uint8_t byte, uint32_t timestamp)
+  {
+    if (interByteTimeout_ != 0U
+        && (state_ != rxStateE::SOF_WAITING || pendingLen_ != 0U)
+        && static_cast<uint32_t>(timestamp - lastByteTime_) > interByteTimeout_)
+    {
+      // The sender went quiet in the middle of a frame, drop the partial frame
+      ++stats_.timeouts;
+      TRACE(DECODER_TIMEOUT, candidateLen_ + pendingLen_, 0, 0);
+      state_ = rxStateE::SOF_WAITING;
+      candidateLen_ = 0;
+      pendingLen_ = 0;
+    }
+    lastByteTime_ = timestamp;
+    return processByte(byte);
+  }
+
+  // Drop the false SOF and rescan the bytes after it from the next SOF on
+  void Decoder::reject()
+  {
+    state_ = rxStateE::SOF_WAITING;
+
+    // FEC candidates are rescanned from the codewords as received
+    const uint8_t* received = isFec() ? codewords_.data() : candidate_.data();
+    const size_t receivedLen = isFec() ? codewordsLen_ : candidateLen_;
+    size_t sof = 0;
+    while (sof < receivedLen && !isSof(received[sof]))
+    {
+      ++sof;
+    }
+    if (sof == receivedLen)
+    {
+      candidateLen_ = 0;
+      codewordsLen_ = 0;
+      return;
+    }
+
+    // The next SOF starts a new candidate right away, only the bytes
+    // after it need a rescan
+    size_t count = receivedLen - sof - 1U;
+    startCandidate(received[sof]);
+    if (count == 0U)
+      return;
+
+    // Should a rescan chain ever exceed the buffer, the newest bytes are lost
+    size_t keep = std::min(pendingLen_, pending_.size() - count);
+    std::memmove(&pending_[count], pending_.data(), keep);
+    std::memcpy(pending_.data(), &received[sof + 1U], count);
+    pendingLen_ = count + keep;
+  }
 } // namespace protocol
@@ -10,8 +10,164 @@ namespace protocol
 
   // Start of Frame Marker
   constexpr uint8_t SOF = 0xAA;
+  // Start of Frame Marker of header-checked frames
+  constexpr uint8_t SOF_HC = 0xA5;
+  // Start of Frame Marker of FEC frames, accepted with one bit flipped
+  constexpr uint8_t SOF_FEC = 0xC9;
   constexpr size_t MAX_PAYLOAD = 32;
-  constexpr size_t MAX_FRAME_SIZE = 4 + MAX_PAYLOAD; // SOF + LEN + SIG + PAYLOAD + CRC
+  constexpr size_t MAX_HC_FRAME_SIZE = 5 + MAX_PAYLOAD;        // SOF + LEN + SIG + HCRC + PAYLOAD + CRC
+  constexpr size_t MAX_FEC_FRAME_SIZE = 1 + 2 * (3 + MAX_PAYLOAD); // SOF + 2 codewords per LEN, SIG, PAYLOAD, CRC
+  // Largest encoded frame of any format
+  constexpr size_t MAX_FRAME_SIZE = MAX_FEC_FRAME_SIZE;
+
+  // Frame formats, also used as bits of the framing mask in CONNECT_REQ/CFM
+  enum class frameFormatE : uint8_t
+  {
+    BASIC           = 0x01,   ///< [SOF][LEN][SIG][PAYLOAD][CRC]
+    HEADER_CHECK    = 0x02,   ///< [SOF_HC][LEN][SIG][HCRC][PAYLOAD][CRC]
+    FEC             = 0x04    ///< [SOF_FEC] + SECDED codewords of [LEN][SIG][PAYLOAD][CRC]
+  };
+
+  // Formats this implementation can send and receive
+  constexpr uint8_t SUPPORTED_FRAME_FORMATS =
+    static_cast<uint8_t>(frameFormatE::BASIC) | static_cast<uint8_t>(frameFormatE::HEADER_CHECK)
+    | static_cast<uint8_t>(frameFormatE::FEC);
+
+  // Formats a host offers unless asked for more. Header-checked frames are
+  // opt-in like FEC: their extra byte costs more frames on a noisy line than
+  // the early header rejection saves, since the decoder rescans after a bad
+  // LEN anyway. They do let fewer corrupted frames through at high BER.
+  constexpr uint8_t DEFAULT_FRAME_FORMATS = static_cast<uint8_t>(frameFormatE::BASIC);
+
+  // Version of the capability record exchanged in CONNECT_REQ/CFM, 0 = legacy peer.
+  // Version 2 adds LOOP_REQ/CFM.
+  constexpr uint8_t PROTOCOL_VERSION = 2;
+  constexpr uint8_t LOOP_STATS_VERSION = 2;
+  // Baud rate every peer supports
+  constexpr uint32_t BASELINE_BAUD_RATE = 115200;
+  // Encoded size of CapabilitiesS
+  constexpr size_t CAPABILITIES_SIZE = 9;
+
+  // Feature bits of the capability record
+  constexpr uint8_t FEATURE_TICK_SEQ = 0x01;  ///< TICK_IND/CFM carry a sequence id (2B, LE)
+  constexpr uint8_t FEATURE_TIME_SYNC = 0x02; ///< Target answers TIME_REQ
+  constexpr uint8_t FEATURE_BUTTON_TIME = 0x04; ///< BUTTON_IND carries target timestamps
+  constexpr uint8_t FEATURE_STATS = 0x08;     ///< Target answers STATS_REQ
+  constexpr uint8_t FEATURE_PERF = 0x10;      ///< Target has cycle probes and answers PERF_REQ
+  constexpr uint8_t FEATURE_TRACE = 0x20;     ///< Target records trace points and answers TRACE_REQ
+  constexpr uint8_t FEATURE_LOG = 0x40;       ///< Target keeps a flight recorder and answers LOG_REQ
+  constexpr uint8_t FEATURE_STREAM = 0x80;    ///< Target streams samples between STREAM_START and STREAM_STOP
+  constexpr size_t TICK_SEQ_SIZE = 2;
+
+  // Payload of BAUD_REQ/CFM, the baud rate (4B, LE)
+  constexpr size_t BAUD_RATE_SIZE = 4;
+  // Time the target waits for PROBE_REQ at a new baud rate before it falls back
+  constexpr uint32_t BAUD_PROBE_TIMEOUT_MS = 500;
+  // PROBE_REQ payload, echoed by PROBE_CFM. Runs of equal bits and alternating
+  // bits fail first when the two sides disagree on the rate.
+  constexpr uint8_t BAUD_PROBE_PATTERN[] = {0x55, 0xAA, 0x00, 0xFF, 0x0F, 0xF0, 0x33, 0xCC};
+  constexpr size_t BAUD_PROBE_SIZE = sizeof(BAUD_PROBE_PATTERN);
+
+  // ECHO_REQ/CFM payload header, the sequence id (2B, LE) followed by any data
+  constexpr size_t ECHO_HEADER_SIZE = 2;
+
+  // TIME_CFM payload: SEQ (2B), target RX time T2 and TX time T3 (4B each, LE, us).
+  // TIME_REQ carries SEQ padded to the same size, so both directions take
+  // equally long on the wire and the offset estimate stays symmetric.
+  constexpr size_t TIME_SYNC_SIZE = 10;
+
+  // BUTTON_IND payload: press time and the time the frame was queued (4B each, LE, us),
+  // on the same target time base as TIME_CFM
+  constexpr size_t BUTTON_TIME_SIZE = 8;
+
+  // STATS_CFM payload, an encoded LinkStatsS. STATS_REQ is empty.
+  constexpr size_t LINK_STATS_SIZE = 32;
+
+  // Target main loop events, in the order of the LOOP_CFM latencies
+  enum class loopEventE : uint8_t
+  {
+    RX_FRAME,
+    TX_DONE,
+    TICK,
+    BUTTON,
+    STREAM,
+    COUNT
+  };
+  // LOOP_CFM payload, an encoded LoopStatsS. LOOP_REQ is empty.
+  constexpr size_t LOOP_STATS_SIZE = 2 + 4 * static_cast<size_t>(loopEventE::COUNT);
+
+  // Cycle probes of a target built with TARGET_CYCLE_PROBES
+  enum class probeIdE : uint8_t
+  {
+    RX_ISR,         ///< Target::receiver(), decoding in the UART RX interrupt
+    TX_DONE_ISR,    ///< Target::onTxDone(), including the next TX start
+    TICK_ISR,       ///< Target::incTimerMsCounter()
+    PROCESS,        ///< One Target::process() iteration that handled events
+    SAMPLE_ISR,     ///< Target::onSampleTimer(), one telemetry sample
+    COUNT
+  };
+
+  // PERF_REQ payload: [PROBE][PAGE]. PERF_CFM echoes both, page 0 is the
+  // summary [CLOCK_HZ][COUNT][MIN][MAX][AVG] (4B each, LE, cycles), the
+  // following pages carry PERF_BUCKETS_PER_PAGE histogram counts (4B each, LE).
+  constexpr size_t PERF_REQ_SIZE = 2;
+  constexpr size_t PERF_SUMMARY_SIZE = PERF_REQ_SIZE + 5 * 4;
+  constexpr size_t PERF_BUCKETS = 14;
+  constexpr size_t PERF_BUCKETS_PER_PAGE = 7;
+  constexpr size_t PERF_HISTOGRAM_SIZE = PERF_REQ_SIZE + PERF_BUCKETS_PER_PAGE * 4;
+  constexpr uint8_t PERF_PAGES = 1 + PERF_BUCKETS / PERF_BUCKETS_PER_PAGE;
+
+  // Flight recorder events of the target, see LogRecordS for the arguments
+  enum class logEventE : uint8_t
+  {
+    BOOT,             ///< Target::init()
+    STATE,            ///< State change: ARG0 old, ARG1 new state
+    TICK_TIMEOUT,     ///< Connection watchdog expired: ARG0 state
+    BAUD_RATE,        ///< UART re-initialized: ARG1 baud rate / 100
+    BAUD_FALLBACK,    ///< No PROBE_REQ at the new rate
+    BUTTON,           ///< Button pressed: ARG0 state
+    CRC_ERRORS,       ///< Errors and drops are counted per second: ARG1 count
+    LENGTH_ERRORS,
+    RX_TIMEOUTS,
+    RX_DROPS,
+    TX_DROPS,
+    UART_ERRORS,      ///< Framing, noise and parity errors and overruns
+    STREAM_DROPS,     ///< Telemetry samples dropped on a full double buffer
+    COUNT
+  };
+
+  // LOG_REQ payload: [SEQ (4B)][COUNT (2B)], LE. The target streams LOG_CFMs
+  // with the records from SEQ on, at most COUNT of them, as the TX queue drains.
+  constexpr size_t LOG_REQ_SIZE = 6;
+  // LOG_CFM payload: [HEAD (4B)][SEQ (4B)] and up to LOG_RECORDS_PER_CFM records.
+  // HEAD is the number of records ever written, SEQ the sequence number of the
+  // first record sent. A LOG_CFM without records means there is nothing from SEQ on.
+  constexpr size_t LOG_CFM_HEADER_SIZE = 8;
+  constexpr size_t LOG_RECORD_SIZE = 8;
+  constexpr size_t LOG_RECORDS_PER_CFM = 3;
+
+  // STREAM_START payload: the sample rate (4B, LE, Hz), 1 to STREAM_MAX_RATE_HZ.
+  // STREAM_STOP is empty.
+  constexpr size_t STREAM_START_SIZE = 4;
+  constexpr uint32_t STREAM_MAX_RATE_HZ = 50000;
+  // STREAM_START with a window: [RATE (4B)][WINDOW (2B)][BINS][SHIFT][LOW (2B)].
+  // The target then sends one STREAM_SUMMARY per WINDOW samples instead of
+  // STREAM_DATA, with BINS (0 to STREAM_MAX_BINS) histogram bins of 2^SHIFT
+  // values each from LOW on; values outside count in the first or last bin.
+  constexpr size_t STREAM_START_WINDOW_SIZE = 10;
+  constexpr size_t STREAM_MAX_BINS = 8;
+  // STREAM_SUMMARY payload: [SEQ (4B)][COUNT (2B)][MIN (2B)][MAX (2B)][MEAN (4B)]
+  // and BINS counts (2B each). SEQ is the number of the first sample, as in
+  // STREAM_DATA but not truncated, MEAN the average in 1/256 units.
+  constexpr size_t STREAM_SUMMARY_HEADER_SIZE = 14;
+  constexpr unsigned STREAM_MEAN_FRACTION_BITS = 8;
+  // STREAM_DATA payload: [SEQ (2B)] and as many samples (2B each, LE) as the
+  // negotiated max payload holds. SEQ is the sequence number of the first
+  // sample modulo 2^16, counting every sample taken since STREAM_START, so
+  // a jump means samples were dropped on the target or frames lost on the line.
+  constexpr size_t STREAM_HEADER_SIZE = 2;
+  constexpr size_t STREAM_SAMPLE_SIZE = 2;
+  constexpr size_t STREAM_MAX_SAMPLES = (MAX_PAYLOAD - STREAM_HEADER_SIZE) / STREAM_SAMPLE_SIZE;
 
   // Signal IDs
   enum class signalIdE : uint8_t
@@ -22,9 +178,230 @@ namespace protocol
     TICK_CFM        = 0x04,
     BUTTON_IND      = 0x05,
     BUTTON_CFM      = 0x06,
-    DISCONNECT_REQ  = 0x07
+    DISCONNECT_REQ  = 0x07,
+    BAUD_REQ        = 0x08,
+    BAUD_CFM        = 0x09,
+    PROBE_REQ       = 0x0A,
+    PROBE_CFM       = 0x0B,
+    ECHO_REQ        = 0x0C,
+    ECHO_CFM        = 0x0D,
+    TIME_REQ        = 0x0E,
+    TIME_CFM        = 0x0F,
+    STATS_REQ       = 0x10,
+    STATS_CFM       = 0x11,
+    PERF_REQ        = 0x12,
+    PERF_CFM        = 0x13,
+    TRACE_REQ       = 0x14,
+    TRACE_CFM       = 0x15,
+    LOG_REQ         = 0x16,
+    LOG_CFM         = 0x17,
+    STREAM_START    = 0x18,
+    STREAM_DATA     = 0x19,
+    STREAM_STOP     = 0x1A,
+    STREAM_SUMMARY  = 0x1B,
+    LOOP_REQ        = 0x1C,
+    LOOP_CFM        = 0x1D
+  };
+
+  // --- Payload fields -----------------------------------------------------
+
+  /**
+   * @brief Store a 16-bit value little-endian, returns the 2 bytes written.
+   */
+  size_t writeUint16(uint16_t value, uint8_t* out);
+
+  /**
+   * @brief Load a 16-bit little-endian value.
+   */
+  uint16_t readUint16(const uint8_t* data);
+
+  /**
+   * @brief Store a 32-bit value little-endian, returns the 4 bytes written.
+   */
+  size_t writeUint32(uint32_t value, uint8_t* out);
+
+  /**
+   * @brief Load a 32-bit little-endian value.
+   */
+  uint32_t readUint32(const uint8_t* data);
+
+  // --- Capabilities -----------------------------------------------------
+
+  /**
+   * @brief Capability record carried by CONNECT_REQ and CONNECT_CFM.
+   *
+   * CONNECT_REQ carries what the host supports, CONNECT_CFM the configuration
+   * the target chose from both records. The defaults are the baseline that a
+   * legacy peer with an empty payload gets.
+   */
+  struct CapabilitiesS
+  {
+    uint8_t version {0};                          ///< PROTOCOL_VERSION of the sender
+    uint8_t maxPayload {MAX_PAYLOAD};             ///< Largest payload the sender accepts
+    uint8_t frameFormats {static_cast<uint8_t>(frameFormatE::BASIC)}; ///< Framing mask
+    uint32_t maxBaudRate {BASELINE_BAUD_RATE};    ///< Highest baud rate the sender can run
+    uint8_t rxQueueDepth {1};                     ///< Frames the sender buffers before handling them
+    uint8_t features {0};                         ///< FEATURE_* bits
   };
 
+  /**
+   * @brief Encode a capability record, returns CAPABILITIES_SIZE.
+   *
+   * Layout: [VERSION][MAX_PAYLOAD][FRAME_FORMATS][MAX_BAUD (4B, LE)][RX_QUEUE][FEATURES]
+   */
+  size_t encodeCapabilities(const CapabilitiesS& caps, uint8_t* out);
+
+  /**
+   * @brief Decode a capability record. Fields missing from a short record keep
+   * their baseline value, an empty record gives the baseline.
+   */
+  CapabilitiesS decodeCapabilities(const uint8_t* data, size_t len);
+
+  /**
+   * @brief Best configuration both sides support. frameFormats of the result
+   * holds the single format chosen by selectFrameFormat().
+   */
+  CapabilitiesS negotiateCapabilities(const CapabilitiesS& local, const CapabilitiesS& peer);
+
+  // --- Link statistics -----------------------------------------------------
+
+  /**
+   * @brief Link and queue counters of the target, carried by STATS_CFM.
+   *
+   * All counters run from start and wrap. The error and drop counters are
+   * sent as their low 16 bits, so a reader takes differences modulo 2^16.
+   */
+  struct LinkStatsS
+  {
+    uint32_t rxBytes {0};
+    uint32_t txBytes {0};
+    uint32_t rxFrames {0};          ///< Valid frames decoded
+    uint32_t txFrames {0};          ///< Frames queued for transmission
+    uint32_t crcErrors {0};         ///< Frame or header CRC mismatches
+    uint32_t lengthErrors {0};      ///< LEN out of range or not fitting the SIG
+    uint32_t rxTimeouts {0};        ///< Partial frames dropped on the inter-byte timeout
+    uint32_t rxQueueDrops {0};      ///< Decoded frames lost to a full RX queue
+    uint32_t txQueueDrops {0};      ///< Frames lost to a full TX queue, any class
+    uint32_t uartErrors {0};        ///< Framing, noise and parity errors
+    uint32_t uartOverruns {0};
+    uint8_t rxQueueHighWater {0};   ///< Most frames ever waiting in the RX queue
+    uint8_t txQueueHighWater {0};
+  };
+
+  /**
+   * @brief Encode link statistics, returns LINK_STATS_SIZE.
+   *
+   * Layout: [RX_BYTES][TX_BYTES][RX_FRAMES][TX_FRAMES] (4B each, LE),
+   * [CRC][LEN][TIMEOUT][RX_DROP][TX_DROP][UART_ERR][UART_ORE] (2B each, LE),
+   * [RX_HWM][TX_HWM]
+   */
+  size_t encodeLinkStats(const LinkStatsS& stats, uint8_t* out);
+
+  /**
+   * @brief Decode link statistics, a short record gives all zero.
+   */
+  LinkStatsS decodeLinkStats(const uint8_t* data, size_t len);
+
+  /**
+   * @brief Target main loop load, carried by LOOP_CFM.
+   */
+  struct LoopStatsS
+  {
+    uint16_t dutyCyclePermille {0};     ///< Awake time over the last statistics window
+    uint32_t maxLatencyUs[static_cast<size_t>(loopEventE::COUNT)] {};  ///< Worst event-to-handler latency since start
+  };
+
+  /**
+   * @brief Encode main loop statistics, returns LOOP_STATS_SIZE.
+   *
+   * Layout: [DUTY] (2B, LE, permille), then one LATENCY per loopEventE (4B each, LE, us)
+   */
+  size_t encodeLoopStats(const LoopStatsS& stats, uint8_t* out);
+
+  /**
+   * @brief Decode main loop statistics, a short record gives all zero.
+   */
+  LoopStatsS decodeLoopStats(const uint8_t* data, size_t len);
+
+  /**
+   * @brief Name of a loopEventE for reports.
+   */
+  const char* loopEventName(uint8_t event);
+
+  // --- Flight recorder -----------------------------------------------------
+
+  /**
+   * @brief One flight recorder record, LOG_RECORD_SIZE bytes on the wire.
+   *
+   * Layout: [TIME (4B, LE, ms since start)][EVENT][ARG0][ARG1 (2B, LE)]
+   */
+  struct LogRecordS
+  {
+    uint32_t timeMs {0};
+    uint8_t event {0};    ///< logEventE
+    uint8_t arg0 {0};
+    uint16_t arg1 {0};
+  };
+
+  /**
+   * @brief Encode a record, returns LOG_RECORD_SIZE.
+   */
+  size_t encodeLogRecord(const LogRecordS& record, uint8_t* out);
+  LogRecordS decodeLogRecord(const uint8_t* data);
+
+  /**
+   * @brief Name of a logEventE for dumps.
+   */
+  const char* logEventName(uint8_t event);
+
+  // --- Telemetry stream ----------------------------------------------------
+
+  /**
+   * @brief Window of a STREAM_START, samples 0 streams raw STREAM_DATA.
+   */
+  struct StreamWindowS
+  {
+    uint16_t samples {0};   ///< Samples per STREAM_SUMMARY
+    uint8_t bins {0};       ///< Histogram bins, 0 to STREAM_MAX_BINS
+    uint8_t binShift {0};   ///< Each bin spans 2^binShift values, 0 to 15
+    uint16_t binLow {0};    ///< First value of bin 0
+  };
+
+  /**
+   * @brief Encode a STREAM_START payload, returns STREAM_START_SIZE without
+   * a window and STREAM_START_WINDOW_SIZE with one.
+   */
+  size_t encodeStreamStart(uint32_t rateHz, const StreamWindowS& window, uint8_t* out);
+
+  /**
+   * @brief Window of a STREAM_START payload, samples 0 for a raw stream.
+   */
+  StreamWindowS decodeStreamWindow(const uint8_t* data, size_t len);
+
+  /**
+   * @brief One window of samples, carried by STREAM_SUMMARY.
+   */
+  struct StreamSummaryS
+  {
+    uint32_t seq {0};       ///< Number of the first sample since STREAM_START
+    uint16_t count {0};     ///< Samples in the window, fewer than the window size after STREAM_STOP
+    uint16_t min {0};
+    uint16_t max {0};
+    uint32_t mean {0};      ///< In 1 / 2^STREAM_MEAN_FRACTION_BITS units
+    uint8_t bins {0};
+    uint16_t binCounts[STREAM_MAX_BINS] {};
+  };
+
+  /**
+   * @brief Encode a summary, returns STREAM_SUMMARY_HEADER_SIZE plus 2 bytes per bin.
+   */
+  size_t encodeStreamSummary(const StreamSummaryS& summary, uint8_t* out);
+
+  /**
+   * @brief Decode a summary of a STREAM_SUMMARY payload of len bytes.
+   */
+  StreamSummaryS decodeStreamSummary(const uint8_t* data, size_t len);
+
   // --- Frame structure -----------------------------------------------------
 
   // Protocol frame structure
@@ -32,6 +409,7 @@ namespace protocol
   {
     signalIdE sigId {};
     std::array<uint8_t, MAX_PAYLOAD> payload {}; ///< optional payload data
+    uint8_t payloadLen {0};                      ///< number of valid payload bytes
   };
 
   // Result of frame decoding
@@ -54,33 +432,138 @@ namespace protocol
    * - LEN = number of bytes: SIG + PAYLOAD
    * - SIG = Signal ID
    * - PAYLOAD = optional payload data
-   * - CRC = CRC8 over [LEN][SIG][PAYLOAD...]
+   * - CRC = CRC8 over [SIG][PAYLOAD...]
+   *
+   * Header-checked format:
+   *   [SOF_HC][LEN][SIG][HCRC][PAYLOAD...][CRC]
+   *
+   * - SOF_HC = Start of Frame marker (0xA5)
+   * - HCRC = CRC8 over [SOF_HC][LEN][SIG]
+   * - CRC = CRC8 over [LEN][SIG][HCRC][PAYLOAD...]
+   *
+   * FEC format:
+   *   [SOF_FEC][LEN][SIG][PAYLOAD...][CRC]
+   *
+   * - SOF_FEC = Start of Frame marker (0xC9)
+   * - Every byte after SOF_FEC is sent as two SECDED(8,4) codewords, high
+   *   nibble first. A single bit error per codeword is corrected, two are
+   *   detected.
+   * - CRC = CRC8 over [SIG][PAYLOAD...] as in the basic format
    */
   size_t encodeFrame(
     signalIdE sigId,
     const uint8_t* payload,
     size_t payloadLen,
-    uint8_t* outFrame);
+    uint8_t* outFrame,
+    frameFormatE format = frameFormatE::BASIC);
+
+  /**
+   * @brief Pick the format to use from a framing mask.
+   * The most robust format wins, an empty mask (legacy peer) selects BASIC.
+   */
+  frameFormatE selectFrameFormat(uint8_t offeredMask);
+
+  const char* frameFormatName(frameFormatE format);
   
   // CRC8 calculation
   uint8_t crc8(const uint8_t* data, size_t);
+
+  /**
+   * @brief Check that a signal is known and may carry payloadLen bytes.
+   */
+  bool isPlausibleFrame(uint8_t sigId, size_t payloadLen);
   
-  // Byte-wise frame decoder with interanl state machine
+  // Rejection counters of a Decoder
+  struct DecoderStatsS
+  {
+    uint32_t frames {0};          ///< Valid frames returned
+    uint32_t crcErrors {0};       ///< Candidates dropped for a CRC or HCRC mismatch
+    uint32_t lengthErrors {0};    ///< Candidates dropped for LEN, or SIG that LEN does not fit
+    uint32_t timeouts {0};        ///< Partial frames dropped on the inter-byte timeout
+  };
+
+  // Forward error correction counters of a Decoder
+  struct FecStatsS
+  {
+    uint32_t corrected {0};       ///< Codewords corrected in delivered frames
+    uint32_t uncorrectable {0};   ///< FEC candidates dropped for a double bit error after LEN
+    uint32_t falseSofs {0};       ///< FEC candidates dropped at the first codeword, most likely a false SOF
+  };
+
+  /**
+   * @brief Byte-wise frame decoder with interanl state machine.
+   *
+   * All frame formats are accepted at any time, they are told apart by
+   * their SOF. A header-checked frame with a bad HCRC is rejected right
+   * after its header. FEC codewords are decoded in pairs and the resulting
+   * bytes run through the same states as a basic frame.
+   *
+   * A candidate frame is rejected as early as possible: LEN out of range,
+   * unknown SIG or a LEN that does not fit the SIG, and finally a CRC
+   * mismatch. The bytes after a rejected SOF are rescanned for the next
+   * SOF, so a false SOF in line noise does not swallow the real frame
+   * behind it. The rescan window is bounded by MAX_FRAME_SIZE, which bounds
+   * the worst-case work per input byte.
+   *
+   * At most one frame is returned per call. If a rescan completes a frame
+   * before all rescanned bytes are consumed, the rest is processed on the
+   * next call(s).
+   *
+   * With an inter-byte timeout set, a partial frame is abandoned when the
+   * sender goes quiet for longer than the timeout, so a frame that lost a
+   * byte does not eat into the next one.
+   */
   class Decoder
   {
   public:
     frameResult processByte(uint8_t byte);
+
+    /**
+     * @brief Process a byte received at timestamp.
+     * Timestamp and timeout use the caller's time unit and may wrap.
+     * Bytes of one chunk may share a timestamp.
+     */
+    frameResult processByte(uint8_t byte, uint32_t timestamp);
+
+    /**
+     * @brief Maximum gap between two bytes of a frame, 0 = no timeout (default).
+     */
+    void setInterByteTimeout(uint32_t timeout) { interByteTimeout_ = timeout; }
+
+    const DecoderStatsS& stats() const { return stats_; }
+    const FecStatsS& fecStats() const { return fecStats_; }
   private:
     enum class rxStateE
     {
       SOF_WAITING,
       LEN_READING,
+      SIG_READING,
+      HCRC_READING,
       PAYLOAD_READING,
       CRC_READING
     };
+
+    bool step(uint8_t byte, frameResult& res);
+    bool takeCodeword(uint8_t& byte);
+    void startCandidate(uint8_t sof);
+    void reject();
+    void rejectField(uint8_t byte);
+    bool isHeaderCheck() const { return format_ == static_cast<uint8_t>(frameFormatE::HEADER_CHECK); }
+    bool isFec() const { return format_ == static_cast<uint8_t>(frameFormatE::FEC); }
+
     rxStateE state_ {rxStateE::SOF_WAITING};
     uint8_t len_ {0};
-    std::array<uint8_t, MAX_PAYLOAD + 1> buffer_ {}; // +1 for sigId
-    size_t bufferIndex_ {0};
+    uint8_t format_ {0};                                // frameFormatE of the candidate's SOF
+    std::array<uint8_t, MAX_HC_FRAME_SIZE> candidate_ {}; // [LEN][SIG]([HCRC])[PAYLOAD...] after SOF
+    size_t candidateLen_ {0};
+    std::array<uint8_t, MAX_FEC_FRAME_SIZE - 1U> codewords_ {}; // Received codewords of an FEC candidate
+    size_t codewordsLen_ {0};
+    uint32_t candidateCorrections_ {0};
+    DecoderStatsS stats_ {};
+    FecStatsS fecStats_ {};
+    std::array<uint8_t, 2 * MAX_FRAME_SIZE> pending_ {}; // Bytes waiting for a rescan
+    size_t pendingLen_ {0};
+    uint32_t interByteTimeout_ {0};
+    uint32_t lastByteTime_ {0};
   };
 } // namespace protocol
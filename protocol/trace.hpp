@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Build with PROTOCOL_TRACE=1 to record trace points, TRACE() is empty otherwise
+#ifndef PROTOCOL_TRACE
+#define PROTOCOL_TRACE 0
+#endif
+
+namespace protocol
+{
+  // Trace point ids, shared by the target and the host so both rings decode the same way
+  enum class traceIdE : uint8_t
+  {
+    // Decoder, on both sides
+    DECODER_SOF,          ///< Candidate started: format
+    DECODER_FRAME,        ///< Valid frame: SIG, payload length
+    DECODER_LEN_ERROR,    ///< Candidate rejected: LEN, SIG
+    DECODER_CRC_ERROR,    ///< Candidate rejected: SIG, received CRC, 1 = header CRC
+    DECODER_TIMEOUT,      ///< Partial frame dropped on the inter-byte timeout: bytes taken
+    // Target
+    TARGET_STATE,         ///< State change: old, new
+    TARGET_RX_PUSH,       ///< Decoded frame queued: SIG, queue size
+    TARGET_RX_DROP,       ///< RX queue full: SIG
+    TARGET_RX_POP,        ///< Frame handled: SIG
+    TARGET_TX_PUSH,       ///< Frame queued: SIG, queue size, frame bytes
+    TARGET_TX_DROP,       ///< TX queue full: SIG
+    TARGET_TX_START,      ///< Transfer started: frames, bytes
+    TARGET_TX_DONE,       ///< Transfer complete: frames
+    TARGET_BAUD,          ///< UART re-initialized: baud rate / 9600
+    TARGET_UART_ERROR,    ///< HAL_UART_ERROR_* bits
+    // Host
+    HOST_STATE,           ///< State change: new
+    HOST_TX,              ///< Frame written: SIG, payload length
+    HOST_RX,              ///< Frame handled: SIG, payload length
+    HOST_LINK_LOST,       ///< Watchdog expired: seconds since the last frame
+    COUNT
+  };
+
+  /**
+   * @brief One trace event, 8 bytes in RAM and on the wire.
+   *
+   * timeUs is Target::timestampUs() on the target and the low 32 bits of the
+   * steady clock in microseconds on the host.
+   */
+  struct TraceEventS
+  {
+    uint32_t timeUs {0};
+    uint8_t id {0};         ///< traceIdE
+    uint8_t args[3] {};
+  };
+
+  // Encoded TraceEventS: [TIME (4B, LE)][ID][ARG0][ARG1][ARG2]
+  constexpr size_t TRACE_EVENT_SIZE = 8;
+  // TRACE_REQ payload: [SEQ (4B, LE)][FLAGS], SEQ is the first event wanted
+  constexpr size_t TRACE_REQ_SIZE = 5;
+  // Stop recording until a TRACE_REQ without it or the next CONNECT_REQ, so the
+  // frames of the readout do not overwrite the events being read
+  constexpr uint8_t TRACE_FREEZE = 0x01;
+  // TRACE_CFM payload: [HEAD (4B)][SEQ (4B)] and up to TRACE_EVENTS_PER_CFM events.
+  // HEAD is the number of events ever written, SEQ the sequence number of the
+  // first event sent. No events means the reader has caught up.
+  constexpr size_t TRACE_CFM_HEADER_SIZE = 8;
+  constexpr size_t TRACE_EVENTS_PER_CFM = 3;
+
+  /**
+   * @brief Fixed ring of the last N trace events, oldest overwritten first.
+   *
+   * Events are addressed by sequence number, the count of events written
+   * before them. Not thread-safe.
+   */
+  template<size_t N>
+  class TraceRing
+  {
+  public:
+    static_assert(N != 0U && (N & (N - 1U)) == 0U, "TraceRing size must be a power of two");
+    static constexpr size_t CAPACITY = N;
+
+    void push(const TraceEventS& event)
+    {
+      events_[head_ & (N - 1U)] = event;
+      ++head_;
+    }
+
+    /**
+     * @brief Sequence number of the next event, the number ever written.
+     */
+    uint32_t head() const { return head_; }
+
+    /**
+     * @brief Sequence number of the oldest event still in the ring.
+     */
+    uint32_t oldest() const { return head_ > N ? head_ - static_cast<uint32_t>(N) : 0U; }
+
+    /**
+     * @brief Event seq, false if it was overwritten or not written yet.
+     */
+    bool get(uint32_t seq, TraceEventS& event) const
+    {
+      if (seq < oldest() || seq >= head_)
+        return false;
+      event = events_[seq & (N - 1U)];
+      return true;
+    }
+
+  private:
+    TraceEventS events_[N] {};
+    uint32_t head_ {0};
+  };
+
+  /**
+   * @brief Record one event. Defined by each program that builds with
+   * PROTOCOL_TRACE, use the TRACE() macro rather than calling it.
+   */
+  void traceWrite(traceIdE id, uint8_t arg0, uint8_t arg1, uint8_t arg2);
+
+  /**
+   * @brief Encode an event, returns TRACE_EVENT_SIZE.
+   */
+  size_t encodeTraceEvent(const TraceEventS& event, uint8_t* out);
+  TraceEventS decodeTraceEvent(const uint8_t* data);
+
+  /**
+   * @brief Name of a trace point for dumps.
+   */
+  const char* traceName(uint8_t id);
+} // namespace protocol
+
+#if PROTOCOL_TRACE
+#define TRACE(id, arg0, arg1, arg2) \
+  ::protocol::traceWrite(::protocol::traceIdE::id, static_cast<uint8_t>(arg0), \
+                         static_cast<uint8_t>(arg1), static_cast<uint8_t>(arg2))
+#else
+#define TRACE(id, arg0, arg1, arg2) do { } while (0)
+#endif
@@ -0,0 +1,308 @@
+#include "board.hpp"
+
+#include <cassert>
+#include <cmath>
+
+namespace sim
+{
+  namespace
+  {
+    thread_local Board* currentBoard = nullptr;
+
+    constexpr uint64_t NS_PER_CYCLE = 1000000000ULL / Board::CORE_CLOCK_HZ;
+    constexpr uint64_t BITS_PER_BYTE = 10; // 8N1
+    constexpr uint64_t NS_PER_TIMER_COUNT = 1000;  // TIM10 runs at 1 MHz
+    constexpr uint64_t TIMER_REGISTER_MASK = 0xFFFF; // 16-bit PSC and ARR of TIM10/TIM11
+  }
+
+  constexpr uint64_t Board::TICK_PERIOD_NS;
+  constexpr uint64_t Board::CORE_CLOCK_HZ;
+
+  Board::Board(Clock& clock, UartPort& uart)
+    : clock_{clock}, uart_{uart}
+  {
+  }
+
+  Board& Board::current()
+  {
+    assert(currentBoard != nullptr && "HAL call outside of a simulated board");
+    return *currentBoard;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Execution
+  // ---------------------------------------------------------------------------
+  void Board::start()
+  {
+    currentBoard = this;
+
+    // MX_USART1_UART_Init()
+    uartInit(huart1_);
+
+    // HAL_TIM_Base_Start_IT(&htim10)
+    tickRunning_ = true;
+    tickStartNs_ = localNs(clock_.nowNs());
+    nextTickNs_ = tickStartNs_ + TICK_PERIOD_NS;
+
+    target_.init();
+  }
+
+  void Board::step()
+  {
+    currentBoard = this;
+    wfi_ = false;
+    dispatch();
+    target_.process();
+  }
+
+  bool Board::sleeping() const
+  {
+    return wfi_ && nextEventNs() > clock_.nowNs();
+  }
+
+  uint64_t Board::nextEventNs() const
+  {
+    if (buttonPending_)
+      return 0;
+
+    uint64_t next = tickRunning_ ? clockNs(nextTickNs_) : NEVER;
+    if (sampleRunning_ && clockNs(nextSampleNs_) < next)
+      next = clockNs(nextSampleNs_);
+    if (txBusy_ && txDoneNs_ < next)
+      next = txDoneNs_;
+    if (uart_.nextEventNs() < next)
+      next = uart_.nextEventNs();
+    if (buttons_ != nullptr && buttons_->nextPressNs() < next)
+      next = buttons_->nextPressNs();
+    return next;
+  }
+
+  void Board::pressButton()
+  {
+    buttonPending_ = true;
+  }
+
+  void Board::enableIrq()
+  {
+    primask_ = 0U;
+    dispatch();
+  }
+
+  // ---------------------------------------------------------------------------
+  // Interrupt delivery, mirrors the callbacks in target/Core/Src/main.cpp
+  // ---------------------------------------------------------------------------
+  void Board::dispatch()
+  {
+    if (primask_ != 0U || inIsr_)
+      return;
+
+    inIsr_ = true;
+    const uint64_t now = clock_.nowNs();
+
+    // HAL_TIM_PeriodElapsedCallback
+    while (tickRunning_ && nextTickNs_ <= localNs(now))
+    {
+      nextTickNs_ += TICK_PERIOD_NS;
+      target_.incTimerMsCounter();
+    }
+
+    // HAL_TIM_PeriodElapsedCallback, TIM11
+    while (sampleRunning_ && nextSampleNs_ <= localNs(now))
+    {
+      nextSampleNs_ += samplePeriodNs_;
+      target_.onSampleTimer();
+    }
+
+    // HAL_UART_TxCpltCallback
+    if (txBusy_ && txDoneNs_ <= now)
+    {
+      txBusy_ = false;
+      target_.onTxDone();
+    }
+
+    // HAL_UART_RxCpltCallback
+    uart_.poll(now);
+    uint8_t byte;
+    while (rxRemaining_ != 0U && uart_.read(byte, now))
+    {
+      *rxData_++ = byte;
+      if (--rxRemaining_ == 0U)
+      {
+        target_.receiver();
+      }
+    }
+
+    // HAL_GPIO_EXTI_Callback
+    if (buttons_ != nullptr && buttons_->nextPressNs() <= now)
+    {
+      buttons_->advance();
+      buttonPending_ = true;
+    }
+    if (buttonPending_)
+    {
+      buttonPending_ = false;
+      target_.handleButtonPress();
+    }
+
+    inIsr_ = false;
+  }
+
+  // ---------------------------------------------------------------------------
+  // USART1
+  // ---------------------------------------------------------------------------
+  uint64_t Board::byteTimeNs() const
+  {
+    return BITS_PER_BYTE * 1000000000ULL / baudRate_;
+  }
+
+  HAL_StatusTypeDef Board::uartInit(const UART_HandleTypeDef& huart)
+  {
+    if (huart.Init.BaudRate == 0U)
+      return HAL_ERROR;
+
+    baudRate_ = huart.Init.BaudRate;
+    uart_.setBaudRate(baudRate_);
+    return HAL_OK;
+  }
+
+  HAL_StatusTypeDef Board::uartTransmit(const uint8_t* data, uint16_t size)
+  {
+    if (txBusy_)
+      return HAL_BUSY;
+    if (data == nullptr || size == 0U)
+      return HAL_ERROR;
+
+    const uint64_t now = clock_.nowNs();
+    uart_.write(data, size, now);
+    txBusy_ = true;
+    txDoneNs_ = now + size * byteTimeNs();
+    return HAL_OK;
+  }
+
+  HAL_StatusTypeDef Board::uartReceive(uint8_t* data, uint16_t size)
+  {
+    if (rxRemaining_ != 0U)
+      return HAL_BUSY;
+    if (data == nullptr || size == 0U)
+      return HAL_ERROR;
+
+    rxData_ = data;
+    rxRemaining_ = size;
+    return HAL_OK;
+  }
+
+  // ---------------------------------------------------------------------------
+  // TIM11
+  // ---------------------------------------------------------------------------
+  HAL_StatusTypeDef Board::sampleTimerInit(const TIM_HandleTypeDef& htim)
+  {
+    // Counts the 100 MHz timer clock divided by Prescaler + 1, updates after Period + 1 counts.
+    // PSC and ARR of TIM11 are 16 bits wide, larger values are truncated as on the chip.
+    samplePeriodNs_ = ((htim.Init.Prescaler & TIMER_REGISTER_MASK) + 1U)
+                      * ((htim.Init.Period & TIMER_REGISTER_MASK) + 1U) * NS_PER_CYCLE;
+    return HAL_OK;
+  }
+
+  HAL_StatusTypeDef Board::sampleTimerStart(bool start)
+  {
+    if (start && samplePeriodNs_ == 0U)
+      return HAL_ERROR;
+
+    sampleRunning_ = start;
+    nextSampleNs_ = localNs(clock_.nowNs()) + samplePeriodNs_;
+    return HAL_OK;
+  }
+
+  // ---------------------------------------------------------------------------
+  // GPIO
+  // ---------------------------------------------------------------------------
+  uint16_t& Board::outputRegister(const GPIO_TypeDef* port)
+  {
+    return odr_[static_cast<size_t>(port->name - 'A') % 8U];
+  }
+
+  bool Board::pinState(const GPIO_TypeDef* port, uint16_t pin) const
+  {
+    return (odr_[static_cast<size_t>(port->name - 'A') % 8U] & pin) != 0U;
+  }
+
+  void Board::gpioWrite(const GPIO_TypeDef* port, uint16_t pin, bool set)
+  {
+    uint16_t& odr = outputRegister(port);
+    const uint16_t previous = odr;
+    odr = set ? static_cast<uint16_t>(odr | pin) : static_cast<uint16_t>(odr & ~pin);
+
+    if (gpioTrace_ == nullptr || odr == previous)
+      return;
+
+    const uint64_t nowUs = clock_.nowNs() / 1000U;
+    for (unsigned bit = 0; bit < 16U; ++bit)
+    {
+      if ((pin & (1U << bit)) != 0U)
+      {
+        *gpioTrace_ << nowUs << " P" << port->name << bit << '=' << (set ? 1 : 0) << '\n';
+      }
+    }
+  }
+
+  void Board::gpioToggle(const GPIO_TypeDef* port, uint16_t pin)
+  {
+    // Toggle each pin separately so the trace shows the resulting level
+    for (unsigned bit = 0; bit < 16U; ++bit)
+    {
+      const uint16_t mask = static_cast<uint16_t>(1U << bit);
+      if ((pin & mask) != 0U)
+      {
+        gpioWrite(port, mask, !pinState(port, mask));
+      }
+    }
+  }
+
+  // ---------------------------------------------------------------------------
+  // DWT cycle counter
+  // ---------------------------------------------------------------------------
+  uint32_t Board::cycleCounter() const
+  {
+    return static_cast<uint32_t>(localNs(clock_.nowNs()) / NS_PER_CYCLE - cycleOffset_);
+  }
+
+  void Board::setCycleCounter(uint32_t value)
+  {
+    cycleOffset_ = localNs(clock_.nowNs()) / NS_PER_CYCLE - value;
+  }
+
+  // ---------------------------------------------------------------------------
+  // TIM10 counter and the skewed board clock
+  // ---------------------------------------------------------------------------
+  uint32_t Board::timerCounter() const
+  {
+    // Keeps counting through the update even while the interrupt is held off
+    const uint64_t counts = (localNs(clock_.nowNs()) - tickStartNs_) / NS_PER_TIMER_COUNT;
+    return static_cast<uint32_t>(counts % (TICK_PERIOD_NS / NS_PER_TIMER_COUNT));
+  }
+
+  uint32_t Board::timerStatus() const
+  {
+    // UIF is set at the update and cleared when its interrupt is taken
+    return tickRunning_ && nextTickNs_ <= localNs(clock_.nowNs()) ? TIM_SR_UIF : 0U;
+  }
+
+  uint64_t Board::localNs(uint64_t nowNs) const
+  {
+    if (clockSkewPpm_ == 0.0)
+      return nowNs;
+    return static_cast<uint64_t>(static_cast<double>(nowNs) * (1.0 + clockSkewPpm_ * 1e-6));
+  }
+
+  uint64_t Board::clockNs(uint64_t boardNs) const
+  {
+    if (clockSkewPpm_ == 0.0 || boardNs == NEVER)
+      return boardNs;
+    // First clock time at which the board has reached boardNs
+    uint64_t nowNs = static_cast<uint64_t>(
+      std::ceil(static_cast<double>(boardNs) / (1.0 + clockSkewPpm_ * 1e-6)));
+    while (localNs(nowNs) < boardNs)
+      ++nowNs;
+    return nowNs;
+  }
+} // namespace sim
@@ -0,0 +1,193 @@
+#pragma once
+
+extern "C" {
+  #include "main.h"
+}
+
+#include "clock.hpp"
+#include "uartPort.hpp"
+#include "target.hpp"
+
+#include <cstdint>
+#include <ostream>
+
+namespace sim
+{
+  /**
+   * @brief Source of scheduled user button presses.
+   */
+  class ButtonSource
+  {
+  public:
+    virtual ~ButtonSource() = default;
+    /// Time of the next press, NEVER if there is none
+    virtual uint64_t nextPressNs() const = 0;
+    /// Called once the press returned by nextPressNs() was delivered
+    virtual void advance() = 0;
+  };
+
+  /**
+   * @brief One simulated STM32F411 board running the unmodified Target.
+   *
+   * The board plays the role of the MCU peripherals: it implements the HAL
+   * fake for the thread it is stepped on and raises the same interrupt
+   * callbacks as target/Core/Src/main.cpp (TIM10 tick, TIM11 sample timer,
+   * USART1 RX/TX, EXTI0).
+   *
+   * Interrupts are delivered only when PRIMASK is clear: before each
+   * process() call and whenever the target re-enables interrupts, which
+   * mirrors how pending IRQs are taken on the real core.
+   */
+  class Board
+  {
+  public:
+    static constexpr uint64_t TICK_PERIOD_NS = 1000000;   // TIM10: 1 ms
+    static constexpr uint64_t CORE_CLOCK_HZ  = 100000000; // SYSCLK: 100 MHz
+
+    Board(Clock& clock, UartPort& uart);
+
+    Board(const Board&) = delete;
+    Board& operator=(const Board&) = delete;
+
+    /**
+     * @brief Board running on the calling thread (target of HAL calls).
+     */
+    static Board& current();
+
+    /**
+     * @brief Equivalent of the reset sequence in main(): start TIM10 and init Target.
+     */
+    void start();
+
+    /**
+     * @brief Deliver due interrupts and run one Target::process() iteration.
+     */
+    void step();
+
+    /**
+     * @brief True if the last iteration went to WFI and no interrupt is due.
+     */
+    bool sleeping() const;
+
+    /**
+     * @brief Earliest time an interrupt becomes due (NEVER if none is scheduled).
+     */
+    uint64_t nextEventNs() const;
+
+    /**
+     * @brief Raise the EXTI0 user button interrupt.
+     */
+    void pressButton();
+
+    /**
+     * @brief Press the button at the times given by source (not owned).
+     */
+    void setButtonSource(ButtonSource* source) { buttons_ = source; }
+
+    /**
+     * @brief Run the board crystal ppm parts per million fast (negative: slow).
+     * Scales TIM10 and the DWT cycle counter, call before start().
+     */
+    void setClockSkewPpm(double ppm) { clockSkewPpm_ = ppm; }
+
+    /**
+     * @brief Record every GPIO output change as "<time_us> P<port><pin>=<level>".
+     */
+    void setGpioTrace(std::ostream* trace) { gpioTrace_ = trace; }
+
+    /**
+     * @brief Rate MX_USART1_UART_Init() sets up, call before start().
+     */
+    void setDefaultBaudRate(uint32_t baudRate) { huart1_.Init.BaudRate = baudRate; }
+
+    bool pinState(const GPIO_TypeDef* port, uint16_t pin) const;
+    uint32_t baudRate() const { return baudRate_; }
+
+    Target& target() { return target_; }
+    const Clock& clock() const { return clock_; }
+    UartPort& uart() { return uart_; }
+
+    // --- HAL fake backend ----------------------------------------------------
+
+    HAL_StatusTypeDef uartInit(const UART_HandleTypeDef& huart);
+    HAL_StatusTypeDef uartTransmit(const uint8_t* data, uint16_t size);
+    HAL_StatusTypeDef uartReceive(uint8_t* data, uint16_t size);
+
+    void gpioWrite(const GPIO_TypeDef* port, uint16_t pin, bool set);
+    void gpioToggle(const GPIO_TypeDef* port, uint16_t pin);
+
+    uint32_t primask() const { return primask_; }
+    void disableIrq() { primask_ = 1U; }
+    void enableIrq();
+    void waitForInterrupt() { wfi_ = true; }
+
+    uint32_t cycleCounter() const;
+    void setCycleCounter(uint32_t value);
+    DWT_Type& dwt() { return dwt_; }
+    CoreDebug_Type& coreDebug() { return coreDebug_; }
+
+    uint32_t timerCounter() const;
+    uint32_t timerStatus() const;
+    TIM_TypeDef& tim10() { return tim10_; }
+    TIM_TypeDef& tim11() { return tim11_; }
+
+    // huart1 and htim11 of main.cpp, see the HAL fake
+    UART_HandleTypeDef& uartHandle() { return huart1_; }
+    TIM_HandleTypeDef& sampleTimerHandle() { return htim11_; }
+
+    HAL_StatusTypeDef sampleTimerInit(const TIM_HandleTypeDef& htim);
+    HAL_StatusTypeDef sampleTimerStart(bool start);
+
+  private:
+    void dispatch();
+    uint64_t byteTimeNs() const;
+    uint64_t localNs(uint64_t nowNs) const;
+    uint64_t clockNs(uint64_t boardNs) const;
+    uint16_t& outputRegister(const GPIO_TypeDef* port);
+
+    Clock& clock_;
+    UartPort& uart_;
+    Target target_;
+
+    // Core
+    uint32_t primask_ {0};
+    bool inIsr_ {false};
+    bool wfi_ {false};
+    uint64_t cycleOffset_ {0};
+    DWT_Type dwt_ {};
+    CoreDebug_Type coreDebug_ {};
+    double clockSkewPpm_ {0.0};
+
+    // TIM10, in board-local time
+    TIM_TypeDef tim10_ {};
+    bool tickRunning_ {false};
+    uint64_t tickStartNs_ {0};
+    uint64_t nextTickNs_ {0};
+
+    // TIM11, the telemetry sample timer, in board-local time
+    TIM_TypeDef tim11_ {};
+    uint64_t samplePeriodNs_ {0};
+    bool sampleRunning_ {false};
+    uint64_t nextSampleNs_ {0};
+
+    // Application handles of main.cpp. TIM11 is the only timer started
+    // through the HAL, so its Instance stays unset.
+    UART_HandleTypeDef huart1_ {USART1, {115200, 0, 0, 0, 0, 0, 0}, nullptr, nullptr, 0};
+    TIM_HandleTypeDef htim11_ {nullptr, {99, 999}};
+
+    // USART1
+    uint32_t baudRate_ {115200};
+    uint8_t* rxData_ {nullptr};
+    uint16_t rxRemaining_ {0};
+    bool txBusy_ {false};
+    uint64_t txDoneNs_ {0};
+
+    // EXTI0
+    bool buttonPending_ {false};
+    ButtonSource* buttons_ {nullptr};
+
+    // GPIO output data registers, indexed by port letter
+    uint16_t odr_[8] {};
+    std::ostream* gpioTrace_ {nullptr};
+  };
+} // namespace sim
@@ -0,0 +1,41 @@
+#include "buttonScript.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+namespace sim
+{
+  namespace
+  {
+    constexpr uint64_t NS_PER_MS = 1000000ULL;
+  }
+
+  bool readPressScript(std::istream& in, std::vector<uint64_t>& pressTimesNs)
+  {
+    std::string line;
+    while (std::getline(in, line))
+    {
+      line = line.substr(0, line.find('#'));
+      std::istringstream fields(line);
+      uint64_t startMs;
+      if (!(fields >> startMs))
+      {
+        if (line.find_first_not_of(" \t\r") != std::string::npos)
+          return false;
+        continue;
+      }
+
+      uint64_t count {1};
+      uint64_t intervalMs {0};
+      if (fields >> count && !(fields >> intervalMs))
+        return false;
+      for (uint64_t i = 0; i < count; ++i)
+      {
+        pressTimesNs.push_back((startMs + i * intervalMs) * NS_PER_MS);
+      }
+    }
+    std::sort(pressTimesNs.begin(), pressTimesNs.end());
+    return true;
+  }
+} // namespace sim
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "board.hpp"
+
+#include <cstdint>
+#include <istream>
+#include <vector>
+
+namespace sim
+{
+  /**
+   * @brief Read a button press script into sorted press times.
+   *
+   * One entry per line, times in ms from the start of the run:
+   *   <time_ms>                          one press
+   *   <start_ms> <count> <interval_ms>   count presses, interval_ms apart
+   * '#' starts a comment. Returns false on a malformed line.
+   */
+  bool readPressScript(std::istream& in, std::vector<uint64_t>& pressTimesNs);
+
+  /**
+   * @brief Button presses at the times of a press script.
+   */
+  class ScriptedButtons : public ButtonSource
+  {
+  public:
+    explicit ScriptedButtons(const std::vector<uint64_t>& pressTimesNs)
+      : pressTimesNs_{pressTimesNs} {}
+
+    uint64_t nextPressNs() const override
+    {
+      return next_ < pressTimesNs_.size() ? pressTimesNs_[next_] : NEVER;
+    }
+
+    void advance() override { ++next_; }
+
+  private:
+    std::vector<uint64_t> pressTimesNs_;
+    size_t next_ {0};
+  };
+} // namespace sim
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace sim
+{
+  /**
+   * @brief Time source of a simulated board (in ns).
+   */
+  class Clock
+  {
+  public:
+    virtual ~Clock() = default;
+    virtual uint64_t nowNs() const = 0;
+  };
+
+  /**
+   * @brief Wall clock based on std::chrono::steady_clock.
+   */
+  class RealClock : public Clock
+  {
+  public:
+    RealClock() : start_{std::chrono::steady_clock::now()} {}
+
+    uint64_t nowNs() const override
+    {
+      auto elapsed = std::chrono::steady_clock::now() - start_;
+      return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+  private:
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  /**
+   * @brief Manually advanced clock for deterministic simulations.
+   */
+  class VirtualClock : public Clock
+  {
+  public:
+    uint64_t nowNs() const override { return nowNs_; }
+
+    void advanceTo(uint64_t timeNs)
+    {
+      if (timeNs > nowNs_)
+        nowNs_ = timeNs;
+    }
+
+  private:
+    uint64_t nowNs_ {0};
+  };
+} // namespace sim
@@ -0,0 +1,208 @@
+/**
+ * @file stm32f4xx_hal.h
+ * @brief HAL fake for the Linux simulation build.
+ *
+ * Provides the subset of the STM32F4 HAL and CMSIS used by the Target
+ * class. Every call is routed to the sim::Board that is currently
+ * running on the calling thread (see sim/board.hpp).
+ */
+#ifndef SIM_STM32F4XX_HAL_H
+#define SIM_STM32F4XX_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Common ---------------------------------------------------------------*/
+typedef enum
+{
+  HAL_OK       = 0x00U,
+  HAL_ERROR    = 0x01U,
+  HAL_BUSY     = 0x02U,
+  HAL_TIMEOUT  = 0x03U
+} HAL_StatusTypeDef;
+
+/* --- GPIO -----------------------------------------------------------------*/
+typedef struct
+{
+  char name;                      /* Port letter used in the GPIO trace */
+} GPIO_TypeDef;
+
+typedef enum
+{
+  GPIO_PIN_RESET = 0U,
+  GPIO_PIN_SET
+} GPIO_PinState;
+
+extern GPIO_TypeDef simGpioA;
+extern GPIO_TypeDef simGpioB;
+extern GPIO_TypeDef simGpioD;
+
+#define GPIOA (&simGpioA)
+#define GPIOB (&simGpioB)
+#define GPIOD (&simGpioD)
+
+#define GPIO_PIN_0   ((uint16_t)0x0001)
+#define GPIO_PIN_1   ((uint16_t)0x0002)
+#define GPIO_PIN_2   ((uint16_t)0x0004)
+#define GPIO_PIN_3   ((uint16_t)0x0008)
+#define GPIO_PIN_4   ((uint16_t)0x0010)
+#define GPIO_PIN_5   ((uint16_t)0x0020)
+#define GPIO_PIN_6   ((uint16_t)0x0040)
+#define GPIO_PIN_7   ((uint16_t)0x0080)
+#define GPIO_PIN_8   ((uint16_t)0x0100)
+#define GPIO_PIN_9   ((uint16_t)0x0200)
+#define GPIO_PIN_10  ((uint16_t)0x0400)
+#define GPIO_PIN_11  ((uint16_t)0x0800)
+#define GPIO_PIN_12  ((uint16_t)0x1000)
+#define GPIO_PIN_13  ((uint16_t)0x2000)
+#define GPIO_PIN_14  ((uint16_t)0x4000)
+#define GPIO_PIN_15  ((uint16_t)0x8000)
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+void HAL_GPIO_TogglePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+
+/* --- DMA ------------------------------------------------------------------*/
+typedef struct
+{
+  void* Instance;
+} DMA_HandleTypeDef;
+
+/* --- UART -----------------------------------------------------------------*/
+typedef struct
+{
+  char name;
+} USART_TypeDef;
+
+extern USART_TypeDef simUsart1;
+#define USART1 (&simUsart1)
+
+typedef struct
+{
+  uint32_t BaudRate;
+  uint32_t WordLength;
+  uint32_t StopBits;
+  uint32_t Parity;
+  uint32_t Mode;
+  uint32_t HwFlowCtl;
+  uint32_t OverSampling;
+} UART_InitTypeDef;
+
+typedef struct
+{
+  USART_TypeDef*      Instance;
+  UART_InitTypeDef    Init;
+  DMA_HandleTypeDef*  hdmatx;
+  DMA_HandleTypeDef*  hdmarx;
+  volatile uint32_t   ErrorCode;
+} UART_HandleTypeDef;
+
+#define HAL_UART_ERROR_NONE  0x00000000U
+#define HAL_UART_ERROR_PE    0x00000001U
+#define HAL_UART_ERROR_NE    0x00000002U
+#define HAL_UART_ERROR_FE    0x00000004U
+#define HAL_UART_ERROR_ORE   0x00000008U
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef* huart);
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef* huart, const uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, const uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size);
+
+/* --- Cortex-M core --------------------------------------------------------*/
+uint32_t __get_PRIMASK(void);
+void __disable_irq(void);
+void __enable_irq(void);
+void __WFI(void);
+
+typedef struct
+{
+  volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24U)
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL)
+
+#ifdef __cplusplus
+/* CYCCNT reads the board clock scaled to the 100 MHz core clock */
+struct SimCycleCounter
+{
+  operator uint32_t() const;
+  SimCycleCounter& operator=(uint32_t value);
+};
+
+typedef struct
+{
+  volatile uint32_t CTRL;
+  SimCycleCounter   CYCCNT;
+} DWT_Type;
+
+DWT_Type* simDwt(void);
+CoreDebug_Type* simCoreDebug(void);
+
+#define DWT       (simDwt())
+#define CoreDebug (simCoreDebug())
+
+/* --- TIM ------------------------------------------------------------------*/
+/* TIM10 CNT reads the board clock, counting microseconds within the 1 ms period.
+ * TIM10 SR has UIF set while an update is due but its interrupt not yet taken.
+ * TIM11 only raises its update interrupt, CNT and SR are not modelled. */
+struct SimTimerCounter
+{
+  operator uint32_t() const;
+};
+
+struct SimTimerStatus
+{
+  operator uint32_t() const;
+};
+
+typedef struct
+{
+  SimTimerStatus SR;
+  SimTimerCounter CNT;
+} TIM_TypeDef;
+
+#define TIM_SR_UIF ((uint32_t)0x0001)
+
+typedef struct
+{
+  uint32_t Prescaler;
+  uint32_t Period;
+} TIM_Base_InitTypeDef;
+
+typedef struct
+{
+  TIM_TypeDef*          Instance;
+  TIM_Base_InitTypeDef  Init;
+} TIM_HandleTypeDef;
+
+TIM_TypeDef* simTim10(void);
+TIM_TypeDef* simTim11(void);
+
+#define TIM10 (simTim10())
+#define TIM11 (simTim11())
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef* htim);
+
+/* --- Application handles --------------------------------------------------*/
+/* The handles main.cpp defines on the board. Every simulated board has its
+ * own, like the peripherals above, so boards on different threads do not
+ * share a baud rate or a sample timer period. */
+UART_HandleTypeDef* simHuart1(void);
+TIM_HandleTypeDef* simHtim11(void);
+
+#define huart1 (*simHuart1())
+#define htim11 (*simHtim11())
+#endif /* __cplusplus */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_STM32F4XX_HAL_H */
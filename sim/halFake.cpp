@@ -0,0 +1,137 @@
+#include "board.hpp"
+
+// -----------------------------------------------------------------------------
+// Peripheral instances and application handles
+// -----------------------------------------------------------------------------
+GPIO_TypeDef simGpioA {'A'};
+GPIO_TypeDef simGpioB {'B'};
+GPIO_TypeDef simGpioD {'D'};
+USART_TypeDef simUsart1 {'1'};
+
+// -----------------------------------------------------------------------------
+// HAL fake, forwarded to the board running on the calling thread
+// -----------------------------------------------------------------------------
+extern "C" {
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef* huart)
+{
+  return sim::Board::current().uartInit(*huart);
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef*, const uint8_t* pData, uint16_t Size)
+{
+  return sim::Board::current().uartTransmit(pData, Size);
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef*, const uint8_t* pData, uint16_t Size)
+{
+  return sim::Board::current().uartTransmit(pData, Size);
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef*, uint8_t* pData, uint16_t Size)
+{
+  return sim::Board::current().uartReceive(pData, Size);
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef* htim)
+{
+  return sim::Board::current().sampleTimerInit(*htim);
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef*)
+{
+  return sim::Board::current().sampleTimerStart(true);
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef*)
+{
+  return sim::Board::current().sampleTimerStart(false);
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+  sim::Board::current().gpioWrite(GPIOx, GPIO_Pin, PinState == GPIO_PIN_SET);
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+  sim::Board::current().gpioToggle(GPIOx, GPIO_Pin);
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+  return sim::Board::current().pinState(GPIOx, GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+uint32_t __get_PRIMASK(void)
+{
+  return sim::Board::current().primask();
+}
+
+void __disable_irq(void)
+{
+  sim::Board::current().disableIrq();
+}
+
+void __enable_irq(void)
+{
+  sim::Board::current().enableIrq();
+}
+
+void __WFI(void)
+{
+  sim::Board::current().waitForInterrupt();
+}
+
+DWT_Type* simDwt(void)
+{
+  return &sim::Board::current().dwt();
+}
+
+CoreDebug_Type* simCoreDebug(void)
+{
+  return &sim::Board::current().coreDebug();
+}
+
+TIM_TypeDef* simTim10(void)
+{
+  return &sim::Board::current().tim10();
+}
+
+TIM_TypeDef* simTim11(void)
+{
+  return &sim::Board::current().tim11();
+}
+
+UART_HandleTypeDef* simHuart1(void)
+{
+  return &sim::Board::current().uartHandle();
+}
+
+TIM_HandleTypeDef* simHtim11(void)
+{
+  return &sim::Board::current().sampleTimerHandle();
+}
+
+} // extern "C"
+
+SimCycleCounter::operator uint32_t() const
+{
+  return sim::Board::current().cycleCounter();
+}
+
+SimCycleCounter& SimCycleCounter::operator=(uint32_t value)
+{
+  sim::Board::current().setCycleCounter(value);
+  return *this;
+}
+
+SimTimerCounter::operator uint32_t() const
+{
+  return sim::Board::current().timerCounter();
+}
+
+SimTimerStatus::operator uint32_t() const
+{
+  return sim::Board::current().timerStatus();
+}
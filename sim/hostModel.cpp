@@ -0,0 +1,542 @@
+#include "hostModel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace sim
+{
+  namespace
+  {
+    constexpr uint64_t NS_PER_MS = 1000000ULL;
+    constexpr uint64_t BITS_PER_BYTE = 10; // 8N1
+
+    uint64_t elapsedNs(uint64_t fromNs, uint64_t toNs)
+    {
+      return toNs > fromNs ? toNs - fromNs : 0U;
+    }
+  }
+
+  HostModel::HostModel(LinkChannel& toTarget, const ConfigS& config)
+    : toTarget_{toTarget}, config_{config},
+      defaultBaudRate_{toTarget.baudRate()}, baudRate_{toTarget.baudRate()},
+      tickSentNs_(std::max<size_t>(config.maxTicksInFlight, 1U), NEVER)
+  {
+    decoder_.setInterByteTimeout(static_cast<uint32_t>(config_.rxInterByteTimeoutNs / 1000U));
+  }
+
+  void HostModel::start(uint64_t nowNs)
+  {
+    state_ = StateE::CONNECTING;
+    lastRxNs_ = nowNs;
+    std::fill(tickSentNs_.begin(), tickSentNs_.end(), NEVER);
+    nextSyncNs_ = NEVER;
+    timeReqHeld_ = false;
+    timeSyncSentNs_ = NEVER;
+    clockSync_.reset();
+    session_ = protocol::CapabilitiesS {};
+    txFormat_ = protocol::frameFormatE::BASIC;
+    baudRate_ = defaultBaudRate_;
+    upshift_ = UpshiftE::NONE;
+    logRequested_ = false;
+    logDrainStartNs_ = NEVER;
+    bulkInFlight_ = 0;
+    streamStarted_ = false;
+    haveStreamSeq_ = false;
+
+    protocol::CapabilitiesS local;
+    local.version = protocol::PROTOCOL_VERSION;
+    local.frameFormats = config_.frameFormats;
+    local.maxBaudRate = config_.maxBaudRate;
+    local.rxQueueDepth = config_.rxQueueDepth;
+    local.features = protocol::FEATURE_TICK_SEQ | protocol::FEATURE_TIME_SYNC | protocol::FEATURE_BUTTON_TIME
+                     | protocol::FEATURE_LOG | protocol::FEATURE_STREAM;
+    uint8_t record[protocol::CAPABILITIES_SIZE];
+    send(protocol::signalIdE::CONNECT_REQ, nowNs, record, protocol::encodeCapabilities(local, record));
+    nextTimerNs_ = nowNs + config_.connectPollNs;
+  }
+
+  void HostModel::send(protocol::signalIdE sig, uint64_t nowNs, const uint8_t* payload, size_t payloadLen)
+  {
+    std::array<uint8_t, protocol::MAX_FRAME_SIZE> frame;
+    size_t frameSize = protocol::encodeFrame(sig, payload, payloadLen, frame.data(), txFormat_);
+    toTarget_.setBaudRate(baudRate_);
+    toTarget_.push(frame.data(), frameSize, nowNs);
+    ++stats_.framesSent;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Timers: connect timeout while CONNECTING, tick + watchdog while CONNECTED
+  // ---------------------------------------------------------------------------
+  void HostModel::onTimer(uint64_t nowNs)
+  {
+    if (nowNs >= nextSyncNs_)
+    {
+      // T1 is taken when TIME_REQ is written, so it must not queue behind
+      // bulk requests. Let the line drain and hold the bulk refills meanwhile.
+      if (state_ == StateE::CONNECTED && toTarget_.wireFreeNs() > nowNs)
+      {
+        timeReqHeld_ = true;
+        nextSyncNs_ = toTarget_.wireFreeNs();
+      }
+      else
+      {
+        timeReqHeld_ = false;
+        nextSyncNs_ = NEVER;
+        if (state_ == StateE::CONNECTED)
+        {
+          sendTimeReq(nowNs);
+          if (upshift_ == UpshiftE::NONE && logDrainStartNs_ == NEVER)
+            fillBulkWindow(nowNs);
+        }
+      }
+    }
+
+    if (nowNs < nextTimerNs_)
+      return;
+
+    switch (state_)
+    {
+    case StateE::CONNECTING:
+      if (nowNs - lastRxNs_ > config_.connectTimeoutNs)
+      {
+        // Host gives up and the operator restarts it
+        ++stats_.connectFailures;
+        start(nowNs);
+        return;
+      }
+      nextTimerNs_ = nowNs + config_.connectPollNs;
+      break;
+
+    case StateE::CONNECTED:
+      if (upshift_ != UpshiftE::NONE)
+      {
+        onUpshiftTimer(nowNs);
+        return;
+      }
+
+      // Drain the flight recorder once per connection, ticks wait for it like in Host::connect()
+      if (logDrainStartNs_ != NEVER)
+      {
+        if (logReqsSent_ < config_.logReqAttempts)
+        {
+          sendLogReq(nowNs);
+          return;
+        }
+        endLogDrain(nowNs, false);
+      }
+      if (config_.drainLog && !logRequested_ && (session_.features & protocol::FEATURE_LOG) != 0U)
+      {
+        logRequested_ = true;
+        logDrainStartNs_ = nowNs;
+        logReqsSent_ = 0;
+        haveLogCfm_ = false;
+        logDrain_ = LogDrainS {};
+        sendLogReq(nowNs);
+        return;
+      }
+
+      if (config_.streamRateHz != 0U && !streamStarted_ && (session_.features & protocol::FEATURE_STREAM) != 0U)
+      {
+        streamStarted_ = true;
+        uint8_t payload[protocol::STREAM_START_WINDOW_SIZE];
+        send(protocol::signalIdE::STREAM_START, nowNs, payload,
+             protocol::encodeStreamStart(config_.streamRateHz, config_.streamWindow, payload));
+      }
+
+      if (config_.sessionNs != 0U && nowNs - connectedNs_ >= config_.sessionNs)
+      {
+        send(protocol::signalIdE::DISCONNECT_REQ, nowNs);
+        start(nowNs);
+        return;
+      }
+
+      ++stats_.ticksSent;
+      if ((session_.features & protocol::FEATURE_TICK_SEQ) == 0U)
+      {
+        send(protocol::signalIdE::TICK_IND, nowNs);
+      }
+      else
+      {
+        const uint16_t seq = tickSeq_++;
+        tickSentNs_[seq % tickSentNs_.size()] = nowNs;
+        uint8_t payload[protocol::TICK_SEQ_SIZE];
+        send(protocol::signalIdE::TICK_IND, nowNs, payload, protocol::writeUint16(seq, payload));
+      }
+      nextSyncNs_ = nowNs + config_.timeSyncOffsetNs;
+      fillBulkWindow(nowNs);
+
+      if (nowNs - lastRxNs_ > config_.connectTimeoutNs)
+      {
+        ++stats_.linkLosses;
+        if (stats_.firstLossNs == NEVER)
+          stats_.firstLossNs = nowNs;
+        start(nowNs);
+        return;
+      }
+      nextTimerNs_ += config_.tickPeriodNs;
+      break;
+
+    case StateE::INIT:
+      nextTimerNs_ = NEVER;
+      break;
+    }
+  }
+
+  // ---------------------------------------------------------------------------
+  // Baud rate upshift, like Host::upshiftBaudRate()
+  // ---------------------------------------------------------------------------
+  void HostModel::startUpshift(uint64_t nowNs)
+  {
+    uint8_t payload[protocol::BAUD_RATE_SIZE];
+    protocol::writeUint32(std::min(config_.upshiftBaudRate, session_.maxBaudRate), payload);
+    send(protocol::signalIdE::BAUD_REQ, nowNs, payload, sizeof(payload));
+    upshift_ = UpshiftE::WAIT_CFM;
+    nextTimerNs_ = nowNs + config_.baudCfmTimeoutNs;
+  }
+
+  void HostModel::sendProbe(uint64_t nowNs)
+  {
+    send(protocol::signalIdE::PROBE_REQ, nowNs, protocol::BAUD_PROBE_PATTERN, protocol::BAUD_PROBE_SIZE);
+    ++probesSent_;
+    nextTimerNs_ = nowNs + config_.probeWaitNs;
+  }
+
+  void HostModel::onUpshiftTimer(uint64_t nowNs)
+  {
+    const bool probing = upshift_ == UpshiftE::PROBING || upshift_ == UpshiftE::CHECKING
+                         || upshift_ == UpshiftE::REPROBING;
+    if (probing && probesSent_ < config_.probeAttempts)
+    {
+      sendProbe(nowNs);
+      return;
+    }
+
+    switch (upshift_)
+    {
+    case UpshiftE::PROBING:
+      // Fall back and wait until the target has given up on the probes too
+      baudRate_ = defaultBaudRate_;
+      upshift_ = UpshiftE::SETTLING;
+      nextTimerNs_ = nowNs + protocol::BAUD_PROBE_TIMEOUT_MS * NS_PER_MS;
+      return;
+    case UpshiftE::SETTLING:
+      upshift_ = UpshiftE::CHECKING;
+      probesSent_ = 0;
+      sendProbe(nowNs);
+      return;
+    case UpshiftE::CHECKING:
+      // A probe committed the new rate on the target, only its CFMs were lost
+      baudRate_ = std::min(config_.upshiftBaudRate, session_.maxBaudRate);
+      upshift_ = UpshiftE::REPROBING;
+      probesSent_ = 0;
+      sendProbe(nowNs);
+      return;
+    case UpshiftE::REPROBING:
+      // No answer at either rate, the watchdogs take over
+      ++stats_.upshiftFallbacks;
+      baudRate_ = defaultBaudRate_;
+      break;
+    default:
+      break;
+    }
+
+    // No BAUD_CFM or settled, the first TICK_IND goes out right away
+    upshift_ = UpshiftE::NONE;
+    nextTimerNs_ = nowNs;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Clock sync, like Host::sendTimeReq()
+  // ---------------------------------------------------------------------------
+  void HostModel::sendTimeReq(uint64_t nowNs)
+  {
+    if ((session_.features & protocol::FEATURE_TIME_SYNC) == 0U)
+      return;
+
+    uint8_t payload[protocol::TIME_SYNC_SIZE] {};
+    protocol::writeUint16(++timeSyncSeq_, payload);
+    timeSyncSentNs_ = nowNs;
+    send(protocol::signalIdE::TIME_REQ, nowNs, payload, sizeof(payload));
+  }
+
+  // ---------------------------------------------------------------------------
+  // Bulk load, like LinkBench with a fixed window
+  // ---------------------------------------------------------------------------
+  void HostModel::fillBulkWindow(uint64_t nowNs)
+  {
+    if (config_.bulkWindow == 0U || timeReqHeld_)
+      return;
+
+    // Requests lost on the line are never answered, start over after a quiet tick period
+    if (bulkInFlight_ != 0U && nowNs - lastBulkNs_ >= config_.tickPeriodNs)
+      bulkInFlight_ = 0;
+    // STATS_REQ is empty, its answer is a full LINK_STATS_SIZE payload
+    size_t len {0};
+    if (config_.bulkRequest == protocol::signalIdE::ECHO_REQ)
+      len = config_.echoBytes != 0U ? std::min<size_t>(config_.echoBytes, session_.maxPayload) : session_.maxPayload;
+    const uint8_t payload[protocol::MAX_PAYLOAD] {};
+    while (bulkInFlight_ < config_.bulkWindow)
+    {
+      send(config_.bulkRequest, nowNs, payload, len);
+      ++stats_.bulkSent;
+      if (bulkInFlight_++ == 0U)
+        lastBulkNs_ = nowNs;
+    }
+  }
+
+  // ---------------------------------------------------------------------------
+  // Telemetry stream, like Host::onStreamData()
+  // ---------------------------------------------------------------------------
+  void HostModel::onStreamData(const protocol::FrameS& frame)
+  {
+    const uint16_t seq = protocol::readUint16(frame.payload.data());
+    const size_t count = (frame.payloadLen - protocol::STREAM_HEADER_SIZE) / protocol::STREAM_SAMPLE_SIZE;
+    // Frames are never reordered, a jump forward is samples dropped or lost
+    if (haveStreamSeq_)
+      stats_.streamLost += static_cast<uint16_t>(seq - static_cast<uint16_t>(streamSeq_));
+    haveStreamSeq_ = true;
+    streamSeq_ = static_cast<uint16_t>(seq + count);
+
+    // The target sends its sample counter, see streamSample()
+    const uint8_t* samples = frame.payload.data() + protocol::STREAM_HEADER_SIZE;
+    for (size_t i = 0; i < count; ++i)
+    {
+      if (protocol::readUint16(samples + i * protocol::STREAM_SAMPLE_SIZE) != static_cast<uint16_t>(seq + i))
+        ++stats_.streamCorrupt;
+    }
+    ++stats_.streamFrames;
+    stats_.streamSamples += count;
+  }
+
+  void HostModel::onStreamSummary(const protocol::FrameS& frame)
+  {
+    const protocol::StreamSummaryS summary = protocol::decodeStreamSummary(frame.payload.data(), frame.payloadLen);
+    if (haveStreamSeq_)
+      stats_.streamLost += summary.seq - streamSeq_;
+    haveStreamSeq_ = true;
+    streamSeq_ = summary.seq + summary.count;
+
+    // Samples are numbered consecutively, so without a wrap in the window
+    // min, max and mean follow from SEQ and COUNT
+    bool valid = summary.count != 0U;
+    const uint32_t first = summary.seq & 0xFFFFU;
+    if (valid && first + summary.count <= 0x10000U)
+    {
+      valid = summary.min == first && summary.max == first + summary.count - 1U
+              && summary.mean == (first << protocol::STREAM_MEAN_FRACTION_BITS)
+                                 + ((summary.count - 1U) << (protocol::STREAM_MEAN_FRACTION_BITS - 1U));
+    }
+    uint32_t binned {0};
+    for (size_t i = 0; i < summary.bins; ++i)
+    {
+      binned += summary.binCounts[i];
+    }
+    if (!valid || (summary.bins != 0U && binned != summary.count))
+      ++stats_.streamCorrupt;
+    ++stats_.streamFrames;
+    stats_.streamSamples += summary.count;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Flight recorder, like Host::drainFlightLog()
+  // ---------------------------------------------------------------------------
+  void HostModel::sendLogReq(uint64_t nowNs)
+  {
+    uint8_t payload[protocol::LOG_REQ_SIZE];
+    size_t len = protocol::writeUint32(logSeq_, payload);
+    len += protocol::writeUint16(0xFFFF, payload + len);
+    send(protocol::signalIdE::LOG_REQ, nowNs, payload, len);
+    ++logReqsSent_;
+    nextTimerNs_ = nowNs + config_.logIdleTimeoutNs;
+  }
+
+  void HostModel::onLogCfm(const protocol::FrameS& frame, uint64_t nowNs)
+  {
+    if (logDrainStartNs_ == NEVER)
+      return;
+
+    const uint32_t head = protocol::readUint32(frame.payload.data());
+    const uint32_t seq = protocol::readUint32(frame.payload.data() + sizeof(head));
+    const uint32_t count = (frame.payloadLen - protocol::LOG_CFM_HEADER_SIZE) / protocol::LOG_RECORD_SIZE;
+    if (!haveLogCfm_)
+    {
+      haveLogCfm_ = true;
+      logEnd_ = head;
+    }
+    // Records before a repeated request may arrive twice
+    if (seq + count > logSeq_)
+    {
+      if (seq > logSeq_)
+        logDrain_.lost += seq - logSeq_;
+      logDrain_.records += seq + count - std::max(seq, logSeq_);
+      logSeq_ = seq + count;
+    }
+    nextTimerNs_ = nowNs + config_.logIdleTimeoutNs;
+    if (count == 0U || logSeq_ >= logEnd_)
+      endLogDrain(nowNs, true);
+  }
+
+  void HostModel::endLogDrain(uint64_t nowNs, bool complete)
+  {
+    logDrain_.durationNs = nowNs - logDrainStartNs_;
+    logDrain_.complete = complete;
+    stats_.logDrains.push_back(logDrain_);
+    logDrainStartNs_ = NEVER;
+    // First TICK_IND goes out right away
+    nextTimerNs_ = nowNs;
+  }
+
+  void HostModel::recordButtonLatency(const protocol::FrameS& frame, uint64_t nowNs)
+  {
+    // Serialization time of this BUTTON_IND, the target sends in our TX format
+    std::array<uint8_t, protocol::MAX_FRAME_SIZE> encoded;
+    const size_t frameSize = protocol::encodeFrame(frame.sigId, frame.payload.data(), frame.payloadLen,
+                                                   encoded.data(), txFormat_);
+
+    ButtonLatencyS latency;
+    latency.pressNs = clockSync_.toHostUs(protocol::readUint32(frame.payload.data())) * 1000U;
+    const uint64_t queuedNs =
+      clockSync_.toHostUs(protocol::readUint32(frame.payload.data() + sizeof(uint32_t))) * 1000U;
+    latency.wireNs = frameSize * BITS_PER_BYTE * 1000000000ULL / baudRate_;
+    latency.targetNs = elapsedNs(latency.pressNs, queuedNs);
+    latency.queueNs = elapsedNs(queuedNs + latency.wireNs, nowNs);
+    latency.totalNs = elapsedNs(latency.pressNs, nowNs);
+    stats_.buttonLatency.push_back(latency);
+  }
+
+  // ---------------------------------------------------------------------------
+  // RX
+  // ---------------------------------------------------------------------------
+  void HostModel::onByte(uint8_t byte, uint64_t nowNs)
+  {
+    auto res = decoder_.processByte(byte, static_cast<uint32_t>(nowNs / 1000U));
+    if (!res.valid)
+      return;
+
+    ++stats_.framesReceived;
+    stats_.bytesReceived += 1U + res.frame.payloadLen;
+    lastRxNs_ = nowNs;
+    handleSignal(res.frame, nowNs);
+  }
+
+  void HostModel::handleSignal(const protocol::FrameS& frame, uint64_t nowNs)
+  {
+    switch (frame.sigId)
+    {
+    case protocol::signalIdE::CONNECT_CFM:
+      if (state_ == StateE::CONNECTING)
+      {
+        session_ = protocol::decodeCapabilities(frame.payload.data(), frame.payloadLen);
+        txFormat_ = protocol::selectFrameFormat(session_.frameFormats);
+        state_ = StateE::CONNECTED;
+        ++stats_.connects;
+        connectedNs_ = nowNs;
+        if (config_.upshiftBaudRate > baudRate_ && session_.maxBaudRate > baudRate_)
+        {
+          startUpshift(nowNs);
+          break;
+        }
+        // First TICK_IND goes out right away, like Host::mainLoop
+        nextTimerNs_ = nowNs;
+      }
+      break;
+    case protocol::signalIdE::BAUD_CFM:
+      if (upshift_ == UpshiftE::WAIT_CFM)
+      {
+        // The target switches once the CFM is out, so do we
+        const uint32_t baudRate = protocol::readUint32(frame.payload.data());
+        if (baudRate == std::min(config_.upshiftBaudRate, session_.maxBaudRate))
+        {
+          baudRate_ = baudRate;
+          upshift_ = UpshiftE::PROBING;
+          probesSent_ = 0;
+          sendProbe(nowNs);
+        }
+        else
+        {
+          upshift_ = UpshiftE::NONE;
+          nextTimerNs_ = nowNs;
+        }
+      }
+      break;
+    case protocol::signalIdE::PROBE_CFM:
+      if (probeCfmsDropped_ < config_.dropProbeCfms)
+      {
+        ++probeCfmsDropped_;
+        break;
+      }
+      if ((upshift_ == UpshiftE::PROBING || upshift_ == UpshiftE::CHECKING || upshift_ == UpshiftE::REPROBING)
+          && std::memcmp(frame.payload.data(), protocol::BAUD_PROBE_PATTERN, protocol::BAUD_PROBE_SIZE) == 0)
+      {
+        if (upshift_ == UpshiftE::CHECKING)
+          ++stats_.upshiftFallbacks;
+        else
+          ++stats_.upshifts;
+        if (upshift_ == UpshiftE::REPROBING)
+          ++stats_.upshiftRecoveries;
+        upshift_ = UpshiftE::NONE;
+        nextTimerNs_ = nowNs;
+      }
+      break;
+    case protocol::signalIdE::TICK_CFM:
+      if (frame.payloadLen != protocol::TICK_SEQ_SIZE)
+      {
+        // Legacy target, the CFM cannot be matched to its tick
+        ++stats_.ticksConfirmed;
+      }
+      else
+      {
+        // A CFM older than maxTicksInFlight ticks finds its slot reused and is ignored
+        const uint16_t seq = protocol::readUint16(frame.payload.data());
+        const uint16_t age = static_cast<uint16_t>(tickSeq_ - seq);
+        const size_t slot = seq % tickSentNs_.size();
+        if (age != 0U && age <= tickSentNs_.size() && tickSentNs_[slot] != NEVER)
+        {
+          ++stats_.ticksConfirmed;
+          stats_.tickRttNs.push_back(nowNs - tickSentNs_[slot]);
+          tickSentNs_[slot] = NEVER;
+        }
+      }
+      break;
+    case protocol::signalIdE::TIME_CFM:
+      if (timeSyncSentNs_ != NEVER && protocol::readUint16(frame.payload.data()) == timeSyncSeq_)
+      {
+        const uint32_t t2 = protocol::readUint32(frame.payload.data() + sizeof(timeSyncSeq_));
+        const uint32_t t3 = protocol::readUint32(frame.payload.data() + sizeof(timeSyncSeq_) + sizeof(t2));
+        clockSync_.addSample(timeSyncSentNs_ / 1000U, t2, t3, nowNs / 1000U);
+        timeSyncSentNs_ = NEVER;
+      }
+      break;
+    case protocol::signalIdE::LOG_CFM:
+      onLogCfm(frame, nowNs);
+      break;
+    case protocol::signalIdE::ECHO_CFM:
+    case protocol::signalIdE::STATS_CFM:
+      ++stats_.bulkReceived;
+      stats_.bulkBytes += frame.payloadLen;
+      lastBulkNs_ = nowNs;
+      if (bulkInFlight_ != 0U)
+        --bulkInFlight_;
+      if (state_ == StateE::CONNECTED && upshift_ == UpshiftE::NONE && logDrainStartNs_ == NEVER)
+        fillBulkWindow(nowNs);
+      break;
+    case protocol::signalIdE::STREAM_DATA:
+      if (state_ == StateE::CONNECTED)
+        onStreamData(frame);
+      break;
+    case protocol::signalIdE::STREAM_SUMMARY:
+      if (state_ == StateE::CONNECTED)
+        onStreamSummary(frame);
+      break;
+    case protocol::signalIdE::BUTTON_IND:
+      ++stats_.buttonInds;
+      send(protocol::signalIdE::BUTTON_CFM, nowNs);
+      if (frame.payloadLen == protocol::BUTTON_TIME_SIZE && clockSync_.synced())
+        recordButtonLatency(frame, nowNs);
+      break;
+    default:
+      break;
+    }
+  }
+} // namespace sim
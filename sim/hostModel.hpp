@@ -0,0 +1,205 @@
+#pragma once
+
+#include "clockSync.hpp"
+#include "linkChannel.hpp"
+#include "protocol.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace sim
+{
+  /**
+   * @brief Event-driven model of the Host connection logic on virtual time.
+   *
+   * Mirrors host/host.cpp: CONNECT_REQ with a connect timeout, the optional
+   * baud rate upshift, a sequence-numbered TICK_IND every tick period with
+   * several in flight, a TIME_REQ half way between ticks, BUTTON_CFM for
+   * every BUTTON_IND and the connection watchdog checked on the tick
+   * schedule. Optionally keeps a window of ECHO_REQs or STATS_REQs in
+   * flight as bulk load, like the host link benchmark, and starts the
+   * telemetry stream before the first tick. Uses the real protocol
+   * encoder/decoder and the host ClockSync, with the virtual clock as the
+   * host clock.
+   */
+  class HostModel
+  {
+  public:
+    struct ConfigS
+    {
+      uint64_t tickPeriodNs {1000000000ULL};       ///< Host::TICK_PERIOD
+      size_t maxTicksInFlight {8};                 ///< Host::MAX_TICKS_IN_FLIGHT
+      uint64_t timeSyncOffsetNs {500000000ULL};    ///< Host::TIME_SYNC_OFFSET
+      uint64_t sessionNs {0};                      ///< Reconnect after this long, 0 = stay connected
+      uint64_t connectTimeoutNs {5000000000ULL};   ///< Host::CONNECT_TIMEOUT
+      uint64_t connectPollNs {1000000000ULL};      ///< Host::CONNECT_POLL_DELAY
+      uint64_t rxInterByteTimeoutNs {50000000ULL}; ///< Host::RX_INTER_BYTE_TIMEOUT, 0 = off
+      uint8_t frameFormats {protocol::DEFAULT_FRAME_FORMATS}; ///< Framing mask offered in CONNECT_REQ
+      uint32_t maxBaudRate {921600};               ///< Host::MAX_BAUD_RATE
+      uint8_t rxQueueDepth {255};                  ///< Host::RX_QUEUE_DEPTH
+      uint32_t upshiftBaudRate {0};                ///< Host --baud, 0 = stay at baudRate
+      uint64_t baudCfmTimeoutNs {500000000ULL};    ///< Host::BAUD_CFM_TIMEOUT
+      uint64_t probeWaitNs {100000000ULL};         ///< Host::BAUD_PROBE_WAIT
+      uint32_t probeAttempts {3};                  ///< Host::BAUD_PROBE_ATTEMPTS
+      uint32_t dropProbeCfms {0};                  ///< First PROBE_CFMs ignored as if lost on the line
+      bool drainLog {false};                       ///< Host --flight-log, drain before the first tick
+      uint64_t logIdleTimeoutNs {500000000ULL};    ///< Host::LOG_IDLE_TIMEOUT
+      uint32_t logReqAttempts {3};                 ///< Host::LOG_REQ_ATTEMPTS
+      size_t bulkWindow {0};                       ///< Bulk requests kept in flight, 0 = no bulk load
+      protocol::signalIdE bulkRequest {protocol::signalIdE::ECHO_REQ}; ///< ECHO_REQ or STATS_REQ
+      size_t echoBytes {0};                        ///< ECHO_REQ payload, 0 = the session maximum
+      uint32_t streamRateHz {0};                   ///< Host --stream, 0 = no telemetry stream
+      protocol::StreamWindowS streamWindow {};     ///< Host --stream-window, 0 samples = raw STREAM_DATA
+    };
+
+    /**
+     * @brief Breakdown of one button press as in Host::onButtonInd(), host times.
+     */
+    struct ButtonLatencyS
+    {
+      uint64_t pressNs {0};     ///< Press time estimated from the target timestamp
+      uint64_t targetNs {0};
+      uint64_t queueNs {0};
+      uint64_t wireNs {0};
+      uint64_t totalNs {0};     ///< Press to BUTTON_CFM, the model answers at once
+    };
+
+    /**
+     * @brief One flight recorder drain, LOG_REQ to the last LOG_CFM.
+     */
+    struct LogDrainS
+    {
+      uint64_t durationNs {0};
+      uint32_t records {0};
+      uint32_t lost {0};        ///< Overwritten before they were read
+      bool complete {false};
+    };
+
+    struct StatsS
+    {
+      uint64_t framesSent {0};
+      uint64_t framesReceived {0};
+      uint64_t bytesReceived {0};        ///< SIG + PAYLOAD bytes of valid frames
+      uint64_t connects {0};
+      uint64_t connectFailures {0};
+      uint64_t linkLosses {0};
+      uint64_t firstLossNs {NEVER};      ///< Time the watchdog first expired
+      uint64_t buttonInds {0};
+      uint64_t ticksSent {0};
+      uint64_t ticksConfirmed {0};
+      uint64_t upshifts {0};             ///< Rate switches confirmed by a probe
+      uint64_t upshiftFallbacks {0};     ///< Switches undone after the probes failed
+      uint64_t upshiftRecoveries {0};    ///< Upshifts kept after no answer at the baseline rate
+      uint64_t bulkSent {0};
+      uint64_t bulkReceived {0};
+      uint64_t bulkBytes {0};            ///< Payload bytes of the bulk answers received
+      uint64_t streamFrames {0};         ///< STREAM_DATA or STREAM_SUMMARY
+      uint64_t streamSamples {0};        ///< Samples received or summarized
+      uint64_t streamLost {0};           ///< Gaps in the sample sequence numbers
+      uint64_t streamCorrupt {0};        ///< Samples or summaries not matching the target's counter source
+      std::vector<uint64_t> tickRttNs;
+      std::vector<ButtonLatencyS> buttonLatency;
+      std::vector<LogDrainS> logDrains;
+    };
+
+    /**
+     * @brief The port is opened at the baud rate of toTarget.
+     */
+    HostModel(LinkChannel& toTarget, const ConfigS& config);
+
+    /**
+     * @brief Send CONNECT_REQ and start the connect timeout.
+     */
+    void start(uint64_t nowNs);
+
+    /**
+     * @brief Byte delivered by the target -> host channel.
+     */
+    void onByte(uint8_t byte, uint64_t nowNs);
+
+    /**
+     * @brief Run timers due at nowNs.
+     */
+    void onTimer(uint64_t nowNs);
+
+    uint64_t nextTimerNs() const { return nextTimerNs_ < nextSyncNs_ ? nextTimerNs_ : nextSyncNs_; }
+    bool connected() const { return state_ == StateE::CONNECTED; }
+    uint32_t baudRate() const { return baudRate_; }
+    const protocol::CapabilitiesS& session() const { return session_; }
+    const StatsS& stats() const { return stats_; }
+    const ClockSync& clockSync() const { return clockSync_; }
+
+  private:
+    enum class StateE
+    {
+      INIT,
+      CONNECTING,
+      CONNECTED
+    };
+
+    /**
+     * @brief Steps of the baud rate upshift that runs before the first TICK_IND.
+     */
+    enum class UpshiftE
+    {
+      NONE,
+      WAIT_CFM,         ///< BAUD_REQ sent
+      PROBING,          ///< Switched, PROBE_REQ sent
+      SETTLING,         ///< Fell back, waiting for the target to do the same
+      CHECKING,         ///< Fell back, PROBE_REQ sent at the baseline rate
+      REPROBING         ///< No answer at the baseline, PROBE_REQ sent at the new rate again
+    };
+
+    void startUpshift(uint64_t nowNs);
+    void sendProbe(uint64_t nowNs);
+    void sendTimeReq(uint64_t nowNs);
+    void fillBulkWindow(uint64_t nowNs);
+    void onStreamData(const protocol::FrameS& frame);
+    void onStreamSummary(const protocol::FrameS& frame);
+    void sendLogReq(uint64_t nowNs);
+    void onLogCfm(const protocol::FrameS& frame, uint64_t nowNs);
+    void endLogDrain(uint64_t nowNs, bool complete);
+    void recordButtonLatency(const protocol::FrameS& frame, uint64_t nowNs);
+    void onUpshiftTimer(uint64_t nowNs);
+    void send(protocol::signalIdE sig, uint64_t nowNs, const uint8_t* payload = nullptr, size_t payloadLen = 0);
+    void handleSignal(const protocol::FrameS& frame, uint64_t nowNs);
+
+    LinkChannel& toTarget_;
+    ConfigS config_;
+    protocol::Decoder decoder_;
+    StateE state_ {StateE::INIT};
+    protocol::CapabilitiesS session_ {};
+    protocol::frameFormatE txFormat_ {protocol::frameFormatE::BASIC};
+    uint32_t defaultBaudRate_;
+    uint32_t baudRate_;
+    UpshiftE upshift_ {UpshiftE::NONE};
+    uint32_t probesSent_ {0};
+    uint32_t probeCfmsDropped_ {0};
+    uint64_t nextTimerNs_ {NEVER};
+    uint64_t lastRxNs_ {0};
+    uint64_t connectedNs_ {0};
+    uint16_t tickSeq_ {0};
+    std::vector<uint64_t> tickSentNs_;  ///< By sequence id % maxTicksInFlight, NEVER = free
+    uint64_t nextSyncNs_ {NEVER};
+    bool timeReqHeld_ {false};          ///< TIME_REQ due, waiting for the line to drain
+    uint16_t timeSyncSeq_ {0};
+    uint64_t timeSyncSentNs_ {NEVER};   ///< TIME_REQ in flight, NEVER = none
+    ClockSync clockSync_;
+    // Flight recorder drain, continued from logSeq_ on the next connect
+    bool logRequested_ {false};
+    uint64_t logDrainStartNs_ {NEVER};  ///< NEVER = no drain running
+    uint32_t logSeq_ {0};               ///< Next record expected
+    uint32_t logEnd_ {0};               ///< HEAD of the first LOG_CFM
+    bool haveLogCfm_ {false};
+    uint32_t logReqsSent_ {0};
+    LogDrainS logDrain_ {};
+    // Bulk load, the window is refilled when no answer came for a tick period
+    size_t bulkInFlight_ {0};
+    uint64_t lastBulkNs_ {0};
+    // Telemetry stream, started once per connection
+    bool streamStarted_ {false};
+    bool haveStreamSeq_ {false};
+    uint32_t streamSeq_ {0};            ///< Next sample expected, STREAM_DATA has the low 16 bits
+    StatsS stats_ {};
+  };
+} // namespace sim
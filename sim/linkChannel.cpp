@@ -0,0 +1,206 @@
+#include "linkChannel.hpp"
+
+#include <algorithm>
+
+namespace sim
+{
+  namespace
+  {
+    constexpr uint64_t BITS_PER_BYTE = 10; // 8N1
+  }
+
+  // ---------------------------------------------------------------------------
+  // Link channel
+  // ---------------------------------------------------------------------------
+  LinkChannel::LinkChannel(uint64_t seed, uint32_t baudRate)
+    : baudRate_{baudRate}, rng_{seed}
+  {
+  }
+
+  void LinkChannel::setImpairment(const ImpairmentS& impairment)
+  {
+    // The next burst is drawn on the next push()/pop() that knows the time
+    noiseRescheduled_ = noiseRescheduled_ || impairment.noiseBurstRate != impairment_.noiseBurstRate;
+    impairment_ = impairment;
+  }
+
+  uint64_t LinkChannel::byteTimeNs() const
+  {
+    return baudRate_ == 0U ? 0U : BITS_PER_BYTE * 1000000000ULL / baudRate_;
+  }
+
+  uint8_t LinkChannel::corrupt(uint8_t byte)
+  {
+    if (impairment_.bitErrorRate <= 0.0)
+      return byte;
+
+    std::bernoulli_distribution flip(impairment_.bitErrorRate);
+    uint8_t mask {0};
+    for (unsigned bit = 0; bit < 8U; ++bit)
+    {
+      if (flip(rng_))
+      {
+        mask = static_cast<uint8_t>(mask | (1U << bit));
+        ++counters_.bitFlips;
+      }
+    }
+    if (mask != 0U)
+      ++counters_.corruptedBytes;
+    return static_cast<uint8_t>(byte ^ mask);
+  }
+
+  uint8_t LinkChannel::garble()
+  {
+    ++counters_.garbledBytes;
+    std::uniform_int_distribution<uint32_t> value(0, 0xFF);
+    return static_cast<uint8_t>(value(rng_));
+  }
+
+  void LinkChannel::enqueue(uint8_t byte, uint64_t nowNs)
+  {
+    // The byte occupies the wire even if it gets lost on the way
+    const uint64_t start = std::max(nowNs, wireFreeNs_);
+    wireFreeNs_ = start + byteTimeNs();
+    counters_.busyNs += byteTimeNs();
+
+    uint64_t delivery = wireFreeNs_ + impairment_.latencyNs;
+    if (impairment_.jitterNs != 0U)
+    {
+      std::uniform_int_distribution<uint64_t> jitter(0, impairment_.jitterNs);
+      delivery += jitter(rng_);
+    }
+    delivery = std::max(delivery, lastDeliveryNs_);
+    lastDeliveryNs_ = delivery;
+    if (impairment_.maxBaudRate != 0U && baudRate_ > impairment_.maxBaudRate)
+      byte = garble();
+    inFlight_.push_back(InFlightS{delivery, baudRate_, corrupt(byte)});
+  }
+
+  void LinkChannel::push(const uint8_t* data, size_t len, uint64_t nowNs)
+  {
+    injectNoise(nowNs);
+
+    std::bernoulli_distribution drop(impairment_.dropRate);
+    std::bernoulli_distribution duplicate(impairment_.duplicateRate);
+    for (size_t i = 0; i < len; ++i)
+    {
+      ++counters_.bytesIn;
+
+      if (impairment_.dropRate > 0.0 && drop(rng_))
+      {
+        ++counters_.dropped;
+        const uint64_t start = std::max(nowNs, wireFreeNs_);
+        wireFreeNs_ = start + byteTimeNs();
+        counters_.busyNs += byteTimeNs();
+        continue;
+      }
+
+      enqueue(data[i], nowNs);
+
+      // A duplicated byte arrives again right after the original
+      if (impairment_.duplicateRate > 0.0 && duplicate(rng_))
+      {
+        ++counters_.duplicated;
+        enqueue(data[i], nowNs);
+      }
+    }
+  }
+
+  bool LinkChannel::pop(uint8_t& byte, uint64_t nowNs)
+  {
+    injectNoise(nowNs);
+
+    if (inFlight_.empty() || inFlight_.front().deliveryNs > nowNs)
+      return false;
+
+    const InFlightS& entry = inFlight_.front();
+    byte = entry.byte;
+    if (receiverBaudRate_ != 0U && entry.baudRate != receiverBaudRate_)
+      byte = garble();
+    inFlight_.pop_front();
+    ++counters_.bytesOut;
+    return true;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Line noise: bursts of random bytes at exponentially distributed times
+  // ---------------------------------------------------------------------------
+  void LinkChannel::scheduleNoiseBurst(uint64_t nowNs)
+  {
+    if (impairment_.noiseBurstRate <= 0.0)
+    {
+      nextNoiseNs_ = NEVER;
+      return;
+    }
+    std::exponential_distribution<double> interval(impairment_.noiseBurstRate);
+    nextNoiseNs_ = nowNs + static_cast<uint64_t>(interval(rng_) * 1e9);
+  }
+
+  void LinkChannel::injectNoise(uint64_t nowNs)
+  {
+    if (noiseRescheduled_)
+    {
+      noiseRescheduled_ = false;
+      scheduleNoiseBurst(nowNs);
+    }
+
+    while (nextNoiseNs_ <= nowNs)
+    {
+      const uint64_t burstNs = nextNoiseNs_;
+      std::uniform_int_distribution<uint32_t> length(1, std::max<uint32_t>(impairment_.noiseBurstLen, 1U));
+      std::uniform_int_distribution<uint32_t> value(0, 0xFF);
+      const uint32_t count = length(rng_);
+      for (uint32_t i = 0; i < count; ++i)
+      {
+        ++counters_.noiseBytes;
+        enqueue(static_cast<uint8_t>(value(rng_)), burstNs);
+      }
+      scheduleNoiseBurst(burstNs);
+    }
+  }
+
+  uint64_t LinkChannel::nextDeliveryNs() const
+  {
+    const uint64_t next = inFlight_.empty() ? NEVER : inFlight_.front().deliveryNs;
+    return std::min(next, nextNoiseNs_);
+  }
+
+  // ---------------------------------------------------------------------------
+  // Impaired port
+  // ---------------------------------------------------------------------------
+  ImpairedPort::ImpairedPort(UartPort& inner, uint64_t seed)
+    : inner_{inner}, tx_{seed}, rx_{seed ^ 0x9E3779B97F4A7C15ULL}
+  {
+  }
+
+  void ImpairedPort::write(const uint8_t* data, size_t len, uint64_t nowNs)
+  {
+    tx_.push(data, len, nowNs);
+    poll(nowNs);
+  }
+
+  bool ImpairedPort::read(uint8_t& byte, uint64_t nowNs)
+  {
+    return rx_.pop(byte, nowNs);
+  }
+
+  void ImpairedPort::poll(uint64_t nowNs)
+  {
+    uint8_t byte;
+    while (tx_.pop(byte, nowNs))
+    {
+      inner_.write(&byte, 1, nowNs);
+    }
+
+    inner_.poll(nowNs);
+    while (inner_.read(byte, nowNs))
+    {
+      rx_.push(&byte, 1, nowNs);
+    }
+  }
+
+  uint64_t ImpairedPort::nextEventNs() const
+  {
+    return std::min(std::min(tx_.nextDeliveryNs(), rx_.nextDeliveryNs()), inner_.nextEventNs());
+  }
+} // namespace sim
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "uartPort.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+
+namespace sim
+{
+  /**
+   * @brief Impairments applied by a LinkChannel to every byte.
+   */
+  struct ImpairmentS
+  {
+    uint64_t latencyNs {0};       ///< Fixed delay added after serialization
+    uint64_t jitterNs {0};        ///< Uniform extra delay in [0, jitterNs]
+    double bitErrorRate {0.0};    ///< Probability of each bit being flipped
+    double dropRate {0.0};        ///< Probability of a byte being lost
+    double duplicateRate {0.0};   ///< Probability of a byte being received twice
+    double noiseBurstRate {0.0};  ///< Mean noise bursts per second
+    uint32_t noiseBurstLen {8};   ///< Max random bytes inserted per burst
+    uint32_t maxBaudRate {0};     ///< Bytes sent faster arrive garbled, 0 = no limit
+  };
+
+  /**
+   * @brief Per-direction byte counters.
+   */
+  struct ChannelCountersS
+  {
+    uint64_t bytesIn {0};         ///< Bytes handed to the channel
+    uint64_t bytesOut {0};        ///< Bytes delivered at the far end
+    uint64_t dropped {0};
+    uint64_t duplicated {0};
+    uint64_t bitFlips {0};
+    uint64_t corruptedBytes {0};
+    uint64_t noiseBytes {0};      ///< Random bytes inserted by noise bursts
+    uint64_t garbledBytes {0};    ///< Bytes lost to a baud rate mismatch or limit
+    uint64_t busyNs {0};          ///< Wire time of the bytes handed in, at the rate each was sent
+  };
+
+  /**
+   * @brief One direction of a serial line.
+   *
+   * Bytes are serialized at the configured baud rate (8N1, 0 = unthrottled),
+   * delayed by the configured latency and impaired with a seeded PRNG, so a
+   * run is reproducible from its seed. A receiver set to a different baud
+   * rate than the one a byte was sent at samples garbage instead.
+   */
+  class LinkChannel
+  {
+  public:
+    explicit LinkChannel(uint64_t seed = 1, uint32_t baudRate = 0);
+
+    void setImpairment(const ImpairmentS& impairment);
+    const ImpairmentS& impairment() const { return impairment_; }
+
+    void setBaudRate(uint32_t baudRate) { baudRate_ = baudRate; }
+    uint32_t baudRate() const { return baudRate_; }
+
+    /**
+     * @brief Baud rate of the far end, 0 = always the rate the byte was sent at.
+     */
+    void setReceiverBaudRate(uint32_t baudRate) { receiverBaudRate_ = baudRate; }
+
+    /**
+     * @brief Bytes entering the line at nowNs.
+     */
+    void push(const uint8_t* data, size_t len, uint64_t nowNs);
+
+    /**
+     * @brief Fetch the next byte that reached the far end by nowNs.
+     */
+    bool pop(uint8_t& byte, uint64_t nowNs);
+
+    /**
+     * @brief Delivery time of the next byte, NEVER if the line is empty.
+     */
+    uint64_t nextDeliveryNs() const;
+
+    /**
+     * @brief Time the last byte handed in has left the sender.
+     */
+    uint64_t wireFreeNs() const { return wireFreeNs_; }
+
+    const ChannelCountersS& counters() const { return counters_; }
+    void resetCounters() { counters_ = ChannelCountersS{}; }
+
+  private:
+    struct InFlightS
+    {
+      uint64_t deliveryNs;
+      uint32_t baudRate;            ///< Rate the byte was sent at
+      uint8_t byte;
+    };
+
+    uint64_t byteTimeNs() const;
+    uint8_t corrupt(uint8_t byte);
+    uint8_t garble();
+    void enqueue(uint8_t byte, uint64_t nowNs);
+    void scheduleNoiseBurst(uint64_t nowNs);
+    void injectNoise(uint64_t nowNs);
+
+    ImpairmentS impairment_ {};
+    uint32_t baudRate_ {0};
+    uint32_t receiverBaudRate_ {0};
+    uint64_t wireFreeNs_ {0};       ///< End of the last byte on the wire
+    uint64_t lastDeliveryNs_ {0};   ///< Keeps deliveries in order
+    uint64_t nextNoiseNs_ {NEVER};
+    bool noiseRescheduled_ {false};
+    std::deque<InFlightS> inFlight_;
+    std::mt19937_64 rng_;
+    ChannelCountersS counters_ {};
+  };
+
+  /**
+   * @brief UartPort decorator that routes both directions through a LinkChannel.
+   */
+  class ImpairedPort : public UartPort
+  {
+  public:
+    ImpairedPort(UartPort& inner, uint64_t seed);
+
+    LinkChannel& tx() { return tx_; }   ///< Target -> peer
+    LinkChannel& rx() { return rx_; }   ///< Peer -> target
+
+    void write(const uint8_t* data, size_t len, uint64_t nowNs) override;
+    bool read(uint8_t& byte, uint64_t nowNs) override;
+    void poll(uint64_t nowNs) override;
+    uint64_t nextEventNs() const override;
+    int fd() const override { return inner_.fd(); }
+
+  private:
+    UartPort& inner_;
+    LinkChannel tx_;
+    LinkChannel rx_;
+  };
+} // namespace sim
@@ -0,0 +1,315 @@
+#include "linkSimulator.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+  constexpr uint64_t NS_PER_MS = 1000000ULL;
+  constexpr uint64_t NS_PER_US = 1000ULL;
+
+  void printUsage()
+  {
+    std::cout << "Usage: linksim [options]" << std::endl;
+    std::cout << "  --seed <n>               PRNG seed (default 1)" << std::endl;
+    std::cout << "  --duration-s <s>         simulated time (default 60)" << std::endl;
+    std::cout << "  --baud <rate>            line rate at connect, 8N1 (default 115200)" << std::endl;
+    std::cout << "  --upshift-baud <rate>    rate the host switches to after connecting" << std::endl;
+    std::cout << "  --max-line-baud <rate>   bytes sent faster arrive garbled (both directions)" << std::endl;
+    std::cout << "  --drop-probe-cfm <n>     the host loses the first n PROBE_CFMs of the upshift" << std::endl;
+    std::cout << "  --prop-us <us>           propagation delay per direction" << std::endl;
+    std::cout << "  --ber <p>                bit error rate (both directions)" << std::endl;
+    std::cout << "  --drop <p>               byte drop probability (both directions)" << std::endl;
+    std::cout << "  --dup <p>                byte duplication probability (both directions)" << std::endl;
+    std::cout << "  --tick-ms <ms>           host heartbeat period (default 1000)" << std::endl;
+    std::cout << "  --timeout-ms <ms>        host connection watchdog (default 5000)" << std::endl;
+    std::cout << "  --press-interval-ms <ms> button press period (default off)" << std::endl;
+    std::cout << "  --press-script <file>    button presses from a script, see buttonScript.hpp" << std::endl;
+    std::cout << "  --session-s <s>          host reconnects after this long (default never)" << std::endl;
+    std::cout << "  --link-down-s <s>        cut the line at this time" << std::endl;
+    std::cout << "  --clock-skew-ppm <ppm>   target crystal error, positive = fast" << std::endl;
+    std::cout << "  --framing <basic|header|fec> frame formats offered by the host (default basic)" << std::endl;
+    std::cout << "  --drain-log <0|1>        host drains the target flight recorder after each connect" << std::endl;
+    std::cout << "  --bulk-window <n>        bulk requests the host keeps in flight (default 0)" << std::endl;
+    std::cout << "  --bulk-load <echo|stats> bulk request, ECHO_REQ or STATS_REQ (default echo)" << std::endl;
+    std::cout << "  --echo-bytes <n>         ECHO_REQ payload (default the session maximum)" << std::endl;
+    std::cout << "  --stream-hz <rate>       telemetry sample rate the host starts (default off)" << std::endl;
+    std::cout << "  --stream-window <n>      one STREAM_SUMMARY per n samples instead of raw samples" << std::endl;
+    std::cout << "  --stream-bins <n>        summary histogram bins, 0 to 8 (default 0)" << std::endl;
+    std::cout << "  --stream-bin-shift <n>   each bin spans 2^n sample values (default 13)" << std::endl;
+  }
+
+  bool parseOptions(int argc, char* argv[], sim::LinkSimConfigS& config)
+  {
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+      const char* name = argv[i];
+      const char* value = argv[i + 1];
+      if (std::strcmp(name, "--seed") == 0)
+        config.seed = std::strtoull(value, nullptr, 10);
+      else if (std::strcmp(name, "--duration-s") == 0)
+        config.durationNs = static_cast<uint64_t>(std::strtod(value, nullptr) * 1e9);
+      else if (std::strcmp(name, "--baud") == 0)
+        config.baudRate = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+      else if (std::strcmp(name, "--upshift-baud") == 0)
+        config.host.upshiftBaudRate = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+      else if (std::strcmp(name, "--drop-probe-cfm") == 0)
+        config.host.dropProbeCfms = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+      else if (std::strcmp(name, "--max-line-baud") == 0)
+        config.hostToTarget.maxBaudRate = config.targetToHost.maxBaudRate =
+          static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+      else if (std::strcmp(name, "--prop-us") == 0)
+        config.propagationNs = static_cast<uint64_t>(std::strtod(value, nullptr) * 1e3);
+      else if (std::strcmp(name, "--ber") == 0)
+        config.hostToTarget.bitErrorRate = config.targetToHost.bitErrorRate = std::strtod(value, nullptr);
+      else if (std::strcmp(name, "--drop") == 0)
+        config.hostToTarget.dropRate = config.targetToHost.dropRate = std::strtod(value, nullptr);
+      else if (std::strcmp(name, "--dup") == 0)
+        config.hostToTarget.duplicateRate = config.targetToHost.duplicateRate = std::strtod(value, nullptr);
+      else if (std::strcmp(name, "--tick-ms") == 0)
+        config.host.tickPeriodNs = std::strtoull(value, nullptr, 10) * NS_PER_MS;
+      else if (std::strcmp(name, "--timeout-ms") == 0)
+        config.host.connectTimeoutNs = std::strtoull(value, nullptr, 10) * NS_PER_MS;
+      else if (std::strcmp(name, "--press-interval-ms") == 0)
+        config.pressIntervalNs = std::strtoull(value, nullptr, 10) * NS_PER_MS;
+      else if (std::strcmp(name, "--press-script") == 0)
+      {
+        std::ifstream script(value);
+        if (!script || !sim::readPressScript(script, config.pressTimesNs))
+          return false;
+      }
+      else if (std::strcmp(name, "--session-s") == 0)
+        config.host.sessionNs = static_cast<uint64_t>(std::strtod(value, nullptr) * 1e9);
+      else if (std::strcmp(name, "--link-down-s") == 0)
+        config.linkDownNs = static_cast<uint64_t>(std::strtod(value, nullptr) * 1e9);
+      else if (std::strcmp(name, "--clock-skew-ppm") == 0)
+        config.clockSkewPpm = std::strtod(value, nullptr);
+      else if (std::strcmp(name, "--framing") == 0 && std::strcmp(value, "basic") == 0)
+        config.host.frameFormats = static_cast<uint8_t>(protocol::frameFormatE::BASIC);
+      else if (std::strcmp(name, "--framing") == 0 && std::strcmp(value, "header") == 0)
+        config.host.frameFormats = static_cast<uint8_t>(protocol::frameFormatE::BASIC)
+                                   | static_cast<uint8_t>(protocol::frameFormatE::HEADER_CHECK);
+      else if (std::strcmp(name, "--framing") == 0 && std::strcmp(value, "fec") == 0)
+        config.host.frameFormats = protocol::SUPPORTED_FRAME_FORMATS;
+      else if (std::strcmp(name, "--drain-log") == 0)
+        config.host.drainLog = std::strtoul(value, nullptr, 10) != 0U;
+      else if (std::strcmp(name, "--bulk-window") == 0)
+        config.host.bulkWindow = std::strtoul(value, nullptr, 10);
+      else if (std::strcmp(name, "--bulk-load") == 0 && std::strcmp(value, "echo") == 0)
+        config.host.bulkRequest = protocol::signalIdE::ECHO_REQ;
+      else if (std::strcmp(name, "--bulk-load") == 0 && std::strcmp(value, "stats") == 0)
+        config.host.bulkRequest = protocol::signalIdE::STATS_REQ;
+      else if (std::strcmp(name, "--echo-bytes") == 0)
+        config.host.echoBytes = std::strtoul(value, nullptr, 10);
+      else if (std::strcmp(name, "--stream-hz") == 0)
+        config.host.streamRateHz = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+      else if (std::strcmp(name, "--stream-window") == 0)
+        config.host.streamWindow.samples = static_cast<uint16_t>(std::strtoul(value, nullptr, 10));
+      else if (std::strcmp(name, "--stream-bins") == 0)
+        config.host.streamWindow.bins = static_cast<uint8_t>(std::strtoul(value, nullptr, 10));
+      else if (std::strcmp(name, "--stream-bin-shift") == 0)
+        config.host.streamWindow.binShift = static_cast<uint8_t>(std::strtoul(value, nullptr, 10));
+      else
+        return false;
+    }
+    return (argc % 2) == 1 && config.baudRate != 0U;
+  }
+
+  void printDirection(const char* name, const sim::DirectionReportS& dir, double seconds, uint32_t baud)
+  {
+    const double goodput = static_cast<double>(dir.goodputBytes) / seconds;
+    std::cout << name << std::endl;
+    std::cout << "  frames sent        " << dir.framesSent << std::endl;
+    std::cout << "  frames received    " << dir.framesReceived << std::endl;
+    std::cout << "  frame loss         " << dir.frameLoss() * 100.0 << " %" << std::endl;
+    std::cout << "  goodput            " << goodput << " B/s ("
+              << goodput * 1000.0 / (baud / 10.0) << " permille of line)" << std::endl;
+    std::cout << "  line bytes         " << dir.line.bytesIn << " in, " << dir.line.bytesOut << " out, "
+              << dir.line.dropped << " dropped, " << dir.line.duplicated << " duplicated, "
+              << dir.line.corruptedBytes << " corrupted, " << dir.line.garbledBytes << " garbled" << std::endl;
+    std::cout << "  line busy          " << static_cast<double>(dir.line.busyNs) * 100.0 / (seconds * 1e9)
+              << " %" << std::endl;
+  }
+
+  void printPercentiles(const char* name, std::vector<uint64_t> values)
+  {
+    std::sort(values.begin(), values.end());
+    std::cout << "  " << std::setw(19) << std::left << name << std::right;
+    const double percentiles[] = {50.0, 99.0, 100.0};
+    for (double p : percentiles)
+    {
+      std::cout << " p" << static_cast<int>(p) << " " << std::setw(10)
+                << static_cast<double>(sim::LinkSimReportS::percentileNs(values, p)) / NS_PER_US;
+    }
+    std::cout << " us" << std::endl;
+  }
+
+  void printDuration(const char* name, uint64_t ns)
+  {
+    std::cout << "  " << name;
+    if (ns == sim::NEVER)
+      std::cout << "n/a" << std::endl;
+    else
+      std::cout << static_cast<double>(ns) / NS_PER_MS << " ms" << std::endl;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  sim::LinkSimConfigS config;
+  // 8 bins of 2^13 values cover the 16-bit sample range
+  config.host.streamWindow.binShift = 13;
+  if (!parseOptions(argc, argv, config))
+  {
+    printUsage();
+    return 0;
+  }
+
+  sim::LinkSimulator simulator(config);
+  sim::LinkSimReportS report = simulator.run();
+  const double seconds = static_cast<double>(report.durationNs) / 1e9;
+
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "seed " << config.seed << ", " << seconds << " s simulated at "
+            << config.baudRate << " baud" << std::endl;
+  printDirection("host -> target", report.hostToTarget, seconds, report.baudRate);
+  printDirection("target -> host", report.targetToHost, seconds, report.baudRate);
+
+  std::cout << "connection" << std::endl;
+  std::cout << "  connects           " << report.connects << std::endl;
+  std::cout << "  connect failures   " << report.connectFailures << std::endl;
+  std::cout << "  link losses        " << report.linkLosses << std::endl;
+  std::cout << "  button events      " << report.buttonInds << std::endl;
+  std::cout << "  session            v" << static_cast<unsigned>(report.session.version) << ", "
+            << protocol::frameFormatName(protocol::selectFrameFormat(report.session.frameFormats))
+            << ", max baud " << report.session.maxBaudRate << std::endl;
+  std::cout << "  baud rate          " << report.baudRate << " (" << report.upshifts << " upshifts, "
+            << report.upshiftFallbacks << " fallbacks, " << report.upshiftRecoveries << " recovered)" << std::endl;
+  printDuration("host detection     ", report.hostLossDetectionNs);
+  printDuration("target detection   ", report.targetLossDetectionNs);
+
+  const protocol::LinkStatsS& target = report.targetStats;
+  std::cout << "target counters" << std::endl;
+  std::cout << "  rx                 " << target.rxBytes << " bytes, " << target.rxFrames << " frames" << std::endl;
+  std::cout << "  tx                 " << target.txBytes << " bytes, " << target.txFrames << " frames" << std::endl;
+  std::cout << "  rx errors          " << target.crcErrors << " crc, " << target.lengthErrors << " length, "
+            << target.rxTimeouts << " timeouts" << std::endl;
+  std::cout << "  queue drops        " << target.rxQueueDrops << " rx, " << target.txQueueDrops << " tx" << std::endl;
+  std::cout << "  queue high water   " << static_cast<unsigned>(target.rxQueueHighWater) << " rx, "
+            << static_cast<unsigned>(target.txQueueHighWater) << " tx" << std::endl;
+  std::cout << "  main loop          busy " << report.targetLoop.dutyCyclePermille / 10.0 << "%, max latency";
+  for (uint32_t event = 0; event < Target::EVENT_COUNT; ++event)
+  {
+    std::cout << ' ' << protocol::loopEventName(static_cast<uint8_t>(event)) << ' '
+              << static_cast<double>(report.targetLoop.maxLatencyCycles[event]) * 1e6 / sim::Board::CORE_CLOCK_HZ;
+  }
+  std::cout << " us" << std::endl;
+  const char* const txClassNames[Target::TX_CLASS_COUNT] = {"control", "event", "bulk"};
+  for (uint32_t txClass = 0; txClass < Target::TX_CLASS_COUNT; ++txClass)
+  {
+    const Target::TxClassStatsS& stats = report.txClasses[txClass];
+    std::cout << "  tx " << std::setw(16) << std::left << txClassNames[txClass] << std::right
+              << stats.frames << " frames, " << stats.drops << " dropped, high water "
+              << static_cast<unsigned>(stats.highWater) << ", max wait "
+              << static_cast<double>(stats.maxWaitCycles) * 1e6 / sim::Board::CORE_CLOCK_HZ << " us" << std::endl;
+  }
+
+  std::cout << "tick rtt (" << report.tickRttNs.size() << " samples, " << report.ticksConfirmed
+            << " of " << report.ticksSent << " ticks confirmed)" << std::endl;
+  const double percentiles[] = {50.0, 90.0, 99.0, 100.0};
+  for (double p : percentiles)
+  {
+    std::cout << "  p" << std::setw(18) << std::left << static_cast<int>(p) << std::right
+              << static_cast<double>(report.rttPercentileNs(p)) / NS_PER_US << " us" << std::endl;
+  }
+
+  std::cout << "clock sync error (" << report.syncErrorNs.size() << " samples, drift "
+            << report.driftPpm << " ppm, injected " << config.clockSkewPpm << " ppm)" << std::endl;
+  for (double p : percentiles)
+  {
+    std::cout << "  p" << std::setw(18) << std::left << static_cast<int>(p) << std::right
+              << static_cast<double>(report.syncErrorPercentileNs(p)) / NS_PER_US << " us" << std::endl;
+  }
+
+  std::cout << "button latency (" << report.buttonLatency.size() << " of " << report.buttonInds
+            << " events timestamped)" << std::endl;
+  std::vector<uint64_t> stages[4];
+  for (const sim::HostModel::ButtonLatencyS& latency : report.buttonLatency)
+  {
+    stages[0].push_back(latency.targetNs);
+    stages[1].push_back(latency.queueNs);
+    stages[2].push_back(latency.wireNs);
+    stages[3].push_back(latency.totalNs);
+  }
+  printPercentiles("target", stages[0]);
+  printPercentiles("queue", stages[1]);
+  printPercentiles("wire", stages[2]);
+  printPercentiles("total", stages[3]);
+  printPercentiles("press time error", report.pressErrorNs);
+
+  if (config.host.bulkWindow != 0U)
+  {
+    std::cout << "bulk load (" << config.host.bulkWindow << " "
+              << (config.host.bulkRequest == protocol::signalIdE::ECHO_REQ ? "ECHO_REQ" : "STATS_REQ")
+              << " in flight)" << std::endl;
+    std::cout << "  answers            " << report.bulkReceived << " of " << report.bulkSent << std::endl;
+    std::cout << "  goodput            " << static_cast<double>(report.bulkBytes) / seconds << " B/s" << std::endl;
+  }
+
+  if (config.host.streamRateHz != 0U)
+  {
+    // Line bytes of the target -> host direction, streaming is most of it
+    const uint64_t lineBytes = report.targetToHost.line.bytesIn;
+    const double sampleBytes = static_cast<double>(report.streamSamples * protocol::STREAM_SAMPLE_SIZE);
+    std::cout << "telemetry stream (" << config.host.streamRateHz << " Hz, ";
+    if (config.host.streamWindow.samples == 0U)
+      std::cout << "raw)" << std::endl;
+    else
+      std::cout << config.host.streamWindow.samples << " sample windows, "
+                << static_cast<unsigned>(config.host.streamWindow.bins) << " bins)" << std::endl;
+    std::cout << "  samples            " << report.streamSamples << " received in " << report.streamFrames
+              << " frames, " << static_cast<double>(report.streamSamples) / seconds << " /s" << std::endl;
+    std::cout << "  lost               " << report.streamLost << " (target dropped "
+              << report.targetStream.dropped << " of " << report.targetStream.samples << " since the last start), "
+              << report.streamCorrupt << " corrupt" << std::endl;
+    std::cout << "  line bytes/sample  "
+              << (report.streamSamples != 0U ? static_cast<double>(lineBytes) / report.streamSamples : 0.0)
+              << std::endl;
+    if (config.host.streamWindow.samples == 0U)
+    {
+      std::cout << "  payload efficiency "
+                << (lineBytes != 0U ? sampleBytes * 100.0 / static_cast<double>(lineBytes) : 0.0)
+                << " % sample bytes per line byte" << std::endl;
+    }
+  }
+
+  if (config.host.drainLog)
+  {
+    // Drain throughput over the drains that read records
+    uint64_t records {0};
+    uint64_t lost {0};
+    uint64_t drainNs {0};
+    size_t complete {0};
+    std::vector<uint64_t> durations;
+    for (const sim::HostModel::LogDrainS& drain : report.logDrains)
+    {
+      records += drain.records;
+      lost += drain.lost;
+      complete += drain.complete ? 1U : 0U;
+      durations.push_back(drain.durationNs);
+      if (drain.records != 0U)
+        drainNs += drain.durationNs;
+    }
+    std::cout << "flight log (" << report.logDrains.size() << " drains, " << complete << " complete)" << std::endl;
+    std::cout << "  records            " << records << " read, " << lost << " overwritten before read" << std::endl;
+    printPercentiles("drain time", durations);
+    const double drainSeconds = static_cast<double>(drainNs) / 1e9;
+    std::cout << "  throughput         " << (drainSeconds > 0.0 ? records / drainSeconds : 0.0)
+              << " records/s" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,263 @@
+#include "linkSimulator.hpp"
+
+#include <algorithm>
+
+namespace sim
+{
+  namespace
+  {
+    // Upper bound of process() iterations per simulated instant
+    constexpr unsigned MAX_STEPS_PER_EVENT = 256;
+    // Period of the clock sync accuracy check
+    constexpr uint64_t SYNC_CHECK_PERIOD_NS = 100000000ULL;
+
+    std::vector<uint64_t> pressTimes(const LinkSimConfigS& config)
+    {
+      if (!config.pressTimesNs.empty() || config.pressIntervalNs == 0U)
+        return config.pressTimesNs;
+
+      std::vector<uint64_t> times;
+      for (uint64_t t = config.pressIntervalNs; t < config.durationNs; t += config.pressIntervalNs)
+      {
+        times.push_back(t);
+      }
+      return times;
+    }
+  }
+
+  double DirectionReportS::frameLoss() const
+  {
+    if (framesSent == 0U)
+      return 0.0;
+    return 1.0 - static_cast<double>(std::min(framesReceived, framesSent)) /
+                 static_cast<double>(framesSent);
+  }
+
+  uint64_t LinkSimReportS::rttPercentileNs(double percentile) const
+  {
+    return percentileNs(tickRttNs, percentile);
+  }
+
+  uint64_t LinkSimReportS::syncErrorPercentileNs(double percentile) const
+  {
+    return percentileNs(syncErrorNs, percentile);
+  }
+
+  uint64_t LinkSimReportS::percentileNs(const std::vector<uint64_t>& sorted, double percentile)
+  {
+    if (sorted.empty())
+      return 0;
+    size_t index = static_cast<size_t>(percentile / 100.0 * static_cast<double>(sorted.size() - 1U) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1U)];
+  }
+
+  // ---------------------------------------------------------------------------
+  // Target side of the line
+  // ---------------------------------------------------------------------------
+  LinkSimulator::TargetPort::TargetPort(LinkChannel& toHost, LinkChannel& toTarget,
+                                        DirectionReportS& rxReport)
+    : toHost_{toHost}, toTarget_{toTarget}, rxReport_{rxReport}
+  {
+  }
+
+  void LinkSimulator::TargetPort::write(const uint8_t* data, size_t len, uint64_t nowNs)
+  {
+    for (size_t i = 0; i < len; ++i)
+    {
+      if (txTap_.processByte(data[i]).valid)
+        ++framesWritten_;
+    }
+    toHost_.push(data, len, nowNs);
+  }
+
+  bool LinkSimulator::TargetPort::read(uint8_t& byte, uint64_t nowNs)
+  {
+    if (!toTarget_.pop(byte, nowNs))
+      return false;
+
+    auto res = rxTap_.processByte(byte);
+    if (res.valid)
+    {
+      ++rxReport_.framesReceived;
+      rxReport_.goodputBytes += 1U + res.frame.payloadLen;
+    }
+    return true;
+  }
+
+  void LinkSimulator::TargetPort::setBaudRate(uint32_t baudRate)
+  {
+    toHost_.setBaudRate(baudRate);
+    toTarget_.setReceiverBaudRate(baudRate);
+  }
+
+  // ---------------------------------------------------------------------------
+  // Simulator
+  // ---------------------------------------------------------------------------
+  LinkSimulator::LinkSimulator(const LinkSimConfigS& config)
+    : config_{config},
+      toTarget_{config.seed, config.baudRate},
+      toHost_{config.seed ^ 0x9E3779B97F4A7C15ULL, config.baudRate},
+      port_{toHost_, toTarget_, report_.hostToTarget},
+      board_{clock_, port_},
+      host_{toTarget_, config.host},
+      buttons_{pressTimes(config)}
+  {
+    ImpairmentS hostToTarget = config_.hostToTarget;
+    hostToTarget.latencyNs = config_.propagationNs;
+    toTarget_.setImpairment(hostToTarget);
+
+    ImpairmentS targetToHost = config_.targetToHost;
+    targetToHost.latencyNs = config_.propagationNs;
+    toHost_.setImpairment(targetToHost);
+
+    board_.setButtonSource(&buttons_);
+    board_.setClockSkewPpm(config_.clockSkewPpm);
+    board_.setDefaultBaudRate(config_.baudRate);
+  }
+
+  LinkSimReportS LinkSimulator::run()
+  {
+    bool linkDown = false;
+    Target::StateE lastTargetState = Target::StateE::IDLE;
+    uint64_t nextSyncCheckNs = SYNC_CHECK_PERIOD_NS;
+
+    board_.start();
+    host_.start(clock_.nowNs());
+
+    while (clock_.nowNs() < config_.durationNs)
+    {
+      const uint64_t now = clock_.nowNs();
+
+      if (!linkDown && now >= config_.linkDownNs)
+      {
+        linkDown = true;
+        ImpairmentS cut = toTarget_.impairment();
+        cut.dropRate = 1.0;
+        toTarget_.setImpairment(cut);
+        cut = toHost_.impairment();
+        cut.dropRate = 1.0;
+        toHost_.setImpairment(cut);
+      }
+
+      // Target runs until it has nothing left to do at this instant
+      for (unsigned i = 0; i < MAX_STEPS_PER_EVENT; ++i)
+      {
+        board_.step();
+        if (board_.sleeping())
+          break;
+      }
+
+      const Target::StateE targetState = board_.target().state();
+      if (linkDown && report_.targetLossDetectionNs == NEVER &&
+          lastTargetState != Target::StateE::IDLE && targetState == Target::StateE::IDLE)
+      {
+        report_.targetLossDetectionNs = now - config_.linkDownNs;
+      }
+      lastTargetState = targetState;
+
+      // Host side, its receiver follows every rate switch
+      uint8_t byte;
+      toHost_.setReceiverBaudRate(host_.baudRate());
+      while (toHost_.pop(byte, now))
+      {
+        host_.onByte(byte, now);
+        toHost_.setReceiverBaudRate(host_.baudRate());
+      }
+      host_.onTimer(now);
+
+      if (now >= nextSyncCheckNs)
+      {
+        nextSyncCheckNs += SYNC_CHECK_PERIOD_NS;
+        checkClockSync(now);
+      }
+
+      if (linkDown && report_.hostLossDetectionNs == NEVER && host_.stats().linkLosses != 0U)
+      {
+        report_.hostLossDetectionNs = host_.stats().firstLossNs - config_.linkDownNs;
+      }
+
+      // Jump to the next event
+      uint64_t next = std::min(board_.nextEventNs(), host_.nextTimerNs());
+      next = std::min(next, toHost_.nextDeliveryNs());
+      next = std::min(next, nextSyncCheckNs);
+      if (!linkDown)
+        next = std::min(next, config_.linkDownNs);
+      if (next <= now)
+        continue;
+      clock_.advanceTo(std::min(next, config_.durationNs));
+    }
+
+    const HostModel::StatsS& hostStats = host_.stats();
+    report_.durationNs = clock_.nowNs();
+    report_.hostToTarget.framesSent = hostStats.framesSent;
+    report_.hostToTarget.line = toTarget_.counters();
+    report_.targetToHost.framesSent = port_.framesWritten();
+    report_.targetToHost.framesReceived = hostStats.framesReceived;
+    report_.targetToHost.goodputBytes = hostStats.bytesReceived;
+    report_.targetToHost.line = toHost_.counters();
+    report_.connects = hostStats.connects;
+    report_.connectFailures = hostStats.connectFailures;
+    report_.linkLosses = hostStats.linkLosses;
+    report_.buttonInds = hostStats.buttonInds;
+    report_.ticksSent = hostStats.ticksSent;
+    report_.ticksConfirmed = hostStats.ticksConfirmed;
+    report_.session = host_.session();
+    report_.baudRate = host_.baudRate();
+    report_.upshifts = hostStats.upshifts;
+    report_.upshiftFallbacks = hostStats.upshiftFallbacks;
+    report_.upshiftRecoveries = hostStats.upshiftRecoveries;
+    report_.tickRttNs = hostStats.tickRttNs;
+    std::sort(report_.tickRttNs.begin(), report_.tickRttNs.end());
+    std::sort(report_.syncErrorNs.begin(), report_.syncErrorNs.end());
+    report_.driftPpm = host_.clockSync().driftPpm();
+    report_.buttonLatency = hostStats.buttonLatency;
+    report_.logDrains = hostStats.logDrains;
+    report_.bulkSent = hostStats.bulkSent;
+    report_.bulkReceived = hostStats.bulkReceived;
+    report_.bulkBytes = hostStats.bulkBytes;
+    report_.streamFrames = hostStats.streamFrames;
+    report_.streamSamples = hostStats.streamSamples;
+    report_.streamLost = hostStats.streamLost;
+    report_.streamCorrupt = hostStats.streamCorrupt;
+    report_.targetStream = board_.target().streamStats();
+    report_.targetStats = board_.target().linkStats();
+    report_.targetLoop = board_.target().loopStats();
+    for (uint32_t txClass = 0; txClass < Target::TX_CLASS_COUNT; ++txClass)
+    {
+      report_.txClasses[txClass] = board_.target().txClassStats(static_cast<Target::TxClassE>(txClass));
+    }
+    checkPressTimes();
+    return report_;
+  }
+
+  void LinkSimulator::checkClockSync(uint64_t nowNs)
+  {
+    const ClockSync& clockSync = host_.clockSync();
+    if (!host_.connected() || !clockSync.synced())
+      return;
+
+    // The virtual clock is the host clock, the target stamps with its own
+    const uint64_t estimateNs = clockSync.toHostUs(board_.target().timestampUs()) * 1000U;
+    report_.syncErrorNs.push_back(estimateNs > nowNs ? estimateNs - nowNs : nowNs - estimateNs);
+  }
+
+  void LinkSimulator::checkPressTimes()
+  {
+    // Presses while the button is disabled are not reported, match the nearest one
+    const std::vector<uint64_t> truth = pressTimes(config_);
+    if (truth.empty())
+      return;
+
+    for (const HostModel::ButtonLatencyS& latency : report_.buttonLatency)
+    {
+      const auto next = std::lower_bound(truth.begin(), truth.end(), latency.pressNs);
+      uint64_t error = NEVER;
+      if (next != truth.end())
+        error = *next - latency.pressNs;
+      if (next != truth.begin())
+        error = std::min(error, latency.pressNs - *(next - 1));
+      report_.pressErrorNs.push_back(error);
+    }
+    std::sort(report_.pressErrorNs.begin(), report_.pressErrorNs.end());
+  }
+} // namespace sim
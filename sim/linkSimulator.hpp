@@ -0,0 +1,149 @@
+#pragma once
+
+#include "board.hpp"
+#include "buttonScript.hpp"
+#include "hostModel.hpp"
+#include "linkChannel.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace sim
+{
+  /**
+   * @brief Link simulation parameters.
+   */
+  struct LinkSimConfigS
+  {
+    uint64_t seed {1};
+    uint64_t durationNs {60000000000ULL};
+    uint32_t baudRate {115200};         ///< Rate both ends start at
+    uint64_t propagationNs {0};
+    ImpairmentS hostToTarget {};        ///< latencyNs is overridden by propagationNs
+    ImpairmentS targetToHost {};
+    HostModel::ConfigS host {};
+    uint64_t pressIntervalNs {0};       ///< Button press period, 0 = no presses
+    std::vector<uint64_t> pressTimesNs; ///< Scripted presses, replace pressIntervalNs if not empty
+    uint64_t linkDownNs {NEVER};        ///< Time the line is cut in both directions
+    double clockSkewPpm {0.0};          ///< Target crystal error, positive = fast
+  };
+
+  /**
+   * @brief Per-direction results.
+   */
+  struct DirectionReportS
+  {
+    uint64_t framesSent {0};
+    uint64_t framesReceived {0};        ///< Frames with a valid CRC at the far end
+    uint64_t goodputBytes {0};          ///< SIG + PAYLOAD bytes of valid frames
+    ChannelCountersS line {};
+
+    double frameLoss() const;
+  };
+
+  /**
+   * @brief Link simulation results.
+   */
+  struct LinkSimReportS
+  {
+    uint64_t durationNs {0};
+    DirectionReportS hostToTarget {};
+    DirectionReportS targetToHost {};
+    uint64_t connects {0};
+    uint64_t connectFailures {0};
+    uint64_t linkLosses {0};
+    uint64_t buttonInds {0};
+    uint64_t ticksSent {0};
+    uint64_t ticksConfirmed {0};
+    protocol::CapabilitiesS session {};  ///< Last configuration confirmed by the target
+    uint32_t baudRate {0};              ///< Host rate at the end of the run
+    uint64_t upshifts {0};
+    uint64_t upshiftFallbacks {0};
+    uint64_t upshiftRecoveries {0};
+    std::vector<uint64_t> tickRttNs;    ///< Sorted
+    std::vector<uint64_t> syncErrorNs;  ///< Sorted |host estimate - true time| of target timestamps
+    double driftPpm {0.0};              ///< Drift estimated by the host at the end of the run
+    std::vector<HostModel::ButtonLatencyS> buttonLatency;
+    protocol::LinkStatsS targetStats {};  ///< Target::linkStats() at the end of the run
+    Target::LoopStatsS targetLoop {};     ///< Target::loopStats() at the end of the run
+    Target::TxClassStatsS txClasses[Target::TX_CLASS_COUNT] {};  ///< Target::txClassStats() at the end
+    std::vector<uint64_t> pressErrorNs; ///< Sorted |estimated - true press time|
+    std::vector<HostModel::LogDrainS> logDrains;  ///< Flight recorder drains, one per connect
+    uint64_t bulkSent {0};              ///< Bulk load requests
+    uint64_t bulkReceived {0};
+    uint64_t bulkBytes {0};
+    uint64_t streamFrames {0};          ///< Telemetry stream, host side
+    uint64_t streamSamples {0};
+    uint64_t streamLost {0};
+    uint64_t streamCorrupt {0};
+    Target::StreamStatsS targetStream {};  ///< Target::streamStats() at the end of the run
+    uint64_t hostLossDetectionNs {NEVER};   ///< Link cut -> host watchdog
+    uint64_t targetLossDetectionNs {NEVER}; ///< Link cut -> target back in IDLE
+
+    uint64_t rttPercentileNs(double percentile) const;
+    uint64_t syncErrorPercentileNs(double percentile) const;
+
+    static uint64_t percentileNs(const std::vector<uint64_t>& sorted, double percentile);
+  };
+
+  /**
+   * @brief Deterministic discrete-event co-simulation of the host logic and
+   * the unmodified Target over a virtual 8N1 line.
+   *
+   * Everything runs on one thread against a VirtualClock. Time jumps to the
+   * next event of the board, the host model or the line, so a run only
+   * depends on its configuration and seed.
+   */
+  class LinkSimulator
+  {
+  public:
+    explicit LinkSimulator(const LinkSimConfigS& config);
+
+    LinkSimReportS run();
+
+  private:
+    /**
+     * @brief Compare the host's estimate of the current target time with the virtual clock.
+     */
+    void checkClockSync(uint64_t nowNs);
+
+    /**
+     * @brief Compare the host's press time estimates with the injected presses.
+     */
+    void checkPressTimes();
+
+    /**
+     * @brief Target side of the virtual line.
+     */
+    class TargetPort : public UartPort
+    {
+    public:
+      TargetPort(LinkChannel& toHost, LinkChannel& toTarget, DirectionReportS& rxReport);
+
+      void write(const uint8_t* data, size_t len, uint64_t nowNs) override;
+      bool read(uint8_t& byte, uint64_t nowNs) override;
+      void setBaudRate(uint32_t baudRate) override;
+      uint64_t nextEventNs() const override { return toTarget_.nextDeliveryNs(); }
+
+      uint64_t framesWritten() const { return framesWritten_; }
+
+    private:
+      LinkChannel& toHost_;
+      LinkChannel& toTarget_;
+      DirectionReportS& rxReport_;
+      protocol::Decoder txTap_;   ///< Counts frames put on the line by the target
+      protocol::Decoder rxTap_;   ///< Counts valid frames seen by the target
+      uint64_t framesWritten_ {0};
+    };
+
+    LinkSimConfigS config_;
+    LinkSimReportS report_ {};
+    VirtualClock clock_;
+    LinkChannel toTarget_;
+    LinkChannel toHost_;
+    TargetPort port_;
+    Board board_;
+    HostModel host_;
+    ScriptedButtons buttons_;
+  };
+} // namespace sim
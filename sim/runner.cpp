@@ -0,0 +1,59 @@
+#include "runner.hpp"
+
+#include <poll.h>
+
+#include <cerrno>
+#include <ctime>
+
+namespace sim
+{
+  namespace
+  {
+    // Upper bound of process() iterations per board before moving on,
+    // keeps a busy board from starving the others on the same thread
+    constexpr unsigned MAX_STEPS_PER_ROUND = 64;
+  }
+
+  void runRealTime(const std::vector<Board*>& boards, const std::atomic<bool>& running)
+  {
+    std::vector<pollfd> fds;
+    fds.reserve(boards.size());
+
+    while (running)
+    {
+      uint64_t next = NEVER;
+      for (Board* board : boards)
+      {
+        for (unsigned i = 0; i < MAX_STEPS_PER_ROUND; ++i)
+        {
+          board->step();
+          if (board->sleeping())
+            break;
+        }
+        const uint64_t boardNext = board->nextEventNs();
+        if (boardNext < next)
+          next = boardNext;
+      }
+
+      if (boards.empty())
+        return;
+
+      const uint64_t now = boards.front()->clock().nowNs();
+      if (next <= now)
+        continue;
+
+      fds.clear();
+      for (Board* board : boards)
+      {
+        if (board->uart().fd() >= 0)
+          fds.push_back(pollfd{board->uart().fd(), POLLIN, 0});
+      }
+
+      const uint64_t waitNs = (next == NEVER) ? 1000000ULL : next - now;
+      timespec timeout {};
+      timeout.tv_sec = static_cast<time_t>(waitNs / 1000000000ULL);
+      timeout.tv_nsec = static_cast<long>(waitNs % 1000000000ULL);
+      ppoll(fds.data(), fds.size(), &timeout, nullptr);
+    }
+  }
+} // namespace sim
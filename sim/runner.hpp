@@ -0,0 +1,17 @@
+#pragma once
+
+#include "board.hpp"
+
+#include <atomic>
+#include <vector>
+
+namespace sim
+{
+  /**
+   * @brief Run boards against a real-time clock on the calling thread.
+   *
+   * Each board is stepped until it goes to WFI, then the thread sleeps until
+   * the earliest board event or until one of the UART descriptors is readable.
+   */
+  void runRealTime(const std::vector<Board*>& boards, const std::atomic<bool>& running);
+} // namespace sim
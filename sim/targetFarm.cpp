@@ -0,0 +1,225 @@
+#include "board.hpp"
+#include "linkChannel.hpp"
+#include "runner.hpp"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  std::atomic<bool> running {true};
+
+  void onSignal(int)
+  {
+    running = false;
+  }
+
+  struct OptionsS
+  {
+    size_t boards {1};
+    size_t threads {1};
+    uint64_t latencyMs {0};
+    uint64_t pressIntervalMs {0};   ///< Mean interval of random presses, 0 = off
+    double dropRate {0.0};
+    double bitErrorRate {0.0};
+    uint64_t seed {1};
+    std::string linkDir;
+  };
+
+  /**
+   * @brief Button presses with exponentially distributed intervals.
+   */
+  class RandomButtons : public sim::ButtonSource
+  {
+  public:
+    RandomButtons(const sim::Clock& clock, uint64_t meanIntervalNs, uint64_t seed)
+      : clock_{clock}, interval_{1.0 / static_cast<double>(meanIntervalNs)}, rng_{seed}
+    {
+      advance();
+    }
+
+    uint64_t nextPressNs() const override { return nextPressNs_; }
+
+    void advance() override
+    {
+      nextPressNs_ = clock_.nowNs() + static_cast<uint64_t>(interval_(rng_));
+    }
+
+  private:
+    const sim::Clock& clock_;
+    std::exponential_distribution<double> interval_;
+    std::mt19937_64 rng_;
+    uint64_t nextPressNs_ {sim::NEVER};
+  };
+
+  /**
+   * @brief One virtual board with its pty and fault injection.
+   */
+  struct InstanceS
+  {
+    InstanceS(sim::Clock& clock, uint64_t seed)
+      : port{pty, seed}, board{clock, port}
+    {
+    }
+
+    sim::PtyPort pty;
+    sim::ImpairedPort port;
+    sim::Board board;
+    std::unique_ptr<RandomButtons> buttons;
+  };
+
+  void printUsage()
+  {
+    std::cout << "Usage: target_farm <boards> [options]" << std::endl;
+    std::cout << "  --threads <n>            worker threads (default 1)" << std::endl;
+    std::cout << "  --latency-ms <ms>        response latency added to every TX byte" << std::endl;
+    std::cout << "  --press-interval-ms <ms> mean interval of random button presses" << std::endl;
+    std::cout << "  --drop <p>               byte drop probability (both directions)" << std::endl;
+    std::cout << "  --ber <p>                bit error rate (both directions)" << std::endl;
+    std::cout << "  --seed <n>               PRNG seed (default 1)" << std::endl;
+    std::cout << "  --link-dir <dir>         create <dir>/board<i> symlinks to the ptys" << std::endl;
+  }
+
+  bool parseOptions(int argc, char* argv[], OptionsS& options)
+  {
+    if (argc < 2)
+      return false;
+
+    options.boards = std::strtoul(argv[1], nullptr, 10);
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+      const char* value = argv[i + 1];
+      if (std::strcmp(argv[i], "--threads") == 0)
+        options.threads = std::strtoul(value, nullptr, 10);
+      else if (std::strcmp(argv[i], "--latency-ms") == 0)
+        options.latencyMs = std::strtoull(value, nullptr, 10);
+      else if (std::strcmp(argv[i], "--press-interval-ms") == 0)
+        options.pressIntervalMs = std::strtoull(value, nullptr, 10);
+      else if (std::strcmp(argv[i], "--drop") == 0)
+        options.dropRate = std::strtod(value, nullptr);
+      else if (std::strcmp(argv[i], "--ber") == 0)
+        options.bitErrorRate = std::strtod(value, nullptr);
+      else if (std::strcmp(argv[i], "--seed") == 0)
+        options.seed = std::strtoull(value, nullptr, 10);
+      else if (std::strcmp(argv[i], "--link-dir") == 0)
+        options.linkDir = value;
+      else
+        return false;
+    }
+    return (argc % 2) == 0 && options.boards > 0U && options.threads > 0U;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  OptionsS options;
+  if (!parseOptions(argc, argv, options))
+  {
+    printUsage();
+    return 0;
+  }
+
+  sim::RealClock clock;
+  sim::ImpairmentS impairment;
+  impairment.dropRate = options.dropRate;
+  impairment.bitErrorRate = options.bitErrorRate;
+
+  std::vector<std::unique_ptr<InstanceS>> instances;
+  for (size_t i = 0; i < options.boards; ++i)
+  {
+    const uint64_t seed = options.seed * 1000003ULL + i;
+    std::unique_ptr<InstanceS> instance(new InstanceS(clock, seed));
+    if (!instance->pty.isOpen())
+    {
+      std::cout << "[target_farm] Failed to create pty for board " << i << std::endl;
+      return 1;
+    }
+
+    sim::ImpairmentS txImpairment = impairment;
+    txImpairment.latencyNs = options.latencyMs * 1000000ULL;
+    instance->port.tx().setImpairment(txImpairment);
+    instance->port.rx().setImpairment(impairment);
+
+    if (options.pressIntervalMs != 0U)
+    {
+      instance->buttons.reset(new RandomButtons(clock, options.pressIntervalMs * 1000000ULL, ~seed));
+      instance->board.setButtonSource(instance->buttons.get());
+    }
+
+    if (!options.linkDir.empty())
+    {
+      std::string link = options.linkDir + "/board" + std::to_string(i);
+      unlink(link.c_str());
+      if (symlink(instance->pty.slaveName().c_str(), link.c_str()) != 0)
+      {
+        std::cout << "[target_farm] Failed to create link " << link << std::endl;
+        return 1;
+      }
+    }
+
+    std::cout << "[target_farm] board " << i << ": " << instance->pty.slaveName() << std::endl;
+    instance->board.start();
+    instances.push_back(std::move(instance));
+  }
+
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+
+  // Boards are spread round-robin over the worker threads
+  std::vector<std::vector<sim::Board*>> groups(options.threads);
+  for (size_t i = 0; i < instances.size(); ++i)
+  {
+    groups[i % options.threads].push_back(&instances[i]->board);
+  }
+
+  std::vector<std::thread> workers;
+  for (auto& group : groups)
+  {
+    workers.emplace_back([&group]() { sim::runRealTime(group, running); });
+  }
+  std::cout << "[target_farm] Running " << instances.size() << " boards on "
+            << workers.size() << " threads" << std::endl;
+
+  for (auto& worker : workers)
+  {
+    worker.join();
+  }
+
+  // Summary
+  size_t connected {0};
+  sim::ChannelCountersS tx {};
+  sim::ChannelCountersS rx {};
+  for (size_t i = 0; i < instances.size(); ++i)
+  {
+    InstanceS& instance = *instances[i];
+    if (instance.board.target().state() != Target::StateE::IDLE)
+      ++connected;
+
+    tx.bytesIn += instance.port.tx().counters().bytesIn;
+    tx.dropped += instance.port.tx().counters().dropped;
+    tx.corruptedBytes += instance.port.tx().counters().corruptedBytes;
+    rx.bytesIn += instance.port.rx().counters().bytesIn;
+    rx.dropped += instance.port.rx().counters().dropped;
+    rx.corruptedBytes += instance.port.rx().counters().corruptedBytes;
+
+    if (!options.linkDir.empty())
+      unlink((options.linkDir + "/board" + std::to_string(i)).c_str());
+  }
+
+  std::cout << "[target_farm] Connected at exit: " << connected << "/" << instances.size() << std::endl;
+  std::cout << "[target_farm] TX bytes " << tx.bytesIn << ", dropped " << tx.dropped
+            << ", corrupted " << tx.corruptedBytes << std::endl;
+  std::cout << "[target_farm] RX bytes " << rx.bytesIn << ", dropped " << rx.dropped
+            << ", corrupted " << rx.corruptedBytes << std::endl;
+  return 0;
+}
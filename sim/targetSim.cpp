@@ -0,0 +1,113 @@
+#include "board.hpp"
+#include "buttonScript.hpp"
+#include "runner.hpp"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+  std::atomic<bool> running {true};
+
+  void onSignal(int)
+  {
+    running = false;
+  }
+
+  void printUsage()
+  {
+    std::cout << "Usage: target_sim [--link <path>] [--gpio-trace <file>] [--clock-skew-ppm <ppm>]" << std::endl;
+    std::cout << "                  [--press-script <file>]" << std::endl;
+    std::cout << "  --link <path>        create a symlink to the simulated UART pty" << std::endl;
+    std::cout << "  --gpio-trace <file>  record LED changes as '<time_us> P<port><pin>=<level>'" << std::endl;
+    std::cout << "  --clock-skew-ppm <ppm> run the board clock fast (positive) or slow" << std::endl;
+    std::cout << "  --press-script <file> press the button at scripted times, one per line:" << std::endl;
+    std::cout << "                       '<ms>' or '<start_ms> <count> <interval_ms>'" << std::endl;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  std::string linkPath;
+  std::string tracePath;
+  double clockSkewPpm {0.0};
+  std::vector<uint64_t> pressTimesNs;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strcmp(argv[i], "--link") == 0 && i + 1 < argc)
+    {
+      linkPath = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--gpio-trace") == 0 && i + 1 < argc)
+    {
+      tracePath = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--clock-skew-ppm") == 0 && i + 1 < argc)
+    {
+      clockSkewPpm = std::strtod(argv[++i], nullptr);
+    }
+    else if (std::strcmp(argv[i], "--press-script") == 0 && i + 1 < argc)
+    {
+      std::ifstream script(argv[++i]);
+      if (!script || !sim::readPressScript(script, pressTimesNs))
+      {
+        std::cout << "[target_sim] Invalid press script " << argv[i] << std::endl;
+        return 1;
+      }
+    }
+    else
+    {
+      printUsage();
+      return 0;
+    }
+  }
+
+  sim::PtyPort uart;
+  if (!uart.isOpen())
+  {
+    std::cout << "[target_sim] Failed to create pty" << std::endl;
+    return 1;
+  }
+
+  if (!linkPath.empty())
+  {
+    unlink(linkPath.c_str());
+    if (symlink(uart.slaveName().c_str(), linkPath.c_str()) != 0)
+    {
+      std::cout << "[target_sim] Failed to create link " << linkPath << std::endl;
+      return 1;
+    }
+  }
+
+  std::ofstream trace;
+  sim::RealClock clock;
+  sim::Board board(clock, uart);
+  board.setClockSkewPpm(clockSkewPpm);
+  sim::ScriptedButtons buttons(pressTimesNs);
+  board.setButtonSource(&buttons);
+  if (!tracePath.empty())
+  {
+    trace.open(tracePath);
+    board.setGpioTrace(&trace);
+  }
+
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+
+  std::cout << "[target_sim] UART is " << uart.slaveName() << std::endl;
+  board.start();
+  sim::runRealTime({&board}, running);
+
+  if (!linkPath.empty())
+    unlink(linkPath.c_str());
+  std::cout << "[target_sim] Stopped" << std::endl;
+  return 0;
+}
@@ -0,0 +1,292 @@
+#include "timerService.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Host build of the target TimerService. tick() stands for the 1 ms timer
+// ISR and process() for the main loop; several tick() calls before one
+// process() model a main loop that fell behind the ISR.
+
+namespace
+{
+  using Timers = TimerService<8>;
+
+  struct ExpiryS
+  {
+    char name;
+    uint32_t tick;
+  };
+
+  struct FixtureS
+  {
+    Timers timers;
+    uint32_t now {0};                 ///< Ticks counted by the "ISR"
+    std::vector<ExpiryS> expiries;
+  };
+
+  struct TimerContextS
+  {
+    FixtureS* fixture;
+    char name;
+    Timers::TimerIdT stopOnExpiry;
+  };
+
+  void onExpiry(void* context)
+  {
+    TimerContextS& timer = *static_cast<TimerContextS*>(context);
+    timer.fixture->expiries.push_back({timer.name, timer.fixture->now});
+    if (timer.stopOnExpiry != Timers::INVALID_TIMER)
+      timer.fixture->timers.stop(timer.stopOnExpiry);
+  }
+
+  // One ISR tick followed by one main loop pass
+  void step(FixtureS& fixture, uint32_t ticks)
+  {
+    for (uint32_t i = 0; i < ticks; ++i)
+    {
+      ++fixture.now;
+      fixture.timers.tick();
+      fixture.timers.process();
+    }
+  }
+
+  // Ticks counted by the ISR while the main loop was busy, then one pass
+  void stepLate(FixtureS& fixture, uint32_t ticks)
+  {
+    for (uint32_t i = 0; i < ticks; ++i)
+    {
+      ++fixture.now;
+      fixture.timers.tick();
+    }
+    fixture.timers.process();
+  }
+
+  unsigned failures = 0;
+
+  void check(bool condition, const std::string& what)
+  {
+    if (!condition)
+    {
+      std::cout << "FAIL: " << what << std::endl;
+      ++failures;
+    }
+  }
+
+  std::string names(const std::vector<ExpiryS>& expiries)
+  {
+    std::string result;
+    for (const ExpiryS& expiry : expiries)
+      result += expiry.name;
+    return result;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Tests
+  // ---------------------------------------------------------------------------
+  void oneShotExpiry()
+  {
+    FixtureS fixture;
+    TimerContextS a {&fixture, 'A', Timers::INVALID_TIMER};
+    const Timers::TimerIdT id = fixture.timers.create(onExpiry, &a);
+    check(id != Timers::INVALID_TIMER, "one-shot: create");
+
+    fixture.timers.startOneShot(id, 3);
+    check(fixture.timers.isActive(id), "one-shot: active after start");
+    step(fixture, 2);
+    check(fixture.expiries.empty(), "one-shot: not expired before its timeout");
+    step(fixture, 1);
+    check(fixture.expiries.size() == 1 && fixture.expiries[0].tick == 3,
+          "one-shot: expires on tick 3");
+    check(!fixture.timers.isActive(id), "one-shot: inactive after expiry");
+    step(fixture, 10);
+    check(fixture.expiries.size() == 1, "one-shot: expires only once");
+
+    // A zero timeout still waits for the next tick
+    fixture.expiries.clear();
+    fixture.timers.startOneShot(id, 0);
+    fixture.timers.process();
+    check(fixture.expiries.empty(), "one-shot: not expired in the start tick");
+    step(fixture, 1);
+    check(fixture.expiries.size() == 1, "one-shot: zero timeout expires on the next tick");
+  }
+
+  void periodicRearm()
+  {
+    FixtureS fixture;
+    TimerContextS a {&fixture, 'A', Timers::INVALID_TIMER};
+    const Timers::TimerIdT id = fixture.timers.create(onExpiry, &a);
+
+    fixture.timers.startPeriodic(id, 4);
+    step(fixture, 12);
+    check(fixture.expiries.size() == 3, "periodic: 3 expiries in 12 ticks");
+    for (size_t i = 0; i < fixture.expiries.size(); ++i)
+      check(fixture.expiries[i].tick == 4U * (i + 1U), "periodic: expires every 4 ticks");
+    check(fixture.timers.isActive(id), "periodic: still active");
+
+    // A late main loop catches up on every missed period
+    fixture.expiries.clear();
+    stepLate(fixture, 8);
+    check(fixture.expiries.size() == 2, "periodic: 2 expiries caught up in one pass");
+    step(fixture, 4);
+    check(fixture.expiries.size() == 3 && fixture.expiries[2].tick == 24,
+          "periodic: phase kept after catching up");
+
+    // Re-armed before the callback, so the callback may stop it
+    fixture.expiries.clear();
+    a.stopOnExpiry = id;
+    step(fixture, 4);
+    check(fixture.expiries.size() == 1, "periodic: expires once more");
+    check(!fixture.timers.isActive(id), "periodic: stopped from its callback");
+    step(fixture, 12);
+    check(fixture.expiries.size() == 1, "periodic: no expiry after stop");
+  }
+
+  void stopRestartPending()
+  {
+    FixtureS fixture;
+    TimerContextS a {&fixture, 'A', Timers::INVALID_TIMER};
+    TimerContextS b {&fixture, 'B', Timers::INVALID_TIMER};
+    TimerContextS c {&fixture, 'C', Timers::INVALID_TIMER};
+    const Timers::TimerIdT idA = fixture.timers.create(onExpiry, &a);
+    const Timers::TimerIdT idB = fixture.timers.create(onExpiry, &b);
+    const Timers::TimerIdT idC = fixture.timers.create(onExpiry, &c);
+
+    // Stopping B in the middle of the list keeps C on time
+    fixture.timers.startOneShot(idA, 2);
+    fixture.timers.startOneShot(idB, 5);
+    fixture.timers.startOneShot(idC, 7);
+    step(fixture, 3);
+    fixture.timers.stop(idB);
+    check(!fixture.timers.isActive(idB), "stop: inactive after stop");
+    fixture.timers.stop(idB);
+    step(fixture, 10);
+    check(names(fixture.expiries) == "AC", "stop: stopped timer does not expire");
+    check(fixture.expiries.size() == 2 && fixture.expiries[1].tick == 7,
+          "stop: later timer keeps its expiry");
+
+    // Restarting a pending timer counts from the restart
+    fixture.expiries.clear();
+    const uint32_t start = fixture.now;
+    fixture.timers.startOneShot(idA, 5);
+    fixture.timers.startOneShot(idB, 6);
+    step(fixture, 3);
+    fixture.timers.startOneShot(idA, 5);
+    step(fixture, 10);
+    check(names(fixture.expiries) == "BA", "restart: restarted timer moves behind the other");
+    check(fixture.expiries.size() == 2 &&
+          fixture.expiries[0].tick == start + 6U && fixture.expiries[1].tick == start + 8U,
+          "restart: expires 5 ticks after the restart");
+
+    // A periodic restart replaces the one-shot
+    fixture.expiries.clear();
+    fixture.timers.startOneShot(idC, 3);
+    step(fixture, 1);
+    fixture.timers.startPeriodic(idC, 2);
+    step(fixture, 6);
+    check(fixture.expiries.size() == 3, "restart: one-shot turned periodic");
+    fixture.timers.stop(idC);
+  }
+
+  void sameTickOrder()
+  {
+    FixtureS fixture;
+    TimerContextS a {&fixture, 'A', Timers::INVALID_TIMER};
+    TimerContextS b {&fixture, 'B', Timers::INVALID_TIMER};
+    TimerContextS c {&fixture, 'C', Timers::INVALID_TIMER};
+    TimerContextS d {&fixture, 'D', Timers::INVALID_TIMER};
+    const Timers::TimerIdT idA = fixture.timers.create(onExpiry, &a);
+    const Timers::TimerIdT idB = fixture.timers.create(onExpiry, &b);
+    const Timers::TimerIdT idC = fixture.timers.create(onExpiry, &c);
+    const Timers::TimerIdT idD = fixture.timers.create(onExpiry, &d);
+
+    // Equal expiries run in start order, earlier expiries first
+    fixture.timers.startOneShot(idA, 3);
+    fixture.timers.startOneShot(idB, 3);
+    fixture.timers.startOneShot(idC, 3);
+    fixture.timers.startOneShot(idD, 2);
+    step(fixture, 3);
+    check(names(fixture.expiries) == "DABC", "same tick: start order");
+
+    // The same when the ISR counted all ticks before the main loop ran
+    fixture.expiries.clear();
+    fixture.timers.startOneShot(idA, 3);
+    fixture.timers.startOneShot(idB, 3);
+    fixture.timers.startOneShot(idC, 3);
+    fixture.timers.startOneShot(idD, 2);
+    stepLate(fixture, 3);
+    check(names(fixture.expiries) == "DABC", "same tick, late main loop: start order");
+
+    // A periodic timer re-armed onto a tick goes behind the timers already there
+    fixture.expiries.clear();
+    fixture.timers.startPeriodic(idA, 2);
+    fixture.timers.startOneShot(idB, 4);
+    step(fixture, 4);
+    check(names(fixture.expiries) == "ABA", "same tick: re-armed periodic after pending one-shot");
+
+    // A callback stopping a timer due on the same tick cancels it
+    fixture.timers.stop(idA);
+    fixture.expiries.clear();
+    b.stopOnExpiry = idC;
+    fixture.timers.startOneShot(idB, 2);
+    fixture.timers.startOneShot(idC, 2);
+    stepLate(fixture, 2);
+    check(names(fixture.expiries) == "B", "same tick: stopped from an earlier callback");
+  }
+
+  void startWithPendingTicks()
+  {
+    FixtureS fixture;
+    TimerContextS a {&fixture, 'A', Timers::INVALID_TIMER};
+    TimerContextS b {&fixture, 'B', Timers::INVALID_TIMER};
+    const Timers::TimerIdT idA = fixture.timers.create(onExpiry, &a);
+    const Timers::TimerIdT idB = fixture.timers.create(onExpiry, &b);
+
+    // Started after the ISR counted a tick the main loop has not processed
+    ++fixture.now;
+    fixture.timers.tick();
+    fixture.timers.startOneShot(idA, 1);
+    fixture.timers.process();
+    check(fixture.expiries.empty(), "pending tick: not expired in the start tick");
+    step(fixture, 1);
+    check(fixture.expiries.size() == 1 && fixture.expiries[0].tick == 2,
+          "pending tick: expires one tick after the start");
+
+    // Several pending ticks and a periodic timer keep its full period
+    fixture.expiries.clear();
+    fixture.timers.startOneShot(idB, 5);
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+      ++fixture.now;
+      fixture.timers.tick();
+    }
+    const uint32_t start = fixture.now;
+    fixture.timers.startPeriodic(idA, 3);
+    fixture.timers.process();
+    check(fixture.expiries.empty(), "pending ticks: nothing due yet");
+    step(fixture, 6);
+    check(names(fixture.expiries) == "BAA", "pending ticks: earlier timer keeps its expiry");
+    check(fixture.expiries.size() == 3 && fixture.expiries[0].tick == start + 2U &&
+          fixture.expiries[1].tick == start + 3U && fixture.expiries[2].tick == start + 6U,
+          "pending ticks: periodic counts from the start");
+  }
+}
+
+int main()
+{
+  oneShotExpiry();
+  periodicRearm();
+  stopRestartPending();
+  sameTickOrder();
+  startWithPendingTicks();
+
+  if (failures != 0U)
+  {
+    std::cout << failures << " check(s) failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "timer service: all checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
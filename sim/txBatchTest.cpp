@@ -0,0 +1,184 @@
+#include "board.hpp"
+#include "clock.hpp"
+#include "uartPort.hpp"
+#include "protocol.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// TX batching of the unmodified Target on a simulated board. A burst of
+// TICK_INDs is handled in one main loop pass, so their TICK_CFMs sit in the
+// TX queue together and must leave in one UART transfer, in order, and the
+// next batch must start in the TX complete interrupt of the previous one.
+
+namespace
+{
+  constexpr uint64_t BYTE_TIME_NS = 10U * 1000000000ULL / 115200U;   // 8N1 at the default rate
+
+  struct TransferS
+  {
+    uint64_t startNs;
+    std::vector<uint8_t> bytes;
+  };
+
+  /**
+   * @brief Line with every host byte available at once, records each HAL transmit call.
+   */
+  class RecordingPort : public sim::UartPort
+  {
+  public:
+    void write(const uint8_t* data, size_t len, uint64_t nowNs) override
+    {
+      transfers.push_back({nowNs, std::vector<uint8_t>(data, data + len)});
+    }
+
+    bool read(uint8_t& byte, uint64_t) override
+    {
+      if (rx_.empty())
+        return false;
+      byte = rx_.front();
+      rx_.pop_front();
+      return true;
+    }
+
+    uint64_t nextEventNs() const override { return rx_.empty() ? sim::NEVER : 0U; }
+
+    void send(protocol::signalIdE sig, const uint8_t* payload, size_t payloadLen)
+    {
+      std::array<uint8_t, protocol::MAX_FRAME_SIZE> frame;
+      const size_t frameSize = protocol::encodeFrame(sig, payload, payloadLen, frame.data());
+      rx_.insert(rx_.end(), frame.begin(), frame.begin() + frameSize);
+    }
+
+    std::vector<TransferS> transfers;
+
+  private:
+    std::deque<uint8_t> rx_;
+  };
+
+  unsigned failures = 0;
+
+  void check(bool condition, const std::string& what)
+  {
+    if (!condition)
+    {
+      std::cout << "FAIL: " << what << std::endl;
+      ++failures;
+    }
+  }
+
+  std::vector<protocol::FrameS> decode(const std::vector<uint8_t>& bytes)
+  {
+    protocol::Decoder decoder;
+    std::vector<protocol::FrameS> frames;
+    for (uint8_t byte : bytes)
+    {
+      const protocol::frameResult result = decoder.processByte(byte);
+      if (result.valid)
+        frames.push_back(result.frame);
+    }
+    return frames;
+  }
+
+  // Step the board at the current time until it waits for an interrupt
+  void settle(sim::Board& board)
+  {
+    do
+    {
+      board.step();
+    } while (!board.sleeping());
+  }
+
+  void sendTickInds(RecordingPort& port, uint16_t firstSeq, size_t count)
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      uint8_t payload[sizeof(uint16_t)];
+      protocol::writeUint16(static_cast<uint16_t>(firstSeq + i), payload);
+      port.send(protocol::signalIdE::TICK_IND, payload, sizeof(payload));
+    }
+  }
+
+  // A transfer that holds count TICK_CFMs numbered from firstSeq, in order
+  void checkBatch(const TransferS& transfer, uint16_t firstSeq, size_t count, const std::string& what)
+  {
+    const std::vector<protocol::FrameS> frames = decode(transfer.bytes);
+    check(frames.size() == count, what + ": " + std::to_string(count) + " frames in one transfer, got "
+                                  + std::to_string(frames.size()));
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+      const bool inOrder = frames[i].sigId == protocol::signalIdE::TICK_CFM && frames[i].payloadLen == 2U
+                           && protocol::readUint16(frames[i].payload.data()) == firstSeq + i;
+      check(inOrder, what + ": TICK_CFM " + std::to_string(firstSeq + i) + " in place");
+    }
+  }
+}
+
+int main()
+{
+  sim::VirtualClock clock;
+  RecordingPort port;
+  sim::Board board(clock, port);
+  board.start();
+
+  // Connect with a capability record, the CONNECT_CFM tells the TX queue depth
+  protocol::CapabilitiesS local;
+  local.version = protocol::PROTOCOL_VERSION;
+  local.features = protocol::FEATURE_TICK_SEQ;
+  uint8_t record[protocol::CAPABILITIES_SIZE];
+  port.send(protocol::signalIdE::CONNECT_REQ, record, protocol::encodeCapabilities(local, record));
+  settle(board);
+  if (port.transfers.size() != 1U)
+  {
+    std::cout << "FAIL: no CONNECT_CFM" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::vector<protocol::FrameS> cfm = decode(port.transfers[0].bytes);
+  check(cfm.size() == 1U && cfm[0].sigId == protocol::signalIdE::CONNECT_CFM, "CONNECT_CFM alone");
+  const size_t numFrames = protocol::decodeCapabilities(cfm[0].payload.data(), cfm[0].payloadLen).rxQueueDepth;
+  check(numFrames > 1U, "queue depth from CONNECT_CFM");
+
+  // Idle line: a full queue of replies goes out in one transfer, right away
+  clock.advanceTo(port.transfers[0].startNs + port.transfers[0].bytes.size() * BYTE_TIME_NS);
+  settle(board);
+  const uint64_t burstNs = clock.nowNs();
+  sendTickInds(port, 1, numFrames);
+  settle(board);
+  check(port.transfers.size() == 2U, "first burst: one transfer");
+  if (port.transfers.size() == 2U)
+  {
+    checkBatch(port.transfers[1], 1, numFrames, "first burst");
+    check(port.transfers[1].startNs == burstNs, "first burst: starts in the pass that queued it");
+  }
+
+  // Busy line: replies queued during the transfer leave in the TX complete
+  // interrupt, back-to-back with the previous batch
+  sendTickInds(port, static_cast<uint16_t>(1U + numFrames), numFrames);
+  settle(board);
+  check(port.transfers.size() == 2U, "second burst: waits for the transfer in flight");
+  const uint64_t txDoneNs = burstNs + port.transfers.back().bytes.size() * BYTE_TIME_NS;
+  clock.advanceTo(txDoneNs);
+  settle(board);
+  check(port.transfers.size() == 3U, "second burst: one transfer");
+  if (port.transfers.size() == 3U)
+  {
+    checkBatch(port.transfers[2], static_cast<uint16_t>(1U + numFrames), numFrames, "second burst");
+    check(port.transfers[2].startNs == txDoneNs, "second burst: no idle gap after the first");
+  }
+
+  const protocol::LinkStatsS stats = board.target().linkStats();
+  check(stats.txQueueDrops == 0U, "no TX queue drops");
+
+  if (failures != 0U)
+  {
+    std::cout << failures << " check(s) failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "TX batching: " << numFrames << " frames per transfer, all checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,361 @@
+#include "clock.hpp"
+#include "linkChannel.hpp"
+#include "uartPort.hpp"
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace
+{
+  std::atomic<bool> running {true};
+
+  void onSignal(int)
+  {
+    running = false;
+  }
+
+  constexpr uint64_t MAX_POLL_NS = 100000000ULL;   // 100 ms
+  constexpr size_t CHUNK_SIZE = 256;
+
+  struct OptionsS
+  {
+    uint32_t baudRate {115200};
+    sim::ImpairmentS impairment {};
+    uint64_t seed {1};
+    std::string linkA;
+    std::string linkB;
+    std::string deviceB;    ///< Attach side B to an existing device instead of a new pty
+  };
+
+  /**
+   * @brief One direction of the emulated line.
+   */
+  struct DirectionS
+  {
+    DirectionS(const char* directionName, sim::UartPort& fromPort, sim::UartPort& toPort,
+               uint64_t seed, uint32_t baudRate)
+      : name{directionName}, from{fromPort}, to{toPort}, channel{seed, baudRate}
+    {
+    }
+
+    /// Move bytes read from the source into the line and due bytes to the sink
+    void forward(uint64_t nowNs)
+    {
+      uint8_t chunk[CHUNK_SIZE];
+      size_t len = 0;
+      while (len < sizeof(chunk) && from.read(chunk[len], nowNs))
+      {
+        ++len;
+      }
+      if (len != 0U)
+        channel.push(chunk, len, nowNs);
+
+      len = 0;
+      while (channel.pop(chunk[len], nowNs))
+      {
+        if (++len == sizeof(chunk))
+        {
+          to.write(chunk, len, nowNs);
+          len = 0;
+        }
+      }
+      if (len != 0U)
+        to.write(chunk, len, nowNs);
+    }
+
+    const char* name;
+    sim::UartPort& from;
+    sim::UartPort& to;
+    sim::LinkChannel channel;
+  };
+
+  void printUsage()
+  {
+    std::cout << "Usage: uart_netem [options]" << std::endl;
+    std::cout << "  --link-a <path>      create a symlink to the pty of side A" << std::endl;
+    std::cout << "  --link-b <path>      create a symlink to the pty of side B" << std::endl;
+    std::cout << "  --device-b <path>    use an existing serial device as side B" << std::endl;
+    std::cout << "  --baud <n>           line rate, 0 = unthrottled (default 115200)" << std::endl;
+    std::cout << "  --latency-us <us>    fixed latency" << std::endl;
+    std::cout << "  --jitter-us <us>     uniform extra latency" << std::endl;
+    std::cout << "  --ber <p>            bit error rate" << std::endl;
+    std::cout << "  --drop <p>           byte drop probability" << std::endl;
+    std::cout << "  --dup <p>            byte duplication probability" << std::endl;
+    std::cout << "  --noise-rate <n>     mean line noise bursts per second" << std::endl;
+    std::cout << "  --noise-len <n>      max random bytes per noise burst (default 8)" << std::endl;
+    std::cout << "  --seed <n>           PRNG seed (default 1)" << std::endl;
+    std::cout << "Impairments apply to both directions and can be changed at runtime" << std::endl;
+    std::cout << "through stdin, type 'help' for the commands." << std::endl;
+  }
+
+  void printCommands()
+  {
+    std::cout << "  set <a2b|b2a|both> <param> <value>" << std::endl;
+    std::cout << "      params: baud latency-us jitter-us ber drop dup noise-rate noise-len" << std::endl;
+    std::cout << "  show      print the current settings" << std::endl;
+    std::cout << "  stats     print the per-direction counters" << std::endl;
+    std::cout << "  reset     clear the counters" << std::endl;
+    std::cout << "  quit" << std::endl;
+  }
+
+  /**
+   * @brief Apply one "<param> <value>" pair. Returns false for unknown params.
+   */
+  bool setParam(const std::string& param, const std::string& value,
+                sim::ImpairmentS& impairment, uint32_t& baudRate)
+  {
+    const char* text = value.c_str();
+    if (param == "baud")
+      baudRate = static_cast<uint32_t>(std::strtoul(text, nullptr, 10));
+    else if (param == "latency-us")
+      impairment.latencyNs = std::strtoull(text, nullptr, 10) * 1000ULL;
+    else if (param == "jitter-us")
+      impairment.jitterNs = std::strtoull(text, nullptr, 10) * 1000ULL;
+    else if (param == "ber")
+      impairment.bitErrorRate = std::strtod(text, nullptr);
+    else if (param == "drop")
+      impairment.dropRate = std::strtod(text, nullptr);
+    else if (param == "dup")
+      impairment.duplicateRate = std::strtod(text, nullptr);
+    else if (param == "noise-rate")
+      impairment.noiseBurstRate = std::strtod(text, nullptr);
+    else if (param == "noise-len")
+      impairment.noiseBurstLen = static_cast<uint32_t>(std::strtoul(text, nullptr, 10));
+    else
+      return false;
+    return true;
+  }
+
+  bool parseOptions(int argc, char* argv[], OptionsS& options)
+  {
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+      const std::string option = argv[i];
+      const std::string value = argv[i + 1];
+      if (option == "--link-a")
+        options.linkA = value;
+      else if (option == "--link-b")
+        options.linkB = value;
+      else if (option == "--device-b")
+        options.deviceB = value;
+      else if (option == "--seed")
+        options.seed = std::strtoull(value.c_str(), nullptr, 10);
+      else if (option.compare(0, 2, "--") != 0
+               || !setParam(option.substr(2), value, options.impairment, options.baudRate))
+        return false;
+    }
+    return (argc % 2) == 1;
+  }
+
+  void printSettings(const DirectionS& direction)
+  {
+    const sim::ImpairmentS& impairment = direction.channel.impairment();
+    std::cout << direction.name << ": baud " << direction.channel.baudRate()
+              << ", latency " << impairment.latencyNs / 1000U << " us"
+              << ", jitter " << impairment.jitterNs / 1000U << " us"
+              << ", ber " << impairment.bitErrorRate
+              << ", drop " << impairment.dropRate
+              << ", dup " << impairment.duplicateRate
+              << ", noise " << impairment.noiseBurstRate << "/s x " << impairment.noiseBurstLen
+              << std::endl;
+  }
+
+  void printCounters(const DirectionS& direction)
+  {
+    const sim::ChannelCountersS& counters = direction.channel.counters();
+    std::cout << direction.name << ": in " << counters.bytesIn
+              << ", out " << counters.bytesOut
+              << ", dropped " << counters.dropped
+              << ", duplicated " << counters.duplicated
+              << ", corrupted " << counters.corruptedBytes
+              << " (" << counters.bitFlips << " bits)"
+              << ", noise " << counters.noiseBytes
+              << std::endl;
+  }
+
+  /**
+   * @brief Execute one runtime command. Returns false on 'quit'.
+   */
+  bool runCommand(const std::string& line, DirectionS& a2b, DirectionS& b2a)
+  {
+    std::istringstream words(line);
+    std::string command;
+    if (!(words >> command))
+      return true;
+
+    if (command == "quit" || command == "exit")
+      return false;
+
+    if (command == "set")
+    {
+      std::string target, param, value;
+      words >> target >> param >> value;
+      DirectionS* directions[2] {nullptr, nullptr};
+      if (target == "a2b" || target == "both")
+        directions[0] = &a2b;
+      if (target == "b2a" || target == "both")
+        directions[1] = &b2a;
+
+      bool applied = false;
+      for (DirectionS* direction : directions)
+      {
+        if (direction == nullptr || value.empty())
+          continue;
+        sim::ImpairmentS impairment = direction->channel.impairment();
+        uint32_t baudRate = direction->channel.baudRate();
+        if (!setParam(param, value, impairment, baudRate))
+          break;
+        direction->channel.setImpairment(impairment);
+        direction->channel.setBaudRate(baudRate);
+        printSettings(*direction);
+        applied = true;
+      }
+      if (!applied)
+        std::cout << "Invalid command, type 'help'" << std::endl;
+    }
+    else if (command == "show")
+    {
+      printSettings(a2b);
+      printSettings(b2a);
+    }
+    else if (command == "stats")
+    {
+      printCounters(a2b);
+      printCounters(b2a);
+    }
+    else if (command == "reset")
+    {
+      a2b.channel.resetCounters();
+      b2a.channel.resetCounters();
+    }
+    else
+    {
+      printCommands();
+    }
+    return true;
+  }
+
+  bool createLink(const sim::PtyPort& pty, const std::string& linkPath)
+  {
+    if (linkPath.empty())
+      return true;
+
+    unlink(linkPath.c_str());
+    if (symlink(pty.slaveName().c_str(), linkPath.c_str()) != 0)
+    {
+      std::cout << "[uart_netem] Failed to create link " << linkPath << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  OptionsS options;
+  if (!parseOptions(argc, argv, options))
+  {
+    printUsage();
+    return 0;
+  }
+
+  sim::PtyPort ptyA;
+  std::unique_ptr<sim::PtyPort> ptyB;
+  std::unique_ptr<sim::DevicePort> deviceB;
+  sim::UartPort* portB = nullptr;
+  if (options.deviceB.empty())
+  {
+    ptyB.reset(new sim::PtyPort());
+    if (ptyB->isOpen())
+      portB = ptyB.get();
+  }
+  else
+  {
+    deviceB.reset(new sim::DevicePort(options.deviceB));
+    if (deviceB->isOpen())
+      portB = deviceB.get();
+  }
+
+  if (!ptyA.isOpen() || portB == nullptr)
+  {
+    std::cout << "[uart_netem] Failed to open the endpoints" << std::endl;
+    return 1;
+  }
+  if (!createLink(ptyA, options.linkA) || (ptyB && !createLink(*ptyB, options.linkB)))
+    return 1;
+
+  DirectionS a2b("a2b", ptyA, *portB, options.seed, options.baudRate);
+  DirectionS b2a("b2a", *portB, ptyA, ~options.seed, options.baudRate);
+  a2b.channel.setImpairment(options.impairment);
+  b2a.channel.setImpairment(options.impairment);
+
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+
+  std::cout << "[uart_netem] A is " << ptyA.slaveName() << std::endl;
+  std::cout << "[uart_netem] B is " << (ptyB ? ptyB->slaveName() : options.deviceB) << std::endl;
+  printSettings(a2b);
+  printSettings(b2a);
+
+  sim::RealClock clock;
+  bool stdinOpen = true;
+  std::string input;
+  while (running)
+  {
+    uint64_t now = clock.nowNs();
+    a2b.forward(now);
+    b2a.forward(now);
+
+    // Sleep until the next byte is due or any side has input
+    const uint64_t next = std::min(a2b.channel.nextDeliveryNs(), b2a.channel.nextDeliveryNs());
+    now = clock.nowNs();
+    const uint64_t waitNs = next <= now ? 0U : std::min(next - now, MAX_POLL_NS);
+
+    pollfd fds[3] {
+      {ptyA.fd(), POLLIN, 0},
+      {portB->fd(), POLLIN, 0},
+      {stdinOpen ? STDIN_FILENO : -1, POLLIN, 0}
+    };
+    timespec timeout {static_cast<time_t>(waitNs / 1000000000ULL),
+                      static_cast<long>(waitNs % 1000000000ULL)};
+    if (ppoll(fds, 3, &timeout, nullptr) <= 0 || (fds[2].revents & (POLLIN | POLLHUP)) == 0)
+      continue;
+
+    char buffer[256];
+    ssize_t received = read(STDIN_FILENO, buffer, sizeof(buffer));
+    if (received <= 0)
+    {
+      stdinOpen = false;
+      continue;
+    }
+    input.append(buffer, static_cast<size_t>(received));
+
+    size_t end;
+    while (running && (end = input.find('\n')) != std::string::npos)
+    {
+      if (!runCommand(input.substr(0, end), a2b, b2a))
+        running = false;
+      input.erase(0, end + 1);
+    }
+  }
+
+  printCounters(a2b);
+  printCounters(b2a);
+  if (!options.linkA.empty())
+    unlink(options.linkA.c_str());
+  if (ptyB && !options.linkB.empty())
+    unlink(options.linkB.c_str());
+  std::cout << "[uart_netem] Stopped" << std::endl;
+  return 0;
+}
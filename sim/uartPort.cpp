@@ -0,0 +1,162 @@
+#include "uartPort.hpp"
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <utility>
+
+namespace sim
+{
+  namespace
+  {
+    void writeAll(int fd, const uint8_t* data, size_t len)
+    {
+      while (len > 0U && fd >= 0)
+      {
+        ssize_t written = ::write(fd, data, len);
+        if (written < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          // Nobody is draining the other side, drop the bytes like a real line
+          return;
+        }
+        data += written;
+        len -= static_cast<size_t>(written);
+      }
+    }
+
+    bool readBuffered(int fd, uint8_t* buffer, size_t size, size_t& head, size_t& count, uint8_t& byte)
+    {
+      if (count == 0U && fd >= 0)
+      {
+        ssize_t received = ::read(fd, buffer, size);
+        if (received <= 0)
+          return false;
+        head = 0;
+        count = static_cast<size_t>(received);
+      }
+      if (count == 0U)
+        return false;
+
+      byte = buffer[head++];
+      --count;
+      return true;
+    }
+  }
+
+  // ---------------------------------------------------------------------------
+  // Pseudo terminal
+  // ---------------------------------------------------------------------------
+  PtyPort::PtyPort()
+  {
+    master_ = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master_ < 0)
+      return;
+
+    if (grantpt(master_) != 0 || unlockpt(master_) != 0)
+    {
+      close(master_);
+      master_ = -1;
+      return;
+    }
+    slaveName_ = ptsname(master_);
+
+    // Raw mode on the slave side, otherwise the line discipline echoes
+    // the target's input back to it until the host configures the port
+    slave_ = open(slaveName_.c_str(), O_RDWR | O_NOCTTY);
+    if (slave_ >= 0)
+    {
+      termios tio {};
+      tcgetattr(slave_, &tio);
+      cfmakeraw(&tio);
+      tcsetattr(slave_, TCSANOW, &tio);
+    }
+
+    fcntl(master_, F_SETFL, fcntl(master_, F_GETFL) | O_NONBLOCK);
+  }
+
+  PtyPort::~PtyPort()
+  {
+    if (slave_ >= 0)
+      close(slave_);
+    if (master_ >= 0)
+      close(master_);
+  }
+
+  void PtyPort::write(const uint8_t* data, size_t len, uint64_t)
+  {
+    writeAll(master_, data, len);
+  }
+
+  bool PtyPort::read(uint8_t& byte, uint64_t)
+  {
+    return readBuffered(master_, rxBuffer_, sizeof(rxBuffer_), rxHead_, rxCount_, byte);
+  }
+
+  // ---------------------------------------------------------------------------
+  // Existing serial device
+  // ---------------------------------------------------------------------------
+  DevicePort::DevicePort(const std::string& path)
+  {
+    fd_ = open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd_ < 0)
+      return;
+
+    termios tio {};
+    if (tcgetattr(fd_, &tio) == 0)
+    {
+      cfmakeraw(&tio);
+      tcsetattr(fd_, TCSANOW, &tio);
+    }
+  }
+
+  DevicePort::~DevicePort()
+  {
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  void DevicePort::write(const uint8_t* data, size_t len, uint64_t)
+  {
+    writeAll(fd_, data, len);
+  }
+
+  bool DevicePort::read(uint8_t& byte, uint64_t)
+  {
+    return readBuffered(fd_, rxBuffer_, sizeof(rxBuffer_), rxHead_, rxCount_, byte);
+  }
+
+  // ---------------------------------------------------------------------------
+  // In-memory port
+  // ---------------------------------------------------------------------------
+  void MemoryPort::write(const uint8_t* data, size_t len, uint64_t)
+  {
+    tx_.insert(tx_.end(), data, data + len);
+  }
+
+  bool MemoryPort::read(uint8_t& byte, uint64_t)
+  {
+    if (rx_.empty())
+      return false;
+
+    byte = rx_.front();
+    rx_.pop_front();
+    return true;
+  }
+
+  void MemoryPort::inject(const uint8_t* data, size_t len)
+  {
+    rx_.insert(rx_.end(), data, data + len);
+  }
+
+  std::deque<uint8_t> MemoryPort::drain()
+  {
+    std::deque<uint8_t> bytes;
+    std::swap(bytes, tx_);
+    return bytes;
+  }
+} // namespace sim
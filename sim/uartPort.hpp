@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+
+namespace sim
+{
+  constexpr uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+  /**
+   * @brief Byte transport behind the fake USART1 of a simulated board.
+   */
+  class UartPort
+  {
+  public:
+    virtual ~UartPort() = default;
+
+    /**
+     * @brief Bytes transmitted by the target, starting at nowNs.
+     */
+    virtual void write(const uint8_t* data, size_t len, uint64_t nowNs) = 0;
+
+    /**
+     * @brief Fetch the next byte received by the target if available at nowNs.
+     */
+    virtual bool read(uint8_t& byte, uint64_t nowNs) = 0;
+
+    /**
+     * @brief Let the port move bytes that became due at nowNs.
+     */
+    virtual void poll(uint64_t) {}
+
+    /**
+     * @brief USART1 was re-initialized at a new baud rate.
+     */
+    virtual void setBaudRate(uint32_t) {}
+
+    /**
+     * @brief Next time the port needs poll() or has an RX byte, NEVER if unknown.
+     */
+    virtual uint64_t nextEventNs() const { return NEVER; }
+
+    /**
+     * @brief File descriptor to poll for RX readiness, -1 if none.
+     */
+    virtual int fd() const { return -1; }
+  };
+
+  /**
+   * @brief UART backed by a pseudo terminal.
+   *
+   * The slave side (e.g. /dev/pts/3) is opened by the host application.
+   */
+  class PtyPort : public UartPort
+  {
+  public:
+    PtyPort();
+    ~PtyPort() override;
+
+    PtyPort(const PtyPort&) = delete;
+    PtyPort& operator=(const PtyPort&) = delete;
+
+    bool isOpen() const { return master_ >= 0; }
+    const std::string& slaveName() const { return slaveName_; }
+
+    void write(const uint8_t* data, size_t len, uint64_t nowNs) override;
+    bool read(uint8_t& byte, uint64_t nowNs) override;
+    int fd() const override { return master_; }
+
+  private:
+    int master_ {-1};
+    int slave_ {-1};      ///< Kept open so the master never reads EOF/EIO
+    std::string slaveName_;
+    uint8_t rxBuffer_[256] {};
+    size_t rxHead_ {0};
+    size_t rxCount_ {0};
+  };
+
+  /**
+   * @brief UART backed by an existing serial device, e.g. another pty slave
+   * or a USB serial adapter. The device is put in raw mode.
+   */
+  class DevicePort : public UartPort
+  {
+  public:
+    explicit DevicePort(const std::string& path);
+    ~DevicePort() override;
+
+    DevicePort(const DevicePort&) = delete;
+    DevicePort& operator=(const DevicePort&) = delete;
+
+    bool isOpen() const { return fd_ >= 0; }
+
+    void write(const uint8_t* data, size_t len, uint64_t nowNs) override;
+    bool read(uint8_t& byte, uint64_t nowNs) override;
+    int fd() const override { return fd_; }
+
+  private:
+    int fd_ {-1};
+    uint8_t rxBuffer_[256] {};
+    size_t rxHead_ {0};
+    size_t rxCount_ {0};
+  };
+
+  /**
+   * @brief UART backed by in-memory queues, fed and drained by the test code.
+   */
+  class MemoryPort : public UartPort
+  {
+  public:
+    void write(const uint8_t* data, size_t len, uint64_t nowNs) override;
+    bool read(uint8_t& byte, uint64_t nowNs) override;
+    uint64_t nextEventNs() const override { return rx_.empty() ? NEVER : 0; }
+
+    /// Queue bytes to be received by the target
+    void inject(const uint8_t* data, size_t len);
+    /// Take all bytes transmitted by the target so far
+    std::deque<uint8_t> drain();
+
+  private:
+    std::deque<uint8_t> rx_;
+    std::deque<uint8_t> tx_;
+  };
+} // namespace sim
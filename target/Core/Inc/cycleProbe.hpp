@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Build with TARGET_CYCLE_PROBES=1 to time the ISRs and the main loop
+#ifndef TARGET_CYCLE_PROBES
+#define TARGET_CYCLE_PROBES 0
+#endif
+
+/**
+ * @brief Execution time statistics of one code path, in core clock cycles.
+ *
+ * Keeps count, min, max and the total for the average, and a histogram with
+ * one bucket per power of two: bucket 0 holds everything below
+ * 2^FIRST_BUCKET_BITS cycles, the last one everything from
+ * 2^(FIRST_BUCKET_BITS + NUM_BUCKETS - 2) cycles on. record() is a few
+ * compares and a count leading zeros, cheap enough for the UART RX interrupt.
+ *
+ * Not thread-safe, record each probe from one context and copy it with
+ * interrupts masked.
+ */
+class CycleProbe
+{
+public:
+  static constexpr size_t NUM_BUCKETS = 14;
+  static constexpr unsigned FIRST_BUCKET_BITS = 4;
+
+  void record(uint32_t cycles)
+  {
+    if (count_ == 0U || cycles < minCycles_)
+      minCycles_ = cycles;
+    if (cycles > maxCycles_)
+      maxCycles_ = cycles;
+    ++count_;
+    totalCycles_ += cycles;
+    ++buckets_[bucketIndex(cycles)];
+  }
+
+  uint32_t count() const { return count_; }
+  uint32_t minCycles() const { return minCycles_; }
+  uint32_t maxCycles() const { return maxCycles_; }
+  uint32_t avgCycles() const { return count_ == 0U ? 0U : static_cast<uint32_t>(totalCycles_ / count_); }
+  uint32_t bucketCount(size_t index) const { return buckets_[index]; }
+
+  /**
+   * @brief First cycle count above bucket index, 0 for the open last bucket.
+   */
+  static uint32_t bucketLimit(size_t index)
+  {
+    return index + 1U < NUM_BUCKETS ? static_cast<uint32_t>(1UL << (FIRST_BUCKET_BITS + index)) : 0U;
+  }
+
+private:
+  static size_t bucketIndex(uint32_t cycles)
+  {
+    // Number of significant bits, the CLZ instruction on Cortex-M4
+    const unsigned bits = cycles == 0U ? 0U : 32U - static_cast<unsigned>(__builtin_clz(cycles));
+    if (bits <= FIRST_BUCKET_BITS)
+      return 0;
+    const size_t index = bits - FIRST_BUCKET_BITS;
+    return index < NUM_BUCKETS ? index : NUM_BUCKETS - 1U;
+  }
+
+  uint32_t count_ {0};
+  uint32_t minCycles_ {0};
+  uint32_t maxCycles_ {0};
+  uint64_t totalCycles_ {0};
+  uint32_t buckets_[NUM_BUCKETS] {};
+};
+
+/**
+ * @brief Records the cycles from construction to the end of the scope.
+ *
+ * ClockT::now() returns a free running 32-bit cycle count. The target reads
+ * the DWT cycle counter, a host build can pass any clock scaled to cycles.
+ */
+template<typename ClockT>
+class CycleProbeScope
+{
+public:
+  explicit CycleProbeScope(CycleProbe& probe) : probe_{probe}, start_{ClockT::now()} {}
+  ~CycleProbeScope() { probe_.record(ClockT::now() - start_); }
+
+  CycleProbeScope(const CycleProbeScope&) = delete;
+  CycleProbeScope& operator=(const CycleProbeScope&) = delete;
+
+private:
+  CycleProbe& probe_;
+  uint32_t start_;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "protocol.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Flight recorder, a fixed ring of the last N LogRecordS.
+ *
+ * Always built in, so the history is there after a field incident. Records
+ * are addressed by sequence number, the count of records written before
+ * them, so a reader can continue where it left off and see what it missed.
+ *
+ * Not thread-safe, record and read from the main loop only.
+ */
+template<size_t N>
+class FlightLog
+{
+public:
+  static constexpr size_t CAPACITY = N;
+
+  void record(uint32_t timeMs, protocol::logEventE event, uint8_t arg0 = 0, uint16_t arg1 = 0)
+  {
+    protocol::LogRecordS& slot = records_[head_ % N];
+    slot.timeMs = timeMs;
+    slot.event = static_cast<uint8_t>(event);
+    slot.arg0 = arg0;
+    slot.arg1 = arg1;
+    ++head_;
+  }
+
+  /**
+   * @brief Sequence number of the next record, the number ever written.
+   */
+  uint32_t head() const { return head_; }
+
+  /**
+   * @brief Sequence number of the oldest record still in the ring.
+   */
+  uint32_t oldest() const { return head_ > N ? head_ - static_cast<uint32_t>(N) : 0U; }
+
+  /**
+   * @brief Record seq, false if it was overwritten or not written yet.
+   */
+  bool get(uint32_t seq, protocol::LogRecordS& record) const
+  {
+    if (seq < oldest() || seq >= head_)
+      return false;
+    record = records_[seq % N];
+    return true;
+  }
+
+private:
+  protocol::LogRecordS records_[N] {};
+  uint32_t head_ {0};
+};
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "Protocol.hpp"
+#include "protocol.hpp"
 
 #include <cstring>
 #include <cstddef>
@@ -18,6 +18,7 @@ public:
       return false;
 
     std::memcpy(buffer_[head_], frame, len);
+    length_[head_] = len;
 
     head_ = (head_ + 1U) % NUM_FRAMES;
     ++count_;
@@ -34,6 +35,19 @@ public:
     return true;
   }
 
+  /**
+   * @brief Release several frames at once (e.g. once copied into a batched transmission).
+   */
+  bool pop(size_t num)
+  {
+    if (num > count_)
+      return false;
+
+    tail_ = (tail_ + num) % NUM_FRAMES;
+    count_ -= num;
+    return true;
+  }
+
   bool front(const uint8_t*& frame) const
   {
     if (count_ == 0U)
@@ -43,10 +57,26 @@ public:
     return true;
   }
 
+  /**
+   * @brief Access the frame at position index (0 = front) with its pushed length.
+   */
+  bool peek(size_t index, const uint8_t*& frame, size_t& len) const
+  {
+    if (index >= count_)
+      return false;
+
+    size_t slot = (tail_ + index) % NUM_FRAMES;
+    frame = buffer_[slot];
+    len = length_[slot];
+    return true;
+  }
+
   bool empty() const {return count_ == 0U;}
+  size_t size() const {return count_;}
 
 private:
   uint8_t buffer_[NUM_FRAMES][FRAME_SIZE] {};
+  size_t length_[NUM_FRAMES] {};
   size_t head_ {0};
   size_t tail_ {0};
   size_t count_ {0};
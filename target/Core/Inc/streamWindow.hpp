@@ -0,0 +1,104 @@
+#pragma once
+
+#include "protocol.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Running summary of one window of telemetry samples: count, min,
+ * max, sum and an optional coarse histogram.
+ *
+ * add() is two compares, an add and for the histogram a subtract and a
+ * shift, cheap enough for the sample interrupt. The mean is only divided
+ * out by summary(), once per window in the main loop. Fixed point
+ * throughout, the sum of a full window of 16-bit samples fits its 32 bits.
+ *
+ * Not thread-safe, add from the sample ISR and read the summary once the
+ * ISR has moved on to another window.
+ */
+class StreamWindow
+{
+public:
+  static_assert(protocol::STREAM_SUMMARY_HEADER_SIZE + protocol::STREAM_MAX_BINS * protocol::STREAM_SAMPLE_SIZE
+                <= protocol::MAX_PAYLOAD, "STREAM_SUMMARY must fit the max payload");
+
+  /**
+   * @brief Histogram of window.bins bins, values outside the bin range
+   * count in the first or the last bin.
+   */
+  void configure(const protocol::StreamWindowS& window)
+  {
+    bins_ = window.bins < protocol::STREAM_MAX_BINS ? window.bins : static_cast<uint8_t>(protocol::STREAM_MAX_BINS);
+    binShift_ = window.binShift;
+    binLow_ = window.binLow;
+  }
+
+  /**
+   * @brief Start an empty window, firstSeq is the number of its first sample.
+   */
+  void start(uint32_t firstSeq)
+  {
+    firstSeq_ = firstSeq;
+    count_ = 0;
+    sum_ = 0;
+    for (size_t i = 0; i < bins_; ++i)
+    {
+      binCounts_[i] = 0;
+    }
+  }
+
+  void add(uint16_t sample)
+  {
+    if (count_ == 0U || sample < min_)
+      min_ = sample;
+    if (count_ == 0U || sample > max_)
+      max_ = sample;
+    ++count_;
+    sum_ += sample;
+    if (bins_ != 0U)
+    {
+      const uint32_t bin = sample > binLow_ ? static_cast<uint32_t>(sample - binLow_) >> binShift_ : 0U;
+      ++binCounts_[bin < bins_ ? bin : bins_ - 1U];
+    }
+  }
+
+  uint16_t count() const { return count_; }
+
+  protocol::StreamSummaryS summary() const
+  {
+    protocol::StreamSummaryS summary;
+    summary.seq = firstSeq_;
+    summary.count = count_;
+    summary.min = min_;
+    summary.max = max_;
+    // 64-bit since the sum may use all 32 bits
+    summary.mean = count_ == 0U ? 0U
+      : static_cast<uint32_t>((static_cast<uint64_t>(sum_) << protocol::STREAM_MEAN_FRACTION_BITS) / count_);
+    summary.bins = bins_;
+    for (size_t i = 0; i < bins_; ++i)
+    {
+      summary.binCounts[i] = binCounts_[i];
+    }
+    return summary;
+  }
+
+  /**
+   * @brief STREAM_SUMMARY payload size for bins histogram bins.
+   */
+  static size_t payloadSize(uint8_t bins)
+  {
+    return protocol::STREAM_SUMMARY_HEADER_SIZE + static_cast<size_t>(bins) * protocol::STREAM_SAMPLE_SIZE;
+  }
+
+private:
+  uint8_t bins_ {0};
+  uint8_t binShift_ {0};
+  uint16_t binLow_ {0};
+  uint32_t firstSeq_ {0};
+  uint16_t count_ {0};
+  uint16_t min_ {0};
+  uint16_t max_ {0};
+  uint32_t sum_ {0};
+  uint16_t binCounts_[protocol::STREAM_MAX_BINS] {};
+};
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "cycleProbe.hpp"
+#include "flightLog.hpp"
 #include "protocol.hpp"
 #include "ringBuffer.hpp"
+#include "streamWindow.hpp"
+#include "timerService.hpp"
 
 #include <cstdint>
 #include <cstring>
@@ -24,6 +28,64 @@ public:
     BUTTON_PRESSED,
     BUTTON_DISABLED
   };
+
+/**
+ * @brief Events raised from ISR context and consumed by process().
+ */
+  enum EventE : uint32_t
+  {
+    EVENT_RX_FRAME,
+    EVENT_TX_DONE,
+    EVENT_TICK,
+    EVENT_BUTTON,
+    EVENT_STREAM,
+    EVENT_COUNT
+  };
+  static_assert(EVENT_COUNT == static_cast<uint32_t>(protocol::loopEventE::COUNT),
+                "LOOP_CFM reports one latency per event");
+
+/**
+ * @brief TX priority classes, each with its own queue. tryStartTx() serves
+ * them in this order.
+ */
+  enum TxClassE : uint32_t
+  {
+    TX_CLASS_CONTROL,   ///< CONNECT_CFM, TICK_CFM and the baud rate and time sync answers
+    TX_CLASS_EVENT,     ///< BUTTON_IND
+    TX_CLASS_BULK,      ///< Echo, statistics, probe, trace and log readout
+    TX_CLASS_COUNT
+  };
+
+/**
+ * @brief Queue statistics of one TX class.
+ */
+  struct TxClassStatsS
+  {
+    uint32_t frames {0};          ///< Frames queued
+    uint32_t drops {0};           ///< Frames lost to a full queue
+    uint32_t maxWaitCycles {0};   ///< Longest time from queued to handed to the UART
+    uint8_t highWater {0};        ///< Most frames ever waiting in the queue
+  };
+
+/**
+ * @brief Telemetry stream counters since the last STREAM_START.
+ */
+  struct StreamStatsS
+  {
+    uint32_t samples {0};   ///< Samples taken
+    uint32_t dropped {0};   ///< Samples lost to a full double buffer
+    uint32_t frames {0};    ///< STREAM_DATA or STREAM_SUMMARY frames queued
+  };
+
+/**
+ * @brief Main loop instrumentation.
+ */
+  struct LoopStatsS
+  {
+    uint32_t dutyCyclePermille {0};                 ///< Awake time over the last second
+    uint32_t maxLatencyCycles[EVENT_COUNT] {};      ///< Worst-case event-to-handler latency
+  };
+
   Target() = default;
   ~Target() = default;
 
@@ -35,11 +97,44 @@ public:
   void init();
 
   /**
-   * @brief Main non-blocking processing loop.
-   * Call periodically from main while(1).
+   * @brief Main event-driven processing loop.
+   * Runs handlers for raised events, sleeps with WFI when there are none.
+   * Call from main while(1).
    */
   void process();
 
+  /**
+   * @brief Current FSM state.
+   */
+  StateE state() const { return state_; }
+
+  /**
+   * @brief Main loop duty cycle and event latency statistics.
+   */
+  const LoopStatsS& loopStats() const { return loopStats_; }
+
+  /**
+   * @brief Snapshot of the link and queue counters, as sent in STATS_CFM.
+   */
+  protocol::LinkStatsS linkStats() const;
+
+  /**
+   * @brief Snapshot of the queue statistics of one TX class.
+   */
+  TxClassStatsS txClassStats(TxClassE txClass) const;
+
+  /**
+   * @brief Snapshot of the telemetry stream counters.
+   */
+  StreamStatsS streamStats() const;
+
+#if TARGET_CYCLE_PROBES
+  /**
+   * @brief Copy of a cycle probe, taken with interrupts masked.
+   */
+  CycleProbe probe(protocol::probeIdE id) const;
+#endif
+
   /**
    * @brief UART RX byte handler.
    * Call from HAL_UART_RxCpltCallback().
@@ -52,6 +147,13 @@ public:
    */
   void incTimerMsCounter();
 
+  /**
+   * @brief Microseconds since init from the ms counter and TIM10.
+   * Wraps after 71 minutes. Safe in ISRs and critical sections, a pending
+   * TIM10 update is accounted for.
+   */
+  uint32_t timestampUs() const;
+
   // --- Externall events for ISR handlers -----------------------------------------
 
   /**
@@ -60,12 +162,24 @@ public:
    */
   void handleButtonPress();
 
+  /**
+   * @brief Take one telemetry sample.
+   * Call from HAL_TIM_PeriodElapsedCallback() for TIM11.
+   */
+  void onSampleTimer();
+
   /**
    * @brief UART TX complete callback.
    * Call from HAL_UART_TxCpltCallback().
    */
   void onTxDone();
 
+  /**
+   * @brief UART error callback, errorCode holds HAL_UART_ERROR_* bits.
+   * Call from HAL_UART_ErrorCallback().
+   */
+  void onUartError(uint32_t errorCode);
+
   // --- Public data -----------------------------------------------------------
 
   /**
@@ -75,10 +189,97 @@ public:
   uint8_t rxByte_ {0};
 
 private:
+  /**
+   * @brief Mark an event as pending. Safe to call from ISR context.
+   */
+  void raiseEvent(EventE event);
+
+  /**
+   * @brief Fetch and clear pending events with the cycle counter when each
+   * was raised, update latency statistics.
+   */
+  uint32_t takeEvents(uint32_t (&stamps)[EVENT_COUNT]);
+
+  /**
+   * @brief Sleep until the next interrupt if no event is pending.
+   */
+  void waitForEvent();
+
+  // --- Event handlers (main loop context) -----------------------------------
+
+  void onRxFrameEvent();
+  void onTxDoneEvent();
+  void onTickEvent();
+  void onButtonEvent(uint32_t pressCycles);
+
+  // --- Flight recorder (main loop context) ----------------------------------
+
+  /**
+   * @brief Add a record stamped with msCounter_.
+   */
+  void logEvent(protocol::logEventE event, uint8_t arg0 = 0, uint16_t arg1 = 0);
+
+  /**
+   * @brief Record the link errors and queue drops since the last call.
+   */
+  void logLinkErrors();
+
+  /**
+   * @brief Start streaming the records asked for by LOG_REQ.
+   */
+  void onLogReq(const protocol::FrameS& frame);
+
+  /**
+   * @brief Queue the next LOG_CFMs of a LOG_REQ while the TX queue has room.
+   */
+  void drainLog();
+
+  // --- Telemetry stream ------------------------------------------------------
+
+  /**
+   * @brief Start sampling at the STREAM_START rate, raw or summarized per
+   * window. Restarts a running stream.
+   */
+  void startStream(const protocol::FrameS& frame);
+
+  /**
+   * @brief Stop sampling. With flush the samples taken so far are still sent.
+   */
+  void stopStream(bool flush);
+
+  /**
+   * @brief Queue the full half of the double buffer, or its window summary,
+   * while the bulk TX queue has room.
+   */
+  void sendStreamData();
+
+  /**
+   * @brief Hand the half being filled to the main loop. Call from the sample
+   * ISR or with interrupts masked, only while no half is ready.
+   */
+  void swapStreamHalves();
+
+  // --- Timer callbacks (main loop context) ----------------------------------
+
+  void onTickTimeout();
+  void onBlinkTimer();
+  void onStatsTimer();
+  void onProbeTimeout();
+
   /**
    * @brief Handle received signal frame.
    */
-  void handleSignal(const uint8_t* frame);
+  void handleSignal(const protocol::FrameS& frame);
+
+  /**
+   * @brief Answer PERF_REQ with one page of a cycle probe.
+   */
+  void sendPerfCfm(const protocol::FrameS& frame);
+
+  /**
+   * @brief Answer TRACE_REQ with the next events of the trace ring.
+   */
+  void sendTraceCfm(const protocol::FrameS& frame);
 
   /**
    * @brief Change internal FSM state.
@@ -86,15 +287,36 @@ private:
   void changeState(StateE newState);
 
   /**
-   * @brief Push a frame to UART TX queue.
+   * @brief Push a frame to UART TX queue in the negotiated frame format.
    */
-  void sendFrame(protocol::signalIdE sig);
+  void sendFrame(protocol::signalIdE sig, const uint8_t* payload = nullptr, size_t payloadLen = 0);
 
   /**
    * @brief Start UART transmission if not already in progress.
+   * Queued frames are gathered into one contiguous transfer, highest class first.
    */
   void tryStartTx();
 
+  /**
+   * @brief Encode the pending TIME_CFM to out with T3 taken now, returns its size.
+   */
+  size_t encodeTimeCfm(uint8_t* out);
+
+  /**
+   * @brief Switch the UART to baudRate once the frames queued so far are sent.
+   */
+  void requestBaudRate(uint32_t baudRate);
+
+  /**
+   * @brief Frames still to send at the old rate before a pending switch.
+   */
+  size_t framesBeforeSwitch() const;
+
+  /**
+   * @brief Re-initialize the UART at the pending baud rate. TX must be idle.
+   */
+  void applyBaudRate();
+
   /**
    * @brief Configure LEDs for CONNECTED state.
    */
@@ -105,17 +327,97 @@ private:
   protocol::Decoder decoder_;
   StateE state_ = StateE::IDLE;
 
+  // Configuration negotiated with CONNECT_REQ, the baseline while IDLE
+  protocol::CapabilitiesS session_ {};
+  protocol::frameFormatE txFormat_ {protocol::frameFormatE::BASIC};
+
+  // Baud rate set up by MX_USART1_UART_Init(), restored when a switch fails
+  uint32_t defaultBaudRate_ {protocol::BASELINE_BAUD_RATE};
+  uint32_t baudRate_ {protocol::BASELINE_BAUD_RATE};
+  // Baud rate switch waiting for the frames queued before it, 0 = none
+  uint32_t pendingBaudRate_ {0};
+  size_t framesBeforeSwitch_[TX_CLASS_COUNT] {};
+
+  // Pending events (bit per EventE) and the cycle counter when each was raised
+  volatile uint32_t events_ {0};
+  volatile uint32_t eventStamp_[EVENT_COUNT] {};
+
+  // Link counters kept by the target, decoder counters are added by linkStats()
+  protocol::LinkStatsS linkStats_ {};
+
+  // Flight recorder, kept within its RAM budget
+  constexpr static size_t FLIGHT_LOG_RECORDS = 126;
+  constexpr static size_t FLIGHT_LOG_RAM_BUDGET = 1024;
+  static_assert(sizeof(FlightLog<FLIGHT_LOG_RECORDS>) <= FLIGHT_LOG_RAM_BUDGET,
+                "Flight recorder exceeds its RAM budget");
+  FlightLog<FLIGHT_LOG_RECORDS> flightLog_;
+  // Records of the LOG_REQ being streamed, none left when equal
+  uint32_t logDrainSeq_ {0};
+  uint32_t logDrainEnd_ {0};
+  // Counters at the last logLinkErrors()
+  protocol::LinkStatsS loggedStats_ {};
+  uint32_t loggedStreamDrops_ {0};
+
+  // Telemetry stream. The sample ISR packs samples into one half of the
+  // double buffer, already laid out as a STREAM_DATA payload, or adds them to
+  // one of two window summaries, while the main loop sends the other half.
+  uint8_t streamBuffer_[2][protocol::MAX_PAYLOAD] {};
+  StreamWindow streamWindows_[2];
+  size_t streamSamplesPerFrame_ {0};    // Fitting the negotiated max payload, or the window
+  bool streamSummarized_ {false};       // STREAM_SUMMARY per window instead of STREAM_DATA
+  volatile size_t streamFillHalf_ {0};  // Half written by the ISR
+  volatile size_t streamFill_ {0};      // Samples in it
+  volatile bool streamReady_ {false};   // The other half waits for the main loop
+  volatile size_t streamReadyLen_ {0};  // Payload bytes of the ready STREAM_DATA half
+  volatile bool streamFlush_ {false};   // Stopped, a partial half is sent too
+  StreamStatsS streamStats_ {};         // samples is the number of the next sample
+
+#if TARGET_CYCLE_PROBES
+  // Cycles spent per ISR and main loop iteration
+  CycleProbe probes_[static_cast<size_t>(protocol::probeIdE::COUNT)];
+#endif
+
+  // Main loop instrumentation
+  LoopStatsS loopStats_ {};
+  uint32_t statsWindowStart_ {0};
+  uint32_t statsWindowSleep_ {0};
+
   // Time tracking (in ms)
   volatile uint32_t msCounter_ {0};
-  volatile uint32_t lastRxTime_ {0};
+
+  // Software timers driven by the 1 ms tick
+  constexpr static size_t NUM_TIMERS = 4;
+  using TimersT = TimerService<NUM_TIMERS>;
+  TimersT timers_;
+  TimersT::TimerIdT tickTimeoutTimer_ {TimersT::INVALID_TIMER};
+  TimersT::TimerIdT blinkTimer_ {TimersT::INVALID_TIMER};
+  TimersT::TimerIdT statsTimer_ {TimersT::INVALID_TIMER};
+  TimersT::TimerIdT probeTimer_ {TimersT::INVALID_TIMER};
 
   // LED1 blinking control
-  uint32_t lastBlinkTime_ {0};
   uint32_t blinkCounter_ {0};
 
-  // UART TX queue
+  // UART TX queues, one per TxClassE. Each slot holds the cycle counter when
+  // the frame was queued followed by the frame. Frames leave the queue when
+  // they are copied into txBatch_.
   constexpr static size_t NUM_FRAMES = 4;
-  RingBuffer<NUM_FRAMES, protocol::MAX_FRAME_SIZE> txQueue_;
-  RingBuffer<NUM_FRAMES, protocol::MAX_FRAME_SIZE> rxQueue_;
+  constexpr static size_t TX_STAMP_SIZE = sizeof(uint32_t);
+  RingBuffer<NUM_FRAMES, TX_STAMP_SIZE + protocol::MAX_FRAME_SIZE> txQueues_[TX_CLASS_COUNT];
+  TxClassStatsS txClassStats_[TX_CLASS_COUNT] {};
+  // Decoded frames, slots are sized for FrameS rather than the longer FEC encoding
+  RingBuffer<NUM_FRAMES, sizeof(protocol::FrameS)> rxQueue_;
   bool txBusy_ {false};
+
+  // Gathered TX frames handed to the UART in a single transfer. A batch takes
+  // one bulk frame at most, so a control frame never waits for more than one.
+  constexpr static size_t MAX_BULK_FRAMES_PER_BATCH = 1;
+  uint8_t txBatch_[NUM_FRAMES * protocol::MAX_FRAME_SIZE] {};
+  size_t txBatchFrames_[TX_CLASS_COUNT] {};   // Per class frames of the transfer in flight
+
+  // TIME_CFM waiting for the UART. It is encoded at the head of the next
+  // batch, so T3 is the time its transfer starts, not the time it was queued.
+  bool timeCfmPending_ {false};
+  uint16_t timeCfmSeq_ {0};
+  uint32_t timeCfmRxUs_ {0};          // T2
+  uint32_t timeCfmStamp_ {0};         // Cycle counter when the CFM was due
 };
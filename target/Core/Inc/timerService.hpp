@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Software timers driven by the 1 ms system tick.
+ *
+ * Timers are statically allocated. Active timers are kept in a delta list
+ * sorted by expiry time, where each entry holds the number of ticks left
+ * after the previous entry. Only the list head is touched per tick, so the
+ * idle cost does not depend on the number of timers.
+ *
+ * tick() is called from the timer ISR and only counts ticks.
+ * process() is called from the main loop, advances the list and runs
+ * expired callbacks in main loop context.
+ */
+template<size_t MAX_TIMERS>
+class TimerService
+{
+public:
+  using CallbackT = void (*)(void* context);
+  using TimerIdT = uint8_t;
+
+  static constexpr TimerIdT INVALID_TIMER = 0xFF;
+
+  static_assert(MAX_TIMERS < INVALID_TIMER, "Too many timers");
+
+  TimerService() = default;
+
+  /**
+   * @brief Allocate a timer. Returns INVALID_TIMER if none is left.
+   */
+  TimerIdT create(CallbackT callback, void* context)
+  {
+    if (numTimers_ >= MAX_TIMERS || callback == nullptr)
+      return INVALID_TIMER;
+
+    TimerS& timer = timers_[numTimers_];
+    timer.callback = callback;
+    timer.context = context;
+    return static_cast<TimerIdT>(numTimers_++);
+  }
+
+  /**
+   * @brief (Re)start a timer that expires once after timeoutMs.
+   */
+  void startOneShot(TimerIdT id, uint32_t timeoutMs)
+  {
+    start(id, timeoutMs, 0U);
+  }
+
+  /**
+   * @brief (Re)start a timer that expires every periodMs.
+   */
+  void startPeriodic(TimerIdT id, uint32_t periodMs)
+  {
+    start(id, periodMs, periodMs);
+  }
+
+  void stop(TimerIdT id)
+  {
+    if (id >= numTimers_ || !timers_[id].active)
+      return;
+
+    unlink(id);
+  }
+
+  bool isActive(TimerIdT id) const
+  {
+    return id < numTimers_ && timers_[id].active;
+  }
+
+  /**
+   * @brief Count one elapsed tick.
+   * Call from timer ISR (1 ms tick).
+   */
+  void tick()
+  {
+    tickCount_ = tickCount_ + 1U;
+  }
+
+  /**
+   * @brief Advance timers by the ticks counted since the last call
+   * and run expired callbacks. Call from the main loop.
+   */
+  void process()
+  {
+    while (processedTicks_ != tickCount_)
+    {
+      ++processedTicks_;
+      if (head_ == INVALID_TIMER)
+        continue;
+
+      --timers_[head_].delta;
+      while (head_ != INVALID_TIMER && timers_[head_].delta == 0U)
+      {
+        TimerIdT id = head_;
+        TimerS& timer = timers_[id];
+        head_ = timer.next;
+        timer.active = false;
+
+        // Re-arm before the callback so that it may stop the timer
+        if (timer.period != 0U)
+        {
+          insert(id, timer.period);
+        }
+        timer.callback(timer.context);
+      }
+    }
+  }
+
+private:
+  struct TimerS
+  {
+    CallbackT callback {nullptr};
+    void* context {nullptr};
+    uint32_t delta {0};       ///< Ticks left after the previous timer in the list
+    uint32_t period {0};      ///< 0 for one-shot timers
+    TimerIdT next {INVALID_TIMER};
+    bool active {false};
+  };
+
+  void start(TimerIdT id, uint32_t ticks, uint32_t period)
+  {
+    if (id >= numTimers_)
+      return;
+
+    if (timers_[id].active)
+    {
+      unlink(id);
+    }
+
+    // A timer never expires in the tick it was started in
+    if (ticks == 0U)
+      ticks = 1U;
+
+    timers_[id].period = (period != 0U) ? ticks : 0U;
+
+    // The list counts from processedTicks_, ticks the ISR counted before the
+    // start but process() has not applied yet must not shorten the timeout
+    const uint32_t pending = tickCount_ - processedTicks_;
+    insert(id, ticks + pending);
+  }
+
+  void insert(TimerIdT id, uint32_t ticks)
+  {
+    TimerIdT prev = INVALID_TIMER;
+    TimerIdT cur = head_;
+    while (cur != INVALID_TIMER && timers_[cur].delta <= ticks)
+    {
+      ticks -= timers_[cur].delta;
+      prev = cur;
+      cur = timers_[cur].next;
+    }
+
+    TimerS& timer = timers_[id];
+    timer.delta = ticks;
+    timer.next = cur;
+    timer.active = true;
+    if (cur != INVALID_TIMER)
+    {
+      timers_[cur].delta -= ticks;
+    }
+
+    if (prev == INVALID_TIMER)
+    {
+      head_ = id;
+    }
+    else
+    {
+      timers_[prev].next = id;
+    }
+  }
+
+  void unlink(TimerIdT id)
+  {
+    TimerIdT prev = INVALID_TIMER;
+    TimerIdT cur = head_;
+    while (cur != INVALID_TIMER && cur != id)
+    {
+      prev = cur;
+      cur = timers_[cur].next;
+    }
+    if (cur == INVALID_TIMER)
+      return;
+
+    TimerS& timer = timers_[id];
+    if (timer.next != INVALID_TIMER)
+    {
+      timers_[timer.next].delta += timer.delta;
+    }
+
+    if (prev == INVALID_TIMER)
+    {
+      head_ = timer.next;
+    }
+    else
+    {
+      timers_[prev].next = timer.next;
+    }
+    timer.next = INVALID_TIMER;
+    timer.active = false;
+  }
+
+  TimerS timers_[MAX_TIMERS] {};
+  size_t numTimers_ {0};
+  TimerIdT head_ {INVALID_TIMER};
+
+  // Written by tick() in ISR context only
+  volatile uint32_t tickCount_ {0};
+  // Written by process() in main loop context only
+  uint32_t processedTicks_ {0};
+};
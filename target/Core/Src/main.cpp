@@ -43,6 +43,7 @@ extern "C" {
 
 /* Private variables ---------------------------------------------------------*/
 TIM_HandleTypeDef htim10;
+TIM_HandleTypeDef htim11;
 
 UART_HandleTypeDef huart1;
 
@@ -55,11 +56,13 @@ void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
 static void MX_USART1_UART_Init(void);
 static void MX_TIM10_Init(void);
+static void MX_TIM11_Init(void);
 /* USER CODE BEGIN PFP */
 extern "C" void HAL_UART_RxCpltCallback(UART_HandleTypeDef* huart);
 extern "C" void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart);
 extern "C" void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim);
 extern "C" void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin);
+extern "C" void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart);
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
@@ -98,6 +101,7 @@ int main(void)
   MX_GPIO_Init();
   MX_USART1_UART_Init();
   MX_TIM10_Init();
+  MX_TIM11_Init();
   /* USER CODE BEGIN 2 */
   // Start 1 ms system tick timer
   HAL_TIM_Base_Start_IT(&htim10);
@@ -112,6 +116,7 @@ int main(void)
   /* USER CODE BEGIN WHILE */
   while (1)
   {
+    // Handles pending events, sleeps until the next interrupt when idle
     target.process();
     /* USER CODE END WHILE */
 
@@ -197,6 +202,37 @@ static void MX_TIM10_Init(void)
 
 }
 
+/**
+  * @brief TIM11 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_TIM11_Init(void)
+{
+
+  /* USER CODE BEGIN TIM11_Init 0 */
+
+  /* USER CODE END TIM11_Init 0 */
+
+  /* USER CODE BEGIN TIM11_Init 1 */
+
+  /* USER CODE END TIM11_Init 1 */
+  htim11.Instance = TIM11;
+  htim11.Init.Prescaler = 99;
+  htim11.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim11.Init.Period = 999;
+  htim11.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim11.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_Base_Init(&htim11) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* USER CODE BEGIN TIM11_Init 2 */
+  // Started by Target on STREAM_START, the period sets the sample rate
+  /* USER CODE END TIM11_Init 2 */
+
+}
+
 /**
   * @brief USART1 Initialization Function
   * @param None
@@ -292,12 +328,24 @@ extern "C" void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart)
   }
 }
 
+extern "C" void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart)
+{
+  if (huart->Instance == USART1 && targetPtr)
+  {
+    targetPtr->onUartError(huart->ErrorCode);
+  }
+}
+
 extern "C" void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef* htim)
 {
   if (htim->Instance == TIM10 && targetPtr)
   {
     targetPtr->incTimerMsCounter();
   }
+  else if (htim->Instance == TIM11 && targetPtr)
+  {
+    targetPtr->onSampleTimer();
+  }
 }
 
 extern "C" void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
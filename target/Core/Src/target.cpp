@@ -3,10 +3,17 @@ extern "C" {
 }
 
 #include "target.hpp"
+#include "trace.hpp"
 
+#include <algorithm>
 #include <cstdint>
 
+// Defined by main.cpp. The simulation's HAL fake keeps them per board and
+// maps the names to the board running on the calling thread.
+#ifndef huart1
 extern UART_HandleTypeDef huart1;
+extern TIM_HandleTypeDef htim11;
+#endif
 
 namespace
 {
@@ -14,13 +21,145 @@ constexpr uint32_t TICK_TIMEOUT_MS                  = 5000;
 constexpr uint32_t LED1_IDLE_INTERVAL_MS            = 500;
 constexpr uint32_t LED1_BUTTON_DISABLE_INTERVAL_MS  = 1000;
 constexpr uint32_t BUTTON_DISABLE_BLINKS            = 3;
+constexpr uint32_t STATS_WINDOW_MS                  = 1000;
+
+constexpr uint32_t CORE_CLOCK_HZ                    = 100000000;
+constexpr uint32_t CYCLES_PER_US                    = CORE_CLOCK_HZ / 1000000;
+// TIM10 counts microseconds and updates every millisecond
+constexpr uint32_t US_PER_MS                        = 1000;
+constexpr uint32_t UART_BITS_PER_BYTE               = 10; // 8N1
+// A partial RX frame is dropped after 2 idle character times
+constexpr uint32_t RX_INTER_BYTE_TIMEOUT_BYTES      = 3;
+// Highest baud rate offered to the host
+constexpr uint32_t UART_MAX_BAUD_RATE               = 921600;
+// TIM11 counts microseconds, its period sets the telemetry sample rate.
+// Prescaler and auto-reload are 16-bit registers.
+constexpr uint32_t SAMPLE_TIMER_HZ                  = 1000000;
+constexpr uint32_t SAMPLE_TIMER_PRESCALE            = CORE_CLOCK_HZ / SAMPLE_TIMER_HZ;
+constexpr uint32_t TIMER_REGISTER_MAX               = 0xFFFF;
+
+// DWT cycle counter, used for main loop instrumentation
+inline uint32_t cycleCounter()
+{
+  return DWT->CYCCNT;
+}
+
+// RX inter-byte timeout in DWT cycles for the given baud rate
+inline uint32_t rxInterByteTimeoutCycles(uint32_t baudRate)
+{
+  return RX_INTER_BYTE_TIMEOUT_BYTES * UART_BITS_PER_BYTE * (CORE_CLOCK_HZ / baudRate);
+}
+
+#if TARGET_CYCLE_PROBES
+static_assert(CycleProbe::NUM_BUCKETS == protocol::PERF_BUCKETS, "PERF_CFM histogram size");
+
+// Cycle source of the probes
+struct CoreCycleClock
+{
+  static uint32_t now() { return cycleCounter(); }
+};
+
+// Times the rest of the enclosing scope into probes_[probeIdE::id]
+#define PROBE_SCOPE(id) \
+  CycleProbeScope<CoreCycleClock> probeScope {probes_[static_cast<size_t>(protocol::probeIdE::id)]}
+#else
+#define PROBE_SCOPE(id)
+#endif
+
+// Telemetry sample n. The board has no sensor set up, so the source is a
+// counter the host can check end to end; a sensor read goes here.
+inline uint16_t streamSample(uint16_t seq)
+{
+  return seq;
+}
+
+// TX priority class of the frames the target sends
+Target::TxClassE txClassOf(protocol::signalIdE sig)
+{
+  switch (sig)
+  {
+  case protocol::signalIdE::CONNECT_CFM:
+  case protocol::signalIdE::TICK_CFM:
+  case protocol::signalIdE::BAUD_CFM:
+  case protocol::signalIdE::PROBE_CFM:
+  case protocol::signalIdE::TIME_CFM:
+    return Target::TX_CLASS_CONTROL;
+  case protocol::signalIdE::BUTTON_IND:
+    return Target::TX_CLASS_EVENT;
+  default:
+    return Target::TX_CLASS_BULK;
+  }
+}
+
+// Masks interrupts for the lifetime of the object, restores previous state
+class CriticalSection
+{
+public:
+  CriticalSection() : primask_{__get_PRIMASK()} { __disable_irq(); }
+  ~CriticalSection()
+  {
+    if (primask_ == 0U)
+      __enable_irq();
+  }
+private:
+  uint32_t primask_;
+};
+
+#if PROTOCOL_TRACE
+// Last trace events of the ISRs and the main loop, 8 bytes each
+constexpr size_t TRACE_RING_EVENTS = 256;
+protocol::TraceRing<TRACE_RING_EVENTS> traceRing;
+// Time source of the trace events, set by init()
+const Target* traceTarget {nullptr};
+// Set by TRACE_REQ with TRACE_FREEZE while the host reads the ring
+bool traceFrozen {false};
+#endif
+}
+
+#if PROTOCOL_TRACE
+void protocol::traceWrite(protocol::traceIdE id, uint8_t arg0, uint8_t arg1, uint8_t arg2)
+{
+  protocol::TraceEventS event;
+  event.timeUs = traceTarget != nullptr ? traceTarget->timestampUs() : 0U;
+  event.id = static_cast<uint8_t>(id);
+  event.args[0] = arg0;
+  event.args[1] = arg1;
+  event.args[2] = arg2;
+  CriticalSection lock;
+  if (!traceFrozen)
+    traceRing.push(event);
 }
+#endif
 
 // -----------------------------------------------------------------------------
 // Initialization
 // -----------------------------------------------------------------------------
 void Target::init()
 {
+  // Enable DWT cycle counter for main loop instrumentation
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  statsWindowStart_ = cycleCounter();
+#if PROTOCOL_TRACE
+  traceTarget = this;
+#endif
+
+  defaultBaudRate_ = huart1.Init.BaudRate;
+  baudRate_ = huart1.Init.BaudRate;
+  decoder_.setInterByteTimeout(rxInterByteTimeoutCycles(baudRate_));
+
+  tickTimeoutTimer_ = timers_.create(
+    [](void* target) { static_cast<Target*>(target)->onTickTimeout(); }, this);
+  blinkTimer_ = timers_.create(
+    [](void* target) { static_cast<Target*>(target)->onBlinkTimer(); }, this);
+  statsTimer_ = timers_.create(
+    [](void* target) { static_cast<Target*>(target)->onStatsTimer(); }, this);
+  timers_.startPeriodic(statsTimer_, STATS_WINDOW_MS);
+  probeTimer_ = timers_.create(
+    [](void* target) { static_cast<Target*>(target)->onProbeTimeout(); }, this);
+
+  logEvent(protocol::logEventE::BOOT);
   changeState(StateE::IDLE);
   HAL_UART_Receive_IT(&huart1, &rxByte_, 1);
 }
@@ -30,46 +169,458 @@ void Target::init()
 // -----------------------------------------------------------------------------
 void Target::process()
 {
+  uint32_t stamps[EVENT_COUNT];
+  uint32_t events = takeEvents(stamps);
+  if (events == 0U)
+  {
+    waitForEvent();
+    return;
+  }
+  PROBE_SCOPE(PROCESS);
+
+  if (events & (1U << EVENT_RX_FRAME))
+  {
+    onRxFrameEvent();
+  }
+
+  if (events & (1U << EVENT_TX_DONE))
+  {
+    onTxDoneEvent();
+  }
+
+  if (events & (1U << EVENT_BUTTON))
+  {
+    onButtonEvent(stamps[EVENT_BUTTON]);
+  }
+
+  if (events & (1U << EVENT_TICK))
+  {
+    onTickEvent();
+  }
+
+  if (logDrainSeq_ != logDrainEnd_)
+  {
+    drainLog();
+  }
+
+  // Raised by the sample ISR, or still waiting for room in the TX queue
+  if (streamReady_)
+  {
+    sendStreamData();
+  }
+
   // Start UART TX if not already in progress
-  if (!txBusy_ && !txQueue_.empty())
+  if (!txBusy_)
   {
     tryStartTx();
   }
+}
 
-  if (!rxQueue_.empty())
+// -----------------------------------------------------------------------------
+// Event flags
+// -----------------------------------------------------------------------------
+void Target::raiseEvent(EventE event)
+{
+  const uint32_t mask = 1U << event;
+  // All IRQs run at priority 0 and never nest, the race is with the main
+  // loop: it raises EVENT_STREAM itself, and an ISR between its read and
+  // write of events_ would lose its bit. Masked, the stamp and the bit also
+  // reach takeEvents() together.
+  CriticalSection lock;
+  if ((events_ & mask) == 0U)
   {
-    const uint8_t* frame;
-    if (rxQueue_.front(frame))
+    eventStamp_[event] = cycleCounter();
+    events_ = events_ | mask;
+  }
+}
+
+uint32_t Target::takeEvents(uint32_t (&stamps)[EVENT_COUNT])
+{
+  uint32_t events {0};
+  {
+    CriticalSection lock;
+    events = events_;
+    events_ = 0;
+    for (uint32_t i = 0; i < EVENT_COUNT; ++i)
     {
-      handleSignal(frame);
-      rxQueue_.pop();
+      stamps[i] = eventStamp_[i];
     }
   }
 
+  const uint32_t now = cycleCounter();
+  for (uint32_t i = 0; i < EVENT_COUNT; ++i)
+  {
+    if (events & (1U << i))
+    {
+      uint32_t latency = now - stamps[i];
+      if (latency > loopStats_.maxLatencyCycles[i])
+        loopStats_.maxLatencyCycles[i] = latency;
+    }
+  }
+  return events;
+}
+
+void Target::waitForEvent()
+{
+  // WFI wakes on a pending interrupt even with PRIMASK set, so checking
+  // the flags with interrupts masked closes the check-then-sleep race
+  CriticalSection lock;
+  if (events_ == 0U)
+  {
+    uint32_t sleepStart = cycleCounter();
+    __WFI();
+    statsWindowSleep_ += cycleCounter() - sleepStart;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Event handlers
+// -----------------------------------------------------------------------------
+void Target::onRxFrameEvent()
+{
+  const uint8_t* frame;
+  while (rxQueue_.front(frame))
+  {
+    TRACE(TARGET_RX_POP, reinterpret_cast<const protocol::FrameS*>(frame)->sigId, 0, 0);
+    handleSignal(*reinterpret_cast<const protocol::FrameS*>(frame));
+    CriticalSection lock;
+    rxQueue_.pop();
+  }
+}
+
+void Target::onTxDoneEvent()
+{
+  // The last frame sent at the old rate has left the wire
+  if (pendingBaudRate_ != 0U && framesBeforeSwitch() == 0U)
+  {
+    applyBaudRate();
+  }
+}
+
+void Target::onTickEvent()
+{
+  timers_.process();
+}
+
+// -----------------------------------------------------------------------------
+// Timer callbacks
+// -----------------------------------------------------------------------------
+void Target::onTickTimeout()
+{
   // Connecting timeout
-  if (state_ != StateE::IDLE &&
-      static_cast<uint32_t>(msCounter_ - lastRxTime_) >= TICK_TIMEOUT_MS)
+  if (state_ != StateE::IDLE)
   {
+    logEvent(protocol::logEventE::TICK_TIMEOUT, static_cast<uint8_t>(state_));
     changeState(StateE::IDLE);
   }
+}
 
+void Target::onBlinkTimer()
+{
   // LED1 blinking control in IDLE state
-  if (state_ == StateE::IDLE &&
-      static_cast<uint32_t>(msCounter_ - lastBlinkTime_) >= LED1_IDLE_INTERVAL_MS)
+  if (state_ == StateE::IDLE)
   {
-    lastBlinkTime_ = msCounter_;
     HAL_GPIO_TogglePin(LED1_GPIO_Port, LED1_Pin);
   }
 
   // LED1 blinking control in BUTTON_DISABLED state
-  if (state_ == StateE::BUTTON_DISABLED &&
-      static_cast<uint32_t>(msCounter_ - lastBlinkTime_) >= LED1_BUTTON_DISABLE_INTERVAL_MS/2)
+  if (state_ == StateE::BUTTON_DISABLED)
   {
     if (blinkCounter_++ < BUTTON_DISABLE_BLINKS * 2)
     {
-      lastBlinkTime_ = msCounter_;
       HAL_GPIO_TogglePin(LED1_GPIO_Port, LED1_Pin);
     }
+    else
+    {
+      timers_.stop(blinkTimer_);
+    }
+  }
+}
+
+void Target::onStatsTimer()
+{
+  // Duty cycle over the last statistics window
+  const uint32_t now = cycleCounter();
+  const uint32_t window = now - statsWindowStart_;
+  if (window != 0U)
+  {
+    const uint64_t busy = window - statsWindowSleep_;
+    loopStats_.dutyCyclePermille = static_cast<uint32_t>(busy * 1000U / window);
+  }
+  statsWindowStart_ = now;
+  statsWindowSleep_ = 0;
+
+  logLinkErrors();
+}
+
+void Target::onProbeTimeout()
+{
+  // No PROBE_REQ got through at the new rate, fall back
+  logEvent(protocol::logEventE::BAUD_FALLBACK);
+  requestBaudRate(defaultBaudRate_);
+}
+
+// -----------------------------------------------------------------------------
+// Button handling
+// -----------------------------------------------------------------------------
+void Target::onButtonEvent(uint32_t pressCycles)
+{
+  logEvent(protocol::logEventE::BUTTON, static_cast<uint8_t>(state_));
+  if (state_ == StateE::CONNECTED)
+  {
+    changeState(StateE::BUTTON_PRESSED);
+    if ((session_.features & protocol::FEATURE_BUTTON_TIME) == 0U)
+    {
+      sendFrame(protocol::signalIdE::BUTTON_IND);
+      return;
+    }
+
+    // The EXTI cycle stamp is taken back from now, so the ISR needs no TIM10 read
+    const uint32_t queuedUs = timestampUs();
+    const uint32_t pressUs = queuedUs - (cycleCounter() - pressCycles) / CYCLES_PER_US;
+    uint8_t payload[protocol::BUTTON_TIME_SIZE];
+    size_t len = protocol::writeUint32(pressUs, payload);
+    len += protocol::writeUint32(queuedUs, payload + len);
+    sendFrame(protocol::signalIdE::BUTTON_IND, payload, len);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Flight recorder
+// -----------------------------------------------------------------------------
+void Target::logEvent(protocol::logEventE event, uint8_t arg0, uint16_t arg1)
+{
+  flightLog_.record(msCounter_, event, arg0, arg1);
+}
+
+void Target::logLinkErrors()
+{
+  // One record per counter that moved, saturated, so a noisy line cannot
+  // flush the history faster than one record per counter and second
+  const protocol::LinkStatsS stats = linkStats();
+  const uint32_t streamDrops = streamStats().dropped;
+  const struct
+  {
+    protocol::logEventE event;
+    uint32_t delta;
+  } counters[] = {
+    {protocol::logEventE::CRC_ERRORS, stats.crcErrors - loggedStats_.crcErrors},
+    {protocol::logEventE::LENGTH_ERRORS, stats.lengthErrors - loggedStats_.lengthErrors},
+    {protocol::logEventE::RX_TIMEOUTS, stats.rxTimeouts - loggedStats_.rxTimeouts},
+    {protocol::logEventE::RX_DROPS, stats.rxQueueDrops - loggedStats_.rxQueueDrops},
+    {protocol::logEventE::TX_DROPS, stats.txQueueDrops - loggedStats_.txQueueDrops},
+    {protocol::logEventE::UART_ERRORS, (stats.uartErrors + stats.uartOverruns)
+                                       - (loggedStats_.uartErrors + loggedStats_.uartOverruns)},
+    {protocol::logEventE::STREAM_DROPS, streamDrops - loggedStreamDrops_},
+  };
+  loggedStats_ = stats;
+  loggedStreamDrops_ = streamDrops;
+  for (const auto& counter : counters)
+  {
+    if (counter.delta != 0U)
+      logEvent(counter.event, 0, static_cast<uint16_t>(counter.delta < 0xFFFFU ? counter.delta : 0xFFFFU));
+  }
+}
+
+void Target::onLogReq(const protocol::FrameS& frame)
+{
+  // Records overwritten since are skipped, the LOG_CFM SEQ shows the gap
+  uint32_t seq = protocol::readUint32(frame.payload.data());
+  const uint16_t count = protocol::readUint16(frame.payload.data() + sizeof(seq));
+  if (seq < flightLog_.oldest())
+    seq = flightLog_.oldest();
+  if (count == 0U || seq >= flightLog_.head())
+  {
+    uint8_t payload[protocol::LOG_CFM_HEADER_SIZE];
+    size_t len = protocol::writeUint32(flightLog_.head(), payload);
+    len += protocol::writeUint32(seq, payload + len);
+    sendFrame(protocol::signalIdE::LOG_CFM, payload, len);
+    return;
+  }
+
+  // Records written during the transfer are left for the next request
+  logDrainSeq_ = seq;
+  logDrainEnd_ = flightLog_.head() - seq > count ? seq + count : flightLog_.head();
+  drainLog();
+}
+
+void Target::drainLog()
+{
+  if (session_.maxPayload < protocol::LOG_CFM_HEADER_SIZE + protocol::LOG_RECORD_SIZE)
+  {
+    logDrainEnd_ = logDrainSeq_;
+    return;
+  }
+  const size_t perCfm = std::min<size_t>(protocol::LOG_RECORDS_PER_CFM,
+    (session_.maxPayload - protocol::LOG_CFM_HEADER_SIZE) / protocol::LOG_RECORD_SIZE);
+
+  // Keep a bulk slot for the answers to other requests
+  while (logDrainSeq_ != logDrainEnd_ && txQueues_[TX_CLASS_BULK].size() + 1U < NUM_FRAMES)
+  {
+    if (logDrainSeq_ < flightLog_.oldest())
+    {
+      logDrainSeq_ = flightLog_.oldest() < logDrainEnd_ ? flightLog_.oldest() : logDrainEnd_;
+      continue;
+    }
+
+    uint8_t payload[protocol::LOG_CFM_HEADER_SIZE + protocol::LOG_RECORDS_PER_CFM * protocol::LOG_RECORD_SIZE];
+    size_t len = protocol::writeUint32(flightLog_.head(), payload);
+    len += protocol::writeUint32(logDrainSeq_, payload + len);
+    protocol::LogRecordS record;
+    size_t count {0};
+    while (count < perCfm && logDrainSeq_ + count != logDrainEnd_ && flightLog_.get(logDrainSeq_ + count, record))
+    {
+      len += protocol::encodeLogRecord(record, payload + len);
+      ++count;
+    }
+    sendFrame(protocol::signalIdE::LOG_CFM, payload, len);
+    logDrainSeq_ += static_cast<uint32_t>(count);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Telemetry stream
+// -----------------------------------------------------------------------------
+void Target::startStream(const protocol::FrameS& frame)
+{
+  const uint8_t* data = frame.payload.data();
+  const uint32_t rateHz = protocol::readUint32(data);
+  if (rateHz == 0U || rateHz > protocol::STREAM_MAX_RATE_HZ
+      || session_.maxPayload < protocol::STREAM_HEADER_SIZE + protocol::STREAM_SAMPLE_SIZE)
+    return;
+
+  const protocol::StreamWindowS window = protocol::decodeStreamWindow(data, frame.payloadLen);
+  if (frame.payloadLen == protocol::STREAM_START_WINDOW_SIZE
+      && (window.samples == 0U || window.bins > protocol::STREAM_MAX_BINS || window.binShift > 15U
+          || session_.maxPayload < StreamWindow::payloadSize(window.bins)))
+    return;
+
+  HAL_TIM_Base_Stop_IT(&htim11);
+  {
+    CriticalSection lock;
+    streamSummarized_ = window.samples != 0U;
+    if (streamSummarized_)
+    {
+      streamSamplesPerFrame_ = window.samples;
+      for (StreamWindow& summary : streamWindows_)
+      {
+        summary.configure(window);
+      }
+    }
+    else
+    {
+      streamSamplesPerFrame_ = std::min<size_t>(protocol::STREAM_MAX_SAMPLES,
+        (session_.maxPayload - protocol::STREAM_HEADER_SIZE) / protocol::STREAM_SAMPLE_SIZE);
+    }
+    streamFill_ = 0;
+    streamReady_ = false;
+    streamFlush_ = false;
+    streamStats_ = StreamStatsS {};
+    loggedStreamDrops_ = 0;
+  }
+  // Below 16 Hz the period overflows the auto-reload register, count
+  // slower through the prescaler instead
+  const uint32_t periodUs = SAMPLE_TIMER_HZ / rateHz;
+  const uint32_t scale = periodUs / (TIMER_REGISTER_MAX + 1U) + 1U;
+  htim11.Init.Prescaler = SAMPLE_TIMER_PRESCALE * scale - 1U;
+  htim11.Init.Period = periodUs / scale - 1U;
+  HAL_TIM_Base_Init(&htim11);
+  HAL_TIM_Base_Start_IT(&htim11);
+}
+
+void Target::stopStream(bool flush)
+{
+  HAL_TIM_Base_Stop_IT(&htim11);
+  CriticalSection lock;
+  if (!flush)
+  {
+    streamFill_ = 0;
+    streamReady_ = false;
+    return;
+  }
+  // The partial half follows the ready one, see sendStreamData()
+  streamFlush_ = true;
+  if (!streamReady_ && streamFill_ != 0U)
+  {
+    swapStreamHalves();
+  }
+}
+
+void Target::sendStreamData()
+{
+  // Keep a bulk slot for the answers to other requests. Until there is room
+  // the ISR fills the other half and then drops samples.
+  while (streamReady_ && txQueues_[TX_CLASS_BULK].size() + 1U < NUM_FRAMES)
+  {
+    // The ISR does not touch the ready half, no copy needed
+    const size_t readyHalf = streamFillHalf_ ^ 1U;
+    if (!streamSummarized_)
+    {
+      sendFrame(protocol::signalIdE::STREAM_DATA, streamBuffer_[readyHalf], streamReadyLen_);
+    }
+    else
+    {
+      // The mean is divided out here rather than in the ISR
+      uint8_t payload[protocol::MAX_PAYLOAD];
+      sendFrame(protocol::signalIdE::STREAM_SUMMARY, payload,
+                protocol::encodeStreamSummary(streamWindows_[readyHalf].summary(), payload));
+    }
+    CriticalSection lock;
+    ++streamStats_.frames;
+    streamReady_ = false;
+    if (streamFill_ == streamSamplesPerFrame_ || (streamFlush_ && streamFill_ != 0U))
+    {
+      swapStreamHalves();
+    }
+  }
+}
+
+void Target::swapStreamHalves()
+{
+  streamReadyLen_ = protocol::STREAM_HEADER_SIZE + streamFill_ * protocol::STREAM_SAMPLE_SIZE;
+  streamFillHalf_ = streamFillHalf_ ^ 1U;
+  streamFill_ = 0;
+  streamReady_ = true;
+  raiseEvent(EVENT_STREAM);
+}
+
+// -----------------------------------------------------------------------------
+// Sample timer callback
+// -----------------------------------------------------------------------------
+void Target::onSampleTimer()
+{
+  PROBE_SCOPE(SAMPLE_ISR);
+  const uint32_t seq = streamStats_.samples++;
+  if (streamFill_ == streamSamplesPerFrame_)
+  {
+    // Both halves full, the TX side has not caught up
+    ++streamStats_.dropped;
+    return;
+  }
+
+  if (streamSummarized_)
+  {
+    StreamWindow& window = streamWindows_[streamFillHalf_];
+    if (streamFill_ == 0U)
+    {
+      window.start(seq);
+    }
+    window.add(streamSample(static_cast<uint16_t>(seq)));
+  }
+  else
+  {
+    uint8_t* payload = streamBuffer_[streamFillHalf_];
+    if (streamFill_ == 0U)
+    {
+      protocol::writeUint16(static_cast<uint16_t>(seq), payload);
+    }
+    protocol::writeUint16(streamSample(static_cast<uint16_t>(seq)),
+                          payload + protocol::STREAM_HEADER_SIZE + streamFill_ * protocol::STREAM_SAMPLE_SIZE);
+  }
+  streamFill_ = streamFill_ + 1U;
+  if (streamFill_ == streamSamplesPerFrame_ && !streamReady_)
+  {
+    swapStreamHalves();
   }
 }
 
@@ -78,19 +629,35 @@ void Target::process()
 // -----------------------------------------------------------------------------
 void Target::changeState(Target::StateE newState)
 {
+  TRACE(TARGET_STATE, state_, newState, 0);
+  if (newState != state_)
+    logEvent(protocol::logEventE::STATE, static_cast<uint8_t>(state_), static_cast<uint16_t>(newState));
   state_ = newState;
   switch (state_)
   {
   case StateE::IDLE:
+    logDrainEnd_ = logDrainSeq_;
+    stopStream(false);
+    session_ = protocol::CapabilitiesS {};
+    txFormat_ = protocol::frameFormatE::BASIC;
+    timers_.stop(probeTimer_);
+    if (pendingBaudRate_ != 0U || baudRate_ != defaultBaudRate_)
+    {
+      requestBaudRate(defaultBaudRate_);
+    }
+    timers_.stop(tickTimeoutTimer_);
+    timers_.startPeriodic(blinkTimer_, LED1_IDLE_INTERVAL_MS);
     HAL_GPIO_WritePin(LED2_GPIO_Port, LED2_Pin, GPIO_PIN_RESET);
     break;
   case StateE::CONNECTED:
+    timers_.stop(blinkTimer_);
     setLedsInConnectedState();
     break;
   case StateE::BUTTON_DISABLED:
     blinkCounter_ = 1;
     HAL_GPIO_WritePin(LED1_GPIO_Port, LED1_Pin, GPIO_PIN_SET);
-    lastBlinkTime_ = msCounter_;
+    timers_.startPeriodic(blinkTimer_, LED1_BUTTON_DISABLE_INTERVAL_MS/2);
+    break;
   default:
     break;
   }
@@ -102,26 +669,124 @@ void Target::changeState(Target::StateE newState)
 // think about to move out of rx interrupt, use queue
 void Target::receiver()
 {
-  auto result = decoder_.processByte(rxByte_);
+  PROBE_SCOPE(RX_ISR);
+  ++linkStats_.rxBytes;
+  auto result = decoder_.processByte(rxByte_, cycleCounter());
   if (result.valid)
   {
-    rxQueue_.push(reinterpret_cast<const uint8_t*>(&result.frame), result.frame.payload.size() + 1);
+    if (!rxQueue_.push(reinterpret_cast<const uint8_t*>(&result.frame), sizeof(result.frame)))
+    {
+      ++linkStats_.rxQueueDrops;
+      TRACE(TARGET_RX_DROP, result.frame.sigId, 0, 0);
+    }
+    else
+    {
+      TRACE(TARGET_RX_PUSH, result.frame.sigId, rxQueue_.size(), 0);
+      if (rxQueue_.size() > linkStats_.rxQueueHighWater)
+        linkStats_.rxQueueHighWater = static_cast<uint8_t>(rxQueue_.size());
+    }
+    raiseEvent(EVENT_RX_FRAME);
   }
 
   // Restart UART RX interrupt
   HAL_UART_Receive_IT(&huart1, &rxByte_, 1);
 }
 
+void Target::onUartError(uint32_t errorCode)
+{
+  TRACE(TARGET_UART_ERROR, errorCode, 0, 0);
+  if (errorCode & HAL_UART_ERROR_ORE)
+  {
+    ++linkStats_.uartOverruns;
+  }
+  if (errorCode & (HAL_UART_ERROR_PE | HAL_UART_ERROR_NE | HAL_UART_ERROR_FE))
+  {
+    ++linkStats_.uartErrors;
+  }
+
+  // The HAL ends the RX transfer on an overrun, without a restart nothing
+  // would be received again. The partial frame times out in the decoder.
+  HAL_UART_Receive_IT(&huart1, &rxByte_, 1);
+}
+
+protocol::LinkStatsS Target::linkStats() const
+{
+  CriticalSection lock;
+  protocol::LinkStatsS stats = linkStats_;
+  const protocol::DecoderStatsS& decoder = decoder_.stats();
+  stats.rxFrames = decoder.frames;
+  stats.crcErrors = decoder.crcErrors;
+  stats.lengthErrors = decoder.lengthErrors;
+  stats.rxTimeouts = decoder.timeouts;
+  return stats;
+}
+
+Target::TxClassStatsS Target::txClassStats(TxClassE txClass) const
+{
+  CriticalSection lock;
+  return txClassStats_[txClass];
+}
+
+Target::StreamStatsS Target::streamStats() const
+{
+  CriticalSection lock;
+  return streamStats_;
+}
+
+#if TARGET_CYCLE_PROBES
+CycleProbe Target::probe(protocol::probeIdE id) const
+{
+  CriticalSection lock;
+  return probes_[static_cast<size_t>(id)];
+}
+#endif
+
 // -----------------------------------------------------------------------------
 // Signal handling
 // -----------------------------------------------------------------------------
-void Target::handleSignal(const uint8_t* frame)
+void Target::handleSignal(const protocol::FrameS& frame)
 {
-  lastRxTime_ = msCounter_;
-  switch (static_cast<protocol::signalIdE>(frame[0])) // sigId is at index 0
+  // Any valid frame restarts the connection watchdog
+  timers_.startOneShot(tickTimeoutTimer_, TICK_TIMEOUT_MS);
+  switch (frame.sigId)
   {
   case protocol::signalIdE::CONNECT_REQ:
-    sendFrame(protocol::signalIdE::CONNECT_CFM);
+#if PROTOCOL_TRACE
+    traceFrozen = false;  // In case the last host quit during a readout
+#endif
+    stopStream(false);    // Sized for the old session
+    if (frame.payloadLen == 0U)
+    {
+      // Legacy host without a capability record, stay on the baseline
+      session_ = protocol::CapabilitiesS {};
+      txFormat_ = protocol::frameFormatE::BASIC;
+      sendFrame(protocol::signalIdE::CONNECT_CFM);
+    }
+    else
+    {
+      // Confirm the chosen configuration, the CFM already uses its format
+      protocol::CapabilitiesS local;
+      local.version = protocol::PROTOCOL_VERSION;
+      local.frameFormats = protocol::SUPPORTED_FRAME_FORMATS;
+      local.maxBaudRate = UART_MAX_BAUD_RATE;
+      local.rxQueueDepth = static_cast<uint8_t>(NUM_FRAMES);
+      local.features = protocol::FEATURE_TICK_SEQ | protocol::FEATURE_TIME_SYNC
+                       | protocol::FEATURE_BUTTON_TIME | protocol::FEATURE_STATS | protocol::FEATURE_LOG
+                       | protocol::FEATURE_STREAM;
+#if TARGET_CYCLE_PROBES
+      local.features |= protocol::FEATURE_PERF;
+#endif
+#if PROTOCOL_TRACE
+      local.features |= protocol::FEATURE_TRACE;
+#endif
+      session_ = protocol::negotiateCapabilities(
+        local, protocol::decodeCapabilities(frame.payload.data(), frame.payloadLen));
+      txFormat_ = protocol::selectFrameFormat(session_.frameFormats);
+
+      uint8_t record[protocol::CAPABILITIES_SIZE];
+      const size_t recordLen = protocol::encodeCapabilities(session_, record);
+      sendFrame(protocol::signalIdE::CONNECT_CFM, record, recordLen);
+    }
     changeState(StateE::CONNECTED);
     break;
   case protocol::signalIdE::DISCONNECT_REQ:
@@ -130,17 +795,226 @@ void Target::handleSignal(const uint8_t* frame)
   case protocol::signalIdE::TICK_IND:
     if (state_ != StateE::IDLE)
     {
-      sendFrame(protocol::signalIdE::TICK_CFM);
+      // Echo the sequence id, if any, so the host can match the CFM
+      sendFrame(protocol::signalIdE::TICK_CFM, frame.payload.data(), frame.payloadLen);
     }
     break;
   case protocol::signalIdE::BUTTON_CFM:
     changeState(StateE::BUTTON_DISABLED);
     break;
+  case protocol::signalIdE::BAUD_REQ:
+    if (state_ != StateE::IDLE)
+    {
+      // Switch after the CFM has left at the current rate, a rejected
+      // request is answered with the rate that stays in use
+      const uint32_t baudRate = protocol::readUint32(frame.payload.data());
+      const bool accepted = baudRate >= defaultBaudRate_ && baudRate <= session_.maxBaudRate;
+      uint8_t payload[protocol::BAUD_RATE_SIZE];
+      protocol::writeUint32(accepted ? baudRate : baudRate_, payload);
+      sendFrame(protocol::signalIdE::BAUD_CFM, payload, sizeof(payload));
+      if (accepted)
+      {
+        requestBaudRate(baudRate);
+        timers_.startOneShot(probeTimer_, protocol::BAUD_PROBE_TIMEOUT_MS);
+      }
+    }
+    break;
+  case protocol::signalIdE::PROBE_REQ:
+    if (state_ != StateE::IDLE)
+    {
+      // A probe that made it through commits the current rate
+      timers_.stop(probeTimer_);
+      sendFrame(protocol::signalIdE::PROBE_CFM, frame.payload.data(), frame.payloadLen);
+    }
+    break;
+  case protocol::signalIdE::ECHO_REQ:
+    if (state_ != StateE::IDLE)
+    {
+      sendFrame(protocol::signalIdE::ECHO_CFM, frame.payload.data(), frame.payloadLen);
+    }
+    break;
+  case protocol::signalIdE::TIME_REQ:
+    if (state_ != StateE::IDLE && session_.maxPayload >= protocol::TIME_SYNC_SIZE)
+    {
+      // T2 when the request is handled, T3 when the CFM goes on the wire,
+      // see tryStartTx(). Time spent behind queued frames is then part of
+      // T3 - T2 and does not skew the offset. A request still unanswered is
+      // superseded, the host matches CFMs by SEQ.
+      CriticalSection lock;
+      timeCfmSeq_ = protocol::readUint16(frame.payload.data());
+      timeCfmRxUs_ = timestampUs();
+      timeCfmStamp_ = cycleCounter();
+      timeCfmPending_ = true;
+    }
+    break;
+  case protocol::signalIdE::STATS_REQ:
+    if (state_ != StateE::IDLE)
+    {
+      uint8_t payload[protocol::LINK_STATS_SIZE];
+      const size_t len = protocol::encodeLinkStats(linkStats(), payload);
+      sendFrame(protocol::signalIdE::STATS_CFM, payload, len);
+    }
+    break;
+  case protocol::signalIdE::LOOP_REQ:
+    if (state_ != StateE::IDLE && session_.version >= protocol::LOOP_STATS_VERSION)
+    {
+      protocol::LoopStatsS stats;
+      stats.dutyCyclePermille = static_cast<uint16_t>(loopStats_.dutyCyclePermille);
+      for (size_t i = 0; i < EVENT_COUNT; ++i)
+      {
+        stats.maxLatencyUs[i] = loopStats_.maxLatencyCycles[i] / CYCLES_PER_US;
+      }
+      uint8_t payload[protocol::LOOP_STATS_SIZE];
+      const size_t len = protocol::encodeLoopStats(stats, payload);
+      sendFrame(protocol::signalIdE::LOOP_CFM, payload, len);
+    }
+    break;
+  case protocol::signalIdE::PERF_REQ:
+    if (state_ != StateE::IDLE)
+    {
+      sendPerfCfm(frame);
+    }
+    break;
+  case protocol::signalIdE::TRACE_REQ:
+    if (state_ != StateE::IDLE)
+    {
+      sendTraceCfm(frame);
+    }
+    break;
+  case protocol::signalIdE::LOG_REQ:
+    if (state_ != StateE::IDLE)
+    {
+      onLogReq(frame);
+    }
+    break;
+  case protocol::signalIdE::STREAM_START:
+    if (state_ != StateE::IDLE)
+    {
+      startStream(frame);
+    }
+    break;
+  case protocol::signalIdE::STREAM_STOP:
+    if (state_ != StateE::IDLE)
+    {
+      stopStream(true);
+    }
+    break;
   default:
     break;
   }
 }
 
+void Target::sendPerfCfm(const protocol::FrameS& frame)
+{
+#if TARGET_CYCLE_PROBES
+  const uint8_t id = frame.payload[0];
+  const uint8_t page = frame.payload[1];
+  if (id >= static_cast<uint8_t>(protocol::probeIdE::COUNT) || page >= protocol::PERF_PAGES)
+    return;
+
+  const CycleProbe probe = this->probe(static_cast<protocol::probeIdE>(id));
+  uint8_t payload[protocol::PERF_HISTOGRAM_SIZE];
+  size_t len {0};
+  payload[len++] = id;
+  payload[len++] = page;
+  if (page == 0U)
+  {
+    len += protocol::writeUint32(CORE_CLOCK_HZ, payload + len);
+    len += protocol::writeUint32(probe.count(), payload + len);
+    len += protocol::writeUint32(probe.minCycles(), payload + len);
+    len += protocol::writeUint32(probe.maxCycles(), payload + len);
+    len += protocol::writeUint32(probe.avgCycles(), payload + len);
+  }
+  else
+  {
+    const size_t first = (page - 1U) * protocol::PERF_BUCKETS_PER_PAGE;
+    for (size_t i = first; i < first + protocol::PERF_BUCKETS_PER_PAGE; ++i)
+    {
+      len += protocol::writeUint32(probe.bucketCount(i), payload + len);
+    }
+  }
+  sendFrame(protocol::signalIdE::PERF_CFM, payload, len);
+#else
+  (void)frame;  // Probes compiled out, FEATURE_PERF is not offered
+#endif
+}
+
+void Target::sendTraceCfm(const protocol::FrameS& frame)
+{
+#if PROTOCOL_TRACE
+  // Events from seq on, or from the oldest one left if seq was overwritten
+  uint8_t payload[protocol::TRACE_CFM_HEADER_SIZE + protocol::TRACE_EVENTS_PER_CFM * protocol::TRACE_EVENT_SIZE];
+  protocol::TraceEventS events[protocol::TRACE_EVENTS_PER_CFM];
+  size_t count {0};
+  uint32_t head;
+  uint32_t seq = protocol::readUint32(frame.payload.data());
+  {
+    CriticalSection lock;
+    traceFrozen = (frame.payload[4] & protocol::TRACE_FREEZE) != 0U;
+    head = traceRing.head();
+    if (seq < traceRing.oldest())
+      seq = traceRing.oldest();
+    while (count < protocol::TRACE_EVENTS_PER_CFM && traceRing.get(seq + count, events[count]))
+    {
+      ++count;
+    }
+  }
+
+  size_t len = protocol::writeUint32(head, payload);
+  len += protocol::writeUint32(seq, payload + len);
+  for (size_t i = 0; i < count; ++i)
+  {
+    len += protocol::encodeTraceEvent(events[i], payload + len);
+  }
+  sendFrame(protocol::signalIdE::TRACE_CFM, payload, len);
+#else
+  (void)frame;  // Tracing compiled out, FEATURE_TRACE is not offered
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// Baud rate switching
+// -----------------------------------------------------------------------------
+void Target::requestBaudRate(uint32_t baudRate)
+{
+  {
+    CriticalSection lock;
+    pendingBaudRate_ = baudRate;
+    for (size_t txClass = 0; txClass < TX_CLASS_COUNT; ++txClass)
+    {
+      framesBeforeSwitch_[txClass] = txQueues_[txClass].size() + txBatchFrames_[txClass];
+    }
+  }
+  if (framesBeforeSwitch() == 0U)
+  {
+    applyBaudRate();
+  }
+}
+
+size_t Target::framesBeforeSwitch() const
+{
+  size_t frames {0};
+  for (size_t txClass = 0; txClass < TX_CLASS_COUNT; ++txClass)
+  {
+    frames += framesBeforeSwitch_[txClass];
+  }
+  return frames;
+}
+
+void Target::applyBaudRate()
+{
+  TRACE(TARGET_BAUD, pendingBaudRate_ / 9600U, 0, 0);
+  logEvent(protocol::logEventE::BAUD_RATE, 0, static_cast<uint16_t>(pendingBaudRate_ / 100U));
+  baudRate_ = pendingBaudRate_;
+  pendingBaudRate_ = 0;
+  huart1.Init.BaudRate = baudRate_;
+  HAL_UART_Init(&huart1);
+
+  CriticalSection lock;
+  decoder_.setInterByteTimeout(rxInterByteTimeoutCycles(baudRate_));
+  HAL_UART_Receive_IT(&huart1, &rxByte_, 1);
+}
+
 // -----------------------------------------------------------------------------
 // Leds handling in CONNECTED state
 // -----------------------------------------------------------------------------
@@ -153,37 +1027,151 @@ void Target::setLedsInConnectedState()
 // -----------------------------------------------------------------------------
 // TX handling
 // -----------------------------------------------------------------------------
-void Target::sendFrame(protocol::signalIdE sig)
+void Target::sendFrame(protocol::signalIdE sig, const uint8_t* payload, size_t payloadLen)
 {
-  std::array<uint8_t, protocol::MAX_FRAME_SIZE> frame;
-  size_t frameSize = protocol::encodeFrame(sig, {}, 0, frame.data());
-  if(!txQueue_.push(frame.data(), frameSize))
+  if (payloadLen > session_.maxPayload)
+    return;   // The host would not accept it
+
+  std::array<uint8_t, TX_STAMP_SIZE + protocol::MAX_FRAME_SIZE> slot;
+  size_t frameSize = protocol::encodeFrame(sig, payload, payloadLen, slot.data() + TX_STAMP_SIZE, txFormat_);
+  const TxClassE txClass = txClassOf(sig);
+  TxClassStatsS& classStats = txClassStats_[txClass];
+  CriticalSection lock;
+  protocol::writeUint32(cycleCounter(), slot.data());
+  if(!txQueues_[txClass].push(slot.data(), TX_STAMP_SIZE + frameSize))
+  {
+    // TX queue of the class full, frame dropped
+    ++linkStats_.txQueueDrops;
+    ++classStats.drops;
+    TRACE(TARGET_TX_DROP, sig, 0, 0);
+    return;
+  }
+  const size_t queued = txQueues_[txClass].size();
+  TRACE(TARGET_TX_PUSH, sig, queued, frameSize);
+  ++linkStats_.txFrames;
+  ++classStats.frames;
+  if (queued > classStats.highWater)
+  {
+    classStats.highWater = static_cast<uint8_t>(queued);
+  }
+  size_t totalQueued {0};
+  for (const auto& queue : txQueues_)
   {
-    // TX queue full, frame dropped
+    totalQueued += queue.size();
+  }
+  if (totalQueued > linkStats_.txQueueHighWater)
+  {
+    linkStats_.txQueueHighWater = static_cast<uint8_t>(totalQueued);
   }
 }
 
 void Target::tryStartTx()
 {
-  if (txBusy_ || txQueue_.empty())
+  if (txBusy_)
     return;
 
-  const uint8_t* frame;
-  if (txQueue_.front(frame))
+  // Gather the pending frames, highest class first, so they leave
+  // back-to-back in one transfer. Frames queued after a baud rate switch
+  // wait for the new rate.
+  const uint32_t now = cycleCounter();
+  size_t batchSize {0};
+  size_t numFrames {0};
+  if (timeCfmPending_ && pendingBaudRate_ == 0U)
   {
-    txBusy_ = true;
-    HAL_UART_Transmit_IT(&huart1, frame, 3 + frame[1]); // LEN is at index 1
+    batchSize = encodeTimeCfm(txBatch_);
+    ++numFrames;
+  }
+  for (size_t txClass = 0; txClass < TX_CLASS_COUNT; ++txClass)
+  {
+    size_t maxFrames = pendingBaudRate_ != 0U ? framesBeforeSwitch_[txClass] : NUM_FRAMES;
+    if (txClass == TX_CLASS_BULK && maxFrames > MAX_BULK_FRAMES_PER_BATCH)
+    {
+      maxFrames = MAX_BULK_FRAMES_PER_BATCH;
+    }
+    size_t classFrames {0};
+    const uint8_t* slot;
+    size_t slotSize;
+    while (classFrames < maxFrames && numFrames < NUM_FRAMES
+           && txQueues_[txClass].peek(classFrames, slot, slotSize))
+    {
+      const uint32_t waitCycles = now - protocol::readUint32(slot);
+      if (waitCycles > txClassStats_[txClass].maxWaitCycles)
+      {
+        txClassStats_[txClass].maxWaitCycles = waitCycles;
+      }
+      std::memcpy(&txBatch_[batchSize], slot + TX_STAMP_SIZE, slotSize - TX_STAMP_SIZE);
+      batchSize += slotSize - TX_STAMP_SIZE;
+      ++classFrames;
+      ++numFrames;
+    }
+    // The batch holds a copy, so the slots take new frames during the transfer
+    {
+      CriticalSection lock;
+      txQueues_[txClass].pop(classFrames);
+    }
+    txBatchFrames_[txClass] = classFrames;
+  }
+  if (numFrames == 0U)
+    return;
+
+  txBusy_ = true;
+  linkStats_.txBytes += batchSize;
+  TRACE(TARGET_TX_START, numFrames, batchSize, batchSize >> 8);
+  if (huart1.hdmatx != nullptr)
+  {
+    HAL_UART_Transmit_DMA(&huart1, txBatch_, static_cast<uint16_t>(batchSize));
+  }
+  else
+  {
+    HAL_UART_Transmit_IT(&huart1, txBatch_, static_cast<uint16_t>(batchSize));
   }
 }
 
+size_t Target::encodeTimeCfm(uint8_t* out)
+{
+  TxClassStatsS& classStats = txClassStats_[TX_CLASS_CONTROL];
+  uint8_t payload[protocol::TIME_SYNC_SIZE];
+  size_t len {0};
+  {
+    CriticalSection lock;
+    timeCfmPending_ = false;
+    len += protocol::writeUint16(timeCfmSeq_, payload);
+    len += protocol::writeUint32(timeCfmRxUs_, payload + len);
+    const uint32_t waitCycles = cycleCounter() - timeCfmStamp_;
+    if (waitCycles > classStats.maxWaitCycles)
+    {
+      classStats.maxWaitCycles = waitCycles;
+    }
+  }
+  // T3 last, right before the transfer starts
+  len += protocol::writeUint32(timestampUs(), payload + len);
+  const size_t frameSize = protocol::encodeFrame(protocol::signalIdE::TIME_CFM, payload, len, out, txFormat_);
+  TRACE(TARGET_TX_PUSH, protocol::signalIdE::TIME_CFM, 0, frameSize);
+  ++linkStats_.txFrames;
+  ++classStats.frames;
+  return frameSize;
+}
+
 // -----------------------------------------------------------------------------
 // Tx complete callback
 // -----------------------------------------------------------------------------
 void Target::onTxDone()
 {
-  txQueue_.pop();
+  PROBE_SCOPE(TX_DONE_ISR);
+  size_t numFrames {0};
+  for (size_t txClass = 0; txClass < TX_CLASS_COUNT; ++txClass)
+  {
+    if (pendingBaudRate_ != 0U)
+    {
+      framesBeforeSwitch_[txClass] -= txBatchFrames_[txClass];
+    }
+    numFrames += txBatchFrames_[txClass];
+    txBatchFrames_[txClass] = 0;
+  }
+  TRACE(TARGET_TX_DONE, numFrames, 0, 0);
   txBusy_ = false;
   tryStartTx();
+  raiseEvent(EVENT_TX_DONE);
 }
 
 // -----------------------------------------------------------------------------
@@ -191,7 +1179,33 @@ void Target::onTxDone()
 // -----------------------------------------------------------------------------
 void Target::incTimerMsCounter()
 {
+  PROBE_SCOPE(TICK_ISR);
   msCounter_++;
+  timers_.tick();
+  raiseEvent(EVENT_TICK);
+}
+
+uint32_t Target::timestampUs() const
+{
+  // Read the ms count again after the counter, a TIM10 update in between
+  // would pair the new ms count with the old counter value. In an ISR or a
+  // critical section the update interrupt is held off: CNT has wrapped but
+  // the ms is not counted yet, UIF tells. CNT is read again after UIF so it
+  // cannot be from before the wrap.
+  uint32_t ms;
+  uint32_t counterUs;
+  bool updatePending;
+  do
+  {
+    ms = msCounter_;
+    counterUs = TIM10->CNT;
+    updatePending = (TIM10->SR & TIM_SR_UIF) != 0U;
+    if (updatePending)
+    {
+      counterUs = TIM10->CNT;
+    }
+  } while (ms != msCounter_);
+  return (updatePending ? ms + 1U : ms) * US_PER_MS + counterUs;
 }
 
 // -----------------------------------------------------------------------------
@@ -199,9 +1213,5 @@ void Target::incTimerMsCounter()
 // -----------------------------------------------------------------------------
 void Target::handleButtonPress()
 {
-  if (state_ == Target::StateE::CONNECTED)
-  {
-    changeState(Target::StateE::BUTTON_PRESSED);
-    sendFrame(protocol::signalIdE::BUTTON_IND);
-  }
+  raiseEvent(EVENT_BUTTON);
 }